@@ -3,9 +3,26 @@
 		"target_name": "wakanda_storage",
 		"sources": [
 			"src/addon_entry_point.cpp",
+			"src/change_ring.h",
+			"src/change_ring.cpp",
+			"src/epoch_manager.h",
+			"src/epoch_manager.cpp",
+			"src/item_index.h",
+			"src/item_index.cpp",
+			"src/managed_segment.h",
 			"src/shared_storage.h",
 			"src/shared_storage.cpp",
 			"src/shared_item.h",
+			"src/slab_allocator.h",
+			"src/slab_allocator.cpp",
+			"src/storage_log.h",
+			"src/storage_log.cpp",
+			"src/storage_mutex.h",
+			"src/storage_mutex.cpp",
+			"src/storage_object.h",
+			"src/storage_object.cpp",
+			"src/storage_snapshot.h",
+			"src/storage_snapshot.cpp",
 			"src/js_shared_storage.h",
 			"src/js_shared_storage.cpp",
 			"src/napi_helpers.cpp"
@@ -2,16 +2,18 @@ var binary = require('node-pre-gyp');
 var path = require('path');
 var binding_path = binary.find(path.resolve(path.join(__dirname,'../package.json')));
 var binding = require(binding_path);
+var serializer = require('./serializer');
 
 
 var TagsDescriptor = {
     "object": {
         "tag": "object",
         "beforeSet": function (object) {
-            return JSON.stringify(object);
+            return serializer.serialize(object);
         },
-        "afterGet": function (string) {
-            return JSON.parse(string);
+        "afterGet": function (value) {
+            // objects used to be stored as their JSON text
+            return (typeof(value) == "string") ? JSON.parse(value) : serializer.deserialize(value);
         }
     },
     "date": {
@@ -27,15 +29,31 @@ var TagsDescriptor = {
     },
     "buffer": {
         "tag": "buffer",
-        "beforeSet": function (buffer) {
-            return buffer.toString("utf8");
-        },
-        "afterGet": function (string) {
-            return Buffer.from(string, "utf8");
+        "afterGet": function (value) {
+            // buffers used to be stored as UTF-8 strings
+            return (typeof(value) == "string") ? Buffer.from(value, "utf8") : value;
         }
     }
 };
 
+["Int8Array", "Uint8Array", "Uint8ClampedArray", "Int16Array", "Uint16Array", "Int32Array",
+ "Uint32Array", "Float32Array", "Float64Array", "BigInt64Array", "BigUint64Array"].forEach(function (name) {
+    var TypedArray = global[name];
+    if (typeof(TypedArray) == "function") {
+        TagsDescriptor[name] = {
+            "tag": name,
+            "type": TypedArray,
+            "afterGet": function (buffer) {
+                if ((buffer.byteOffset % TypedArray.BYTES_PER_ELEMENT) != 0) {
+                    // copy the bytes to an aligned array buffer
+                    buffer = new Uint8Array(buffer);
+                }
+                return new TypedArray(buffer.buffer, buffer.byteOffset, buffer.length / TypedArray.BYTES_PER_ELEMENT);
+            }
+        };
+    }
+});
+
 TagsDescriptor.findByValue = function findByValue(value) {
 
     switch (typeof(value)) {
@@ -46,6 +64,10 @@ TagsDescriptor.findByValue = function findByValue(value) {
             else if (value instanceof Buffer) {
                 return TagsDescriptor.buffer;
             }
+            else if (ArrayBuffer.isView(value) && (value.constructor.name in TagsDescriptor) &&
+                     (TagsDescriptor[value.constructor.name].type == value.constructor)) {
+                return TagsDescriptor[value.constructor.name];
+            }
             else {
                 return TagsDescriptor.object;
             }
@@ -69,17 +91,17 @@ var SharedStorageProxy = function SharedStorageProxy(storage) {
 
 
 
-SharedStorageProxy.prototype.set = function set(key, value) {
+SharedStorageProxy.prototype.set = function set(key, value, ttl) {
     if (typeof(value) != "undefined") {
         var desc = TagsDescriptor.findByValue(value);
         if (desc) {
             if ("beforeSet" in desc) {
                 value = desc.beforeSet(value);
             }
-            return this.storage.set(key, value, desc.tag);
+            return this.storage.set(key, value, desc.tag, ttl);
         }
         else {
-            return this.storage.set(key, value);
+            return this.storage.set(key, value, "", ttl);
         }
     }
 };
@@ -99,6 +121,184 @@ SharedStorageProxy.prototype.get = function get(key) {
 };
 
 
+SharedStorageProxy.prototype.getMany = function getMany(keys) {
+    var tags = [];
+    var values = this.storage.getMany(keys, tags);
+    for (var i in tags) {
+        var desc = TagsDescriptor.findByTag(tags[i]);
+        if (desc && ("afterGet" in desc)) {
+            values[i] = desc.afterGet(values[i]);
+        }
+    }
+    return values;
+};
+
+
+SharedStorageProxy.prototype.setMany = function setMany(entries, options) {
+    // entries are [key, value] pairs, from an array or a Map, or the properties of an object
+    if (!Array.isArray(entries)) {
+        entries = (entries instanceof Map) ? Array.from(entries) : Object.entries(entries);
+    }
+    var keys = [];
+    var values = [];
+    var tags = [];
+    var positions = [];
+    for (var i = 0; i < entries.length; ++i) {
+        // undefined values are skipped, as set() does
+        var value = entries[i][1];
+        if (typeof(value) != "undefined") {
+            var desc = TagsDescriptor.findByValue(value);
+            if (desc && ("beforeSet" in desc)) {
+                value = desc.beforeSet(value);
+            }
+            if (desc) {
+                tags[keys.length] = desc.tag;
+            }
+            keys.push(entries[i][0]);
+            values.push(value);
+            positions.push(i);
+        }
+    }
+    var ttl = options && options.ttl;
+    var atomic = !!(options && options.atomic);
+    // the tags are only passed if some value has one
+    var errors = this.storage.setMany(keys, values, (tags.length > 0) ? tags : null, ttl, atomic);
+    var results = new Array(entries.length).fill(null);
+    if (errors) {
+        for (var j = 0; j < positions.length; ++j) {
+            results[positions[j]] = errors[j];
+        }
+    }
+    return results;
+};
+
+
+SharedStorageProxy.prototype.removeMany = function removeMany(keys) {
+    return this.storage.removeMany(keys);
+};
+
+
+SharedStorageProxy.prototype.removePrefix = function removePrefix(prefix, options) {
+    return this.storage.removePrefix(String(prefix), options && options.budget);
+};
+
+
+SharedStorageProxy.prototype.removeByTag = function removeByTag(tag, options) {
+    return this.storage.removeByTag(String(tag), options && options.budget);
+};
+
+
+SharedStorageProxy.prototype.scan = function scan(cursor, count) {
+    return this.storage.scan(cursor || 0, count);
+};
+
+
+SharedStorageProxy.prototype.keys = function* keys() {
+    // each batch only locks its shard while its keys are copied
+    var cursor = 0;
+    do {
+        var batch = this.storage.scan(cursor);
+        yield* batch.keys;
+        cursor = batch.cursor;
+    } while (cursor != 0);
+};
+
+
+SharedStorageProxy.prototype.entries = function* entries() {
+    var cursor = 0;
+    do {
+        var batch = this.storage.scan(cursor);
+        var values = this.getMany(batch.keys);
+        for (var i = 0; i < values.length; ++i) {
+            // keys removed since their batch was scanned are skipped
+            if (typeof(values[i]) != "undefined") {
+                yield [batch.keys[i], values[i]];
+            }
+        }
+        cursor = batch.cursor;
+    } while (cursor != 0);
+};
+
+
+SharedStorageProxy.prototype.scanPrefix = function scanPrefix(prefix, limit) {
+    return this.storage.scanPrefix(String(prefix), limit);
+};
+
+
+SharedStorageProxy.prototype.range = function range(start, end, limit) {
+    // a missing end leaves the range open
+    return this.storage.range(String(start || ""), (end == null) ? "" : String(end), limit);
+};
+
+
+SharedStorageProxy.prototype.keysByTag = function keysByTag(tag) {
+    return this.storage.keysByTag(String(tag));
+};
+
+
+SharedStorageProxy.prototype.countByTag = function countByTag(tag) {
+    return this.storage.countByTag(String(tag));
+};
+
+
+SharedStorageProxy.prototype.view = function view(key) {
+    return this.storage.view(key);
+};
+
+
+SharedStorageProxy.prototype.increment = function increment(key, delta) {
+    return this.storage.increment(key, delta);
+};
+
+
+SharedStorageProxy.prototype.decrement = function decrement(key, delta) {
+    return this.storage.decrement(key, delta);
+};
+
+
+SharedStorageProxy.prototype.compareAndSet = function compareAndSet(key, expected, value) {
+    var expectedDesc = TagsDescriptor.findByValue(expected);
+    if (expectedDesc && ("beforeSet" in expectedDesc)) {
+        expected = expectedDesc.beforeSet(expected);
+    }
+    var desc = TagsDescriptor.findByValue(value);
+    if (desc) {
+        if ("beforeSet" in desc) {
+            value = desc.beforeSet(value);
+        }
+        return this.storage.compareAndSet(key, expected, value, desc.tag);
+    }
+    else {
+        return this.storage.compareAndSet(key, expected, value);
+    }
+};
+
+
+SharedStorageProxy.prototype.getAndSet = function getAndSet(key, value) {
+    var item;
+    var desc = TagsDescriptor.findByValue(value);
+    if (desc) {
+        if ("beforeSet" in desc) {
+            value = desc.beforeSet(value);
+        }
+        item = this.storage.getAndSet(key, value, desc.tag, true);
+    }
+    else {
+        item = this.storage.getAndSet(key, value, "", true);
+    }
+
+    var previous;
+    if (typeof(item) != "undefined") {
+        previous = item.value;
+        var previousDesc = TagsDescriptor.findByTag(item.tag);
+        if (previousDesc && ("afterGet" in previousDesc)) {
+            previous = previousDesc.afterGet(previous);
+        }
+    }
+    return previous;
+};
+
+
 SharedStorageProxy.prototype.remove = function remove(key) {
     this.storage.remove(key);
 };
@@ -109,6 +309,31 @@ SharedStorageProxy.prototype.clear = function clear() {
 };
 
 
+SharedStorageProxy.prototype.snapshot = function snapshot(path) {
+    return this.storage.snapshot(path);
+};
+
+
+SharedStorageProxy.prototype.stats = function stats() {
+    return this.storage.stats();
+};
+
+
+SharedStorageProxy.prototype.compact = function compact() {
+    return this.storage.compact();
+};
+
+
+SharedStorageProxy.prototype.startCompaction = function startCompaction() {
+    return this.storage.startCompaction();
+};
+
+
+SharedStorageProxy.prototype.stopCompaction = function stopCompaction() {
+    return this.storage.stopCompaction();
+};
+
+
 SharedStorageProxy.prototype.unlock = function unlock() {
     return this.storage.unlock();
 };
@@ -124,21 +349,133 @@ SharedStorageProxy.prototype.tryLock = function tryLock() {
 };
 
 
-SharedStorageProxy.create = function create(name, size) {
+SharedStorageProxy.prototype.lockShared = function lockShared() {
+    return this.storage.lockShared();
+};
+
+
+SharedStorageProxy.prototype.unlockShared = function unlockShared() {
+    return this.storage.unlockShared();
+};
+
+
+SharedStorageProxy.prototype.getAsync = function getAsync(key) {
+    return this.storage.getAsync(key, true).then(function (item) {
+        var value;
+        if (typeof(item) != "undefined") {
+            value = item.value;
+            var desc = TagsDescriptor.findByTag(item.tag);
+            if (desc && ("afterGet" in desc)) {
+                value = desc.afterGet(value);
+            }
+        }
+        return value;
+    });
+};
+
+
+SharedStorageProxy.prototype.setAsync = function setAsync(key, value, ttl) {
+    if (typeof(value) == "undefined") {
+        return Promise.resolve();
+    }
+    try {
+        var desc = TagsDescriptor.findByValue(value);
+        if (desc && ("beforeSet" in desc)) {
+            value = desc.beforeSet(value);
+        }
+        return this.storage.setAsync(key, value, desc ? desc.tag : "", ttl);
+    }
+    catch (error) {
+        // unsupported values reject the promise rather than throw
+        return Promise.reject(error);
+    }
+};
+
+
+SharedStorageProxy.prototype.lockAsync = function lockAsync() {
+    return this.storage.lockAsync();
+};
+
+
+// a trailing '*' watches all the keys of a prefix
+var isWatchedKey = function isWatchedKey(pattern, key) {
+    if (pattern.endsWith("*")) {
+        return key.startsWith(pattern.slice(0, -1));
+    }
+    return (key == pattern);
+};
+
+
+SharedStorageProxy.prototype.watch = function watch(keyOrPrefix, callback) {
+    if (typeof(callback) != "function") {
+        throw new TypeError("the callback must be a function.");
+    }
+    var self = this;
+    if (!this.watchers) {
+        this.watchers = [];
+        this.dispatchChanges = function dispatchChanges(keys, types) {
+            // the callbacks may close their watchers or others
+            var watchers = self.watchers.slice();
+            for (var i = 0; i < keys.length; ++i) {
+                for (var j = 0; j < watchers.length; ++j) {
+                    if (!watchers[j].closed &&
+                        ((typeof(keys[i]) == "undefined") || isWatchedKey(watchers[j].pattern, keys[i]))) {
+                        watchers[j].callback(keys[i], types[i]);
+                    }
+                }
+            }
+        };
+    }
+    var watcher = { "pattern": String(keyOrPrefix), "callback": callback, "closed": false };
+    var patterns = function patterns() {
+        return self.watchers.map(function (watcher) { return watcher.pattern; });
+    };
+    this.watchers.push(watcher);
+    try {
+        this.storage.watch(this.dispatchChanges, patterns());
+    }
+    catch (error) {
+        this.watchers.pop();
+        throw error;
+    }
+    return {
+        "close": function close() {
+            if (!watcher.closed) {
+                watcher.closed = true;
+                self.watchers.splice(self.watchers.indexOf(watcher), 1);
+                if (self.watchers.length > 0) {
+                    self.storage.watch(self.dispatchChanges, patterns());
+                }
+                else {
+                    self.storage.unwatch();
+                }
+            }
+        }
+    };
+};
+
+
+SharedStorageProxy.create = function create(name, size, options) {
     var local_size = size || (1024 * 1024);
-    var storage = binding.create(name, local_size);
+    var storage = binding.create(name, local_size, options || {});
     return new SharedStorageProxy(storage);
 };
 
 
-SharedStorageProxy.get = function get(name) {
-    var storage = binding.get(name);
+SharedStorageProxy.get = function get(name, options) {
+    var storage = binding.get(name, options || {});
     return new SharedStorageProxy(storage);
 };
 
 
-SharedStorageProxy.destroy = function destroy(name) {
-    return binding.destroy(name);
+SharedStorageProxy.destroy = function destroy(name, options) {
+    return binding.destroy(name, options || {});
+};
+
+
+SharedStorageProxy.restore = function restore(name, path, options) {
+    var storage = binding.restore(name, path, options || {});
+    return new SharedStorageProxy(storage);
 };
 
 
@@ -146,3 +483,4 @@ SharedStorageProxy.destroy = function destroy(name) {
 module.exports.create = SharedStorageProxy.create;
 module.exports.get = SharedStorageProxy.get;
 module.exports.destroy = SharedStorageProxy.destroy;
+module.exports.restore = SharedStorageProxy.restore;
@@ -0,0 +1,771 @@
+// Binary serializer of the objects, stored as binary items in place of their JSON text.
+//
+// Each value starts with a one-byte type, lengths and integers are varints. Besides what JSON
+// supports, it keeps undefined, Dates, Maps, Sets, Buffers, ArrayBuffers and typed arrays. Like
+// JSON, objects only keep their own enumerable string-keyed properties, and functions and
+// symbols are skipped in objects and become null elsewhere.
+//
+// Plain objects are written as records: the first object of an item with a given list of keys
+// defines a structure, which the next ones refer to by its index. Readers compile a function
+// creating the objects of the structures which they often meet, so that the objects get their
+// final shape at once rather than property after property.
+//
+// The codec runs in JavaScript: through N-API, each property read or created is a call into V8,
+// and these calls alone cost more than JSON.stringify() and JSON.parse() do.
+
+var kFormatVersion = 1;
+var kMaxDepth = 1000;
+var kMaxInteger = 4503599627370496; // 2^52, whose zigzag encoding is still exact
+var kMaxRecordKeys = 64;
+var kMaxTransitions = 16384;
+var kMaxKnownStructures = 1024;
+var kCompiledUses = 8;
+var kShortString = 8;
+var kBufferSize = 64 * 1024;
+var kMargin = 16; // largest header of a value: a type and a double or a varint
+
+var eUndefinedValue = 0;
+var eNullValue = 1;
+var eFalseValue = 2;
+var eTrueValue = 3;
+var eIntegerValue = 4; // zigzag varint
+var eDoubleValue = 5;
+var eStringValue = 6;
+var eArrayValue = 7;
+var eObjectValue = 8;
+var eDateValue = 9;
+var eMapValue = 10;
+var eSetValue = 11;
+var eBufferValue = 12;
+var eArrayBufferValue = 13;
+var eTypedArrayValue = 14;
+var eStructureValue = 15; // byte length of the keys, the keys, then the values of a record
+var eRecordValue = 16; // index of the structure in the item, then the values
+
+var kTypedArrays = ["Int8Array", "Uint8Array", "Uint8ClampedArray", "Int16Array", "Uint16Array",
+                    "Int32Array", "Uint32Array", "Float32Array", "Float64Array", "BigInt64Array",
+                    "BigUint64Array"];
+var typedArrayTypes = Object.create(null);
+kTypedArrays.forEach(function (name, type) {
+    typedArrayTypes[name] = type;
+});
+
+
+// the items are written one after another into a shared buffer, and returned as views on it
+var target = null;
+var targetView = null;
+var position = 0;
+var safeEnd = 0;
+var itemStart = 0;
+var depth = 0;
+
+// structures of the written objects, found from their keys through the keys before
+var transitions = new Map();
+var transitionsCount = 0;
+var itemSerial = 0;
+var structuresCount = 0;
+var previousStructure = null;
+var kNoKeys = [];
+
+// properties added to Object.prototype, which for...in loops would enumerate
+var enumerablePrototype = false;
+
+
+// move the item written so far to a new buffer with room for size more bytes
+var makeRoom = function makeRoom(size) {
+    var length = position - itemStart;
+    var previous = target;
+    target = Buffer.allocUnsafeSlow(Math.max(kBufferSize, 2 * (length + size + kMargin)));
+    targetView = new DataView(target.buffer, target.byteOffset, target.length);
+    if (previous !== null) {
+        previous.copy(target, 0, itemStart, position);
+    }
+    itemStart = 0;
+    position = length;
+    safeEnd = target.length - kMargin;
+};
+
+
+var writeVarint = function writeVarint(number) {
+    if (number < 0x80) {
+        target[position++] = number;
+    }
+    else if (number < 0x4000) {
+        target[position++] = (number & 0x7f) | 0x80;
+        target[position++] = number >>> 7;
+    }
+    else {
+        while (number >= 0x80) {
+            target[position++] = (number % 0x80) | 0x80;
+            number = Math.floor(number / 0x80);
+        }
+        target[position++] = number;
+    }
+};
+
+
+var writeDouble = function writeDouble(type, number) {
+    target[position++] = type;
+    targetView.setFloat64(position, number, true);
+    position += 8;
+};
+
+
+var writeString = function writeString(string) {
+    var length = string.length;
+    if (length < 32) {
+        // short strings, keys in particular, are encoded here, into at most 96 bytes
+        if (position + 3 * length >= safeEnd) {
+            makeRoom(3 * length);
+        }
+        var lengthOffset = position++;
+        for (var i = 0; i < length; ++i) {
+            var code = string.charCodeAt(i);
+            if (code < 0x80) {
+                target[position++] = code;
+            }
+            else if (code < 0x800) {
+                target[position++] = (code >> 6) | 0xc0;
+                target[position++] = (code & 0x3f) | 0x80;
+            }
+            else {
+                if (((code & 0xfc00) == 0xd800) && (i + 1 < length) &&
+                    ((string.charCodeAt(i + 1) & 0xfc00) == 0xdc00)) {
+                    code = 0x10000 + ((code & 0x3ff) << 10) + (string.charCodeAt(++i) & 0x3ff);
+                    target[position++] = (code >> 18) | 0xf0;
+                    target[position++] = ((code >> 12) & 0x3f) | 0x80;
+                }
+                else {
+                    if ((code & 0xf800) == 0xd800) {
+                        // lone surrogates are replaced, as Buffer.from() does
+                        code = 0xfffd;
+                    }
+                    target[position++] = (code >> 12) | 0xe0;
+                }
+                target[position++] = ((code >> 6) & 0x3f) | 0x80;
+                target[position++] = (code & 0x3f) | 0x80;
+            }
+        }
+        target[lengthOffset] = position - lengthOffset - 1;
+    }
+    else {
+        var byteLength = Buffer.byteLength(string, "utf8");
+        if (position + byteLength >= safeEnd) {
+            makeRoom(byteLength);
+        }
+        writeVarint(byteLength);
+        position += target.write(string, position, byteLength, "utf8");
+    }
+};
+
+
+var writeBytes = function writeBytes(type, bytes) {
+    var length = bytes.length;
+    if (position + length >= safeEnd) {
+        makeRoom(length);
+    }
+    target[position++] = type;
+    writeVarint(length);
+    if (length < 64) {
+        for (var i = 0; i < length; ++i) {
+            target[position++] = bytes[i];
+        }
+    }
+    else {
+        target.set(bytes, position);
+        position += length;
+    }
+};
+
+
+var findStructure = function findStructure(keys) {
+    var count = keys.length;
+    var structure = null;
+    var next = transitions;
+    for (var i = 0; i < count; ++i) {
+        structure = next.get(keys[i]);
+        if (typeof(structure) == "undefined") {
+            if (++transitionsCount > kMaxTransitions) {
+                // objects used as dictionaries would make the transitions grow without bound
+                transitions = new Map();
+                transitionsCount = 0;
+                return findStructure(keys);
+            }
+            structure = {
+                "next": null, "keys": null, "keyBytes": null, "write": null, "uses": 0, "item": 0,
+                "index": 0
+            };
+            next.set(keys[i], structure);
+        }
+        if (i + 1 < count) {
+            if (structure.next === null) {
+                structure.next = new Map();
+            }
+            next = structure.next;
+        }
+    }
+    if (structure.keys === null) {
+        structure.keys = keys;
+    }
+    return structure;
+};
+
+
+var writeValue;
+
+// compile a function writing the values of the records of a structure
+var compileWriter = function compileWriter(keys) {
+    return new Function("object", "write", keys.map(function (key) {
+        return "write(object[" + JSON.stringify(key) + "]);";
+    }).join("\n"));
+};
+
+
+var writeProperties = function writeProperties(object, plain) {
+    var structure = null;
+    var keys = null;
+    var count = 0;
+    var i = 0;
+    if (plain) {
+        // objects of arrays usually share their keys, those of the previous object are tried first
+        keys = (previousStructure !== null) ? previousStructure.keys : kNoKeys;
+        var same = true;
+        for (var key in object) {
+            var type = typeof(object[key]);
+            if ((type == "function") || (type == "symbol")) {
+                same = false;
+                break;
+            }
+            same = same && (keys[count] === key);
+            ++count;
+        }
+        if (same && (count == keys.length) && (count > 0)) {
+            structure = previousStructure;
+        }
+    }
+
+    if (structure === null) {
+        keys = Object.keys(object);
+        count = keys.length;
+        for (i = 0; i < count; ++i) {
+            var valueType = typeof(object[keys[i]]);
+            if ((valueType == "function") || (valueType == "symbol")) {
+                break;
+            }
+        }
+        if (i < count) {
+            // functions and symbols are skipped
+            keys = keys.filter(function (key) {
+                var type = typeof(object[key]);
+                return (type != "function") && (type != "symbol");
+            });
+            count = keys.length;
+        }
+
+        if ((count == 0) || (count > kMaxRecordKeys)) {
+            target[position++] = eObjectValue;
+            writeVarint(count);
+            for (i = 0; i < count; ++i) {
+                writeString(keys[i]);
+                writeValue(object[keys[i]]);
+            }
+            return;
+        }
+        structure = findStructure(keys);
+    }
+    previousStructure = structure;
+
+    if (structure.item !== itemSerial) {
+        // the first record of the structure in the item defines it, with the keys encoded once
+        structure.item = itemSerial;
+        structure.index = structuresCount++;
+        if (structure.keyBytes === null) {
+            var keysStart = position - itemStart;
+            for (i = 0; i < count; ++i) {
+                writeString(keys[i]);
+            }
+            structure.keyBytes = Buffer.from(target.subarray(itemStart + keysStart, position));
+            position = itemStart + keysStart;
+        }
+        writeBytes(eStructureValue, structure.keyBytes);
+    }
+    else {
+        target[position++] = eRecordValue;
+        writeVarint(structure.index);
+    }
+
+    if (structure.write !== null) {
+        structure.write(object, writeValue);
+    }
+    else if (++structure.uses >= kCompiledUses) {
+        // named loads are much faster than loads of computed keys
+        structure.write = compileWriter(structure.keys);
+        structure.write(object, writeValue);
+    }
+    else {
+        for (i = 0; i < count; ++i) {
+            writeValue(object[keys[i]]);
+        }
+    }
+};
+
+
+var writeObject = function writeObject(value) {
+    if (Array.isArray(value)) {
+        var length = value.length;
+        target[position++] = eArrayValue;
+        writeVarint(length);
+        for (var i = 0; i < length; ++i) {
+            writeValue(value[i]);
+        }
+        return;
+    }
+
+    // plain objects are the most common, they skip the other checks
+    var prototype = Object.getPrototypeOf(value);
+    if ((prototype === Object.prototype) || (prototype === null)) {
+        writeProperties(value, (prototype === null) || !enumerablePrototype);
+    }
+    else if (value instanceof Date) {
+        writeDouble(eDateValue, value.getTime());
+    }
+    else if (value instanceof Buffer) {
+        writeBytes(eBufferValue, value);
+    }
+    else if (ArrayBuffer.isView(value) && (value[Symbol.toStringTag] in typedArrayTypes)) {
+        target[position++] = eTypedArrayValue;
+        writeBytes(typedArrayTypes[value[Symbol.toStringTag]],
+                   new Uint8Array(value.buffer, value.byteOffset, value.byteLength));
+    }
+    else if (value instanceof ArrayBuffer) {
+        writeBytes(eArrayBufferValue, new Uint8Array(value));
+    }
+    else if ((value instanceof Map) || (value instanceof Set)) {
+        var isMap = (value instanceof Map);
+        target[position++] = isMap ? eMapValue : eSetValue;
+        writeVarint(value.size);
+        value.forEach(function (element, key) {
+            if (isMap) {
+                writeValue(key);
+            }
+            writeValue(element);
+        });
+    }
+    else {
+        writeProperties(value, false);
+    }
+};
+
+
+writeValue = function writeValue(value) {
+    if (position >= safeEnd) {
+        makeRoom(kMargin);
+    }
+
+    switch (typeof(value)) {
+        case "string":
+            target[position++] = eStringValue;
+            writeString(value);
+            break;
+
+        case "number":
+            if ((Math.floor(value) === value) && (value < kMaxInteger) && (value > -kMaxInteger) &&
+                ((value !== 0) || (1 / value > 0))) {
+                target[position++] = eIntegerValue;
+                writeVarint((value >= 0) ? (2 * value) : (-2 * value - 1));
+            }
+            else {
+                writeDouble(eDoubleValue, value);
+            }
+            break;
+
+        case "boolean":
+            target[position++] = value ? eTrueValue : eFalseValue;
+            break;
+
+        case "undefined":
+            target[position++] = eUndefinedValue;
+            break;
+
+        case "object":
+            if (value === null) {
+                target[position++] = eNullValue;
+            }
+            else if (++depth > kMaxDepth) {
+                // cycles end here too
+                throw new TypeError("the value is nested too deeply.");
+            }
+            else {
+                writeObject(value);
+                --depth;
+            }
+            break;
+
+        case "bigint":
+            throw new TypeError("BigInt values cannot be serialized.");
+
+        default:
+            // functions and symbols, which JSON turns into null out of objects
+            target[position++] = eNullValue;
+            break;
+    }
+};
+
+
+var serialize = function serialize(value) {
+    if ((target === null) || (position >= safeEnd)) {
+        itemStart = position;
+        makeRoom(kMargin);
+    }
+    itemStart = position;
+    target[position++] = kFormatVersion;
+    ++itemSerial;
+    structuresCount = 0;
+    depth = 0;
+    enumerablePrototype = false;
+    for (var key in Object.prototype) {
+        enumerablePrototype = true;
+        break;
+    }
+    try {
+        writeValue(value);
+    }
+    catch (error) {
+        position = itemStart;
+        throw error;
+    }
+    var bytes = target.subarray(itemStart, position);
+    if (target.length > kBufferSize) {
+        // the buffers grown for large items are not kept
+        target = null;
+        position = 0;
+    }
+    return bytes;
+};
+
+
+// the items are read from a Buffer on their array buffer, which the next items usually share
+var source = null;
+var sourceView = null;
+var offset = 0;
+var end = 0;
+var structures = [];
+var structuresRead = 0;
+
+// structures met in the items, found from the hashes of their keys
+var knownStructures = new Map();
+
+
+var invalidValue = function invalidValue() {
+    return new Error("the bytes are not a serialized value.");
+};
+
+
+var readByte = function readByte() {
+    if (offset >= end) {
+        throw invalidValue();
+    }
+    return source[offset++];
+};
+
+
+var readVarint = function readVarint() {
+    var byte = readByte();
+    if (byte < 0x80) {
+        return byte;
+    }
+    var number = byte & 0x7f;
+    var factor = 0x80;
+    do {
+        byte = readByte();
+        number += (byte & 0x7f) * factor;
+        factor *= 0x80;
+    } while ((byte >= 0x80) && (factor <= kMaxInteger * 4));
+    if (byte >= 0x80) {
+        throw invalidValue();
+    }
+    return number;
+};
+
+
+var readLength = function readLength() {
+    var length = readVarint();
+    if (length > end - offset) {
+        throw invalidValue();
+    }
+    return length;
+};
+
+
+var readDouble = function readDouble() {
+    if (offset + 8 > end) {
+        throw invalidValue();
+    }
+    var number = sourceView.getFloat64(offset, true);
+    offset += 8;
+    return number;
+};
+
+
+var readString = function readString() {
+    var length = readLength();
+    var start = offset;
+    offset += length;
+    if (length <= kShortString) {
+        // short ASCII strings are decoded here, for less than the call would cost
+        var string = "";
+        for (var i = start; i < offset; ++i) {
+            var code = source[i];
+            if (code >= 0x80) {
+                return source.utf8Slice(start, offset);
+            }
+            string += String.fromCharCode(code);
+        }
+        return string;
+    }
+    return source.utf8Slice(start, offset);
+};
+
+
+var readBytes = function readBytes() {
+    var length = readLength();
+    var start = offset;
+    offset += length;
+    return source.subarray(start, offset);
+};
+
+
+var setProperty = function setProperty(object, key, value) {
+    if (key == "__proto__") {
+        // JSON.parse() defines the property, assigning it would set the prototype
+        Object.defineProperty(object, key, {
+            "value": value, "writable": true, "enumerable": true, "configurable": true
+        });
+    }
+    else {
+        object[key] = value;
+    }
+};
+
+
+var readValue;
+
+var readRecord = function readRecord(structure) {
+    if (structure.create !== null) {
+        return structure.create(readValue);
+    }
+    if ((++structure.uses >= kCompiledUses) && (structure.keys.indexOf("__proto__") < 0)) {
+        // an object literal creates the object with its final shape at once
+        structure.create = new Function("read", "return {" + structure.keys.map(function (key) {
+            return JSON.stringify(key) + ": read()";
+        }).join(", ") + "};");
+        return structure.create(readValue);
+    }
+    var object = {};
+    var keys = structure.keys;
+    for (var i = 0; i < keys.length; ++i) {
+        setProperty(object, keys[i], readValue());
+    }
+    return object;
+};
+
+
+var readStructure = function readStructure() {
+    var length = readLength();
+    var keysEnd = offset + length;
+    // the structures are found from a hash of their keys, checked byte per byte
+    var hash = length;
+    var i = 0;
+    for (i = offset; i < keysEnd; ++i) {
+        hash = Math.imul(hash ^ source[i], 0x01000193);
+    }
+    var structure = knownStructures.get(hash);
+    if (typeof(structure) != "undefined") {
+        var keyBytes = structure.keyBytes;
+        if (keyBytes.length == length) {
+            for (i = 0; (i < length) && (keyBytes[i] === source[offset + i]); ++i) {
+            }
+        }
+        if (i != length) {
+            structure = undefined;
+        }
+    }
+    if (typeof(structure) == "undefined") {
+        var keysStart = offset;
+        var keys = [];
+        while (offset < keysEnd) {
+            keys.push(readString());
+        }
+        if ((offset != keysEnd) || (keys.length == 0)) {
+            throw invalidValue();
+        }
+        if (knownStructures.size >= kMaxKnownStructures) {
+            knownStructures.clear();
+        }
+        structure = {
+            "keys": keys, "keyBytes": Buffer.from(source.subarray(keysStart, keysEnd)), "uses": 0,
+            "create": null
+        };
+        knownStructures.set(hash, structure);
+    }
+    offset = keysEnd;
+    structures[structuresRead++] = structure;
+    return readRecord(structure);
+};
+
+
+var readCollection = function readCollection(isMap) {
+    var count = readLength();
+    var collection = isMap ? new Map() : new Set();
+    for (var i = 0; i < count; ++i) {
+        if (isMap) {
+            var key = readValue();
+            collection.set(key, readValue());
+        }
+        else {
+            collection.add(readValue());
+        }
+    }
+    return collection;
+};
+
+
+var readTypedArray = function readTypedArray() {
+    var TypedArray = global[kTypedArrays[readByte()]];
+    var bytes = readBytes();
+    if ((typeof(TypedArray) != "function") || ((bytes.length % TypedArray.BYTES_PER_ELEMENT) != 0)) {
+        throw invalidValue();
+    }
+    // the bytes are copied to an aligned array buffer
+    var array = new TypedArray(bytes.length / TypedArray.BYTES_PER_ELEMENT);
+    new Uint8Array(array.buffer).set(bytes);
+    return array;
+};
+
+
+var readNested = function readNested(type) {
+    if (++depth > kMaxDepth) {
+        throw invalidValue();
+    }
+    var value;
+    var i = 0;
+    switch (type) {
+        case eArrayValue:
+            var length = readLength();
+            value = new Array(length);
+            for (i = 0; i < length; ++i) {
+                value[i] = readValue();
+            }
+            break;
+
+        case eObjectValue:
+            var count = readLength();
+            value = {};
+            for (i = 0; i < count; ++i) {
+                var key = readString();
+                setProperty(value, key, readValue());
+            }
+            break;
+
+        case eStructureValue:
+            value = readStructure();
+            break;
+
+        case eRecordValue:
+            var index = readVarint();
+            if (index >= structuresRead) {
+                throw invalidValue();
+            }
+            value = readRecord(structures[index]);
+            break;
+
+        default:
+            value = readCollection(type == eMapValue);
+            break;
+    }
+    --depth;
+    return value;
+};
+
+
+readValue = function readValue() {
+    var type = readByte();
+    switch (type) {
+        case eUndefinedValue:
+            return undefined;
+
+        case eNullValue:
+            return null;
+
+        case eFalseValue:
+            return false;
+
+        case eTrueValue:
+            return true;
+
+        case eIntegerValue:
+            var number = readVarint();
+            return ((number % 2) == 0) ? (number / 2) : (-(number + 1) / 2);
+
+        case eDoubleValue:
+            return readDouble();
+
+        case eStringValue:
+            return readString();
+
+        case eArrayValue:
+        case eObjectValue:
+        case eMapValue:
+        case eSetValue:
+        case eStructureValue:
+        case eRecordValue:
+            return readNested(type);
+
+        case eDateValue:
+            return new Date(readDouble());
+
+        case eBufferValue:
+            return Buffer.from(readBytes());
+
+        case eArrayBufferValue:
+            var bytes = readBytes();
+            var arrayBuffer = new ArrayBuffer(bytes.length);
+            new Uint8Array(arrayBuffer).set(bytes);
+            return arrayBuffer;
+
+        case eTypedArrayValue:
+            return readTypedArray();
+
+        default:
+            throw invalidValue();
+    }
+};
+
+
+var deserialize = function deserialize(bytes) {
+    if ((source === null) || (source.buffer !== bytes.buffer)) {
+        source = Buffer.from(bytes.buffer);
+        sourceView = new DataView(bytes.buffer);
+    }
+    offset = bytes.byteOffset;
+    end = offset + bytes.length;
+    depth = 0;
+    structuresRead = 0;
+    if (readByte() != kFormatVersion) {
+        throw invalidValue();
+    }
+    var value = readValue();
+    if (offset != end) {
+        throw invalidValue();
+    }
+    if (source.length > kBufferSize) {
+        // large items have an array buffer of their own, which is not kept
+        source = null;
+    }
+    return value;
+};
+
+
+
+module.exports.serialize = serialize;
+module.exports.deserialize = deserialize;
@@ -37,8 +37,10 @@ napi_value initModule(napi_env env, napi_value exports)
                                            {"get", nullptr, JsSharedStorage::open, nullptr, nullptr,
                                             nullptr, napi_default, nullptr},
                                            {"destroy", nullptr, JsSharedStorage::destroy, nullptr,
+                                            nullptr, nullptr, napi_default, nullptr},
+                                           {"restore", nullptr, JsSharedStorage::restore, nullptr,
                                             nullptr, nullptr, napi_default, nullptr}};
-        status = napi_define_properties(env, exports, 3, desc);
+        status = napi_define_properties(env, exports, 4, desc);
     }
     return exports;
 }
@@ -0,0 +1,255 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    change_ring.cpp
+ */
+
+// Local includes.
+#include "change_ring.h"
+#include "storage_mutex.h"
+#include <algorithm>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <cstring>
+#include <new>
+
+
+namespace storage
+{
+
+ChangeRing::ChangeRing(SegmentManager* manager, size_t capacity)
+: m_mutex(), m_condition(), m_watchersCount(0), m_waitersCount(0), m_head(0), m_capacity(0),
+  m_bytes(), m_watchers()
+{
+    // small segments may not have room for the whole ring, their watchers will miss more changes
+    capacity &= ~static_cast<size_t>(kStampSize - 1);
+    while ((capacity >= getRecordSize(0)) && (m_bytes == nullptr))
+    {
+        void* bytes = manager->allocate(capacity, std::nothrow);
+        if (bytes != nullptr)
+        {
+            // no record is published until its stamp is written
+            std::memset(bytes, 0, capacity);
+            m_bytes = static_cast<char*>(bytes);
+            m_capacity = capacity;
+        }
+        else
+        {
+            capacity = (capacity / 2) & ~static_cast<size_t>(kStampSize - 1);
+        }
+    }
+}
+
+bool ChangeRing::attach(uint64_t& position)
+{
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(m_mutex);
+    releaseDeadWatchers();
+    const uint32_t process = getCurrentProcessId();
+    WatcherSlot* watchers = findWatchers(process);
+    if (watchers == nullptr)
+    {
+        watchers = (m_capacity > 0) ? findWatchers(0) : nullptr;
+        if (watchers == nullptr)
+        {
+            return false;
+        }
+        watchers->m_process = process;
+        m_watchersCount.fetch_add(1);
+    }
+    ++watchers->m_count;
+    position = m_head.load();
+    return true;
+}
+
+void ChangeRing::detach()
+{
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(m_mutex);
+    WatcherSlot* watchers = findWatchers(getCurrentProcessId());
+    if ((watchers != nullptr) && (--watchers->m_count == 0))
+    {
+        watchers->m_process = 0;
+        m_watchersCount.fetch_sub(1);
+    }
+}
+
+void ChangeRing::read(uint64_t& position, uint32_t timeout, std::vector<Change>& changes)
+{
+    if (!isReadable(position))
+    {
+        // a single wait, so that wake() lets the caller check whether it must stop. The writers
+        // publish before they look for waiters, which announce themselves before they check
+        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(m_mutex);
+        WatcherSlot* watchers = findWatchers(getCurrentProcessId());
+        if (watchers != nullptr)
+        {
+            // the waiters of a process which dies while waiting are dropped with its watchers
+            ++watchers->m_waiters;
+            m_waitersCount.fetch_add(1);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!isReadable(position))
+        {
+            m_condition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() +
+                                             boost::posix_time::milliseconds(timeout));
+        }
+        if (watchers != nullptr)
+        {
+            --watchers->m_waiters;
+            m_waitersCount.fetch_sub(1);
+        }
+    }
+
+    while (isReadable(position))
+    {
+        const size_t count = changes.size();
+        uint32_t length = 0;
+        unsigned char kind = 0;
+        copy(position + kStampSize, &length, sizeof(length));
+        copy(position + kStampSize + sizeof(length), &kind, sizeof(kind));
+        const bool valid = (length <= m_capacity - kRecordHeaderSize);
+        if (valid)
+        {
+            changes.push_back(Change{static_cast<ChangeKind>(kind), std::string(length, '\0')});
+            if (length > 0)
+            {
+                copy(position + kRecordHeaderSize, &changes.back().m_key[0], length);
+            }
+        }
+
+        // the record may have been overwritten before or while it was copied
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (!valid || ((head - position) > m_capacity))
+        {
+            changes.resize(count);
+            changes.push_back(Change{eChangeLost, std::string()});
+            position = head;
+            return;
+        }
+        position += getRecordSize(length);
+    }
+}
+
+void ChangeRing::wake()
+{
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(m_mutex);
+    m_condition.notify_all();
+}
+
+void ChangeRing::reset()
+{
+    new (&m_mutex) boost::interprocess::interprocess_mutex();
+    new (&m_condition) boost::interprocess::interprocess_condition();
+    m_watchersCount.store(0, std::memory_order_relaxed);
+    m_waitersCount.store(0, std::memory_order_relaxed);
+    for (WatcherSlot& watchers : m_watchers)
+    {
+        watchers = WatcherSlot();
+    }
+}
+
+void ChangeRing::append(ChangeKind kind, const char* key, size_t length)
+{
+    if (getRecordSize(length) > m_capacity)
+    {
+        // the record cannot fit, the watchers are told that they missed a change
+        kind = eChangeLost;
+        length = 0;
+    }
+
+    // the bytes are reserved before they are overwritten, so that readers detect it
+    const uint64_t size = getRecordSize(length);
+    const uint64_t position = m_head.fetch_add(size);
+    std::atomic_thread_fence(std::memory_order_release);
+    const uint32_t keyLength = static_cast<uint32_t>(length);
+    const unsigned char kindByte = static_cast<unsigned char>(kind);
+    write(position + kStampSize, &keyLength, sizeof(keyLength));
+    write(position + kStampSize + sizeof(keyLength), &kindByte, sizeof(kindByte));
+    if (length > 0)
+    {
+        write(position + kRecordHeaderSize, key, length);
+    }
+    getStamp(position).store(position + 1, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waitersCount.load(std::memory_order_relaxed) != 0)
+    {
+        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(m_mutex);
+        m_condition.notify_all();
+    }
+
+    // the writer which turns around the ring drops the watchers of the processes which died,
+    // unless the mutex is busy
+    if ((position / m_capacity) != ((position + size) / m_capacity))
+    {
+        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(
+            m_mutex, boost::interprocess::try_to_lock);
+        if (lock)
+        {
+            releaseDeadWatchers();
+        }
+    }
+}
+
+ChangeRing::WatcherSlot* ChangeRing::findWatchers(uint32_t process)
+{
+    for (WatcherSlot& watchers : m_watchers)
+    {
+        if (watchers.m_process == process)
+        {
+            return &watchers;
+        }
+    }
+    return nullptr;
+}
+
+void ChangeRing::releaseDeadWatchers()
+{
+    for (WatcherSlot& watchers : m_watchers)
+    {
+        if ((watchers.m_process != 0) && !isProcessAlive(watchers.m_process))
+        {
+            m_waitersCount.fetch_sub(watchers.m_waiters);
+            m_watchersCount.fetch_sub(1);
+            watchers = WatcherSlot();
+        }
+    }
+}
+
+bool ChangeRing::isReadable(uint64_t position)
+{
+    return ((m_head.load() - position) > m_capacity) ||
+           (getStamp(position).load(std::memory_order_acquire) == position + 1);
+}
+
+void ChangeRing::write(uint64_t position, const void* data, size_t length)
+{
+    const size_t offset = static_cast<size_t>(position % m_capacity);
+    const size_t first = std::min(length, static_cast<size_t>(m_capacity) - offset);
+    std::memcpy(m_bytes.get() + offset, data, first);
+    std::memcpy(m_bytes.get(), static_cast<const char*>(data) + first, length - first);
+}
+
+void ChangeRing::copy(uint64_t position, void* data, size_t length) const
+{
+    const size_t offset = static_cast<size_t>(position % m_capacity);
+    const size_t first = std::min(length, static_cast<size_t>(m_capacity) - offset);
+    std::memcpy(data, m_bytes.get() + offset, first);
+    std::memcpy(static_cast<char*>(data) + first, m_bytes.get(), length - first);
+}
+
+} // namespace storage
@@ -0,0 +1,248 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    change_ring.h
+ */
+
+#ifndef CHANGE_RING_H_
+#define CHANGE_RING_H_
+
+
+// Includes.
+#include "managed_segment.h"
+#include <atomic>
+#include <boost/interprocess/offset_ptr.hpp>
+#include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace storage
+{
+
+/**
+ * @brief  Kinds of changes of the items.
+ */
+enum ChangeKind
+{
+    eChangeSet = 1,    ///< The item was created or updated.
+    eChangeRemove = 2, ///< The item was removed.
+    eChangeExpire = 3, ///< The item was erased because it expired.
+    eChangeEvict = 4,  ///< The item was evicted to make room for others.
+    eChangeClear = 5,  ///< All the items were removed, the key is empty.
+    eChangeLost = 6    ///< Changes were overwritten before being read, the key is empty.
+};
+
+
+/**
+ * @brief  Change of an item, as read from the ring.
+ */
+struct Change
+{
+    ChangeKind m_kind;
+    std::string m_key;
+};
+
+
+/**
+ * @brief  Ring of the latest changes of the items, which every process may watch.
+ *
+ * Writers append a record for each change into a ring of bytes living into the memory segment.
+ * They reserve the bytes of a record by moving the head atomically, copy the record, then publish
+ * it by stamping its first word with its position, so that concurrent writers do not wait for
+ * each other. Each watcher reads the published records from its own position, and learns that it
+ * missed some once the writers have reserved the ring around it. The watchers which wait for a
+ * change announce themselves, the writers only signal the interprocess condition for them.
+ *
+ * Nothing is recorded while no process watches the changes. The watchers are counted per process,
+ * so that those of a process which died without detaching are dropped: at the next attachment, or
+ * once the writers have turned around the ring.
+ */
+class ChangeRing
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    ChangeRing() = delete;
+
+    /**
+     * @brief  Constructor.
+     *
+     * @param manager Manager of the memory segment into which allocate the ring.
+     * @param capacity Count of bytes of the ring, it may be reduced if the segment is full.
+     */
+    ChangeRing(SegmentManager* manager, size_t capacity);
+
+    /**
+     * @brief  Record a change of an item, if a process watches the changes.
+     *
+     * @param kind Kind of the change.
+     * @param key Bytes of the key of the item.
+     * @param length Length in bytes of the key.
+     */
+    void post(ChangeKind kind, const char* key, size_t length)
+    {
+        if (m_watchersCount.load(std::memory_order_relaxed) != 0)
+        {
+            append(kind, key, length);
+        }
+    }
+
+    /**
+     * @brief  Start watching the changes from the current process.
+     *
+     * @param[out] position Position from which the changes must be read.
+     *
+     * @return true if the changes are watched,
+     * false if kMaxWatchingProcesses other processes already watch them.
+     */
+    bool attach(uint64_t& position);
+
+    /**
+     * @brief  Stop watching the changes from the current process.
+     */
+    void detach();
+
+    /**
+     * @brief  Read the changes recorded since a position, waiting for one if there is none yet.
+     * If changes were overwritten since the position, the reading resumes from the latest
+     * position and an eChangeLost change is returned.
+     *
+     * @param[in,out] position Position from which the changes are read, then position of the
+     * next ones.
+     * @param timeout Maximum time in milliseconds to wait for a change.
+     * @param[out] changes Changes read, appended to the vector.
+     */
+    void read(uint64_t& position, uint32_t timeout, std::vector<Change>& changes);
+
+    /**
+     * @brief  Wake the threads which wait for changes into read(), of every process.
+     */
+    void wake();
+
+    /**
+     * @brief  Forget the watchers and release the mutex left by the processes which used the
+     * ring, once none of them runs anymore.
+     */
+    void reset();
+
+    static const uint32_t kMaxWatchingProcesses = 64;
+
+private:
+    /**
+     * @brief  Watchers of a process, only accessed under the mutex of the ring.
+     */
+    struct WatcherSlot
+    {
+        uint32_t m_process; ///< Process of the watchers, 0 if the slot is free.
+        uint32_t m_count;   ///< Count of watchers of the process.
+        uint32_t m_waiters; ///< Count of watchers of the process waiting for a change.
+    };
+
+    /**
+     * @brief  Find the watchers of a process. The mutex must be locked.
+     *
+     * @param process Identifier of the process, 0 to find a free slot.
+     *
+     * @return Slot of the watchers of the process, or nullptr if there is none.
+     */
+    WatcherSlot* findWatchers(uint32_t process);
+
+    /**
+     * @brief  Drop the watchers of the processes which died. The mutex must be locked.
+     */
+    void releaseDeadWatchers();
+
+    /**
+     * @brief  Append the record of a change to the ring and wake the waiting watchers.
+     *
+     * @param kind Kind of the change.
+     * @param key Bytes of the key of the item.
+     * @param length Length in bytes of the key.
+     */
+    void append(ChangeKind kind, const char* key, size_t length);
+
+    /**
+     * @brief  Check if a watcher has something to read from a position.
+     *
+     * @param position Position of the next record to read.
+     *
+     * @return true if the record is published or if it was overwritten.
+     */
+    bool isReadable(uint64_t position);
+
+    /**
+     * @brief  Get the stamp of a record, aligned into the ring so that it never wraps around.
+     *
+     * @param position Position of the record.
+     *
+     * @return Stamp of the record, its position plus one once it is published.
+     */
+    std::atomic<uint64_t>& getStamp(uint64_t position)
+    {
+        return *reinterpret_cast<std::atomic<uint64_t>*>(m_bytes.get() + position % m_capacity);
+    }
+
+    /**
+     * @brief  Get the count of bytes of a record, padded so that the next stamp is aligned.
+     *
+     * @param length Length in bytes of the key.
+     *
+     * @return Count of bytes of the record.
+     */
+    static uint64_t getRecordSize(size_t length)
+    {
+        return (kRecordHeaderSize + length + kStampSize - 1) & ~(kStampSize - 1);
+    }
+
+    /**
+     * @brief  Copy bytes into the ring, wrapping around its end.
+     *
+     * @param position Position of the first byte.
+     * @param data Bytes to copy.
+     * @param length Count of bytes to copy.
+     */
+    void write(uint64_t position, const void* data, size_t length);
+
+    /**
+     * @brief  Copy bytes out of the ring, wrapping around its end.
+     *
+     * @param position Position of the first byte.
+     * @param[out] data Copied bytes.
+     * @param length Count of bytes to copy.
+     */
+    void copy(uint64_t position, void* data, size_t length) const;
+
+    static const uint64_t kStampSize = sizeof(uint64_t);
+    static const size_t kRecordHeaderSize = 13; ///< Stamp, length of the key on 4 bytes, kind.
+
+    boost::interprocess::interprocess_mutex m_mutex; ///< Mutex of the watchers and of the waits.
+    boost::interprocess::interprocess_condition m_condition;
+    std::atomic<uint32_t> m_watchersCount; ///< Count of processes which watch the changes.
+    std::atomic<uint32_t> m_waitersCount;  ///< Count of watchers waiting for a change.
+    std::atomic<uint64_t> m_head;          ///< Count of bytes ever reserved by the writers.
+    uint64_t m_capacity;                   ///< Count of bytes of the ring, a multiple of a stamp.
+    boost::interprocess::offset_ptr<char> m_bytes;
+    WatcherSlot m_watchers[kMaxWatchingProcesses];
+};
+
+} // namespace storage
+
+#endif /* CHANGE_RING_H_ */
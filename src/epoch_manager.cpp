@@ -0,0 +1,132 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    epoch_manager.cpp
+ */
+
+// Local includes.
+#include "epoch_manager.h"
+#include "storage_mutex.h"
+#include <new>
+
+
+namespace storage
+{
+
+EpochManager::EpochManager(SegmentManager* manager,
+                           uint32_t readersCount)
+: m_epoch(1), m_readers(), m_readersCount(0)
+{
+    // small segments may not have room for all the slots, their readers will lock more often
+    while ((readersCount > 0) && (m_readers == nullptr))
+    {
+        void* bytes = manager->allocate(sizeof(ReaderSlot) * readersCount, std::nothrow);
+        if (bytes != nullptr)
+        {
+            m_readers = static_cast<ReaderSlot*>(bytes);
+            m_readersCount = readersCount;
+        }
+        else
+        {
+            readersCount /= 2;
+        }
+    }
+    for (uint32_t iter = 0; iter < m_readersCount; ++iter)
+    {
+        new (&m_readers[iter]) ReaderSlot();
+        m_readers[iter].m_epoch.store(0);
+        m_readers[iter].m_process.store(0);
+    }
+}
+
+uint32_t EpochManager::enter()
+{
+    if (m_readersCount == 0)
+    {
+        return kNoReader;
+    }
+
+    // each thread starts looking from its own slot so that readers rarely share a cache line
+    const uint64_t epoch = m_epoch.load();
+    const uint64_t threadId = getCurrentThreadId();
+    const uint32_t first = static_cast<uint32_t>((threadId ^ (threadId >> 32)) % m_readersCount);
+    for (uint32_t iter = 0; iter < m_readersCount; ++iter)
+    {
+        const uint32_t reader = (first + iter) % m_readersCount;
+        uint64_t expected = 0;
+        if (m_readers[reader].m_epoch.compare_exchange_strong(expected, epoch))
+        {
+            m_readers[reader].m_process.store(getCurrentProcessId(), std::memory_order_relaxed);
+            // the reads which follow must not be performed before the slot is visible to writers
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return reader;
+        }
+    }
+    return kNoReader;
+}
+
+void EpochManager::leave(uint32_t reader)
+{
+    m_readers[reader].m_process.store(0, std::memory_order_relaxed);
+    m_readers[reader].m_epoch.store(0, std::memory_order_release);
+}
+
+uint64_t EpochManager::getOldestReader() const
+{
+    // the blocks retired before must be unlinked for readers which are not seen
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = UINT64_MAX;
+    for (uint32_t iter = 0; iter < m_readersCount; ++iter)
+    {
+        const uint64_t epoch = m_readers[iter].m_epoch.load();
+        if ((epoch != 0) && (epoch < oldest))
+        {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+uint32_t EpochManager::releaseDeadReaders()
+{
+    uint32_t released = 0;
+    for (uint32_t iter = 0; iter < m_readersCount; ++iter)
+    {
+        ReaderSlot& slot = m_readers[iter];
+        uint32_t process = slot.m_process.load();
+        if ((slot.m_epoch.load() != 0) && (process != 0) && !isProcessAlive(process) &&
+            slot.m_process.compare_exchange_strong(process, 0))
+        {
+            // only the winner of the process exchange frees the slot, which no reader can take
+            // before it is freed
+            slot.m_epoch.store(0, std::memory_order_release);
+            ++released;
+        }
+    }
+    return released;
+}
+
+void EpochManager::reset()
+{
+    for (uint32_t iter = 0; iter < m_readersCount; ++iter)
+    {
+        m_readers[iter].m_process.store(0, std::memory_order_relaxed);
+        m_readers[iter].m_epoch.store(0, std::memory_order_relaxed);
+    }
+}
+
+} // namespace storage
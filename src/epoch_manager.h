@@ -0,0 +1,173 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    epoch_manager.h
+ */
+
+#ifndef EPOCH_MANAGER_H_
+#define EPOCH_MANAGER_H_
+
+
+// Includes.
+#include "managed_segment.h"
+#include <atomic>
+#include <boost/interprocess/offset_ptr.hpp>
+#include <cstdint>
+
+
+namespace storage
+{
+
+/**
+ * @brief  Epoch-based reclamation of the memory read without lock.
+ *
+ * Lock-free readers announce the global epoch into a reader slot for the duration of a read.
+ * Writers retire the memory they unlink with the current epoch instead of deallocating it, and
+ * only deallocate it once every reader which may still see it has left its slot.
+ *
+ * The reader slots live into the memory segment so that readers of all the processes are seen.
+ * When every slot is taken, readers must fall back to locking. Each slot also records the process
+ * of its reader, so that the slots of the processes which died while reading can be released.
+ */
+class EpochManager
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    EpochManager() = delete;
+
+    /**
+     * @brief  Constructor.
+     *
+     * @param manager Manager of the memory segment into which allocate the reader slots.
+     * @param readersCount Count of reader slots, it may be reduced if the segment is full.
+     */
+    EpochManager(SegmentManager* manager,
+                 uint32_t readersCount);
+
+    /**
+     * @brief  Announce a read of the current thread.
+     *
+     * @return Reader slot taken by the current thread or kNoReader if every slot is taken.
+     */
+    uint32_t enter();
+
+    /**
+     * @brief  Release a reader slot.
+     *
+     * @param reader Reader slot returned by enter().
+     */
+    void leave(uint32_t reader);
+
+    /**
+     * @brief  Get the current epoch, with which unlinked memory is retired.
+     *
+     * @return Current epoch.
+     */
+    uint64_t getEpoch() const { return m_epoch.load(); }
+
+    /**
+     * @brief  Start a new epoch: readers which enter from now on cannot see the memory which was
+     * retired before.
+     */
+    void advance() { m_epoch.fetch_add(1); }
+
+    /**
+     * @brief  Get the epoch of the oldest reader.
+     *
+     * @return Oldest epoch announced by a reader, or UINT64_MAX if there is no reader.
+     */
+    uint64_t getOldestReader() const;
+
+    /**
+     * @brief  Release the reader slots left by the processes which died while reading, so that
+     * they do not hold back the reclamation for good.
+     *
+     * @return Count of released reader slots.
+     */
+    uint32_t releaseDeadReaders();
+
+    /**
+     * @brief  Release every reader slot, once no process uses the storage anymore. The process
+     * identifiers of the slots may have been reused since, they cannot be checked.
+     */
+    void reset();
+
+    static const uint32_t kNoReader = UINT32_MAX;
+
+private:
+    /**
+     * @brief  Reader slot, padded to a cache line so that readers do not contend.
+     */
+    struct ReaderSlot
+    {
+        std::atomic<uint64_t> m_epoch;   ///< Epoch announced by the reader, 0 if the slot is free.
+        std::atomic<uint32_t> m_process; ///< Process of the reader, 0 while it is not known.
+        char m_padding[52];
+    };
+
+    std::atomic<uint64_t> m_epoch;
+    boost::interprocess::offset_ptr<ReaderSlot> m_readers;
+    uint32_t m_readersCount;
+};
+
+
+/**
+ * @brief  Scope of a lock-free read.
+ */
+class EpochGuard
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    EpochGuard() = delete;
+
+    /**
+     * @brief  Constructor, enter a reader slot.
+     *
+     * @param epochs Epoch manager of the storage.
+     */
+    EpochGuard(EpochManager& epochs) : m_epochs(epochs), m_reader(epochs.enter()) {}
+
+    /**
+     * @brief  Destructor, leave the reader slot.
+     */
+    ~EpochGuard()
+    {
+        if (m_reader != EpochManager::kNoReader)
+        {
+            m_epochs.leave(m_reader);
+        }
+    }
+
+    /**
+     * @brief  Check if a reader slot was available.
+     *
+     * @return true if the current thread may read without lock.
+     */
+    bool isEntered() const { return (m_reader != EpochManager::kNoReader); }
+
+private:
+    EpochManager& m_epochs;
+    uint32_t m_reader;
+};
+
+} // namespace storage
+
+#endif /* EPOCH_MANAGER_H_ */
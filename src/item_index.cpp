@@ -0,0 +1,1204 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    item_index.cpp
+ */
+
+// Local includes.
+#include "item_index.h"
+#include <algorithm>
+#include <new>
+#include <thread>
+
+
+namespace storage
+{
+
+namespace
+{
+const size_t kMinCapacity = 16;
+const size_t kMaxRetiredCount = 64;
+const int kReaderChecksInterval = 1024;
+
+/**
+ * @brief  Check if a table must grow before receiving a new item. The maximum load factor, erased
+ * slots included, is 3/4.
+ */
+bool isOverloaded(size_t used, size_t capacity)
+{
+    return ((used + 1) * 4) > (capacity * 3);
+}
+
+/**
+ * @brief  Check that a slot was not updated since its version was read. Plain reads which precede
+ * the check are ordered before it.
+ */
+bool isUnchanged(const std::atomic<uint32_t>& version, uint32_t expected)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (version.load(std::memory_order_relaxed) == expected);
+}
+
+/**
+ * @brief  Get the count of bytes allocated for a copy of keys or tags, which are chained through
+ * their first bytes once retired.
+ */
+size_t getCopySize(size_t length)
+{
+    return std::max(length, sizeof(RetiredBlock));
+}
+
+/**
+ * @brief  Get the count of bytes allocated for a table of slots.
+ */
+size_t getTableSize(size_t capacity)
+{
+    return sizeof(SlotTable) + capacity * sizeof(ItemInfo);
+}
+
+/**
+ * @brief  Get the count of bytes allocated for a value block.
+ */
+size_t getBlockSize(const ValueBlock* block)
+{
+    return ValueBlock::allocationSize(static_cast<size_t>(block->m_capacity));
+}
+} // namespace
+
+
+ItemIndex::ItemIndex(const InterprocessAllocator<char>& allocator, EpochManager* epochs,
+                     EvictionPolicy policy, size_t slabSize, bool ordered, bool tagged,
+                     ChangeRing* changes)
+: m_allocator(allocator), m_slabs(allocator.get_segment_manager(), slabSize), m_epochs(epochs),
+  m_changes(changes), m_policy(policy), m_clockHand(0), m_table(0),
+  m_size(0), m_erased(0),
+  m_retiredHead(), m_retiredTail(), m_retiredCount(0), m_pinned(0),
+  m_expiries(), m_expiriesCount(0), m_expiriesCapacity(0), m_expiredCount(0),
+  m_ordered(ordered), m_tagged(tagged), m_keys(), m_tags()
+{
+}
+
+uint64_t ItemIndex::getNextBucket(uint64_t cursor, uint64_t mask)
+{
+    auto reverse = [](uint64_t bits) {
+        uint64_t reversed = 0;
+        for (int iter = 0; iter < 64; ++iter, bits >>= 1)
+        {
+            reversed = (reversed << 1) | (bits & 1);
+        }
+        return reversed;
+    };
+
+    // the bits above the mask are set so that the increment carries through them
+    return reverse(reverse(cursor | ~mask) + 1);
+}
+
+SlotTable* ItemIndex::getTable() const
+{
+    const int64_t offset = m_table.load(std::memory_order_acquire);
+    if (offset == 0)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<SlotTable*>(const_cast<char*>(reinterpret_cast<const char*>(this)) +
+                                        offset);
+}
+
+void ItemIndex::setTable(SlotTable* table)
+{
+    int64_t offset = 0;
+    if (table != nullptr)
+    {
+        offset = reinterpret_cast<char*>(table) - reinterpret_cast<char*>(this);
+    }
+    m_table.store(offset, std::memory_order_release);
+}
+
+ItemInfo* ItemIndex::find(const ItemKey& key)
+{
+    ItemInfo* info = const_cast<ItemInfo*>(lookup(key));
+    if ((info != nullptr) && info->isExpired((info->m_deadline != 0) ? getCurrentTime() : 0))
+    {
+        erase(*info, eChangeExpire);
+        ++m_expiredCount;
+        return nullptr;
+    }
+    return info;
+}
+
+const ItemInfo* ItemIndex::lookup(const ItemKey& key) const
+{
+    SlotTable* table = getTable();
+    if (table == nullptr)
+    {
+        return nullptr;
+    }
+
+    const size_t mask = table->m_capacity - 1;
+    for (size_t position = key.getHash() & mask;; position = (position + 1) & mask)
+    {
+        const ItemInfo& info = table->slots()[position];
+        if (info.isFree())
+        {
+            return nullptr;
+        }
+        if (info.matches(key))
+        {
+            return &info;
+        }
+    }
+}
+
+ItemIndex::ReadStatus ItemIndex::read(const ItemKey& key, ItemType& type, std::string& value,
+                                      std::string& tag) const
+{
+    SlotTable* table = getTable();
+    if (table == nullptr)
+    {
+        return eMissing;
+    }
+
+    const size_t mask = table->m_capacity - 1;
+    for (size_t position = key.getHash() & mask;; position = (position + 1) & mask)
+    {
+        const ItemInfo& info = table->slots()[position];
+        const uint32_t version = info.m_version.load(std::memory_order_acquire);
+        if ((version & 1) != 0)
+        {
+            return eContended;
+        }
+        if (info.m_state == ItemInfo::eFree)
+        {
+            return eMissing;
+        }
+        if ((info.m_hash != key.getHash()) || (info.m_state != ItemInfo::eUsed) ||
+            (info.m_keyLength != key.length()))
+        {
+            continue;
+        }
+
+        // copy the pointers and the lengths, then check them before following them
+        const char* keyBytes = info.m_key.get();
+        const char* tagBytes = info.m_tag.get();
+        const ValueBlock* block = info.m_block.get();
+        const size_t tagLength = info.m_tagLength;
+        const uint64_t deadline = info.m_deadline;
+        size_t length = (block != nullptr) ? static_cast<size_t>(block->m_length)
+                                           : static_cast<size_t>(info.m_inlineLength);
+        type = static_cast<ItemType>(info.m_type);
+        if (!isUnchanged(info.m_version, version))
+        {
+            return eContended;
+        }
+
+        // the blocks cannot be deallocated before the reader leaves the epoch
+        if (std::memcmp(keyBytes, key.data(), key.length()) != 0)
+        {
+            if (!isUnchanged(info.m_version, version))
+            {
+                return eContended;
+            }
+            continue;
+        }
+        if ((deadline != 0) && (deadline <= getCurrentTime()))
+        {
+            // the expired item is erased by the next writer or by the expiration thread
+            return eMissing;
+        }
+        value.assign((block != nullptr) ? block->data() : info.m_inline, length);
+        tag.assign(tagBytes, tagLength);
+        if (!isUnchanged(info.m_version, version))
+        {
+            return eContended;
+        }
+        if (m_policy != eNoEviction)
+        {
+            info.touch(m_policy);
+        }
+        return eRead;
+    }
+}
+
+bool ItemIndex::pin(const ItemKey& key, ItemType& type, ValueBlock*& block, std::string& value,
+                    std::string& tag) const
+{
+    SlotTable* table = getTable();
+    if (table == nullptr)
+    {
+        return false;
+    }
+
+    const size_t mask = table->m_capacity - 1;
+    for (size_t position = key.getHash() & mask;; position = (position + 1) & mask)
+    {
+        const ItemInfo& info = table->slots()[position];
+        if (info.isFree())
+        {
+            return false;
+        }
+        if (info.matches(key))
+        {
+            if (info.isExpired((info.m_deadline != 0) ? getCurrentTime() : 0))
+            {
+                return false;
+            }
+            type = info.getType();
+            info.getTag(tag);
+            block = info.m_block.get();
+            if (block != nullptr)
+            {
+                block->pin();
+            }
+            else
+            {
+                value.assign(info.m_inline, info.m_inlineLength);
+            }
+            if (m_policy != eNoEviction)
+            {
+                info.touch(m_policy);
+            }
+            return true;
+        }
+    }
+}
+
+void ItemIndex::insert(const ItemKey& key, ItemType type, const char* data, size_t length,
+                       const std::string& tag, uint64_t deadline)
+{
+    // allocate everything first, so that a failure leaves the index unchanged
+    char* keyBytes = copy(key.data(), key.length());
+    char* tagBytes = nullptr;
+    ValueBlock* block = nullptr;
+    KeyNode* node = nullptr;
+    KeyNode* tagKeyNode = nullptr;
+    TagNode* tagNode = nullptr;
+    try
+    {
+        if (m_ordered)
+        {
+            node = new (allocate(KeyNode::allocationSize(key.length()))) KeyNode(key.length());
+            std::memcpy(node->data(), key.data(), key.length());
+        }
+        tagKeyNode = allocateTagNodes(key, tag, tagNode);
+        if (!tag.empty())
+        {
+            tagBytes = copy(tag.data(), tag.size());
+        }
+        block = allocateBlock(length);
+        reserve();
+        if (deadline != 0)
+        {
+            reserveExpiry();
+        }
+    }
+    catch (const std::exception&)
+    {
+        deallocate(keyBytes, getCopySize(key.length()));
+        if (tagBytes != nullptr)
+        {
+            deallocate(tagBytes, getCopySize(tag.size()));
+        }
+        if (block != nullptr)
+        {
+            deallocate(block, getBlockSize(block));
+        }
+        if (node != nullptr)
+        {
+            deallocate(node, KeyNode::allocationSize(key.length()));
+        }
+        deallocateTagNodes(tagKeyNode, tagNode);
+        throw;
+    }
+
+    SlotTable* table = getTable();
+    const size_t mask = table->m_capacity - 1;
+    size_t position = key.getHash() & mask;
+    while (table->slots()[position].isUsed())
+    {
+        position = (position + 1) & mask;
+    }
+
+    ItemInfo& info = table->slots()[position];
+    if (!info.isFree())
+    {
+        --m_erased;
+    }
+    info.beginUpdate();
+    info.m_key = keyBytes;
+    info.m_keyLength = static_cast<uint32_t>(key.length());
+    info.m_hash = key.getHash();
+    info.m_type = static_cast<uint8_t>(type);
+    info.m_tag = tagBytes;
+    info.m_tagLength = static_cast<uint32_t>(tag.size());
+    info.m_deadline = deadline;
+    writeValue(info, block, data, length);
+    info.m_state = ItemInfo::eUsed;
+    info.m_access.store(1, std::memory_order_relaxed);
+    info.endUpdate();
+    ++m_size;
+    if (deadline != 0)
+    {
+        scheduleExpiry(info, false);
+    }
+    if (node != nullptr)
+    {
+        m_keys.insert(*node);
+    }
+    linkTag(tagKeyNode, tagNode, tag);
+    postChange(eChangeSet, key.data(), key.length());
+}
+
+void ItemIndex::update(ItemInfo& info, ItemType type, const char* data, size_t length,
+                       const std::string& tag, uint64_t deadline)
+{
+    const bool scheduled = (info.m_deadline != 0);
+    if ((deadline != 0) && !scheduled)
+    {
+        reserveExpiry();
+    }
+
+    const bool sameTag =
+        (info.m_tagLength == tag.size()) &&
+        (tag.empty() || (std::memcmp(info.m_tag.get(), tag.data(), tag.size()) == 0));
+
+    // reuse the current block unless it is too small or more than twice too large, or viewed
+    ValueBlock* oldBlock = info.m_block.get();
+    ValueBlock* block = oldBlock;
+    if ((length <= ItemInfo::kInlineSize) || (block == nullptr) || (block->m_capacity < length) ||
+        (block->m_capacity > 2 * length) || block->isPinned())
+    {
+        block = allocateBlock(length);
+    }
+
+    char* tagBytes = info.m_tag.get();
+    KeyNode* tagKeyNode = nullptr;
+    TagNode* tagNode = nullptr;
+    if (!sameTag)
+    {
+        try
+        {
+            tagBytes = tag.empty() ? nullptr : copy(tag.data(), tag.size());
+            tagKeyNode = allocateTagNodes(info.getKey(), tag, tagNode);
+        }
+        catch (const std::exception&)
+        {
+            if ((block != nullptr) && (block != oldBlock))
+            {
+                deallocate(block, getBlockSize(block));
+            }
+            if ((tagBytes != nullptr) && (tagBytes != info.m_tag.get()))
+            {
+                deallocate(tagBytes, getCopySize(tag.size()));
+            }
+            throw;
+        }
+    }
+
+    char* oldTag = info.m_tag.get();
+    const size_t oldTagLength = info.m_tagLength;
+    info.beginUpdate();
+    info.m_type = static_cast<uint8_t>(type);
+    writeValue(info, block, data, length);
+    info.m_tag = tagBytes;
+    info.m_tagLength = static_cast<uint32_t>(tag.size());
+    info.m_deadline = deadline;
+    info.endUpdate();
+    if (deadline != 0)
+    {
+        scheduleExpiry(info, scheduled);
+    }
+    else if (scheduled)
+    {
+        unscheduleExpiry(info);
+    }
+    if (m_policy != eNoEviction)
+    {
+        info.touch(m_policy);
+    }
+
+    if (block != oldBlock)
+    {
+        retireBlock(oldBlock);
+    }
+    if (!sameTag)
+    {
+        unlinkTag(info.getKey(), oldTag, oldTagLength);
+        linkTag(tagKeyNode, tagNode, tag);
+        retire(oldTag, getCopySize(oldTagLength));
+    }
+    postChange(eChangeSet, info.m_key.get(), info.m_keyLength);
+}
+
+void ItemIndex::erase(ItemInfo& info, ChangeKind kind)
+{
+    postChange(kind, info.m_key.get(), info.m_keyLength);
+    if (info.m_deadline != 0)
+    {
+        unscheduleExpiry(info);
+    }
+    if (m_ordered)
+    {
+        // the nodes are only walked under the shard lock, they are not retired
+        m_keys.erase_and_dispose(info.getKey(), NodeLess<KeyNode>(),
+                                 [this](boost::interprocess::offset_ptr<KeyNode> node) {
+                                     deallocate(node.get(),
+                                                KeyNode::allocationSize(node->m_length));
+                                 });
+    }
+    unlinkTag(info.getKey(), info.m_tag.get(), info.m_tagLength);
+    info.beginUpdate();
+    info.m_state = ItemInfo::eErased;
+    release(info);
+    info.endUpdate();
+    --m_size;
+    ++m_erased;
+}
+
+void ItemIndex::clear()
+{
+    SlotTable* table = getTable();
+    if (table == nullptr)
+    {
+        return;
+    }
+
+    // the slots stay under update, readers of the old table retry with the new one
+    for (size_t position = 0; position < table->m_capacity; ++position)
+    {
+        ItemInfo& info = table->slots()[position];
+        info.beginUpdate();
+        if (info.isUsed())
+        {
+            release(info);
+        }
+    }
+    m_keys.clear_and_dispose([this](boost::interprocess::offset_ptr<KeyNode> node) {
+        deallocate(node.get(), KeyNode::allocationSize(node->m_length));
+    });
+    m_tags.clear_and_dispose([this](boost::interprocess::offset_ptr<TagNode> tagNode) {
+        tagNode->m_keys.clear_and_dispose([this](boost::interprocess::offset_ptr<KeyNode> node) {
+            deallocate(node.get(), KeyNode::allocationSize(node->m_length));
+        });
+        deallocate(tagNode.get(), TagNode::allocationSize(tagNode->m_length));
+    });
+    setTable(nullptr);
+    retire(table, getTableSize(table->m_capacity));
+    m_size = 0;
+    m_erased = 0;
+    m_expiriesCount = 0;
+}
+
+void ItemIndex::reset()
+{
+    // the unlinked blocks are retired by the next reclamation
+    for (int64_t link = m_pinned; link != 0;)
+    {
+        ValueBlock* block = reinterpret_cast<ValueBlock*>(reinterpret_cast<char*>(this) + link);
+        block->m_pins.store(0, std::memory_order_relaxed);
+        link = static_cast<int64_t>(block->m_length);
+    }
+
+    SlotTable* table = getTable();
+    if (table == nullptr)
+    {
+        return;
+    }
+
+    // a slot left under update is as consistent as its writer left it, readers must not wait
+    for (size_t position = 0; position < table->m_capacity; ++position)
+    {
+        ItemInfo& info = table->slots()[position];
+        if ((info.m_version.load(std::memory_order_relaxed) & 1) != 0)
+        {
+            info.endUpdate();
+        }
+        if (info.isUsed() && (info.m_block != nullptr))
+        {
+            info.m_block->m_pins.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+size_t ItemIndex::expire(size_t count)
+{
+    if (m_expiriesCount == 0)
+    {
+        return 0;
+    }
+
+    const uint64_t now = getCurrentTime();
+    SlotTable* table = getTable();
+    size_t expired = 0;
+    while ((expired < count) && (m_expiriesCount > 0) && (m_expiries[0].m_deadline <= now))
+    {
+        erase(table->slots()[m_expiries[0].m_slot], eChangeExpire);
+        ++expired;
+    }
+    m_expiredCount += expired;
+    return expired;
+}
+
+size_t ItemIndex::evict(size_t count, const std::vector<uint64_t>* kept)
+{
+    SlotTable* table = getTable();
+    if ((m_policy == eNoEviction) || (table == nullptr))
+    {
+        return 0;
+    }
+
+    // the hand makes at most one turn, so that an item is only evicted if it was not accessed
+    // since the previous call, unless every item was accessed: each turn at least halves the
+    // credit of the items, so that further turns evict some
+    const size_t mask = table->m_capacity - 1;
+    const size_t maxSteps = table->m_capacity * ((m_policy == eEvictLfu) ? 6 : 2);
+    size_t evicted = 0;
+    for (size_t step = 0; (evicted < count) && (m_size > 0) &&
+                          ((step < table->m_capacity) || ((evicted == 0) && (step < maxSteps)));
+         ++step)
+    {
+        ItemInfo& info = table->slots()[m_clockHand & mask];
+        m_clockHand = (m_clockHand + 1) & mask;
+        if (!info.isUsed() ||
+            ((kept != nullptr) && std::binary_search(kept->begin(), kept->end(), info.m_hash)))
+        {
+            continue;
+        }
+        const uint8_t access = info.m_access.load(std::memory_order_relaxed);
+        if (access > 0)
+        {
+            info.m_access.store(access / 2, std::memory_order_relaxed);
+        }
+        else
+        {
+            erase(info, eChangeEvict);
+            ++evicted;
+        }
+    }
+
+    // the memory of the evicted items must be available to the next allocation
+    reclaim(true);
+    return evicted;
+}
+
+void ItemIndex::getRelocatableBlocks(uint32_t shard, std::vector<RelocatableBlock>& blocks)
+{
+    SlotTable* table = getTable();
+    if (table == nullptr)
+    {
+        return;
+    }
+
+    blocks.push_back({reinterpret_cast<const char*>(table), shard, RelocatableBlock::kTableSlot});
+    for (size_t slot = 0; slot < table->m_capacity; ++slot)
+    {
+        const ItemInfo& info = table->slots()[slot];
+        if (!info.isUsed())
+        {
+            continue;
+        }
+        if (!m_slabs.accepts(getCopySize(info.m_keyLength)))
+        {
+            blocks.push_back({info.m_key.get(), shard, slot});
+        }
+        if ((info.m_tag != nullptr) && !m_slabs.accepts(getCopySize(info.m_tagLength)))
+        {
+            blocks.push_back({info.m_tag.get(), shard, slot});
+        }
+        const ValueBlock* block = info.m_block.get();
+        if ((block != nullptr) && !block->isPinned() &&
+            !m_slabs.accepts(ValueBlock::allocationSize(static_cast<size_t>(block->m_length))))
+        {
+            blocks.push_back({reinterpret_cast<const char*>(block), shard, slot});
+        }
+    }
+}
+
+size_t ItemIndex::relocateBlock(const RelocatableBlock& block)
+{
+    SlotTable* table = getTable();
+    if (table == nullptr)
+    {
+        return 0;
+    }
+
+    if (block.m_slot == RelocatableBlock::kTableSlot)
+    {
+        // the table is the largest block, its items are moved into the copy
+        const size_t capacity = table->m_capacity;
+        if (block.m_bytes != reinterpret_cast<const char*>(table))
+        {
+            return 0;
+        }
+        SlotTable* moved = nullptr;
+        try
+        {
+            moved = reinterpret_cast<SlotTable*>(
+                m_allocator.allocate(getTableSize(capacity)).get());
+        }
+        catch (const std::exception&)
+        {
+            return 0;
+        }
+        if (moved > table)
+        {
+            deallocate(moved, getTableSize(capacity));
+            return 0;
+        }
+        moveItems(moved, capacity);
+        return getTableSize(capacity);
+    }
+
+    if (block.m_slot >= table->m_capacity)
+    {
+        return 0;
+    }
+    ItemInfo& info = table->slots()[block.m_slot];
+    if (!info.isUsed())
+    {
+        return 0;
+    }
+    char* oldKey = info.m_key.get();
+    char* oldTag = info.m_tag.get();
+    ValueBlock* oldBlock = info.m_block.get();
+    const size_t keySize = getCopySize(info.m_keyLength);
+    const size_t tagSize = getCopySize(info.m_tagLength);
+    char* key = nullptr;
+    char* tag = nullptr;
+    ValueBlock* valueBlock = nullptr;
+    size_t size = 0;
+    if (block.m_bytes == oldKey)
+    {
+        key = relocate(oldKey, keySize);
+        size = keySize;
+    }
+    else if (block.m_bytes == oldTag)
+    {
+        tag = relocate(oldTag, tagSize);
+        size = tagSize;
+    }
+    else if ((block.m_bytes == reinterpret_cast<const char*>(oldBlock)) && !oldBlock->isPinned())
+    {
+        // the copy sheds the spare capacity of the block
+        size = ValueBlock::allocationSize(static_cast<size_t>(oldBlock->m_length));
+        valueBlock =
+            reinterpret_cast<ValueBlock*>(relocate(reinterpret_cast<char*>(oldBlock), size));
+        if (valueBlock != nullptr)
+        {
+            valueBlock->m_capacity = valueBlock->m_length;
+            valueBlock->m_pins.store(0, std::memory_order_relaxed);
+        }
+    }
+    if ((key == nullptr) && (tag == nullptr) && (valueBlock == nullptr))
+    {
+        return 0;
+    }
+
+    info.beginUpdate();
+    if (key != nullptr)
+    {
+        info.m_key = key;
+    }
+    if (tag != nullptr)
+    {
+        info.m_tag = tag;
+    }
+    if (valueBlock != nullptr)
+    {
+        info.m_block = valueBlock;
+    }
+    info.endUpdate();
+    retire((key != nullptr) ? oldKey : nullptr, keySize);
+    retire((tag != nullptr) ? oldTag : nullptr, tagSize);
+    if (valueBlock != nullptr)
+    {
+        retire(oldBlock, getBlockSize(oldBlock));
+    }
+    return size;
+}
+
+char* ItemIndex::allocate(size_t size)
+{
+    try
+    {
+        return m_slabs.accepts(size) ? m_slabs.allocate(size) : m_allocator.allocate(size).get();
+    }
+    catch (const std::exception&)
+    {
+        if ((m_retiredHead == nullptr) && (m_pinned == 0) && (m_slabs.getFreeMemory() == 0))
+        {
+            throw;
+        }
+    }
+
+    // the free chunks of the other size classes may make room once their slabs are empty
+    reclaim(true);
+    m_slabs.trim();
+    return m_slabs.accepts(size) ? m_slabs.allocate(size) : m_allocator.allocate(size).get();
+}
+
+void ItemIndex::deallocate(void* bytes, size_t size)
+{
+    if (m_slabs.accepts(size))
+    {
+        m_slabs.deallocate(static_cast<char*>(bytes), size);
+    }
+    else
+    {
+        m_allocator.deallocate(static_cast<char*>(bytes), 0);
+    }
+}
+
+char* ItemIndex::copy(const char* data, size_t length)
+{
+    char* bytes = allocate(getCopySize(length));
+    std::memcpy(bytes, data, length);
+    return bytes;
+}
+
+char* ItemIndex::relocate(const char* bytes, size_t size)
+{
+    // the chunks of the slabs are reused by blocks of the same class, they do not scatter
+    if (m_slabs.accepts(size))
+    {
+        return nullptr;
+    }
+
+    char* copy = nullptr;
+    try
+    {
+        copy = m_allocator.allocate(size).get();
+    }
+    catch (const std::exception&)
+    {
+        return nullptr;
+    }
+    if (copy > bytes)
+    {
+        m_allocator.deallocate(copy, 0);
+        return nullptr;
+    }
+    std::memcpy(copy, bytes, size);
+    return copy;
+}
+
+ValueBlock* ItemIndex::allocateBlock(size_t length)
+{
+    if (length <= ItemInfo::kInlineSize)
+    {
+        return nullptr;
+    }
+    return new (allocate(ValueBlock::allocationSize(length))) ValueBlock(length);
+}
+
+void ItemIndex::writeValue(ItemInfo& info, ValueBlock* block, const char* data, size_t length)
+{
+    if (block == nullptr)
+    {
+        std::memcpy(info.m_inline, data, length);
+        info.m_inlineLength = static_cast<uint8_t>(length);
+    }
+    else
+    {
+        std::memcpy(block->data(), data, length);
+        block->m_length = length;
+        info.m_inlineLength = 0;
+    }
+    info.m_block = block;
+}
+
+void ItemIndex::reserve()
+{
+    SlotTable* table = getTable();
+    if (table == nullptr)
+    {
+        // the slots are only allocated when the first item is inserted
+        rehash(kMinCapacity);
+    }
+    else if (isOverloaded(m_size + m_erased, table->m_capacity))
+    {
+        // grow only if erased slots are not enough to make room
+        size_t capacity = table->m_capacity;
+        while (isOverloaded(m_size, capacity))
+        {
+            capacity *= 2;
+        }
+        rehash(capacity);
+    }
+}
+
+void ItemIndex::rehash(size_t capacity)
+{
+    moveItems(reinterpret_cast<SlotTable*>(allocate(getTableSize(capacity))), capacity);
+}
+
+void ItemIndex::moveItems(SlotTable* table, size_t capacity)
+{
+    table->m_capacity = capacity;
+    for (size_t position = 0; position < capacity; ++position)
+    {
+        new (&table->slots()[position]) ItemInfo();
+    }
+
+    SlotTable* oldTable = getTable();
+    if (oldTable != nullptr)
+    {
+        const size_t mask = capacity - 1;
+        for (size_t oldPosition = 0; oldPosition < oldTable->m_capacity; ++oldPosition)
+        {
+            ItemInfo& oldInfo = oldTable->slots()[oldPosition];
+            if (oldInfo.isUsed())
+            {
+                size_t position = oldInfo.m_hash & mask;
+                while (!table->slots()[position].isFree())
+                {
+                    position = (position + 1) & mask;
+                }
+                ItemInfo& info = table->slots()[position];
+                info.m_hash = oldInfo.m_hash;
+                info.m_key = oldInfo.m_key;
+                info.m_tag = oldInfo.m_tag;
+                info.m_block = oldInfo.m_block;
+                info.m_keyLength = oldInfo.m_keyLength;
+                info.m_tagLength = oldInfo.m_tagLength;
+                info.m_state = oldInfo.m_state;
+                info.m_type = oldInfo.m_type;
+                info.m_inlineLength = oldInfo.m_inlineLength;
+                info.m_deadline = oldInfo.m_deadline;
+                if (oldInfo.m_deadline != 0)
+                {
+                    // the heap order does not change, only the position of the item
+                    info.m_expiryPosition = oldInfo.m_expiryPosition;
+                    m_expiries[info.m_expiryPosition].m_slot = position;
+                }
+                info.m_access.store(oldInfo.m_access.load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+                std::memcpy(info.m_inline, oldInfo.m_inline, ItemInfo::kInlineSize);
+
+                // the items are now updated through the new table, readers of the old one retry
+                oldInfo.beginUpdate();
+            }
+        }
+    }
+
+    setTable(table);
+    if (oldTable != nullptr)
+    {
+        retire(oldTable, getTableSize(oldTable->m_capacity));
+    }
+    m_erased = 0;
+}
+
+void ItemIndex::reserveExpiry()
+{
+    if (m_expiriesCount < m_expiriesCapacity)
+    {
+        return;
+    }
+
+    // only writers use the heap, the previous entries are deallocated at once
+    const uint64_t capacity = (m_expiriesCapacity > 0) ? (m_expiriesCapacity * 2) : kMinCapacity;
+    ExpiryEntry* expiries =
+        reinterpret_cast<ExpiryEntry*>(allocate(capacity * sizeof(ExpiryEntry)));
+    if (m_expiries != nullptr)
+    {
+        std::memcpy(expiries, m_expiries.get(), m_expiriesCount * sizeof(ExpiryEntry));
+        deallocate(m_expiries.get(), m_expiriesCapacity * sizeof(ExpiryEntry));
+    }
+    m_expiries = expiries;
+    m_expiriesCapacity = capacity;
+}
+
+void ItemIndex::scheduleExpiry(ItemInfo& info, bool scheduled)
+{
+    uint64_t position = info.m_expiryPosition;
+    if (scheduled)
+    {
+        m_expiries[position].m_deadline = info.m_deadline;
+    }
+    else
+    {
+        position = m_expiriesCount++;
+        ExpiryEntry entry;
+        entry.m_deadline = info.m_deadline;
+        entry.m_slot = static_cast<uint64_t>(&info - getTable()->slots());
+        setExpiry(position, entry);
+    }
+    siftExpiry(position);
+}
+
+void ItemIndex::unscheduleExpiry(ItemInfo& info)
+{
+    const uint64_t position = info.m_expiryPosition;
+    if (position != --m_expiriesCount)
+    {
+        setExpiry(position, m_expiries[m_expiriesCount]);
+        siftExpiry(position);
+    }
+}
+
+void ItemIndex::siftExpiry(uint64_t position)
+{
+    const ExpiryEntry entry = m_expiries[position];
+    while ((position > 0) && (m_expiries[(position - 1) / 2].m_deadline > entry.m_deadline))
+    {
+        setExpiry(position, m_expiries[(position - 1) / 2]);
+        position = (position - 1) / 2;
+    }
+    for (uint64_t child = 2 * position + 1; child < m_expiriesCount; child = 2 * position + 1)
+    {
+        if ((child + 1 < m_expiriesCount) &&
+            (m_expiries[child + 1].m_deadline < m_expiries[child].m_deadline))
+        {
+            ++child;
+        }
+        if (m_expiries[child].m_deadline >= entry.m_deadline)
+        {
+            break;
+        }
+        setExpiry(position, m_expiries[child]);
+        position = child;
+    }
+    setExpiry(position, entry);
+}
+
+void ItemIndex::setExpiry(uint64_t position, const ExpiryEntry& entry)
+{
+    m_expiries[position] = entry;
+    getTable()->slots()[entry.m_slot].m_expiryPosition = static_cast<uint32_t>(position);
+}
+
+void ItemIndex::retire(void* bytes, size_t size)
+{
+    if (bytes == nullptr)
+    {
+        return;
+    }
+
+    RetiredBlock* block = new (bytes) RetiredBlock();
+    block->m_epoch = m_epochs->getEpoch();
+    block->m_size = size;
+    if (m_retiredTail != nullptr)
+    {
+        m_retiredTail->m_next = block;
+    }
+    else
+    {
+        m_retiredHead = block;
+    }
+    m_retiredTail = block;
+
+    if (++m_retiredCount >= kMaxRetiredCount)
+    {
+        reclaim(false);
+    }
+}
+
+void ItemIndex::retireBlock(ValueBlock* block)
+{
+    if ((block == nullptr) || !block->isPinned())
+    {
+        retire(block, (block != nullptr) ? getBlockSize(block) : 0);
+        return;
+    }
+
+    // the views read the bytes after the header, the length is no longer needed
+    block->m_length = static_cast<uint64_t>(m_pinned);
+    m_pinned = reinterpret_cast<char*>(block) - reinterpret_cast<char*>(this);
+}
+
+void ItemIndex::reclaim(bool wait)
+{
+    // unlink the blocks whose views were released before retiring them, which may reclaim again
+    ValueBlock* released = nullptr;
+    int64_t* link = &m_pinned;
+    while (*link != 0)
+    {
+        ValueBlock* block = reinterpret_cast<ValueBlock*>(reinterpret_cast<char*>(this) + *link);
+        if (block->isPinned())
+        {
+            link = reinterpret_cast<int64_t*>(&block->m_length);
+        }
+        else
+        {
+            *link = static_cast<int64_t>(block->m_length);
+            block->m_length = reinterpret_cast<uint64_t>(released);
+            released = block;
+        }
+    }
+    while (released != nullptr)
+    {
+        ValueBlock* block = released;
+        released = reinterpret_cast<ValueBlock*>(block->m_length);
+        retire(block, getBlockSize(block));
+    }
+
+    if (m_retiredHead == nullptr)
+    {
+        return;
+    }
+
+    // readers which enter from now on cannot see any retired block
+    m_epochs->advance();
+    uint64_t oldestReader = m_epochs->getOldestReader();
+    if (wait)
+    {
+        // readers do not lock, they leave soon unless their process died while reading: the slots
+        // of the dead processes are released rather than waited for
+        for (int iter = 0; oldestReader <= m_retiredTail->m_epoch; ++iter)
+        {
+            if ((iter % kReaderChecksInterval) == 0)
+            {
+                m_epochs->releaseDeadReaders();
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+            oldestReader = m_epochs->getOldestReader();
+        }
+    }
+
+    while ((m_retiredHead != nullptr) && (m_retiredHead->m_epoch < oldestReader))
+    {
+        RetiredBlock* block = m_retiredHead.get();
+        m_retiredHead = block->m_next;
+        deallocate(block, static_cast<size_t>(block->m_size));
+        --m_retiredCount;
+    }
+    if (m_retiredHead == nullptr)
+    {
+        m_retiredTail = nullptr;
+    }
+}
+
+size_t ItemIndex::countTagged(const std::string& tag) const
+{
+    auto node = m_tags.find(ItemKey(tag), NodeLess<TagNode>());
+    if (node == m_tags.end())
+    {
+        return 0;
+    }
+    if (m_expiriesCount == 0)
+    {
+        return node->m_keys.size();
+    }
+
+    // the expired items stay associated to the tag until they are erased
+    size_t count = 0;
+    forEachTagged(tag, [&count](const ItemKey&) {
+        ++count;
+        return true;
+    });
+    return count;
+}
+
+KeyNode* ItemIndex::allocateTagNodes(const ItemKey& key, const std::string& tag,
+                                     TagNode*& tagNode)
+{
+    tagNode = nullptr;
+    if (!m_tagged || tag.empty())
+    {
+        return nullptr;
+    }
+
+    KeyNode* keyNode =
+        new (allocate(KeyNode::allocationSize(key.length()))) KeyNode(key.length());
+    std::memcpy(keyNode->data(), key.data(), key.length());
+    if (m_tags.find(ItemKey(tag), NodeLess<TagNode>()) == m_tags.end())
+    {
+        try
+        {
+            tagNode = new (allocate(TagNode::allocationSize(tag.size()))) TagNode(tag.size());
+            std::memcpy(tagNode->data(), tag.data(), tag.size());
+        }
+        catch (const std::exception&)
+        {
+            deallocate(keyNode, KeyNode::allocationSize(key.length()));
+            throw;
+        }
+    }
+    return keyNode;
+}
+
+void ItemIndex::deallocateTagNodes(KeyNode* keyNode, TagNode* tagNode)
+{
+    if (keyNode != nullptr)
+    {
+        deallocate(keyNode, KeyNode::allocationSize(keyNode->m_length));
+    }
+    if (tagNode != nullptr)
+    {
+        deallocate(tagNode, TagNode::allocationSize(tagNode->m_length));
+    }
+}
+
+void ItemIndex::linkTag(KeyNode* keyNode, TagNode* tagNode, const std::string& tag)
+{
+    if (keyNode == nullptr)
+    {
+        return;
+    }
+    if (tagNode != nullptr)
+    {
+        m_tags.insert(*tagNode);
+    }
+    else
+    {
+        tagNode = &*m_tags.find(ItemKey(tag), NodeLess<TagNode>());
+    }
+    tagNode->m_keys.insert(*keyNode);
+}
+
+void ItemIndex::unlinkTag(const ItemKey& key, const char* tag, size_t tagLength)
+{
+    if (!m_tagged || (tagLength == 0))
+    {
+        return;
+    }
+    auto tagNode = m_tags.find(ItemKey(tag, tagLength), NodeLess<TagNode>());
+    if (tagNode == m_tags.end())
+    {
+        return;
+    }
+    tagNode->m_keys.erase_and_dispose(
+        key, NodeLess<KeyNode>(), [this](boost::interprocess::offset_ptr<KeyNode> node) {
+            deallocate(node.get(), KeyNode::allocationSize(node->m_length));
+        });
+    if (tagNode->m_keys.empty())
+    {
+        TagNode* node = &*tagNode;
+        m_tags.erase(tagNode);
+        deallocate(node, TagNode::allocationSize(node->m_length));
+    }
+}
+
+void ItemIndex::release(ItemInfo& info)
+{
+    retire(info.m_key.get(), getCopySize(info.m_keyLength));
+    retire(info.m_tag.get(), getCopySize(info.m_tagLength));
+    retireBlock(info.m_block.get());
+    info.m_key = nullptr;
+    info.m_keyLength = 0;
+    info.m_tag = nullptr;
+    info.m_tagLength = 0;
+    info.m_block = nullptr;
+    info.m_deadline = 0;
+    info.m_type = eNone;
+    info.m_inlineLength = 0;
+}
+
+} // namespace storage
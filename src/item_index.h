@@ -0,0 +1,1171 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    item_index.h
+ */
+
+#ifndef ITEM_INDEX_H_
+#define ITEM_INDEX_H_
+
+
+// Includes.
+#include "change_ring.h"
+#include "epoch_manager.h"
+#include "managed_segment.h"
+#include "shared_item.h"
+#include "slab_allocator.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/interprocess/offset_ptr.hpp>
+#include <boost/intrusive/set.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace storage
+{
+
+// Type defs.
+template <class T>
+using InterprocessAllocator =
+    boost::interprocess::allocator<T,
+                                   SegmentManager>;
+
+using CharAllocator =
+    boost::interprocess::allocator<char,
+                                   SegmentManager>;
+
+/**
+ * @brief  Get the current time, as a deadline of expiring items.
+ *
+ * @return Milliseconds elapsed since the Unix epoch, which every process shares.
+ */
+inline uint64_t getCurrentTime()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     std::chrono::system_clock::now().time_since_epoch())
+                                     .count());
+}
+
+
+/**
+ * @brief  Policies which choose the items evicted when the storage is full.
+ */
+enum EvictionPolicy
+{
+    eNoEviction = 0, ///< Writing into a full storage fails.
+    eEvictClock = 1, ///< Items which were not accessed since the last turn of the clock.
+    eEvictLfu = 2    ///< Items which were accessed the least often lately.
+};
+
+
+/**
+ *  @brief  Value bytes which are too large to be stored inline into the item infos.
+ */
+class ValueBlock
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    ValueBlock() = delete;
+
+    /**
+     * @brief  Constructor.
+     *
+     * @param capacity Count of bytes allocated after the block header.
+     */
+    ValueBlock(uint64_t capacity) : m_length(0), m_capacity(capacity), m_pins(0), m_reserved(0) {}
+
+    /**
+     * @brief  Get the count of bytes which must be allocated for a block.
+     *
+     * @param capacity Count of value bytes.
+     *
+     * @return Count of bytes of the block, header included.
+     */
+    static size_t allocationSize(size_t capacity) { return sizeof(ValueBlock) + capacity; }
+
+    /**
+     * @brief  Get the value bytes.
+     *
+     * @return Value bytes.
+     */
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+
+    /**
+     * @brief  Get the value bytes.
+     *
+     * @return Value bytes.
+     */
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+
+    /**
+     * @brief  Pin the value bytes for a view, writers must not change them until it is released.
+     * Writers must be excluded.
+     */
+    void pin() { m_pins.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief  Release a view of the value bytes, the shard lock is not needed.
+     */
+    void unpin() { m_pins.fetch_sub(1, std::memory_order_release); }
+
+    /**
+     * @brief  Check if views of the value bytes are alive.
+     *
+     * @return true if the block must neither be written nor deallocated.
+     */
+    bool isPinned() const { return (m_pins.load(std::memory_order_acquire) != 0); }
+
+    uint64_t m_length; ///< Length of the value, or link to the next pinned block once unlinked.
+    uint64_t m_capacity;
+    std::atomic<uint32_t> m_pins; ///< Count of views of the value bytes.
+    uint32_t m_reserved;
+};
+
+
+/**
+ *  @brief  Information about shared items. For each item, the storage maintains its key, its type,
+ * its tag and its value. An ItemInfo is also a slot of the item index: unused slots are either free
+ * or erased.
+ *
+ * The key and tag bytes are allocated into the memory segment and referenced through offset
+ * pointers, so that every process can compare them. The key hash is cached to short-circuit
+ * comparisons.
+ *
+ * Values up to kInlineSize bytes, such as booleans, numbers and short strings, are stored inline.
+ * Larger values are spilled into a value block.
+ *
+ * Writers make the version odd while they update the slot, so that lock-free readers detect that
+ * what they copied may be inconsistent.
+ */
+class ItemInfo
+{
+public:
+    /**
+     * @brief  Constructor of a free slot.
+     */
+    ItemInfo()
+    : m_hash(0), m_key(), m_tag(), m_block(), m_deadline(0), m_version(0), m_keyLength(0),
+      m_tagLength(0), m_expiryPosition(0), m_state(eFree), m_type(eNone), m_inlineLength(0),
+      m_access(0)
+    {
+    }
+
+    /**
+     * @brief  Deleted copy constructor.
+     */
+    ItemInfo(const ItemInfo&) = delete;
+
+    /**
+     * @brief  Deleted assignment operator.
+     */
+    ItemInfo& operator=(const ItemInfo&) = delete;
+
+    /**
+     * @brief  Check if the slot holds an item.
+     *
+     * @return true if the slot holds an item.
+     */
+    bool isUsed() const { return (m_state == eUsed); }
+
+    /**
+     * @brief  Check if the slot has never held an item. Free slots end probe sequences.
+     *
+     * @return true if the slot is free.
+     */
+    bool isFree() const { return (m_state == eFree); }
+
+    /**
+     * @brief  Check if the slot holds the item identified by the passed key.
+     *
+     * @param key Key of the item.
+     *
+     * @return true if the slot holds the item.
+     */
+    bool matches(const ItemKey& key) const
+    {
+        return (m_hash == key.getHash()) && (m_state == eUsed) && (m_keyLength == key.length()) &&
+               (std::memcmp(m_key.get(), key.data(), key.length()) == 0);
+    }
+
+    /**
+     * @brief  Get the hash of the item key.
+     *
+     * @return Hash of the item key.
+     */
+    uint64_t getHash() const { return m_hash; }
+
+    /**
+     * @brief  Get the key of the shared item.
+     *
+     * @return Key of the shared item, valid as long as the item is not removed.
+     */
+    ItemKey getKey() const { return ItemKey(m_key.get(), m_keyLength); }
+
+    /**
+     * @brief  Get the type of the shared item.
+     *
+     * @return Type of the shared item.
+     */
+    ItemType getType() const { return static_cast<ItemType>(m_type); }
+
+    /**
+     * @brief  Get the tag associated to the shared item.
+     *
+     * @param[out] tag Tag associated to the shared item.
+     */
+    void getTag(std::string& tag) const { tag.assign(m_tag.get(), m_tagLength); }
+
+    /**
+     * @brief  Check if a tag is associated to the shared item.
+     *
+     * @param tag Tag to compare, empty for the items without tag.
+     *
+     * @return true if the tag of the item is the passed one.
+     */
+    bool hasTag(const std::string& tag) const
+    {
+        return (m_tagLength == tag.size()) &&
+               (tag.empty() || (std::memcmp(m_tag.get(), tag.data(), tag.size()) == 0));
+    }
+
+    /**
+     * @brief  Get the value bytes of the shared item.
+     *
+     * @return Value bytes, valid until the value is updated.
+     */
+    const char* getValueData() const { return (m_block != nullptr) ? m_block->data() : m_inline; }
+
+    /**
+     * @brief  Get the length of the value of the shared item.
+     *
+     * @return Length in bytes of the value.
+     */
+    size_t getValueLength() const
+    {
+        return (m_block != nullptr) ? static_cast<size_t>(m_block->m_length) : m_inlineLength;
+    }
+
+    /**
+     * @brief  Get the time at which the shared item expires.
+     *
+     * @return Deadline in milliseconds since the Unix epoch, 0 if the item does not expire.
+     */
+    uint64_t getDeadline() const { return m_deadline; }
+
+    /**
+     * @brief  Check if the shared item has expired.
+     *
+     * @param now Current time, as returned by getCurrentTime().
+     *
+     * @return true if the item must be seen as missing.
+     */
+    bool isExpired(uint64_t now) const { return (m_deadline != 0) && (m_deadline <= now); }
+
+    /**
+     * @brief  Record an access to the item for the eviction policy. Lock-free readers may record
+     * accesses concurrently, an access which is lost only makes the item older.
+     *
+     * @param policy Eviction policy of the storage.
+     */
+    void touch(EvictionPolicy policy) const
+    {
+        const uint8_t access = m_access.load(std::memory_order_relaxed);
+        if ((policy == eEvictLfu) ? (access < kMaxFrequency) : (access == 0))
+        {
+            m_access.store(access + 1, std::memory_order_relaxed);
+        }
+    }
+
+    static const size_t kInlineSize = 23;
+
+    static const uint8_t kMaxFrequency = 15;
+
+private:
+    friend class ItemIndex;
+
+    /**
+     *  @brief  Slot states.
+     */
+    enum State
+    {
+        eFree = 0,
+        eUsed = 1,
+        eErased = 2
+    };
+
+    /**
+     * @brief  Make the version odd before updating the slot.
+     */
+    void beginUpdate()
+    {
+        m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    /**
+     * @brief  Make the version even again once the slot is updated.
+     */
+    void endUpdate()
+    {
+        m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint64_t m_hash;
+    boost::interprocess::offset_ptr<char> m_key;
+    boost::interprocess::offset_ptr<char> m_tag;
+    boost::interprocess::offset_ptr<ValueBlock> m_block;
+    uint64_t m_deadline;
+    std::atomic<uint32_t> m_version;
+    uint32_t m_keyLength;
+    uint32_t m_tagLength;
+    uint32_t m_expiryPosition; ///< Position into the expiry heap, if the item expires.
+    uint8_t m_state;
+    uint8_t m_type;
+    uint8_t m_inlineLength;
+    mutable std::atomic<uint8_t> m_access; ///< Recent accesses, aged by each turn of the clock.
+    char m_inline[kInlineSize];
+};
+
+
+/**
+ * @brief  Header of a table of slots, followed by the slots.
+ */
+struct SlotTable
+{
+    /**
+     * @brief  Get the slots of the table.
+     *
+     * @return Slots of the table.
+     */
+    ItemInfo* slots() { return reinterpret_cast<ItemInfo*>(this + 1); }
+
+    uint64_t m_reserved[3]; ///< Overwritten once the table is retired.
+    uint64_t m_capacity;    ///< Count of slots, a power of two.
+};
+
+
+/**
+ * @brief  Entry of the expiry heap.
+ */
+struct ExpiryEntry
+{
+    uint64_t m_deadline; ///< Deadline of the item.
+    uint64_t m_slot;     ///< Position of the item into the table of slots.
+};
+
+
+/**
+ * @brief  Block of an index which the compaction may relocate.
+ */
+struct RelocatableBlock
+{
+    const char* m_bytes; ///< Address of the block.
+    uint32_t m_shard;    ///< Shard of the index which owns the block.
+    size_t m_slot;       ///< Position of the item which owns the block, kTableSlot for the table.
+
+    static const size_t kTableSlot = SIZE_MAX;
+};
+
+
+/**
+ * @brief  Header written over memory blocks which are retired, to chain them until they can be
+ * deallocated.
+ */
+struct RetiredBlock
+{
+    boost::interprocess::offset_ptr<RetiredBlock> m_next;
+    uint64_t m_epoch;
+    uint64_t m_size; ///< Count of bytes allocated for the block.
+};
+
+
+/**
+ * @brief  Compare keys in the order of their bytes.
+ *
+ * @param left Bytes of the left key.
+ * @param leftLength Length in bytes of the left key.
+ * @param right Bytes of the right key.
+ * @param rightLength Length in bytes of the right key.
+ *
+ * @return true if the left key is ordered before the right one.
+ */
+inline bool isKeyBefore(const char* left, size_t leftLength, const char* right,
+                        size_t rightLength)
+{
+    const int result = std::memcmp(left, right, std::min(leftLength, rightLength));
+    return (result < 0) || ((result == 0) && (leftLength < rightLength));
+}
+
+
+/**
+ * @brief  Node of the ordered keys of an index, followed by its own copy of the key bytes. The
+ * nodes are linked through offset pointers, so that every process can walk them.
+ */
+struct KeyNode
+    : public boost::intrusive::set_base_hook<
+          boost::intrusive::void_pointer<boost::interprocess::offset_ptr<void>>,
+          boost::intrusive::link_mode<boost::intrusive::normal_link>>
+{
+    /**
+     * @brief  Constructor.
+     *
+     * @param length Length in bytes of the key.
+     */
+    explicit KeyNode(size_t length) : m_length(static_cast<uint32_t>(length)) {}
+
+    /**
+     * @brief  Get the count of bytes which must be allocated for a node.
+     *
+     * @param length Length in bytes of the key.
+     *
+     * @return Count of bytes of the node, key included.
+     */
+    static size_t allocationSize(size_t length) { return sizeof(KeyNode) + length; }
+
+    /**
+     * @brief  Get the key bytes.
+     *
+     * @return Key bytes, not null-terminated.
+     */
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+
+    /**
+     * @brief  Get the key bytes.
+     *
+     * @return Key bytes, not null-terminated.
+     */
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+
+    uint32_t m_length;
+};
+
+
+/**
+ * @brief  Order of the key or tag nodes, which also compares them to other bytes.
+ */
+template <class N> struct NodeLess
+{
+    bool operator()(const N& left, const N& right) const
+    {
+        return isKeyBefore(left.data(), left.m_length, right.data(), right.m_length);
+    }
+
+    bool operator()(const ItemKey& left, const N& right) const
+    {
+        return isKeyBefore(left.data(), left.length(), right.data(), right.m_length);
+    }
+
+    bool operator()(const N& left, const ItemKey& right) const
+    {
+        return isKeyBefore(left.data(), left.m_length, right.data(), right.length());
+    }
+};
+
+using KeySet = boost::intrusive::set<KeyNode, boost::intrusive::compare<NodeLess<KeyNode>>>;
+
+
+/**
+ * @brief  Node of the tags of an index, followed by its own copy of the tag bytes. It holds the
+ * nodes of the keys of the items associated to the tag.
+ */
+struct TagNode
+    : public boost::intrusive::set_base_hook<
+          boost::intrusive::void_pointer<boost::interprocess::offset_ptr<void>>,
+          boost::intrusive::link_mode<boost::intrusive::normal_link>>
+{
+    /**
+     * @brief  Constructor.
+     *
+     * @param length Length in bytes of the tag.
+     */
+    explicit TagNode(size_t length) : m_keys(), m_length(static_cast<uint32_t>(length)) {}
+
+    /**
+     * @brief  Get the count of bytes which must be allocated for a node.
+     *
+     * @param length Length in bytes of the tag.
+     *
+     * @return Count of bytes of the node, tag included.
+     */
+    static size_t allocationSize(size_t length) { return sizeof(TagNode) + length; }
+
+    /**
+     * @brief  Get the tag bytes.
+     *
+     * @return Tag bytes, not null-terminated.
+     */
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+
+    /**
+     * @brief  Get the tag bytes.
+     *
+     * @return Tag bytes, not null-terminated.
+     */
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+
+    KeySet m_keys; ///< Keys of the items associated to the tag.
+    uint32_t m_length;
+};
+
+using TagSet = boost::intrusive::set<TagNode, boost::intrusive::compare<NodeLess<TagNode>>,
+                                     boost::intrusive::constant_time_size<false>>;
+
+
+/**
+ * @brief  Open-addressing hash table of item infos living into the memory segment. Each slot
+ * stores the precomputed hash of its key so that a lookup costs one linear probe sequence.
+ *
+ * Updates must be serialized by the caller, while reads may run concurrently with them. The keys,
+ * tags, value blocks and tables which are unlinked are retired, then deallocated when no lock-free
+ * reader may still see them.
+ */
+class ItemIndex
+{
+public:
+    /**
+     * @brief  Result of a lock-free read.
+     */
+    enum ReadStatus
+    {
+        eRead = 0,
+        eMissing = 1,
+        eContended = 2
+    };
+
+    /**
+     * @brief  Deleted constructor.
+     */
+    ItemIndex() = delete;
+
+    /**
+     * @brief  Constructor.
+     *
+     * @param allocator Allocator of the slots, keys, tags and values.
+     * @param epochs Epoch manager of the lock-free readers.
+     * @param policy Policy which chooses the evicted items.
+     * @param slabSize Size in bytes of the slabs of the small blocks, 0 to allocate them from the
+     * segment.
+     * @param ordered true to also keep the keys in their byte order, for the ordered queries.
+     * @param tagged true to also keep the keys of the items associated to each tag.
+     * @param changes Ring into which the changes of the items are recorded, nullptr for none.
+     */
+    ItemIndex(const InterprocessAllocator<char>& allocator, EpochManager* epochs,
+              EvictionPolicy policy, size_t slabSize, bool ordered, bool tagged,
+              ChangeRing* changes);
+
+    /**
+     * @brief  Find the infos of an item. Updates must not run concurrently. An expired item is
+     * erased on the way.
+     *
+     * @param key Key of the item.
+     *
+     * @return Infos of the item or nullptr if the item doesn't exist.
+     */
+    ItemInfo* find(const ItemKey& key);
+
+    /**
+     * @brief  Copy an item. Updates may run concurrently if the caller entered the epoch manager.
+     *
+     * @param key Key of the item.
+     * @param[out] type Type of the item.
+     * @param[out] value Value bytes of the item.
+     * @param[out] tag Tag associated to the item.
+     *
+     * @return eRead if the item was copied
+     * or eMissing if the item doesn't exist or has expired
+     * or eContended if an update overlapped the copy, which must be tried again.
+     */
+    ReadStatus read(const ItemKey& key, ItemType& type, std::string& value, std::string& tag) const;
+
+    /**
+     * @brief  Pin the value block of an item, so that its bytes can be read without copy until
+     * they are unpinned. Writers must be excluded. A pinned block is never updated in place, and
+     * once unlinked it is only deallocated after its last view is released.
+     *
+     * @param key Key of the item.
+     * @param[out] type Type of the item.
+     * @param[out] block Pinned value block, or nullptr if the value is stored inline.
+     * @param[out] value Copy of the value bytes, if they are stored inline.
+     * @param[out] tag Tag associated to the item.
+     *
+     * @return true if the item exists.
+     */
+    bool pin(const ItemKey& key, ItemType& type, ValueBlock*& block, std::string& value,
+             std::string& tag) const;
+
+    /**
+     * @brief  Insert a new item. The item must not already exist. Previously returned infos are
+     * invalidated.
+     *
+     * @param key Key of the item.
+     * @param type Type of the item.
+     * @param data Value bytes.
+     * @param length Length in bytes of the value.
+     * @param tag Tag associated to the item.
+     * @param deadline Time at which the item expires, 0 if it does not expire.
+     *
+     * @throw boost::interprocess::bad_alloc if the memory segment is full.
+     */
+    void insert(const ItemKey& key, ItemType type, const char* data, size_t length,
+                const std::string& tag, uint64_t deadline);
+
+    /**
+     * @brief  Replace the type, the value and the tag of an item. The previous ones are kept if
+     * the update fails.
+     *
+     * @param info Infos of the item.
+     * @param type Type of the item.
+     * @param data Value bytes.
+     * @param length Length in bytes of the value.
+     * @param tag Tag associated to the item.
+     * @param deadline Time at which the item expires, 0 if it does not expire.
+     *
+     * @throw boost::interprocess::bad_alloc if the memory segment is full.
+     */
+    void update(ItemInfo& info, ItemType type, const char* data, size_t length,
+                const std::string& tag, uint64_t deadline);
+
+    /**
+     * @brief  Release the slot, the key, the tag and the value of an item which is removed.
+     *
+     * @param info Infos of the item.
+     */
+    void erase(ItemInfo& info) { erase(info, eChangeRemove); }
+
+    /**
+     * @brief  Release all the slots, the keys, the tags and the values.
+     */
+    void clear();
+
+    /**
+     * @brief  Release the views and the updates left by the processes which used the index, once
+     * none of them runs anymore.
+     */
+    void reset();
+
+    /**
+     * @brief  Evict items according to the eviction policy, then deallocate the retired blocks.
+     * The clock hand sweeps the slots: an item which was accessed since the last sweep loses
+     * some credit, an item without credit left is erased.
+     *
+     * @param count Maximum count of items to evict.
+     * @param kept Sorted hashes of the keys of the items to keep, or nullptr.
+     *
+     * @return Count of evicted items.
+     */
+    size_t evict(size_t count, const std::vector<uint64_t>* kept = nullptr);
+
+    /**
+     * @brief  Erase the items whose deadline has passed, the earliest first.
+     *
+     * @param count Maximum count of items to erase.
+     *
+     * @return Count of erased items.
+     */
+    size_t expire(size_t count);
+
+    /**
+     * @brief  Get the count of items erased because they expired.
+     *
+     * @return Count of expired items.
+     */
+    uint64_t getExpiredCount() const { return m_expiredCount; }
+
+    /**
+     * @brief  Get the blocks which the compaction may relocate: the table of slots, then the keys,
+     * the tags and the value blocks of the items. The blocks allocated from the slabs and the
+     * value blocks pinned by views stay in place.
+     *
+     * @param shard Shard of the index, recorded into the blocks.
+     * @param[out] blocks Blocks, appended.
+     */
+    void getRelocatableBlocks(uint32_t shard, std::vector<RelocatableBlock>& blocks);
+
+    /**
+     * @brief  Relocate a block returned by getRelocatableBlocks() to a lower address of the memory
+     * segment, if it still belongs to the index and the allocator has room there. The item is
+     * relocated within an update of its slot and its previous block is retired, so lock-free
+     * readers of every process either retry or finish reading the previous copy.
+     *
+     * @param block Block to relocate.
+     *
+     * @return Count of bytes copied, 0 if the block did not move.
+     */
+    size_t relocateBlock(const RelocatableBlock& block);
+
+    /**
+     * @brief  Deallocate the retired blocks once no reader may still see them, so that the memory
+     * of the relocated blocks coalesces.
+     */
+    void reclaimRetired() { reclaim(true); }
+
+    /**
+     * @brief  Get the count of slots of the table.
+     *
+     * @return Count of slots, 0 if no item was ever inserted.
+     */
+    size_t getCapacity() const
+    {
+        SlotTable* table = getTable();
+        return (table != nullptr) ? static_cast<size_t>(table->m_capacity) : 0;
+    }
+
+    /**
+     * @brief  Get the count of items.
+     *
+     * @return Count of items.
+     */
+    size_t size() const { return m_size; }
+
+    /**
+     * @brief  Get the memory of the free chunks of the slabs, which the segment counts as
+     * allocated.
+     *
+     * @return Size in bytes of the free chunks.
+     */
+    uint64_t getSlabsFreeMemory() const { return m_slabs.getFreeMemory(); }
+
+    /**
+     * @brief  Call a function with the infos of each item. Updates must not run concurrently.
+     *
+     * @param function Function called with the infos of each item.
+     */
+    template <class F> void forEach(F function) const
+    {
+        SlotTable* table = getTable();
+        if (table != nullptr)
+        {
+            ItemInfo* slots = table->slots();
+            for (uint64_t iter = 0; iter < table->m_capacity; ++iter)
+            {
+                if (slots[iter].isUsed())
+                {
+                    function(static_cast<const ItemInfo&>(slots[iter]));
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief  Call a function with the infos of the items of a batch of buckets, resuming a scan
+     * of all the items. A bucket holds the items whose probe sequence starts at its slot. The
+     * buckets are visited in the reverse binary order of their position, so that the buckets of a
+     * grown table which split the buckets already visited are skipped: an item which exists
+     * during the whole scan is visited exactly once. Updates must not run concurrently.
+     *
+     * @param cursor 0 to start a scan, or the cursor returned by the previous call.
+     * @param count Count of items from which the batch ends, after the bucket which reaches it.
+     * @param function Function called with the infos of each item which has not expired.
+     *
+     * @return Cursor of the next batch, 0 once the scan is complete.
+     */
+    template <class F> uint64_t scan(uint64_t cursor, size_t count, F function) const
+    {
+        SlotTable* table = getTable();
+        if (table == nullptr)
+        {
+            return 0;
+        }
+
+        const uint64_t mask = table->m_capacity - 1;
+        const uint64_t now = getCurrentTime();
+        ItemInfo* slots = table->slots();
+        size_t visited = 0;
+        do
+        {
+            // the items of a bucket are found before the first free slot which follows it
+            const uint64_t bucket = cursor & mask;
+            for (uint64_t position = bucket, iter = 0;
+                 !slots[position].isFree() && (iter <= mask);
+                 position = (position + 1) & mask, ++iter)
+            {
+                const ItemInfo& info = slots[position];
+                if (info.isUsed() && ((info.m_hash & mask) == bucket) && !info.isExpired(now))
+                {
+                    function(info);
+                    ++visited;
+                }
+            }
+            cursor = getNextBucket(cursor, mask);
+        } while ((cursor != 0) && (visited < count));
+        return cursor;
+    }
+
+    /**
+     * @brief  Check if the index keeps the keys in their byte order.
+     *
+     * @return true if forEachOrdered() can be called.
+     */
+    bool isOrdered() const { return m_ordered; }
+
+    /**
+     * @brief  Call a function with the keys of the items in their byte order, from the first one
+     * which is not before a bound, until it returns false. The index must keep the keys ordered.
+     * Updates must not run concurrently.
+     *
+     * @param from Lower bound of the keys.
+     * @param function Function called with the key of each item which has not expired, returns
+     * false to stop.
+     */
+    template <class F> void forEachOrdered(const ItemKey& from, F function) const
+    {
+        const uint64_t now = getCurrentTime();
+        for (auto iter = m_keys.lower_bound(from, NodeLess<KeyNode>()); iter != m_keys.end();
+             ++iter)
+        {
+            const ItemKey key(iter->data(), iter->m_length);
+            const ItemInfo* info = lookup(key);
+            if ((info != nullptr) && !info->isExpired(now) && !function(key))
+            {
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief  Check if the index keeps the keys of the items associated to each tag.
+     *
+     * @return true if forEachTagged() and countTagged() can be called.
+     */
+    bool isTagged() const { return m_tagged; }
+
+    /**
+     * @brief  Call a function with the keys of the items associated to a tag, in their byte
+     * order, until it returns false. The index must keep the keys of each tag. Updates must not
+     * run concurrently.
+     *
+     * @param tag Tag of the items, the items without tag are not indexed.
+     * @param function Function called with the key of each item which has not expired, returns
+     * false to stop.
+     */
+    template <class F> void forEachTagged(const std::string& tag, F function) const
+    {
+        auto node = m_tags.find(ItemKey(tag), NodeLess<TagNode>());
+        if (node == m_tags.end())
+        {
+            return;
+        }
+        const uint64_t now = getCurrentTime();
+        for (const KeyNode& keyNode : node->m_keys)
+        {
+            const ItemKey key(keyNode.data(), keyNode.m_length);
+            const ItemInfo* info = lookup(key);
+            if ((info != nullptr) && !info->isExpired(now) && !function(key))
+            {
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief  Count the items associated to a tag. The index must keep the keys of each tag.
+     * Updates must not run concurrently.
+     *
+     * @param tag Tag of the items, the items without tag are not indexed.
+     *
+     * @return Count of the items which have not expired.
+     */
+    size_t countTagged(const std::string& tag) const;
+
+private:
+    /**
+     * @brief  Find the infos of an item, even if it has expired. Updates must not run
+     * concurrently.
+     *
+     * @param key Key of the item.
+     *
+     * @return Infos of the item or nullptr if the item doesn't exist.
+     */
+    const ItemInfo* lookup(const ItemKey& key) const;
+
+    /**
+     * @brief  Get the bucket which follows another one in a scan: the bits of the position are
+     * incremented from the highest one of the mask down to the lowest one.
+     *
+     * @param cursor Position of the bucket.
+     * @param mask Mask of the positions of the table.
+     *
+     * @return Position of the next bucket, 0 once every bucket was visited.
+     */
+    static uint64_t getNextBucket(uint64_t cursor, uint64_t mask);
+
+    /**
+     * @brief  Get the current table of slots.
+     *
+     * @return Table of slots or nullptr if no item was ever inserted.
+     */
+    SlotTable* getTable() const;
+
+    /**
+     * @brief  Publish a new table of slots.
+     *
+     * @param table Table of slots or nullptr.
+     */
+    void setTable(SlotTable* table);
+
+    /**
+     * @brief  Allocate bytes from the slabs if they are small, else from the memory segment. If
+     * the segment is full, retired blocks are reclaimed and empty slabs are released before trying
+     * again.
+     *
+     * @param size Count of bytes to allocate.
+     *
+     * @return Allocated bytes.
+     *
+     * @throw boost::interprocess::bad_alloc if the memory segment is full.
+     */
+    char* allocate(size_t size);
+
+    /**
+     * @brief  Deallocate bytes returned by allocate().
+     *
+     * @param bytes Allocated bytes.
+     * @param size Count of bytes passed to allocate().
+     */
+    void deallocate(void* bytes, size_t size);
+
+    /**
+     * @brief  Copy bytes which may be retired later into the memory segment.
+     *
+     * @param data Bytes to copy.
+     * @param length Count of bytes to copy.
+     *
+     * @return Copy of the bytes.
+     *
+     * @throw boost::interprocess::bad_alloc if the memory segment is full.
+     */
+    char* copy(const char* data, size_t length);
+
+    /**
+     * @brief  Copy bytes to a lower address of the memory segment, if the allocator has room
+     * there. Blocks small enough for the slabs are not copied.
+     *
+     * @param bytes Bytes to copy.
+     * @param size Count of bytes to copy, which were allocated for them.
+     *
+     * @return Copy of the bytes or nullptr if they cannot move down.
+     */
+    char* relocate(const char* bytes, size_t size);
+
+    /**
+     * @brief  Allocate a value block, unless the value fits inline.
+     *
+     * @param length Length in bytes of the value.
+     *
+     * @return Value block or nullptr if the value fits inline.
+     *
+     * @throw boost::interprocess::bad_alloc if the memory segment is full.
+     */
+    ValueBlock* allocateBlock(size_t length);
+
+    /**
+     * @brief  Write a value, inline or into a value block, during an update of the slot.
+     *
+     * @param info Infos of the item.
+     * @param block Value block allocated for the value or nullptr.
+     * @param data Value bytes.
+     * @param length Length in bytes of the value.
+     */
+    void writeValue(ItemInfo& info, ValueBlock* block, const char* data, size_t length);
+
+    /**
+     * @brief  Make room for a new item, allocating or growing the table of slots when needed.
+     *
+     * @throw boost::interprocess::bad_alloc if the memory segment is full.
+     */
+    void reserve();
+
+    /**
+     * @brief  Move all the items into a new table of slots.
+     *
+     * @param capacity Count of slots of the new table, must be a power of two.
+     *
+     * @throw boost::interprocess::bad_alloc if the memory segment is full.
+     */
+    void rehash(size_t capacity);
+
+    /**
+     * @brief  Move all the items into an allocated table of slots, then publish it.
+     *
+     * @param table New table of slots, not constructed yet.
+     * @param capacity Count of slots of the new table, must be a power of two.
+     */
+    void moveItems(SlotTable* table, size_t capacity);
+
+    /**
+     * @brief  Make room into the expiry heap for one more item.
+     *
+     * @throw boost::interprocess::bad_alloc if the memory segment is full.
+     */
+    void reserveExpiry();
+
+    /**
+     * @brief  Insert an item into the expiry heap, or move it if it is already there.
+     *
+     * @param info Infos of the item, with its new deadline.
+     * @param scheduled true if the item is already into the heap.
+     */
+    void scheduleExpiry(ItemInfo& info, bool scheduled);
+
+    /**
+     * @brief  Remove an item from the expiry heap.
+     *
+     * @param info Infos of the item.
+     */
+    void unscheduleExpiry(ItemInfo& info);
+
+    /**
+     * @brief  Move an entry of the expiry heap to its place.
+     *
+     * @param position Position of the entry.
+     */
+    void siftExpiry(uint64_t position);
+
+    /**
+     * @brief  Store an entry into the expiry heap, and its position into the item infos.
+     *
+     * @param position Position of the entry.
+     * @param entry Entry to store.
+     */
+    void setExpiry(uint64_t position, const ExpiryEntry& entry);
+
+    /**
+     * @brief  Retire a memory block which lock-free readers may still see.
+     *
+     * @param bytes Memory block, at least as large as a RetiredBlock, or nullptr.
+     * @param size Count of bytes allocated for the block.
+     */
+    void retire(void* bytes, size_t size);
+
+    /**
+     * @brief  Retire a value block, or keep it aside until its views are released if it is
+     * pinned.
+     *
+     * @param block Value block or nullptr.
+     */
+    void retireBlock(ValueBlock* block);
+
+    /**
+     * @brief  Deallocate the retired blocks which lock-free readers cannot see anymore, after
+     * retiring the unlinked blocks whose views were released.
+     *
+     * @param wait true to wait for the readers to leave, so that every block is deallocated.
+     */
+    void reclaim(bool wait);
+
+    /**
+     * @brief  Release the slot, the key, the tag and the value of an item.
+     *
+     * @param info Infos of the item.
+     * @param kind Kind of change recorded for the watchers: removal, expiry or eviction.
+     */
+    void erase(ItemInfo& info, ChangeKind kind);
+
+    /**
+     * @brief  Record a change of an item for the watchers, if the storage has a ring of changes.
+     *
+     * @param kind Kind of the change.
+     * @param key Bytes of the key of the item.
+     * @param length Length in bytes of the key.
+     */
+    void postChange(ChangeKind kind, const char* key, size_t length)
+    {
+        if (m_changes != nullptr)
+        {
+            m_changes->post(kind, key, length);
+        }
+    }
+
+    /**
+     * @brief  Allocate the nodes which associate an item to its tag, before the item is written.
+     *
+     * @param key Key of the item.
+     * @param tag Tag of the item.
+     * @param[out] tagNode Node of the tag if it is not indexed yet, else nullptr.
+     *
+     * @return Node of the key, or nullptr if the index does not keep the keys of each tag or if
+     * the tag is empty.
+     *
+     * @throw boost::interprocess::bad_alloc if the memory segment is full.
+     */
+    KeyNode* allocateTagNodes(const ItemKey& key, const std::string& tag, TagNode*& tagNode);
+
+    /**
+     * @brief  Deallocate the nodes returned by allocateTagNodes(), if the item was not written.
+     *
+     * @param keyNode Node of the key or nullptr.
+     * @param tagNode Node of the tag or nullptr.
+     */
+    void deallocateTagNodes(KeyNode* keyNode, TagNode* tagNode);
+
+    /**
+     * @brief  Associate an item to its tag, once it is written.
+     *
+     * @param keyNode Node of the key returned by allocateTagNodes() or nullptr.
+     * @param tagNode Node of the tag returned by allocateTagNodes() or nullptr.
+     * @param tag Tag of the item.
+     */
+    void linkTag(KeyNode* keyNode, TagNode* tagNode, const std::string& tag);
+
+    /**
+     * @brief  Dissociate an item from its tag, and deallocate the tag node once it has no key.
+     *
+     * @param key Key of the item.
+     * @param tag Tag bytes of the item.
+     * @param tagLength Length in bytes of the tag.
+     */
+    void unlinkTag(const ItemKey& key, const char* tag, size_t tagLength);
+
+    /**
+     * @brief  Retire the key, the tag and the value block of an item.
+     *
+     * @param info Infos of the item.
+     */
+    void release(ItemInfo& info);
+
+    CharAllocator m_allocator;
+    SlabAllocator m_slabs;
+    boost::interprocess::offset_ptr<EpochManager> m_epochs;
+    boost::interprocess::offset_ptr<ChangeRing> m_changes;
+    EvictionPolicy m_policy;
+    size_t m_clockHand;
+    std::atomic<int64_t> m_table; ///< Offset of the table of slots from this index, 0 if none.
+    size_t m_size;
+    size_t m_erased;
+    boost::interprocess::offset_ptr<RetiredBlock> m_retiredHead;
+    boost::interprocess::offset_ptr<RetiredBlock> m_retiredTail;
+    size_t m_retiredCount;
+    int64_t m_pinned; ///< Offset of the first unlinked block still pinned from this index, or 0.
+    boost::interprocess::offset_ptr<ExpiryEntry> m_expiries; ///< Min-heap of the deadlines.
+    uint64_t m_expiriesCount;
+    uint64_t m_expiriesCapacity;
+    uint64_t m_expiredCount;
+    bool m_ordered;
+    bool m_tagged;
+    KeySet m_keys; ///< Ordered copies of the keys, if the index keeps them.
+    TagSet m_tags; ///< Tags and the keys of their items, if the index keeps them.
+};
+
+} // namespace storage
+
+#endif /* ITEM_INDEX_H_ */
@@ -22,11 +22,37 @@
 #include "js_shared_storage.h"
 #include "napi_helpers.h"
 #include "shared_storage.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <stdio.h>
+#include <thread>
+#include <type_traits>
 
 
 napi_ref JsSharedStorage::m_constructor = nullptr;
 
+/**
+ * @brief  Default count of keys of a batch of scan().
+ */
+static const double kScanCount = 100.0;
+
+/**
+ * @brief  Tag of the items holding serialized objects.
+ */
+static const char* const kObjectTag = "object";
+
+/**
+ * @brief  Size of the array buffers shared by the bytes of the serialized objects.
+ */
+static const size_t kBytesPoolSize = 64 * 1024;
+
 napi_status JsSharedStorage::define(napi_env env)
 {
     std::vector<napi_property_descriptor> properties;
@@ -34,15 +60,69 @@ napi_status JsSharedStorage::define(napi_env env)
         {"set", nullptr, setItem, nullptr, nullptr, nullptr, napi_default, nullptr});
     properties.push_back(
         {"get", nullptr, getItem, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"view", nullptr, viewItem, nullptr, nullptr, nullptr, napi_default, nullptr});
     properties.push_back(
         {"remove", nullptr, removeItem, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"getMany", nullptr, getItems, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"setMany", nullptr, setItems, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"removeMany", nullptr, removeItems, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"removePrefix", nullptr, removePrefix, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"removeByTag", nullptr, removeByTag, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"scan", nullptr, scan, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"scanPrefix", nullptr, scanPrefix, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"range", nullptr, range, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"keysByTag", nullptr, keysByTag, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"countByTag", nullptr, countByTag, nullptr, nullptr, nullptr, napi_default, nullptr});
     properties.push_back(
         {"clear", nullptr, clear, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"increment", nullptr, increment, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"decrement", nullptr, decrement, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back({"compareAndSet", nullptr, compareAndSet, nullptr, nullptr, nullptr,
+                          napi_default, nullptr});
+    properties.push_back(
+        {"getAndSet", nullptr, getAndSet, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"snapshot", nullptr, snapshot, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"stats", nullptr, stats, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"compact", nullptr, compact, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back({"startCompaction", nullptr, startCompaction, nullptr, nullptr, nullptr,
+                          napi_default, nullptr});
+    properties.push_back({"stopCompaction", nullptr, stopCompaction, nullptr, nullptr, nullptr,
+                          napi_default, nullptr});
     properties.push_back({"lock", nullptr, lock, nullptr, nullptr, nullptr, napi_default, nullptr});
     properties.push_back(
         {"unlock", nullptr, unlock, nullptr, nullptr, nullptr, napi_default, nullptr});
     properties.push_back(
         {"tryLock", nullptr, tryToLock, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"lockShared", nullptr, lockShared, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"unlockShared", nullptr, unlockShared, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"getAsync", nullptr, getItemAsync, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"setAsync", nullptr, setItemAsync, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"lockAsync", nullptr, lockAsync, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"watch", nullptr, watch, nullptr, nullptr, nullptr, napi_default, nullptr});
+    properties.push_back(
+        {"unwatch", nullptr, unwatch, nullptr, nullptr, nullptr, napi_default, nullptr});
     napi_value constructor = nullptr;
     napi_status status =
         napi_define_class(env, "SharedStorage", NAPI_AUTO_LENGTH, JsSharedStorage::constructor,
@@ -52,6 +132,10 @@ napi_status JsSharedStorage::define(napi_env env)
     {
         status = napi_create_reference(env, constructor, 1, &JsSharedStorage::m_constructor);
     }
+    if (status == napi_ok)
+    {
+        status = napi_add_env_cleanup_hook(env, JsSharedStorage::stopWatchers, nullptr);
+    }
     return status;
 }
 
@@ -93,6 +177,7 @@ napi_status JsSharedStorage::createInstance(napi_env env, storage::SharedStorage
 void JsSharedStorage::finalize(napi_env env, void* data, void* hint)
 {
     storage::SharedStorage* storage = static_cast<storage::SharedStorage*>(data);
+    stopWatching(env, storage);
     delete storage;
 }
 
@@ -110,8 +195,8 @@ napi_status JsSharedStorage::getStorage(napi_env env, napi_callback_info info,
 napi_value JsSharedStorage::create(napi_env env, napi_callback_info info)
 {
     napi_value result = nullptr;
-    napi_value args[2];
-    size_t argsCount = 2;
+    napi_value args[3];
+    size_t argsCount = 3;
     napi_status status = napi_get_cb_info(env, info, &argsCount, args, nullptr, nullptr);
     if ((status == napi_ok) && (argsCount > 0))
     {
@@ -122,6 +207,7 @@ napi_value JsSharedStorage::create(napi_env env, napi_callback_info info)
             if (status == napi_ok)
             {
                 int64_t size = 1024 * 1024;
+                storage::StorageOptions options;
                 if (argsCount > 1)
                 {
                     if (napi_helpers::isNumber(env, args[1]))
@@ -129,11 +215,22 @@ napi_value JsSharedStorage::create(napi_env env, napi_callback_info info)
                         status = napi_get_value_int64(env, args[1], &size);
                     }
                 }
-                if (status == napi_ok)
+                if ((status == napi_ok) && (argsCount > 2))
+                {
+                    if (napi_helpers::isObject(env, args[2]))
+                    {
+                        status = getStorageOptions(env, args[2], options);
+                    }
+                }
+                if (status == napi_invalid_arg)
+                {
+                    napi_throw_error(env, nullptr, "unsupported storage option.");
+                }
+                else if (status == napi_ok)
                 {
                     storage::Status stStatus = storage::eOk;
                     storage::SharedStorage* storage =
-                        storage::SharedStorage::create(strKey, size, stStatus);
+                        storage::SharedStorage::create(strKey, size, options, stStatus);
                     if (stStatus == storage::eOk)
                     {
                         status = JsSharedStorage::createInstance(env, storage, &result);
@@ -152,19 +249,29 @@ napi_value JsSharedStorage::create(napi_env env, napi_callback_info info)
 napi_value JsSharedStorage::open(napi_env env, napi_callback_info info)
 {
     napi_value result = nullptr;
-    napi_value args[1];
-    size_t argsCount = 1;
+    napi_value args[2];
+    size_t argsCount = 2;
     napi_status status = napi_get_cb_info(env, info, &argsCount, args, nullptr, nullptr);
-    if ((status == napi_ok) && (argsCount == 1))
+    if ((status == napi_ok) && (argsCount >= 1))
     {
         if (napi_helpers::isString(env, args[0]))
         {
             std::string strKey;
+            storage::StorageOptions options;
             status = napi_helpers::getValueStringUTF8(env, args[0], strKey);
-            if (status == napi_ok)
+            if ((status == napi_ok) && (argsCount > 1) && napi_helpers::isObject(env, args[1]))
+            {
+                status = getStorageOptions(env, args[1], options);
+            }
+            if (status == napi_invalid_arg)
+            {
+                napi_throw_error(env, nullptr, "unsupported storage option.");
+            }
+            else if (status == napi_ok)
             {
                 storage::Status stStatus = storage::eOk;
-                storage::SharedStorage* storage = storage::SharedStorage::open(strKey, stStatus);
+                storage::SharedStorage* storage =
+                    storage::SharedStorage::open(strKey, options.m_backend, stStatus);
                 if (stStatus == storage::eOk)
                 {
                     status = JsSharedStorage::createInstance(env, storage, &result);
@@ -182,18 +289,28 @@ napi_value JsSharedStorage::open(napi_env env, napi_callback_info info)
 napi_value JsSharedStorage::destroy(napi_env env, napi_callback_info info)
 {
     napi_value result = nullptr;
-    napi_value args[1];
-    size_t argsCount = 1;
+    napi_value args[2];
+    size_t argsCount = 2;
     napi_status status = napi_get_cb_info(env, info, &argsCount, args, nullptr, nullptr);
-    if ((status == napi_ok) && (argsCount == 1))
+    if ((status == napi_ok) && (argsCount >= 1))
     {
         if (napi_helpers::isString(env, args[0]))
         {
             std::string strKey;
+            storage::StorageOptions options;
             status = napi_helpers::getValueStringUTF8(env, args[0], strKey);
-            if (status == napi_ok)
+            if ((status == napi_ok) && (argsCount > 1) && napi_helpers::isObject(env, args[1]))
+            {
+                status = getStorageOptions(env, args[1], options);
+            }
+            if (status == napi_invalid_arg)
+            {
+                napi_throw_error(env, nullptr, "unsupported storage option.");
+            }
+            else if (status == napi_ok)
             {
-                storage::Status stStatus = storage::SharedStorage::destroy(strKey);
+                storage::Status stStatus = storage::SharedStorage::destroy(strKey,
+                                                                           options.m_backend);
                 status = napi_get_boolean(env, (stStatus == storage::eOk), &result);
             }
         }
@@ -201,318 +318,2517 @@ napi_value JsSharedStorage::destroy(napi_env env, napi_callback_info info)
     return result;
 }
 
-napi_value JsSharedStorage::setItem(napi_env env, napi_callback_info info)
+napi_value JsSharedStorage::restore(napi_env env, napi_callback_info info)
 {
-    napi_value thisInstance = nullptr;
-    size_t argsCount = 3;
+    napi_value result = nullptr;
     napi_value args[3];
-    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    size_t argsCount = 3;
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, nullptr, nullptr);
     if ((status == napi_ok) && (argsCount >= 2))
     {
-        storage::SharedStorage* storage = nullptr;
-        status = napi_unwrap(env, thisInstance, (void**)&storage);
-        if (status == napi_ok)
+        if (napi_helpers::isString(env, args[0]) && napi_helpers::isString(env, args[1]))
         {
-            std::string key, tag;
-            napi_valuetype type = napi_undefined;
-
-            status = napi_helpers::getValueStringUTF8(env, args[0], key);
-            if ((argsCount >= 3) && napi_helpers::isString(env, args[2]))
+            std::string strKey;
+            std::string path;
+            storage::StorageOptions options;
+            status = napi_helpers::getValueStringUTF8(env, args[0], strKey);
+            if (status == napi_ok)
             {
-                status = napi_helpers::getValueStringUTF8(env, args[2], tag);
+                status = napi_helpers::getValueStringUTF8(env, args[1], path);
             }
-            if (status == napi_ok)
+            if ((status == napi_ok) && (argsCount > 2) && napi_helpers::isObject(env, args[2]))
             {
-                status = napi_typeof(env, args[1], &type);
+                status = getStorageOptions(env, args[2], options);
             }
-            if (status == napi_ok)
+            if (status == napi_invalid_arg)
+            {
+                napi_throw_error(env, nullptr, "unsupported storage option.");
+            }
+            else if (status == napi_ok)
             {
                 storage::Status stStatus = storage::eOk;
-
-                switch (type)
-                {
-                case napi_boolean:
+                storage::SharedStorage* storage =
+                    storage::SharedStorage::open(strKey, options.m_backend, stStatus);
+                if (stStatus != storage::eOk)
                 {
-                    bool value = false;
-                    status = napi_get_value_bool(env, args[1], &value);
-                    if (status == napi_ok)
-                    {
-                        stStatus = storage->setItem<bool>(key, storage::Item<bool>(value, tag));
-                    }
-                    break;
+                    throw_error(env, stStatus, strKey);
                 }
-
-                case napi_number:
+                else
                 {
-                    double value = 0.0;
-                    status = napi_get_value_double(env, args[1], &value);
-                    if (status == napi_ok)
+                    stStatus = storage->restore(path);
+                    if (stStatus == storage::eOk)
                     {
-                        stStatus = storage->setItem<double>(key, storage::Item<double>(value, tag));
+                        status = JsSharedStorage::createInstance(env, storage, &result);
                     }
-                    break;
-                }
-
-                case napi_string:
-                {
-                    std::string value;
-                    status = napi_helpers::getValueStringUTF8(env, args[1], value);
-                    if (status == napi_ok)
+                    else
                     {
-                        stStatus = storage->setItem<std::string>(
-                            key, storage::Item<std::string>(value, tag));
+                        delete storage;
+                        throw_error(env, stStatus, path);
                     }
-                    break;
-                }
-
-                default:
-                    napi_throw_error(env, nullptr, "unsupported value type.");
-                    break;
-                }
-
-                if (stStatus != storage::eOk)
-                {
-                    throw_error(env, stStatus, key);
                 }
             }
         }
     }
-
-    return nullptr;
+    return result;
 }
 
-
 /**
- * @brief  Item consumer compliant with item consumer specifications.
+ * @brief  Snapshot written on a worker thread.
  */
-class ItemConsumer
+struct SnapshotWork
 {
-public:
-    /**
-     * @brief  Deleted constructor.
-     */
-    ItemConsumer() = delete;
-
-    /**
-     * @brief  Constructor.
-     *
-     * @param env Nodejs environment handler.
-     */
-    ItemConsumer(napi_env env) : m_env(env), m_status(napi_ok), m_value(nullptr) {}
-
-    /**
-     * @brief  Get the status of napi_value creation.
-     *
-     * @return napi_ok if the napi_value has been created from the consummed item.
-     */
-    napi_status getStatus() const { return m_status; }
-
-    /**
-     * @brief  Get the value created from the consummed item.
-
-     * @return created napi_value or nullptr.
-     */
-    napi_value getValue() const { return m_value; }
-
-    /**
-     * @brief  Get the tag of the consummed item.
-     *
-     * @return tag of the consummed item.
-     */
-    const std::string& getTag() const { return m_tag; }
-
-    /**
-     * @brief  Create a napi_value from the passed item. Generic implementation.
-     *
-     * @param key Key of the item.
-     * @param item Item description.
-     * @tparam T Value type of the item.
-     */
-    template <class T> void set(const std::string& key, storage::Item<T>& item)
-    {
-        // for unknown type
-        m_status = napi_get_undefined(m_env, &m_value);
-    }
-
-
-private:
-    napi_env m_env;
-    napi_status m_status;
-    napi_value m_value;
-    std::string m_tag;
+    napi_async_work m_work;            ///< Asynchronous work.
+    napi_deferred m_deferred;          ///< Promise returned to JavaScript.
+    napi_ref m_instance;               ///< Storage instance, kept alive until the snapshot ends.
+    storage::SharedStorage* m_storage; ///< Native storage.
+    std::string m_path;                ///< Path of the snapshot file.
+    storage::Status m_status;          ///< Status of the snapshot.
 };
 
-/**
- * @brief  Bool values specialization.
- */
-template <> void ItemConsumer::set<bool>(const std::string& key, storage::Item<bool>& item)
-{
-    m_status = napi_get_boolean(m_env, item.getValue(), &m_value);
-    m_tag = item.getTag();
-}
-
-/**
- * @brief  Double values specialization.
- */
-template <> void ItemConsumer::set<double>(const std::string& key, storage::Item<double>& item)
-{
-    m_status = napi_create_double(m_env, item.getValue(), &m_value);
-    m_tag = item.getTag();
-}
-
-/**
- * @brief  String values specialization.
- */
-template <>
-void ItemConsumer::set<std::string>(const std::string& key, storage::Item<std::string>& item)
-{
-    m_status = napi_create_string_utf8(m_env, item.getValue().c_str(), NAPI_AUTO_LENGTH, &m_value);
-    m_tag = item.getTag();
-}
-
-
-napi_value JsSharedStorage::getItem(napi_env env, napi_callback_info info)
+napi_value JsSharedStorage::snapshot(napi_env env, napi_callback_info info)
 {
     napi_value result = nullptr;
     napi_value thisInstance = nullptr;
-    size_t argsCount = 2;
-    napi_value args[2];
+    size_t argsCount = 1;
+    napi_value args[1];
     napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
-    if ((status == napi_ok) && (argsCount >= 1))
+    if ((status == napi_ok) && (argsCount == 1) && napi_helpers::isString(env, args[0]))
     {
-        storage::SharedStorage* storage = nullptr;
-        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        std::unique_ptr<SnapshotWork> work(new SnapshotWork());
+        work->m_status = storage::eOk;
+        status = napi_unwrap(env, thisInstance, (void**)&work->m_storage);
         if (status == napi_ok)
         {
-            ItemConsumer consumer(env);
-            storage::Status stStatus = storage::eOk;
-            std::string key;
-            status = napi_helpers::getValueStringUTF8(env, args[0], key);
-            if (status == napi_ok)
-            {
-                stStatus = storage->getItem<ItemConsumer>(key, consumer);
-            }
-            if (stStatus == storage::eOk)
-            {
-                result = consumer.getValue();
+            status = napi_helpers::getValueStringUTF8(env, args[0], work->m_path);
+        }
 
-                if ((consumer.getStatus() == napi_ok) && (argsCount >= 2) &&
-                    napi_helpers::isBool(env, args[1]))
+        napi_value resourceName = nullptr;
+        if (status == napi_ok)
+        {
+            status = napi_helpers::createValueStringUTF8("snapshot", env, &resourceName);
+        }
+        if (status == napi_ok)
+        {
+            // the items are copied and written without blocking the JavaScript thread
+            auto execute = [](napi_env env, void* data) {
+                SnapshotWork* work = static_cast<SnapshotWork*>(data);
+                work->m_status = work->m_storage->snapshot(work->m_path);
+            };
+            auto complete = [](napi_env env, napi_status status, void* data) {
+                std::unique_ptr<SnapshotWork> work(static_cast<SnapshotWork*>(data));
+                napi_value error = nullptr;
+                napi_value undefined = nullptr;
+                if (work->m_status == storage::eOk)
                 {
-                    bool withTag = false;
-                    status = napi_get_value_bool(env, args[1], &withTag);
-                    if ((status == napi_ok) && withTag)
-                    {
-                        /**
-                         * if withTag is true, result is an object:
-                         * {
-                         *	 "value": itemValue,
-                         *	 "tag": itemBag
-                         * }
-                         */
-                        napi_value object = nullptr;
-                        napi_value tag = nullptr;
-                        status = napi_create_object(env, &object);
-                        if (status == napi_ok)
-                        {
-                            status =
-                                napi_helpers::createValueStringUTF8(consumer.getTag(), env, &tag);
-                        }
-                        if (status == napi_ok)
-                        {
-                            status = napi_set_named_property(env, object, "value", result);
-                        }
-                        if (status == napi_ok)
-                        {
-                            status = napi_set_named_property(env, object, "tag", tag);
-                        }
-                        if (status == napi_ok)
-                        {
-                            result = object;
-                        }
-                    }
+                    napi_get_undefined(env, &undefined);
+                    napi_resolve_deferred(env, work->m_deferred, undefined);
+                }
+                else if (create_error(env, work->m_status, work->m_path, &error) == napi_ok)
+                {
+                    napi_reject_deferred(env, work->m_deferred, error);
                 }
+                napi_delete_reference(env, work->m_instance);
+                napi_delete_async_work(env, work->m_work);
+            };
+            status = napi_create_async_work(env, nullptr, resourceName, execute, complete,
+                                            work.get(), &work->m_work);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_create_reference(env, thisInstance, 1, &work->m_instance);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_create_promise(env, &work->m_deferred, &result);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_queue_async_work(env, work->m_work);
+        }
+        if (status == napi_ok)
+        {
+            // the work is released once completed
+            work.release();
+        }
+        else
+        {
+            if (work->m_instance != nullptr)
+            {
+                napi_delete_reference(env, work->m_instance);
+            }
+            if (work->m_work != nullptr)
+            {
+                napi_delete_async_work(env, work->m_work);
             }
+            result = nullptr;
         }
     }
     return result;
 }
 
-napi_value JsSharedStorage::removeItem(napi_env env, napi_callback_info info)
+/**
+ * @brief  Get the bytes of a Buffer or a typed array, without copy.
+ *
+ * @param env Nodejs environment handler.
+ * @param value JavaScript value.
+ * @param[out] binary View on the bytes of the value.
+ *
+ * @return napi_ok if reading the bytes succeeded or napi_invalid_arg if the value is neither a
+ * Buffer nor a typed array.
+ */
+static napi_status getBinaryValue(napi_env env, napi_value value, storage::BinaryValue& binary)
 {
-    napi_value thisInstance = nullptr;
-    size_t argsCount = 1;
-    napi_value args[1];
-    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
-    if ((status == napi_ok) && (argsCount == 1))
+    bool isBuffer = false;
+    bool isTypedArray = false;
+    napi_status status = napi_is_buffer(env, value, &isBuffer);
+    if ((status == napi_ok) && isBuffer)
     {
-        storage::SharedStorage* storage = nullptr;
-        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        void* data = nullptr;
+        size_t length = 0;
+        status = napi_get_buffer_info(env, value, &data, &length);
         if (status == napi_ok)
         {
-            std::string key;
-            status = napi_helpers::getValueStringUTF8(env, args[0], key);
-            if (status == napi_ok)
-            {
-                storage::Status stStatus = storage->removeItem(key);
-                if (stStatus != storage::eOk)
-                {
-                    throw_error(env, stStatus, key);
-                }
-            }
+            binary = storage::BinaryValue(data, length);
         }
+        return status;
     }
-    return nullptr;
-}
 
-napi_value JsSharedStorage::clear(napi_env env, napi_callback_info info)
+    if (status == napi_ok)
+    {
+        status = napi_is_typedarray(env, value, &isTypedArray);
+    }
+    if ((status == napi_ok) && isTypedArray)
+    {
+        napi_typedarray_type type = napi_uint8_array;
+        void* data = nullptr;
+        size_t length = 0;
+        status = napi_get_typedarray_info(env, value, &type, &length, &data, nullptr, nullptr);
+        if (status == napi_ok)
+        {
+            binary = storage::BinaryValue(data, length * napi_helpers::getElementSize(type));
+        }
+        return status;
+    }
+    return (status == napi_ok) ? napi_invalid_arg : status;
+}
+
+/**
+ * @brief  Call a function with the native value of a JavaScript boolean, number, string, Buffer
+ * or typed array.
+ *
+ * @param env Nodejs environment handler.
+ * @param value JavaScript value.
+ * @param function Generic function called with the native value.
+ *
+ * @return napi_ok if reading the value succeeded or napi_invalid_arg if its type is unsupported.
+ */
+template <class F> static napi_status withNativeValue(napi_env env, napi_value value, F function)
+{
+    napi_valuetype type = napi_undefined;
+    napi_status status = napi_typeof(env, value, &type);
+    if (status == napi_ok)
+    {
+        switch (type)
+        {
+        case napi_boolean:
+        {
+            bool nativeValue = false;
+            status = napi_get_value_bool(env, value, &nativeValue);
+            if (status == napi_ok)
+            {
+                function(nativeValue);
+            }
+            break;
+        }
+
+        case napi_number:
+        {
+            double nativeValue = 0.0;
+            status = napi_get_value_double(env, value, &nativeValue);
+            if (status == napi_ok)
+            {
+                function(nativeValue);
+            }
+            break;
+        }
+
+        case napi_string:
+        {
+            std::string nativeValue;
+            status = napi_helpers::getValueStringUTF8(env, value, nativeValue);
+            if (status == napi_ok)
+            {
+                function(nativeValue);
+            }
+            break;
+        }
+
+        case napi_object:
+        {
+            storage::BinaryValue nativeValue;
+            status = getBinaryValue(env, value, nativeValue);
+            if (status == napi_ok)
+            {
+                function(nativeValue);
+            }
+            break;
+        }
+
+        default:
+            status = napi_invalid_arg;
+            break;
+        }
+    }
+    return status;
+}
+
+napi_value JsSharedStorage::setItem(napi_env env, napi_callback_info info)
+{
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 4;
+    napi_value args[4];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 2))
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            napi_helpers::StringBuffer keyBuffer;
+            std::string tag;
+            int64_t ttl = 0;
+
+            status = napi_helpers::getValueStringUTF8(env, args[0], keyBuffer);
+            if ((status == napi_ok) && (argsCount >= 3) && napi_helpers::isString(env, args[2]))
+            {
+                status = napi_helpers::getValueStringUTF8(env, args[2], tag);
+            }
+            if ((status == napi_ok) && (argsCount >= 4) && napi_helpers::isNumber(env, args[3]))
+            {
+                status = napi_get_value_int64(env, args[3], &ttl);
+            }
+            if (status == napi_ok)
+            {
+                storage::ItemKey key(keyBuffer.data(), keyBuffer.length());
+                storage::Status stStatus = storage::eOk;
+
+                status = withNativeValue(env, args[1], [&](const auto& value) {
+                    typedef typename std::decay<decltype(value)>::type ValueType;
+                    stStatus = storage->setItem<ValueType>(
+                        key, storage::Item<ValueType>(value, tag),
+                        (ttl > 0) ? static_cast<uint64_t>(ttl) : 0);
+                });
+                if (status == napi_invalid_arg)
+                {
+                    napi_throw_error(env, nullptr, "unsupported value type.");
+                }
+                else if (stStatus != storage::eOk)
+                {
+                    throw_error(env, stStatus, keyBuffer.str());
+                }
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+
+/**
+ * @brief  Array buffer shared by the bytes of the serialized objects which are read.
+ */
+struct BytesPool
+{
+    napi_ref m_buffer;
+    char* m_data;
+    size_t m_offset;
+};
+
+static BytesPool s_bytesPool = {nullptr, nullptr, kBytesPoolSize};
+
+/**
+ * @brief  Copy the bytes of a serialized object into a Uint8Array. As Buffer.allocUnsafe() does
+ * for small sizes, the arrays share the array buffers rather than each owning one, which would
+ * cost more than decoding a small object.
+ *
+ * @param env Nodejs environment handler.
+ * @param data Bytes to copy.
+ * @param length Count of bytes.
+ * @param[out] value Uint8Array holding the copy.
+ *
+ * @return napi_ok if creating the array succeeded.
+ */
+static napi_status createPooledBytes(napi_env env, const char* data, size_t length,
+                                     napi_value* value)
+{
+    napi_value buffer = nullptr;
+    size_t offset = 0;
+    napi_status status = napi_ok;
+    if (length > kBytesPoolSize / 8)
+    {
+        void* bytes = nullptr;
+        status = napi_create_arraybuffer(env, length, &bytes, &buffer);
+        if (status == napi_ok)
+        {
+            std::memcpy(bytes, data, length);
+        }
+    }
+    else
+    {
+        if (s_bytesPool.m_offset + length > kBytesPoolSize)
+        {
+            // the arrays on the previous pool keep it alive
+            void* bytes = nullptr;
+            status = napi_create_arraybuffer(env, kBytesPoolSize, &bytes, &buffer);
+            if ((status == napi_ok) && (s_bytesPool.m_buffer != nullptr))
+            {
+                status = napi_delete_reference(env, s_bytesPool.m_buffer);
+                s_bytesPool.m_buffer = nullptr;
+            }
+            if (status == napi_ok)
+            {
+                status = napi_create_reference(env, buffer, 1, &s_bytesPool.m_buffer);
+            }
+            if (status == napi_ok)
+            {
+                s_bytesPool.m_data = static_cast<char*>(bytes);
+                s_bytesPool.m_offset = 0;
+            }
+        }
+        else
+        {
+            status = napi_get_reference_value(env, s_bytesPool.m_buffer, &buffer);
+        }
+        if (status == napi_ok)
+        {
+            offset = s_bytesPool.m_offset;
+            std::memcpy(s_bytesPool.m_data + offset, data, length);
+            // the next arrays stay aligned on 8 bytes
+            s_bytesPool.m_offset += (length + 7) & ~static_cast<size_t>(7);
+        }
+    }
+    if (status == napi_ok)
+    {
+        status = napi_create_typedarray(env, napi_uint8_array, length, buffer, offset, value);
+    }
+    return status;
+}
+
+
+/**
+ * @brief  Item consumer compliant with item consumer specifications.
+ */
+class ItemConsumer
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    ItemConsumer() = delete;
+
+    /**
+     * @brief  Constructor.
+     *
+     * @param env Nodejs environment handler.
+     */
+    ItemConsumer(napi_env env) : m_env(env), m_status(napi_ok), m_value(nullptr) {}
+
+    /**
+     * @brief  Get the status of napi_value creation.
+     *
+     * @return napi_ok if the napi_value has been created from the consummed item.
+     */
+    napi_status getStatus() const { return m_status; }
+
+    /**
+     * @brief  Get the value created from the consummed item.
+
+     * @return created napi_value or nullptr.
+     */
+    napi_value getValue() const { return m_value; }
+
+    /**
+     * @brief  Get the tag of the consummed item.
+     *
+     * @return tag of the consummed item.
+     */
+    const std::string& getTag() const { return m_tag; }
+
+    /**
+     * @brief  Create a napi_value from the passed item. Generic implementation.
+     *
+     * @param key Key of the item.
+     * @param item Item description.
+     * @tparam T Value type of the item.
+     */
+    template <class T> void set(const storage::ItemKey& key, storage::Item<T>& item)
+    {
+        // for unknown type
+        m_status = napi_get_undefined(m_env, &m_value);
+    }
+
+
+private:
+    napi_env m_env;
+    napi_status m_status;
+    napi_value m_value;
+    std::string m_tag;
+};
+
+/**
+ * @brief  Bool values specialization.
+ */
+template <>
+void ItemConsumer::set<bool>(const storage::ItemKey& key, storage::Item<bool>& item)
+{
+    m_status = napi_get_boolean(m_env, item.getValue(), &m_value);
+    m_tag = item.getTag();
+}
+
+/**
+ * @brief  Double values specialization.
+ */
+template <>
+void ItemConsumer::set<double>(const storage::ItemKey& key, storage::Item<double>& item)
+{
+    m_status = napi_create_double(m_env, item.getValue(), &m_value);
+    m_tag = item.getTag();
+}
+
+/**
+ * @brief  String values specialization.
+ */
+template <>
+void ItemConsumer::set<std::string>(const storage::ItemKey& key,
+                                    storage::Item<std::string>& item)
+{
+    m_status = napi_create_string_utf8(m_env, item.getValue().data(), item.getValue().size(),
+                                       &m_value);
+    m_tag = item.getTag();
+}
+
+/**
+ * @brief  Binary values specialization.
+ */
+template <>
+void ItemConsumer::set<storage::BinaryValue>(const storage::ItemKey& key,
+                                             storage::Item<storage::BinaryValue>& item)
+{
+    if (item.getTag() == kObjectTag)
+    {
+        // only decoded by the module, which needs no Buffer
+        m_status = createPooledBytes(m_env, item.getValue().data(), item.getValue().length(),
+                                     &m_value);
+    }
+    else
+    {
+        m_status = napi_create_buffer_copy(m_env, item.getValue().length(),
+                                           item.getValue().data(), nullptr, &m_value);
+    }
+    m_tag = item.getTag();
+}
+
+
+/**
+ * @brief  Create the JavaScript result of a consumed item.
+ *
+ * @param env Nodejs environment handler.
+ * @param consumer Consumer of the item.
+ * @param withTag If true, the result is an object holding the value and the tag of the item.
+ * @param[out] result Value of the item or object holding the value and the tag of the item.
+ *
+ * @return napi_ok if creating the result succeeded.
+ */
+static napi_status createItemResult(napi_env env, const ItemConsumer& consumer, bool withTag,
+                                    napi_value* result)
+{
+    napi_status status = consumer.getStatus();
+    *result = consumer.getValue();
+    if ((status == napi_ok) && withTag)
+    {
+        /**
+         * if withTag is true, result is an object:
+         * {
+         *	 "value": itemValue,
+         *	 "tag": itemBag
+         * }
+         */
+        napi_value object = nullptr;
+        napi_value tag = nullptr;
+        status = napi_create_object(env, &object);
+        if (status == napi_ok)
+        {
+            status = napi_helpers::createValueStringUTF8(consumer.getTag(), env, &tag);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_set_named_property(env, object, "value", *result);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_set_named_property(env, object, "tag", tag);
+        }
+        if (status == napi_ok)
+        {
+            *result = object;
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief  Read the optional withTag argument of a callback.
+ *
+ * @param env Nodejs environment handler.
+ * @param value Argument value.
+ *
+ * @return true if the argument is the true boolean.
+ */
+static bool isWithTag(napi_env env, napi_value value)
+{
+    bool withTag = false;
+    if (napi_helpers::isBool(env, value) && (napi_get_value_bool(env, value, &withTag) != napi_ok))
+    {
+        withTag = false;
+    }
+    return withTag;
+}
+
+napi_value JsSharedStorage::getItem(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 2;
+    napi_value args[2];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 1))
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            ItemConsumer consumer(env);
+            storage::Status stStatus = storage::eOk;
+            napi_helpers::StringBuffer keyBuffer;
+            status = napi_helpers::getValueStringUTF8(env, args[0], keyBuffer);
+            if (status == napi_ok)
+            {
+                stStatus = storage->getItem<ItemConsumer>(
+                    storage::ItemKey(keyBuffer.data(), keyBuffer.length()), consumer);
+            }
+            if (stStatus == storage::eOk)
+            {
+                bool withTag = (argsCount >= 2) && isWithTag(env, args[1]);
+                status = createItemResult(env, consumer, withTag, &result);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief  View pinned by an external ArrayBuffer, released by its finalizer.
+ */
+struct ViewHolder
+{
+    ViewHolder() : m_view(), m_instance(nullptr) {}
+
+    storage::ItemView m_view;
+    napi_ref m_instance; ///< Storage instance, which must stay mapped while the view is alive.
+};
+
+/**
+ * @brief  Finalizer of the ArrayBuffer of a view: release the view, then the storage instance.
+ */
+static void finalizeView(napi_env env, void* data, void* hint)
+{
+    ViewHolder* holder = static_cast<ViewHolder*>(hint);
+    holder->m_view.reset();
+    napi_delete_reference(env, holder->m_instance);
+    delete holder;
+}
+
+napi_value JsSharedStorage::viewItem(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 1;
+    napi_value args[1];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 1))
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        napi_helpers::StringBuffer keyBuffer;
+        if (status == napi_ok)
+        {
+            status = napi_helpers::getValueStringUTF8(env, args[0], keyBuffer);
+        }
+        std::unique_ptr<ViewHolder> holder;
+        if (status == napi_ok)
+        {
+            holder.reset(new (std::nothrow) ViewHolder());
+        }
+        if ((holder != nullptr) &&
+            (storage->viewItem(storage::ItemKey(keyBuffer.data(), keyBuffer.length()),
+                               holder->m_view) == storage::eOk))
+        {
+            const storage::ItemView& view = holder->m_view;
+            status = napi_create_reference(env, thisInstance, 1, &holder->m_instance);
+            if ((status == napi_ok) && view.isPinned())
+            {
+                status = napi_create_external_arraybuffer(
+                    env, const_cast<char*>(view.data()), view.length(), finalizeView,
+                    holder.get(), &result);
+                if (status == napi_ok)
+                {
+                    holder.release();
+                }
+            }
+            if (holder != nullptr)
+            {
+                // inline values, and runtimes which forbid external buffers, get a copy
+                if (holder->m_instance != nullptr)
+                {
+                    napi_delete_reference(env, holder->m_instance);
+                }
+                void* bytes = nullptr;
+                result = nullptr;
+                if (napi_create_arraybuffer(env, view.length(), &bytes, &result) == napi_ok)
+                {
+                    std::memcpy(bytes, view.data(), view.length());
+                }
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::removeItem(napi_env env, napi_callback_info info)
+{
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 1;
+    napi_value args[1];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount == 1))
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            napi_helpers::StringBuffer keyBuffer;
+            status = napi_helpers::getValueStringUTF8(env, args[0], keyBuffer);
+            if (status == napi_ok)
+            {
+                storage::Status stStatus = storage->removeItem(
+                    storage::ItemKey(keyBuffer.data(), keyBuffer.length()));
+                if (stStatus != storage::eOk)
+                {
+                    throw_error(env, stStatus, keyBuffer.str());
+                }
+            }
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief  Read the keys of a batch from an array of strings.
+ *
+ * @param env Nodejs environment handler.
+ * @param array Array of keys.
+ * @param[out] bytes Bytes of all the keys, one after the other.
+ * @param[out] keys Keys, which refer to the bytes.
+ *
+ * @return napi_ok if reading the keys succeeded.
+ */
+static napi_status getBatchKeys(napi_env env, napi_value array, std::string& bytes,
+                                std::vector<storage::ItemKey>& keys)
+{
+    uint32_t count = 0;
+    napi_status status = napi_get_array_length(env, array, &count);
+    std::vector<size_t> ends;
+    ends.reserve(count);
+    for (uint32_t iter = 0; (status == napi_ok) && (iter < count); ++iter)
+    {
+        napi_value key = nullptr;
+        napi_helpers::StringBuffer keyBuffer;
+        status = napi_get_element(env, array, iter, &key);
+        if (status == napi_ok)
+        {
+            status = napi_helpers::getValueStringUTF8(env, key, keyBuffer);
+        }
+        if (status == napi_ok)
+        {
+            bytes.append(keyBuffer.data(), keyBuffer.length());
+            ends.push_back(bytes.size());
+        }
+    }
+
+    // the keys refer to the bytes once they are not reallocated anymore
+    keys.reserve(ends.size());
+    size_t begin = 0;
+    for (size_t end : ends)
+    {
+        keys.emplace_back(bytes.data() + begin, end - begin);
+        begin = end;
+    }
+    return status;
+}
+
+napi_value JsSharedStorage::getItems(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 2;
+    napi_value args[2];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 1) && napi_helpers::isArray(env, args[0]))
+    {
+        storage::SharedStorage* storage = nullptr;
+        std::string keyBytes;
+        std::vector<storage::ItemKey> keys;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            status = getBatchKeys(env, args[0], keyBytes, keys);
+        }
+        if (status == napi_ok)
+        {
+            std::vector<ItemConsumer> consumers(keys.size(), ItemConsumer(env));
+            std::vector<storage::Status> statuses;
+            storage->getItems<ItemConsumer>(keys, consumers, statuses);
+
+            // the tags are set apart, rather than wrapping every value in an object
+            napi_value tags = ((argsCount >= 2) && napi_helpers::isArray(env, args[1]))
+                                  ? args[1]
+                                  : nullptr;
+            napi_value undefined = nullptr;
+            napi_value array = nullptr;
+            status = napi_get_undefined(env, &undefined);
+            if (status == napi_ok)
+            {
+                status = napi_create_array_with_length(env, keys.size(), &array);
+            }
+            for (size_t iter = 0; (status == napi_ok) && (iter < keys.size()); ++iter)
+            {
+                napi_value value = undefined;
+                if (statuses[iter] == storage::eOk)
+                {
+                    status = createItemResult(env, consumers[iter], false, &value);
+                }
+                if (status == napi_ok)
+                {
+                    status = napi_set_element(env, array, static_cast<uint32_t>(iter), value);
+                }
+                if ((status == napi_ok) && (tags != nullptr) && (statuses[iter] == storage::eOk) &&
+                    !consumers[iter].getTag().empty())
+                {
+                    napi_value tag = nullptr;
+                    status = napi_helpers::createValueStringUTF8(consumers[iter].getTag(), env,
+                                                                 &tag);
+                    if (status == napi_ok)
+                    {
+                        status = napi_set_element(env, tags, static_cast<uint32_t>(iter), tag);
+                    }
+                }
+            }
+            if (status == napi_ok)
+            {
+                result = array;
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::setItems(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 5;
+    napi_value args[5];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 2) && napi_helpers::isArray(env, args[0]) &&
+        napi_helpers::isArray(env, args[1]))
+    {
+        // setMany(keys, values, tags, ttl, atomic): the tags are optional, the ttl applies to
+        // every item
+        storage::SharedStorage* storage = nullptr;
+        std::string keyBytes;
+        std::vector<storage::ItemKey> keys;
+        std::vector<storage::ItemUpdate> updates;
+        const bool withTags = (argsCount >= 3) && napi_helpers::isArray(env, args[2]);
+        int64_t ttl = 0;
+        bool atomic = false;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if ((status == napi_ok) && (argsCount >= 4) && napi_helpers::isNumber(env, args[3]))
+        {
+            status = napi_get_value_int64(env, args[3], &ttl);
+        }
+        if ((status == napi_ok) && (argsCount >= 5) && napi_helpers::isBool(env, args[4]))
+        {
+            status = napi_get_value_bool(env, args[4], &atomic);
+        }
+        if (status == napi_ok)
+        {
+            status = getBatchKeys(env, args[0], keyBytes, keys);
+        }
+        if (status == napi_ok)
+        {
+            updates.reserve(keys.size());
+        }
+
+        // every value is read before the storage is written
+        napi_helpers::StringBuffer tagBuffer;
+        std::string tag;
+        for (size_t iter = 0; (status == napi_ok) && (iter < keys.size()); ++iter)
+        {
+            napi_value value = nullptr;
+            napi_value tagValue = nullptr;
+            tag.clear();
+            status = napi_get_element(env, args[1], static_cast<uint32_t>(iter), &value);
+            if ((status == napi_ok) && withTags)
+            {
+                status = napi_get_element(env, args[2], static_cast<uint32_t>(iter), &tagValue);
+                if ((status == napi_ok) && napi_helpers::isString(env, tagValue))
+                {
+                    status = napi_helpers::getValueStringUTF8(env, tagValue, tagBuffer);
+                    tag.assign(tagBuffer.data(), tagBuffer.length());
+                }
+            }
+            if (status == napi_ok)
+            {
+                status = withNativeValue(env, value, [&](const auto& nativeValue) {
+                    typedef typename std::decay<decltype(nativeValue)>::type ValueType;
+                    updates.emplace_back(keys[iter], storage::Item<ValueType>(nativeValue, tag),
+                                         (ttl > 0) ? static_cast<uint64_t>(ttl) : 0);
+                });
+            }
+        }
+        if (status == napi_invalid_arg)
+        {
+            napi_throw_error(env, nullptr, "unsupported value type.");
+        }
+        else if (status == napi_ok)
+        {
+            std::vector<storage::Status> statuses;
+            storage::Status stStatus = storage->setItems(updates, atomic, statuses);
+            if (atomic && (stStatus != storage::eOk))
+            {
+                throw_error(env, stStatus);
+            }
+            else if (stStatus != storage::eOk)
+            {
+                napi_value array = nullptr;
+                napi_value null = nullptr;
+                status = napi_create_array_with_length(env, statuses.size(), &array);
+                if (status == napi_ok)
+                {
+                    status = napi_get_null(env, &null);
+                }
+                for (size_t iter = 0; (status == napi_ok) && (iter < statuses.size()); ++iter)
+                {
+                    napi_value error = nullptr;
+                    if (statuses[iter] != storage::eOk)
+                    {
+                        status = create_error(
+                            env, statuses[iter],
+                            std::string(keys[iter].data(), keys[iter].length()), &error);
+                    }
+                    if (status == napi_ok)
+                    {
+                        status = napi_set_element(env, array, static_cast<uint32_t>(iter),
+                                                  (error != nullptr) ? error : null);
+                    }
+                }
+                if (status == napi_ok)
+                {
+                    result = array;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::removeItems(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 1;
+    napi_value args[1];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount == 1) && napi_helpers::isArray(env, args[0]))
+    {
+        storage::SharedStorage* storage = nullptr;
+        std::string keyBytes;
+        std::vector<storage::ItemKey> keys;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            status = getBatchKeys(env, args[0], keyBytes, keys);
+        }
+        if (status == napi_ok)
+        {
+            std::vector<storage::Status> statuses;
+            const size_t removed = storage->removeItems(keys, statuses);
+
+            // missing items are not errors, the first failure is thrown once every key was seen
+            auto failed = std::find_if(statuses.begin(), statuses.end(), [](storage::Status st) {
+                return (st != storage::eOk) && (st != storage::eItemNotFound);
+            });
+            if (failed != statuses.end())
+            {
+                const storage::ItemKey& key = keys[failed - statuses.begin()];
+                throw_error(env, *failed, std::string(key.data(), key.length()));
+            }
+            else
+            {
+                status = napi_create_uint32(env, static_cast<uint32_t>(removed), &result);
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::removePrefix(napi_env env, napi_callback_info info)
+{
+    return removeMatching(env, info, false);
+}
+
+napi_value JsSharedStorage::removeByTag(napi_env env, napi_callback_info info)
+{
+    return removeMatching(env, info, true);
+}
+
+napi_value JsSharedStorage::removeMatching(napi_env env, napi_callback_info info, bool byTag)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 2;
+    napi_value args[2];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 1) && napi_helpers::isString(env, args[0]))
+    {
+        storage::SharedStorage* storage = nullptr;
+        std::string pattern;
+        double budget = 0.0;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            status = napi_helpers::getValueStringUTF8(env, args[0], pattern);
+        }
+        if ((status == napi_ok) && (argsCount >= 2) && napi_helpers::isNumber(env, args[1]))
+        {
+            status = napi_get_value_double(env, args[1], &budget);
+        }
+        if (status == napi_ok)
+        {
+            // a budget below one millisecond still lets each lock hold remove one batch
+            const uint64_t milliseconds = (budget >= 1.0) ? static_cast<uint64_t>(budget)
+                                                          : ((budget > 0.0) ? 1 : 0);
+            size_t removed = 0;
+            storage::Status stStatus =
+                byTag ? storage->removeByTag(pattern, milliseconds, removed)
+                      : storage->removePrefix(pattern, milliseconds, removed);
+            if (stStatus != storage::eOk)
+            {
+                throw_error(env, stStatus);
+            }
+            else
+            {
+                status = napi_create_double(env, static_cast<double>(removed), &result);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief  Create an array of keys.
+ *
+ * @param env Nodejs environment handler.
+ * @param keys Keys to put into the array.
+ * @param[out] result Array of strings.
+ *
+ * @return napi_ok if creating the array succeeded.
+ */
+static napi_status createKeysArray(napi_env env, const std::vector<std::string>& keys,
+                                   napi_value* result)
+{
+    napi_value array = nullptr;
+    napi_status status = napi_create_array_with_length(env, keys.size(), &array);
+    for (size_t iter = 0; (status == napi_ok) && (iter < keys.size()); ++iter)
+    {
+        napi_value key = nullptr;
+        status = napi_helpers::createValueStringUTF8(keys[iter], env, &key);
+        if (status == napi_ok)
+        {
+            status = napi_set_element(env, array, static_cast<uint32_t>(iter), key);
+        }
+    }
+    if (status == napi_ok)
+    {
+        *result = array;
+    }
+    return status;
+}
+
+/**
+ * @brief  Read the maximum count of keys of an ordered query.
+ *
+ * @param env Nodejs environment handler.
+ * @param value Count of keys, anything else than a number for no limit.
+ * @param[out] limit Maximum count of keys.
+ *
+ * @return napi_ok if reading the count succeeded.
+ */
+static napi_status getKeysLimit(napi_env env, napi_value value, size_t& limit)
+{
+    limit = std::numeric_limits<size_t>::max();
+    if (!napi_helpers::isNumber(env, value))
+    {
+        return napi_ok;
+    }
+    double count = 0.0;
+    napi_status status = napi_get_value_double(env, value, &count);
+    if ((status == napi_ok) && (count < 9007199254740992.0))
+    {
+        limit = (count >= 1.0) ? static_cast<size_t>(count) : 0;
+    }
+    return status;
+}
+
+napi_value JsSharedStorage::scan(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 2;
+    napi_value args[2];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 1) && napi_helpers::isNumber(env, args[0]))
+    {
+        storage::SharedStorage* storage = nullptr;
+        double cursor = 0.0;
+        double count = kScanCount;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            status = napi_get_value_double(env, args[0], &cursor);
+        }
+        if ((status == napi_ok) && (argsCount >= 2) && napi_helpers::isNumber(env, args[1]))
+        {
+            status = napi_get_value_double(env, args[1], &count);
+        }
+
+        // cursors are returned as numbers, below 2^53
+        if ((status == napi_ok) &&
+            !((cursor >= 0.0) && (cursor < 9007199254740992.0) && (cursor == std::floor(cursor))))
+        {
+            napi_throw_error(env, nullptr, "invalid scan cursor.");
+        }
+        else if (status == napi_ok)
+        {
+            std::vector<std::string> keys;
+            const uint64_t next = storage->scan(static_cast<uint64_t>(cursor),
+                                                (count >= 1.0) ? static_cast<size_t>(count) : 1,
+                                                keys);
+            napi_value object = nullptr;
+            napi_value nextCursor = nullptr;
+            napi_value array = nullptr;
+            status = napi_create_object(env, &object);
+            if (status == napi_ok)
+            {
+                status = napi_create_double(env, static_cast<double>(next), &nextCursor);
+            }
+            if (status == napi_ok)
+            {
+                status = createKeysArray(env, keys, &array);
+            }
+            if (status == napi_ok)
+            {
+                status = napi_set_named_property(env, object, "cursor", nextCursor);
+            }
+            if (status == napi_ok)
+            {
+                status = napi_set_named_property(env, object, "keys", array);
+            }
+            if (status == napi_ok)
+            {
+                result = object;
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::scanPrefix(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 2;
+    napi_value args[2];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 1) && napi_helpers::isString(env, args[0]))
+    {
+        storage::SharedStorage* storage = nullptr;
+        std::string prefix;
+        size_t limit = 0;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            status = napi_helpers::getValueStringUTF8(env, args[0], prefix);
+        }
+        if (status == napi_ok)
+        {
+            status = getKeysLimit(env, (argsCount >= 2) ? args[1] : nullptr, limit);
+        }
+        if (status == napi_ok)
+        {
+            std::vector<std::string> keys;
+            storage->scanPrefix(prefix, limit, keys);
+            status = createKeysArray(env, keys, &result);
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::range(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 3;
+    napi_value args[3];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 1) && napi_helpers::isString(env, args[0]))
+    {
+        storage::SharedStorage* storage = nullptr;
+        std::string start;
+        std::string end;
+        size_t limit = 0;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            status = napi_helpers::getValueStringUTF8(env, args[0], start);
+        }
+        if ((status == napi_ok) && (argsCount >= 2) && napi_helpers::isString(env, args[1]))
+        {
+            status = napi_helpers::getValueStringUTF8(env, args[1], end);
+        }
+        if (status == napi_ok)
+        {
+            status = getKeysLimit(env, (argsCount >= 3) ? args[2] : nullptr, limit);
+        }
+        if (status == napi_ok)
+        {
+            std::vector<std::string> keys;
+            storage->range(start, end, limit, keys);
+            status = createKeysArray(env, keys, &result);
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::keysByTag(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 1;
+    napi_value args[1];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount == 1) && napi_helpers::isString(env, args[0]))
+    {
+        storage::SharedStorage* storage = nullptr;
+        std::string tag;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            status = napi_helpers::getValueStringUTF8(env, args[0], tag);
+        }
+        if (status == napi_ok)
+        {
+            std::vector<std::string> keys;
+            storage->getKeysByTag(tag, keys);
+            status = createKeysArray(env, keys, &result);
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::countByTag(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 1;
+    napi_value args[1];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount == 1) && napi_helpers::isString(env, args[0]))
+    {
+        storage::SharedStorage* storage = nullptr;
+        std::string tag;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            status = napi_helpers::getValueStringUTF8(env, args[0], tag);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_create_double(env, static_cast<double>(storage->countByTag(tag)),
+                                        &result);
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::clear(napi_env env, napi_callback_info info)
+{
+    storage::SharedStorage* storage = nullptr;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        storage::Status stStatus = storage->clear();
+        if (stStatus != storage::eOk)
+        {
+            throw_error(env, stStatus);
+        }
+    }
+    return nullptr;
+}
+
+napi_value JsSharedStorage::addToItem(napi_env env, napi_callback_info info, double sign)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 2;
+    napi_value args[2];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 1))
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            napi_helpers::StringBuffer keyBuffer;
+            double delta = 1.0;
+            status = napi_helpers::getValueStringUTF8(env, args[0], keyBuffer);
+            if ((status == napi_ok) && (argsCount >= 2) && napi_helpers::isNumber(env, args[1]))
+            {
+                status = napi_get_value_double(env, args[1], &delta);
+            }
+            if (status == napi_ok)
+            {
+                double value = 0.0;
+                storage::Status stStatus = storage->increment(
+                    storage::ItemKey(keyBuffer.data(), keyBuffer.length()), sign * delta, value);
+                if (stStatus == storage::eOk)
+                {
+                    status = napi_create_double(env, value, &result);
+                }
+                else
+                {
+                    throw_error(env, stStatus, keyBuffer.str());
+                }
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::increment(napi_env env, napi_callback_info info)
+{
+    return addToItem(env, info, 1.0);
+}
+
+napi_value JsSharedStorage::decrement(napi_env env, napi_callback_info info)
+{
+    return addToItem(env, info, -1.0);
+}
+
+napi_value JsSharedStorage::compareAndSet(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 4;
+    napi_value args[4];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 3))
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            napi_helpers::StringBuffer keyBuffer;
+            std::string tag;
+
+            status = napi_helpers::getValueStringUTF8(env, args[0], keyBuffer);
+            if ((status == napi_ok) && (argsCount >= 4) && napi_helpers::isString(env, args[3]))
+            {
+                status = napi_helpers::getValueStringUTF8(env, args[3], tag);
+            }
+            if (status == napi_ok)
+            {
+                storage::ItemKey key(keyBuffer.data(), keyBuffer.length());
+                storage::Status stStatus = storage::eOk;
+                bool swapped = false;
+
+                status = withNativeValue(env, args[1], [&](const auto& expected) {
+                    status = withNativeValue(env, args[2], [&](const auto& value) {
+                        typedef typename std::decay<decltype(value)>::type ValueType;
+                        stStatus = storage->compareAndSet(
+                            key, expected, storage::Item<ValueType>(value, tag), swapped);
+                    });
+                });
+                if (status == napi_invalid_arg)
+                {
+                    napi_throw_error(env, nullptr, "unsupported value type.");
+                }
+                else if (stStatus != storage::eOk)
+                {
+                    throw_error(env, stStatus, keyBuffer.str());
+                }
+                else if (status == napi_ok)
+                {
+                    status = napi_get_boolean(env, swapped, &result);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::getAndSet(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 4;
+    napi_value args[4];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 2))
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            napi_helpers::StringBuffer keyBuffer;
+            std::string tag;
+
+            status = napi_helpers::getValueStringUTF8(env, args[0], keyBuffer);
+            if ((status == napi_ok) && (argsCount >= 3) && napi_helpers::isString(env, args[2]))
+            {
+                status = napi_helpers::getValueStringUTF8(env, args[2], tag);
+            }
+            if (status == napi_ok)
+            {
+                storage::ItemKey key(keyBuffer.data(), keyBuffer.length());
+                storage::Status stStatus = storage::eOk;
+                ItemConsumer consumer(env);
+
+                status = withNativeValue(env, args[1], [&](const auto& value) {
+                    typedef typename std::decay<decltype(value)>::type ValueType;
+                    stStatus = storage->getAndSet<ValueType, ItemConsumer>(
+                        key, storage::Item<ValueType>(value, tag), consumer);
+                });
+                if (status == napi_invalid_arg)
+                {
+                    napi_throw_error(env, nullptr, "unsupported value type.");
+                }
+                else if (stStatus != storage::eOk)
+                {
+                    throw_error(env, stStatus, keyBuffer.str());
+                }
+                else if ((status == napi_ok) && (consumer.getValue() != nullptr))
+                {
+                    bool withTag = (argsCount >= 4) && isWithTag(env, args[3]);
+                    status = createItemResult(env, consumer, withTag, &result);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::lock(napi_env env, napi_callback_info info)
+{
+    storage::SharedStorage* storage = nullptr;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        storage::Status stStatus = storage->lock();
+        if (stStatus != storage::eOk)
+        {
+            throw_error(env, stStatus);
+        }
+    }
+    return nullptr;
+}
+
+napi_value JsSharedStorage::unlock(napi_env env, napi_callback_info info)
+{
+    storage::SharedStorage* storage = nullptr;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        storage->unlock();
+    }
+    return nullptr;
+}
+
+napi_value JsSharedStorage::stats(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    storage::SharedStorage* storage = nullptr;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        status = napi_create_object(env, &result);
+    }
+
+    auto setNumber = [&](const char* name, double number) {
+        napi_value value = nullptr;
+        if (status == napi_ok)
+        {
+            status = napi_create_double(env, number, &value);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_set_named_property(env, result, name, value);
+        }
+    };
+    if (status == napi_ok)
+    {
+        setNumber("size", static_cast<double>(storage->getSize()));
+        setNumber("usedMemory", static_cast<double>(storage->getUsedMemory()));
+        setNumber("evicted", static_cast<double>(storage->getEvictedCount()));
+        setNumber("expired", static_cast<double>(storage->getExpiredCount()));
+    }
+    return (status == napi_ok) ? result : nullptr;
+}
+
+napi_value JsSharedStorage::compact(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    storage::SharedStorage* storage = nullptr;
+    storage::CompactionReport report;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        storage::Status stStatus = storage->compact(report);
+        if (stStatus != storage::eOk)
+        {
+            throw_error(env, stStatus);
+            return nullptr;
+        }
+        status = napi_create_object(env, &result);
+    }
+
+    auto setNumber = [&](const char* name, double number) {
+        napi_value value = nullptr;
+        if (status == napi_ok)
+        {
+            status = napi_create_double(env, number, &value);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_set_named_property(env, result, name, value);
+        }
+    };
+    setNumber("fragmentationBefore", report.m_fragmentationBefore);
+    setNumber("fragmentationAfter", report.m_fragmentationAfter);
+    setNumber("relocated", static_cast<double>(report.m_relocatedCount));
+    return (status == napi_ok) ? result : nullptr;
+}
+
+napi_value JsSharedStorage::startCompaction(napi_env env, napi_callback_info info)
+{
+    storage::SharedStorage* storage = nullptr;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        storage->startCompaction();
+    }
+    return nullptr;
+}
+
+napi_value JsSharedStorage::stopCompaction(napi_env env, napi_callback_info info)
+{
+    storage::SharedStorage* storage = nullptr;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        storage->stopCompaction();
+    }
+    return nullptr;
+}
+
+napi_value JsSharedStorage::tryToLock(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    storage::SharedStorage* storage = nullptr;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        bool locked = storage->tryToLock();
+        status = napi_get_boolean(env, locked, &result);
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::lockShared(napi_env env, napi_callback_info info)
+{
+    storage::SharedStorage* storage = nullptr;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        storage->lockShared();
+    }
+    return nullptr;
+}
+
+napi_value JsSharedStorage::unlockShared(napi_env env, napi_callback_info info)
+{
+    storage::SharedStorage* storage = nullptr;
+    napi_status status = getStorage(env, info, &storage);
+    if (status == napi_ok)
+    {
+        storage->unlockShared();
+    }
+    return nullptr;
+}
+
+/**
+ * @brief  Item consumer which copies the item, so that a worker thread reads the item and the main
+ * thread creates its value afterwards.
+ */
+class ItemCopy
+{
+public:
+    /**
+     * @brief  Constructor.
+     */
+    ItemCopy() : m_type(storage::eNone), m_bool(false), m_double(0.0) {}
+
+    /**
+     * @brief  Copy the passed item. Generic implementation, for unknown types.
+     *
+     * @param key Key of the item.
+     * @param item Item description.
+     * @tparam T Value type of the item.
+     */
+    template <class T> void set(const storage::ItemKey& key, storage::Item<T>& item) {}
+
+    /**
+     * @brief  Pass the copied item to another consumer.
+     *
+     * @param key Key of the item.
+     * @param consumer Consumer of the item.
+     * @tparam C Item consumer.
+     */
+    template <class C> void replay(const storage::ItemKey& key, C& consumer) const
+    {
+        switch (m_type)
+        {
+        case storage::eBool:
+        {
+            storage::Item<bool> item(m_bool, m_tag);
+            consumer.template set<bool>(key, item);
+            break;
+        }
+
+        case storage::eDouble:
+        {
+            storage::Item<double> item(m_double, m_tag);
+            consumer.template set<double>(key, item);
+            break;
+        }
+
+        case storage::eString:
+        {
+            storage::Item<std::string> item(m_bytes, m_tag);
+            consumer.template set<std::string>(key, item);
+            break;
+        }
+
+        case storage::eBinary:
+        {
+            storage::Item<storage::BinaryValue> item(
+                storage::BinaryValue(m_bytes.data(), m_bytes.size()), m_tag);
+            consumer.template set<storage::BinaryValue>(key, item);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+private:
+    storage::ItemType m_type;
+    bool m_bool;
+    double m_double;
+    std::string m_bytes; ///< Bytes of the string and binary values.
+    std::string m_tag;
+};
+
+template <> void ItemCopy::set<bool>(const storage::ItemKey& key, storage::Item<bool>& item)
+{
+    m_type = storage::eBool;
+    m_bool = item.getValue();
+    m_tag = item.getTag();
+}
+
+template <> void ItemCopy::set<double>(const storage::ItemKey& key, storage::Item<double>& item)
+{
+    m_type = storage::eDouble;
+    m_double = item.getValue();
+    m_tag = item.getTag();
+}
+
+template <>
+void ItemCopy::set<std::string>(const storage::ItemKey& key, storage::Item<std::string>& item)
+{
+    m_type = storage::eString;
+    m_bytes = item.getValue();
+    m_tag = item.getTag();
+}
+
+template <>
+void ItemCopy::set<storage::BinaryValue>(const storage::ItemKey& key,
+                                         storage::Item<storage::BinaryValue>& item)
+{
+    m_type = storage::eBinary;
+    m_bytes.assign(item.getValue().data(), item.getValue().length());
+    m_tag = item.getTag();
+}
+
+
+/**
+ * @brief  Operation on a storage, run by a worker thread, whose result settles a promise.
+ */
+class AsyncOperation
+{
+public:
+    /**
+     * @brief  Constructor.
+     *
+     * @param storage Storage of the operation.
+     */
+    AsyncOperation(storage::SharedStorage* storage)
+    : m_storage(storage), m_status(storage::eOk), m_deferred(nullptr), m_work(nullptr),
+      m_instance(nullptr)
+    {
+    }
+
+    /**
+     * @brief  Destructor.
+     */
+    virtual ~AsyncOperation() {}
+
+    /**
+     * @brief  Run the operation. It must not call Node-API, it runs on a worker thread.
+     */
+    virtual void execute() = 0;
+
+    /**
+     * @brief  Create the value the promise is resolved with, once the operation succeeded.
+     *
+     * @param env Nodejs environment handler.
+     * @param[out] result Result of the operation.
+     *
+     * @return napi_ok if creating the result succeeded.
+     */
+    virtual napi_status getResult(napi_env env, napi_value* result)
+    {
+        return napi_get_undefined(env, result);
+    }
+
+    storage::SharedStorage* m_storage;
+    storage::Status m_status; ///< Status of the operation, the promise is rejected unless eOk.
+    std::string m_key;        ///< Key of the item, it identifies the item in the errors.
+    napi_deferred m_deferred;
+    napi_async_work m_work;
+    napi_ref m_instance; ///< Storage instance, which must stay alive while the operation runs.
+};
+
+/**
+ * @brief  Read an item.
+ */
+class GetOperation : public AsyncOperation
+{
+public:
+    /**
+     * @brief  Constructor.
+     *
+     * @param storage Storage of the item.
+     * @param withTag If true, the result holds the value and the tag of the item.
+     */
+    GetOperation(storage::SharedStorage* storage, bool withTag)
+    : AsyncOperation(storage), m_withTag(withTag), m_found(false), m_item()
+    {
+    }
+
+    void execute() override
+    {
+        m_status = m_storage->getItem<ItemCopy>(storage::ItemKey(m_key), m_item);
+        m_found = (m_status == storage::eOk);
+        if (m_status == storage::eItemNotFound)
+        {
+            m_status = storage::eOk;
+        }
+    }
+
+    napi_status getResult(napi_env env, napi_value* result) override
+    {
+        if (!m_found)
+        {
+            return napi_get_undefined(env, result);
+        }
+        ItemConsumer consumer(env);
+        m_item.replay(storage::ItemKey(m_key), consumer);
+        return createItemResult(env, consumer, m_withTag, result);
+    }
+
+private:
+    bool m_withTag;
+    bool m_found;
+    ItemCopy m_item;
+};
+
+/**
+ * @brief  Write an item.
+ */
+class SetOperation : public AsyncOperation
+{
+public:
+    /**
+     * @brief  Constructor.
+     *
+     * @param storage Storage of the item.
+     */
+    SetOperation(storage::SharedStorage* storage) : AsyncOperation(storage), m_updates() {}
+
+    void execute() override
+    {
+        std::vector<storage::Status> statuses;
+        m_status = m_storage->setItems(m_updates, false, statuses);
+    }
+
+    std::vector<storage::ItemUpdate> m_updates; ///< Update of the item, its key refers to m_key.
+};
+
+/**
+ * @brief  Lock writing on a storage on behalf of the main thread.
+ */
+class LockOperation : public AsyncOperation
+{
+public:
+    /**
+     * @brief  Constructor, announce the lock so that the main thread does not block on the shards
+     * which the worker locks on its behalf.
+     *
+     * @param storage Storage to lock.
+     */
+    LockOperation(storage::SharedStorage* storage)
+    : AsyncOperation(storage), m_owner(storage::getCurrentThreadId())
+    {
+        m_storage->beginLockFor();
+    }
+
+    /**
+     * @brief  Destructor, end the announcement once the worker is done.
+     */
+    ~LockOperation() override { m_storage->endLockFor(); }
+
+    void execute() override { m_status = m_storage->lockFor(m_owner); }
+
+private:
+    uint64_t m_owner;
+};
+
+napi_value JsSharedStorage::getItemAsync(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 2;
+    napi_value args[2];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 1))
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            bool withTag = (argsCount >= 2) && isWithTag(env, args[1]);
+            std::unique_ptr<GetOperation> operation(new (std::nothrow)
+                                                        GetOperation(storage, withTag));
+            if (operation != nullptr)
+            {
+                status = napi_helpers::getValueStringUTF8(env, args[0], operation->m_key);
+            }
+            if ((operation != nullptr) && (status == napi_ok))
+            {
+                result = queueOperation(env, thisInstance, std::move(operation));
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::setItemAsync(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 4;
+    napi_value args[4];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status == napi_ok) && (argsCount >= 2))
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            std::unique_ptr<SetOperation> operation(new (std::nothrow) SetOperation(storage));
+            std::string tag;
+            int64_t ttl = 0;
+
+            status = (operation != nullptr)
+                         ? napi_helpers::getValueStringUTF8(env, args[0], operation->m_key)
+                         : napi_generic_failure;
+            if ((status == napi_ok) && (argsCount >= 3) && napi_helpers::isString(env, args[2]))
+            {
+                status = napi_helpers::getValueStringUTF8(env, args[2], tag);
+            }
+            if ((status == napi_ok) && (argsCount >= 4) && napi_helpers::isNumber(env, args[3]))
+            {
+                status = napi_get_value_int64(env, args[3], &ttl);
+            }
+            if (status == napi_ok)
+            {
+                // the value is copied by the main thread, the storage is written by the worker
+                storage::ItemKey key(operation->m_key);
+                status = withNativeValue(env, args[1], [&](const auto& value) {
+                    typedef typename std::decay<decltype(value)>::type ValueType;
+                    operation->m_updates.emplace_back(key, storage::Item<ValueType>(value, tag),
+                                                      (ttl > 0) ? static_cast<uint64_t>(ttl) : 0);
+                });
+            }
+            if (status == napi_invalid_arg)
+            {
+                napi_throw_error(env, nullptr, "unsupported value type.");
+            }
+            else if (status == napi_ok)
+            {
+                result = queueOperation(env, thisInstance, std::move(operation));
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::lockAsync(napi_env env, napi_callback_info info)
+{
+    napi_value result = nullptr;
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 0;
+    napi_status status = napi_get_cb_info(env, info, &argsCount, nullptr, &thisInstance, nullptr);
+    if (status == napi_ok)
+    {
+        storage::SharedStorage* storage = nullptr;
+        status = napi_unwrap(env, thisInstance, (void**)&storage);
+        if (status == napi_ok)
+        {
+            std::unique_ptr<LockOperation> operation(new (std::nothrow) LockOperation(storage));
+            if (operation != nullptr)
+            {
+                result = queueOperation(env, thisInstance, std::move(operation));
+            }
+        }
+    }
+    return result;
+}
+
+napi_value JsSharedStorage::queueOperation(napi_env env, napi_value instance,
+                                           std::unique_ptr<AsyncOperation> operation)
+{
+    napi_value promise = nullptr;
+    napi_status status = napi_create_promise(env, &operation->m_deferred, &promise);
+    if ((status == napi_ok) &&
+        (operation->m_storage->isLockedByCurrentThread() || operation->m_storage->isLockedShared()))
+    {
+        // the locks of the current thread are only released by the current thread itself
+        operation->execute();
+        status = settleOperation(env, *operation);
+    }
+    else if (status == napi_ok)
+    {
+        napi_value resourceName = nullptr;
+        status = napi_create_reference(env, instance, 1, &operation->m_instance);
+        if (status == napi_ok)
+        {
+            status = napi_helpers::createValueStringUTF8("storage operation", env,
+                                                        &resourceName);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_create_async_work(env, nullptr, resourceName, executeOperation,
+                                            completeOperation, operation.get(),
+                                            &operation->m_work);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_queue_async_work(env, operation->m_work);
+        }
+        if (status == napi_ok)
+        {
+            operation.release();
+        }
+        else
+        {
+            if (operation->m_work != nullptr)
+            {
+                napi_delete_async_work(env, operation->m_work);
+            }
+            if (operation->m_instance != nullptr)
+            {
+                napi_delete_reference(env, operation->m_instance);
+            }
+        }
+    }
+    return (status == napi_ok) ? promise : nullptr;
+}
+
+void JsSharedStorage::executeOperation(napi_env env, void* data)
+{
+    static_cast<AsyncOperation*>(data)->execute();
+}
+
+void JsSharedStorage::completeOperation(napi_env env, napi_status status, void* data)
+{
+    std::unique_ptr<AsyncOperation> operation(static_cast<AsyncOperation*>(data));
+    settleOperation(env, *operation);
+    napi_delete_async_work(env, operation->m_work);
+    napi_delete_reference(env, operation->m_instance);
+}
+
+napi_status JsSharedStorage::settleOperation(napi_env env, AsyncOperation& operation)
+{
+    napi_value result = nullptr;
+    napi_status status = napi_ok;
+    if (operation.m_status == storage::eOk)
+    {
+        status = operation.getResult(env, &result);
+        if (status == napi_ok)
+        {
+            status = napi_resolve_deferred(env, operation.m_deferred, result);
+        }
+    }
+    else
+    {
+        status = create_error(env, operation.m_status, operation.m_key, &result);
+        if (status == napi_ok)
+        {
+            status = napi_reject_deferred(env, operation.m_deferred, result);
+        }
+    }
+
+    // the promise must not stay pending: it is rejected with the exception of a failure, if any,
+    // otherwise it is resolved with undefined as the synchronous methods return undefined
+    bool pending = false;
+    if ((status != napi_ok) && (napi_is_exception_pending(env, &pending) == napi_ok))
+    {
+        if (pending && (napi_get_and_clear_last_exception(env, &result) == napi_ok))
+        {
+            status = napi_reject_deferred(env, operation.m_deferred, result);
+        }
+        else if (!pending && (napi_get_undefined(env, &result) == napi_ok))
+        {
+            status = napi_resolve_deferred(env, operation.m_deferred, result);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief  Maximum delay in milliseconds during which a watcher thread waits for changes, before
+ * it checks whether it must stop.
+ */
+static const uint32_t kWatchTimeout = 100;
+
+/**
+ * @brief  Watcher of the changes of the items of a storage. Its thread reads the changes that
+ * every process records into the ring of the storage, keeps those of the watched keys, and hands
+ * them over to the main thread through a thread-safe function.
+ */
+class ChangeWatcher
 {
-    storage::SharedStorage* storage = nullptr;
-    napi_status status = getStorage(env, info, &storage);
+public:
+    /**
+     * @brief  Constructor of a watcher which the current process attached to the ring.
+     *
+     * @param ring Ring of the changes of the storage.
+     * @param position Position from which the changes must be read, as returned by attach().
+     */
+    ChangeWatcher(storage::ChangeRing& ring, uint64_t position)
+    : m_dispatch(nullptr), m_instance(nullptr), m_ring(ring), m_position(position),
+      m_patterns(), m_mutex(), m_stopping(false), m_thread()
+    {
+    }
+
+    /**
+     * @brief  Destructor, stop the thread then stop recording the changes.
+     */
+    ~ChangeWatcher()
+    {
+        stop();
+        m_ring.detach();
+    }
+
+    /**
+     * @brief  Start the thread which reads the changes.
+     */
+    void start() { m_thread = std::thread(&ChangeWatcher::run, this); }
+
+    /**
+     * @brief  Stop the thread which reads the changes, the changes it dispatched may still be
+     * pending.
+     */
+    void stop()
+    {
+        if (m_thread.joinable())
+        {
+            m_stopping.store(true);
+            m_ring.wake();
+            m_thread.join();
+        }
+    }
+
+    /**
+     * @brief  Replace the watched keys.
+     *
+     * @param patterns Watched keys, or watched prefixes ending with '*'.
+     */
+    void setPatterns(std::vector<std::string>& patterns)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_patterns.swap(patterns);
+    }
+
+    napi_threadsafe_function m_dispatch; ///< Function the changes are dispatched to.
+    napi_ref m_instance; ///< Storage instance, which must stay alive while it is watched.
+
+private:
+    /**
+     * @brief  Read the changes until the watcher stops.
+     */
+    void run()
+    {
+        std::vector<storage::Change> changes;
+        while (!m_stopping.load())
+        {
+            m_ring.read(m_position, kWatchTimeout, changes);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                changes.erase(std::remove_if(changes.begin(), changes.end(),
+                                             [this](const storage::Change& change) {
+                                                 return !matches(change);
+                                             }),
+                              changes.end());
+            }
+            if (!changes.empty())
+            {
+                std::unique_ptr<std::vector<storage::Change>> batch(
+                    new (std::nothrow) std::vector<storage::Change>());
+                if (batch != nullptr)
+                {
+                    batch->swap(changes);
+                    if (napi_call_threadsafe_function(m_dispatch, batch.get(),
+                                                      napi_tsfn_nonblocking) == napi_ok)
+                    {
+                        batch.release();
+                    }
+                }
+                changes.clear();
+            }
+        }
+    }
+
+    /**
+     * @brief  Check if a change concerns the watched keys. The watchers of any key are told
+     * about clearings and lost changes.
+     *
+     * @param change Change of an item.
+     *
+     * @return true if the change must be dispatched.
+     */
+    bool matches(const storage::Change& change) const
+    {
+        if ((change.m_kind == storage::eChangeClear) || (change.m_kind == storage::eChangeLost))
+        {
+            return true;
+        }
+        for (const std::string& pattern : m_patterns)
+        {
+            if (!pattern.empty() && (pattern.back() == '*'))
+            {
+                if (change.m_key.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) ==
+                    0)
+                {
+                    return true;
+                }
+            }
+            else if (change.m_key == pattern)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    storage::ChangeRing& m_ring;
+    uint64_t m_position; ///< Position of the next change to read from the ring.
+    std::vector<std::string> m_patterns;
+    std::mutex m_mutex; ///< Mutex of the patterns, replaced by the main thread.
+    std::atomic<bool> m_stopping;
+    std::thread m_thread;
+};
+
+/**
+ * @brief  Watchers of the storages, only accessed by the main thread.
+ */
+static std::map<storage::SharedStorage*, std::unique_ptr<ChangeWatcher>> sWatchers;
+
+/**
+ * @brief  Call the dispatcher of a watched storage with a batch of changes, on the main thread.
+ * The dispatcher receives the array of the keys, undefined for a clearing or lost changes, and
+ * the array of the types of the changes.
+ *
+ * @param env Nodejs environment handler, nullptr if the environment is torn down.
+ * @param dispatch Dispatcher of the changes.
+ * @param context Unused.
+ * @param data Batch of changes, released once dispatched.
+ */
+static void dispatchChanges(napi_env env, napi_value dispatch, void* context, void* data)
+{
+    static const char* const kChangeTypes[] = {"", "set", "remove", "expire", "evict", "clear",
+                                               "lost"};
+    std::unique_ptr<std::vector<storage::Change>> changes(
+        static_cast<std::vector<storage::Change>*>(data));
+    if ((env == nullptr) || (dispatch == nullptr))
+    {
+        return;
+    }
+
+    napi_value args[2] = {nullptr, nullptr};
+    napi_status status = napi_create_array_with_length(env, changes->size(), &args[0]);
     if (status == napi_ok)
     {
-        storage::Status stStatus = storage->clear();
-        if (stStatus != storage::eOk)
+        status = napi_create_array_with_length(env, changes->size(), &args[1]);
+    }
+    for (size_t iter = 0; (status == napi_ok) && (iter < changes->size()); ++iter)
+    {
+        const storage::Change& change = (*changes)[iter];
+        napi_value key = nullptr;
+        napi_value type = nullptr;
+        status = ((change.m_kind == storage::eChangeClear) ||
+                  (change.m_kind == storage::eChangeLost))
+                     ? napi_get_undefined(env, &key)
+                     : napi_helpers::createValueStringUTF8(change.m_key, env, &key);
+        if (status == napi_ok)
         {
-            throw_error(env, stStatus);
+            status = napi_create_string_utf8(env, kChangeTypes[change.m_kind], NAPI_AUTO_LENGTH,
+                                             &type);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_set_element(env, args[0], static_cast<uint32_t>(iter), key);
+        }
+        if (status == napi_ok)
+        {
+            status = napi_set_element(env, args[1], static_cast<uint32_t>(iter), type);
         }
     }
-    return nullptr;
+    napi_value undefined = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_undefined(env, &undefined);
+    }
+    if (status == napi_ok)
+    {
+        napi_call_function(env, undefined, dispatch, 2, args, nullptr);
+    }
 }
 
-napi_value JsSharedStorage::lock(napi_env env, napi_callback_info info)
+napi_value JsSharedStorage::watch(napi_env env, napi_callback_info info)
 {
+    napi_value thisInstance = nullptr;
+    size_t argsCount = 2;
+    napi_value args[2];
+    napi_status status = napi_get_cb_info(env, info, &argsCount, args, &thisInstance, nullptr);
+    if ((status != napi_ok) || (argsCount != 2) || !napi_helpers::isFunction(env, args[0]) ||
+        !napi_helpers::isArray(env, args[1]))
+    {
+        return nullptr;
+    }
+
     storage::SharedStorage* storage = nullptr;
-    napi_status status = getStorage(env, info, &storage);
+    status = napi_unwrap(env, thisInstance, (void**)&storage);
+    uint32_t patternsCount = 0;
+    if (status == napi_ok)
+    {
+        status = napi_get_array_length(env, args[1], &patternsCount);
+    }
+    std::vector<std::string> patterns(patternsCount);
+    for (uint32_t iter = 0; (status == napi_ok) && (iter < patternsCount); ++iter)
+    {
+        napi_value pattern = nullptr;
+        status = napi_get_element(env, args[1], iter, &pattern);
+        if (status == napi_ok)
+        {
+            status = napi_helpers::getValueStringUTF8(env, pattern, patterns[iter]);
+        }
+    }
+    if (status != napi_ok)
+    {
+        return nullptr;
+    }
+
+    auto found = sWatchers.find(storage);
+    if (found != sWatchers.end())
+    {
+        found->second->setPatterns(patterns);
+        return nullptr;
+    }
+    if (storage->getChanges() == nullptr)
+    {
+        napi_throw_error(env, nullptr, "the storage is too small to be watched.");
+        return nullptr;
+    }
+
+    uint64_t position = 0;
+    if (!storage->getChanges()->attach(position))
+    {
+        napi_throw_error(env, nullptr, "too many processes watch the storage.");
+        return nullptr;
+    }
+    std::unique_ptr<ChangeWatcher> watcher(
+        new (std::nothrow) ChangeWatcher(*storage->getChanges(), position));
+    if (watcher == nullptr)
+    {
+        storage->getChanges()->detach();
+    }
+    napi_value resourceName = nullptr;
+    status = (watcher != nullptr) ? napi_create_reference(env, thisInstance, 1,
+                                                          &watcher->m_instance)
+                                  : napi_generic_failure;
+    if (status == napi_ok)
+    {
+        watcher->setPatterns(patterns);
+        status = napi_helpers::createValueStringUTF8("storage watcher", env, &resourceName);
+    }
+    if (status == napi_ok)
+    {
+        status = napi_create_threadsafe_function(env, args[0], nullptr, resourceName, 0, 1,
+                                                 nullptr, nullptr, nullptr, dispatchChanges,
+                                                 &watcher->m_dispatch);
+    }
     if (status == napi_ok)
     {
-        storage->lock();
+        try
+        {
+            watcher->start();
+            sWatchers[storage] = std::move(watcher);
+        }
+        catch (const std::exception&)
+        {
+            status = napi_generic_failure;
+        }
+    }
+    if ((status != napi_ok) && (watcher != nullptr))
+    {
+        if (watcher->m_dispatch != nullptr)
+        {
+            napi_release_threadsafe_function(watcher->m_dispatch, napi_tsfn_abort);
+        }
+        if (watcher->m_instance != nullptr)
+        {
+            napi_delete_reference(env, watcher->m_instance);
+        }
+        napi_throw_error(env, nullptr, "cannot watch the storage.");
     }
     return nullptr;
 }
 
-napi_value JsSharedStorage::unlock(napi_env env, napi_callback_info info)
+napi_value JsSharedStorage::unwatch(napi_env env, napi_callback_info info)
 {
     storage::SharedStorage* storage = nullptr;
     napi_status status = getStorage(env, info, &storage);
     if (status == napi_ok)
     {
-        storage->unlock();
+        stopWatching(env, storage);
     }
     return nullptr;
 }
 
-napi_value JsSharedStorage::tryToLock(napi_env env, napi_callback_info info)
+void JsSharedStorage::stopWatching(napi_env env, storage::SharedStorage* storage)
 {
-    napi_value result = nullptr;
-    storage::SharedStorage* storage = nullptr;
-    napi_status status = getStorage(env, info, &storage);
+    auto found = sWatchers.find(storage);
+    if (found == sWatchers.end())
+    {
+        return;
+    }
+    std::unique_ptr<ChangeWatcher> watcher(std::move(found->second));
+    sWatchers.erase(found);
+
+    // the changes already dispatched are still delivered, the dispatcher ignores them if needed
+    watcher->stop();
+    napi_release_threadsafe_function(watcher->m_dispatch,
+                                     (env != nullptr) ? napi_tsfn_release : napi_tsfn_abort);
+    if (env != nullptr)
+    {
+        napi_delete_reference(env, watcher->m_instance);
+    }
+}
+
+void JsSharedStorage::stopWatchers(void* arg)
+{
+    // the references of the instances are released along with the environment
+    while (!sWatchers.empty())
+    {
+        stopWatching(nullptr, sWatchers.begin()->first);
+    }
+}
+
+napi_status JsSharedStorage::getStorageOptions(napi_env env, napi_value value,
+                                               storage::StorageOptions& options)
+{
+    napi_value shards = nullptr;
+    napi_status status = napi_get_named_property(env, value, "shards", &shards);
+    if ((status == napi_ok) && napi_helpers::isNumber(env, shards))
+    {
+        status = napi_get_value_uint32(env, shards, &options.m_shardsCount);
+    }
+    napi_value maxSize = nullptr;
     if (status == napi_ok)
     {
-        bool locked = storage->tryToLock();
-        status = napi_get_boolean(env, locked, &result);
+        status = napi_get_named_property(env, value, "maxSize", &maxSize);
     }
-    return result;
+    if ((status == napi_ok) && napi_helpers::isNumber(env, maxSize))
+    {
+        status = napi_get_value_int64(env, maxSize, &options.m_maxSize);
+    }
+    napi_value backend = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_named_property(env, value, "backend", &backend);
+    }
+    if ((status == napi_ok) && napi_helpers::isString(env, backend))
+    {
+        std::string backendName;
+        status = napi_helpers::getValueStringUTF8(env, backend, backendName);
+        if ((status == napi_ok) && (backendName == "file"))
+        {
+            options.m_backend = storage::eMappedFile;
+        }
+        else if ((status == napi_ok) && (backendName != "memory"))
+        {
+            status = napi_invalid_arg;
+        }
+    }
+    napi_value log = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_named_property(env, value, "log", &log);
+    }
+    if ((status == napi_ok) && napi_helpers::isString(env, log))
+    {
+        status = napi_helpers::getValueStringUTF8(env, log, options.m_logPath);
+    }
+    napi_value flushInterval = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_named_property(env, value, "logFlushInterval", &flushInterval);
+    }
+    if ((status == napi_ok) && napi_helpers::isNumber(env, flushInterval))
+    {
+        status = napi_get_value_uint32(env, flushInterval, &options.m_logFlushInterval);
+    }
+    napi_value flushCount = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_named_property(env, value, "logFlushCount", &flushCount);
+    }
+    if ((status == napi_ok) && napi_helpers::isNumber(env, flushCount))
+    {
+        status = napi_get_value_uint32(env, flushCount, &options.m_logFlushCount);
+    }
+    napi_value maxMemory = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_named_property(env, value, "maxMemory", &maxMemory);
+    }
+    if ((status == napi_ok) && napi_helpers::isNumber(env, maxMemory))
+    {
+        status = napi_get_value_int64(env, maxMemory, &options.m_maxMemory);
+        if (options.m_maxMemory > 0)
+        {
+            // a memory limit is useless without eviction
+            options.m_eviction = storage::eEvictClock;
+        }
+    }
+    napi_value eviction = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_named_property(env, value, "eviction", &eviction);
+    }
+    if ((status == napi_ok) && napi_helpers::isString(env, eviction))
+    {
+        std::string policyName;
+        status = napi_helpers::getValueStringUTF8(env, eviction, policyName);
+        if ((status == napi_ok) && (policyName == "clock"))
+        {
+            options.m_eviction = storage::eEvictClock;
+        }
+        else if ((status == napi_ok) && (policyName == "lfu"))
+        {
+            options.m_eviction = storage::eEvictLfu;
+        }
+        else if ((status == napi_ok) && (policyName == "none"))
+        {
+            options.m_eviction = storage::eNoEviction;
+        }
+        else if (status == napi_ok)
+        {
+            status = napi_invalid_arg;
+        }
+    }
+    napi_value slabs = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_named_property(env, value, "slabs", &slabs);
+    }
+    if ((status == napi_ok) && napi_helpers::isBool(env, slabs))
+    {
+        status = napi_get_value_bool(env, slabs, &options.m_slabs);
+    }
+    napi_value orderedKeys = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_named_property(env, value, "orderedKeys", &orderedKeys);
+    }
+    if ((status == napi_ok) && napi_helpers::isBool(env, orderedKeys))
+    {
+        status = napi_get_value_bool(env, orderedKeys, &options.m_orderedKeys);
+    }
+    napi_value tagIndex = nullptr;
+    if (status == napi_ok)
+    {
+        status = napi_get_named_property(env, value, "tagIndex", &tagIndex);
+    }
+    if ((status == napi_ok) && napi_helpers::isBool(env, tagIndex))
+    {
+        status = napi_get_value_bool(env, tagIndex, &options.m_tagIndex);
+    }
+    return status;
 }
 
 napi_status JsSharedStorage::throw_error(napi_env env, unsigned int status)
@@ -522,11 +2838,25 @@ napi_status JsSharedStorage::throw_error(napi_env env, unsigned int status)
 
 napi_status JsSharedStorage::throw_error(napi_env env, unsigned int status,
                                          const std::string& identifier)
+{
+    napi_value error = nullptr;
+    napi_status result = create_error(env, status, identifier, &error);
+    if ((result == napi_ok) && (error != nullptr))
+    {
+        result = napi_throw(env, error);
+    }
+    return result;
+}
+
+napi_status JsSharedStorage::create_error(napi_env env, unsigned int status,
+                                          const std::string& identifier, napi_value* error)
 {
     napi_status result = napi_ok;
     std::string message;
     std::string decoratedIdentifier;
+    bool withCode = true;
 
+    *error = nullptr;
     if (!identifier.empty())
     {
         decoratedIdentifier = " \"" + identifier + "\"";
@@ -563,8 +2893,35 @@ napi_status JsSharedStorage::throw_error(napi_env env, unsigned int status,
         message = "cannot remove all items in the storage.";
         break;
 
+    case storage::eCannotUpgradeLock:
+        message = "cannot write into the storage while it is locked for reading.";
+        break;
+
+    case storage::eItemTypeMismatch:
+        message = "cannot update the item" + decoratedIdentifier + ". Its value is not a number.";
+        break;
+
+    case storage::eCannotWriteSnapshot:
+        message = "cannot write the snapshot" + decoratedIdentifier + ".";
+        break;
+
+    case storage::eCannotReadSnapshot:
+        message = "cannot restore the snapshot" + decoratedIdentifier +
+                  ". It may be missing or corrupted.";
+        break;
+
+    case storage::eCannotWriteLog:
+        message = "cannot write into the operation log. The change is applied but it may be lost.";
+        break;
+
+    case storage::eCannotRollBack:
+        message = "cannot set the items. Some of them could not be restored and keep their new "
+                  "value.";
+        break;
+
     default:
-        result = napi_throw_error(env, nullptr, "internal storage error.");
+        message = "internal storage error.";
+        withCode = false;
         break;
     }
 
@@ -572,10 +2929,9 @@ napi_status JsSharedStorage::throw_error(napi_env env, unsigned int status,
     {
         napi_value errorMsg = nullptr;
         napi_value errorCode = nullptr;
-        napi_value error = nullptr;
 
         result = napi_helpers::createValueStringUTF8(message, env, &errorMsg);
-        if (result == napi_ok)
+        if ((result == napi_ok) && withCode)
         {
             char buffer[16];
             if (snprintf(buffer, 16, "%d", status) > 0)
@@ -585,13 +2941,9 @@ napi_status JsSharedStorage::throw_error(napi_env env, unsigned int status,
         }
         if (result == napi_ok)
         {
-            result = napi_create_error(env, errorCode, errorMsg, &error);
-        }
-        if (result == napi_ok)
-        {
-            result = napi_throw(env, error);
+            result = napi_create_error(env, errorCode, errorMsg, error);
         }
     }
 
     return result;
-}
\ No newline at end of file
+}
@@ -24,10 +24,14 @@
 namespace storage
 {
 class SharedStorage;
+struct StorageOptions;
 } // namespace storage
 
+class AsyncOperation;
+
 // Includes.
 #include <node_api.h>
+#include <memory>
 #include <string>
 
 
@@ -129,6 +133,66 @@ public:
      */
     static napi_value destroy(napi_env env, napi_callback_info info);
 
+    /**
+     * @brief  Restore an existing storage from a snapshot file.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return SharedStorage JavaScript instance.
+     */
+    static napi_value restore(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Write all the items into a snapshot file, on a worker thread.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Promise resolved once the snapshot is written.
+     */
+    static napi_value snapshot(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Get the statistics of the storage.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Object with the size, the used memory and the counts of evicted and expired items.
+     */
+    static napi_value stats(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Relocate the items so that the free memory coalesces.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Object with the fragmentation before and after and the count of relocated items.
+     */
+    static napi_value compact(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Start the incremental compaction of the current process.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return nullptr.
+     */
+    static napi_value startCompaction(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Stop the incremental compaction of the current process.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return nullptr.
+     */
+    static napi_value stopCompaction(napi_env env, napi_callback_info info);
+
     /**
      * @brief  Set an item.
      *
@@ -149,6 +213,17 @@ public:
      */
     static napi_value getItem(napi_env env, napi_callback_info info);
 
+    /**
+     * @brief  Get a view on the value bytes of an item, as an ArrayBuffer which refers to the
+     * shared memory. The storage stays open until the ArrayBuffer is collected.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return ArrayBuffer or nullptr if the item was not found.
+     */
+    static napi_value viewItem(napi_env env, napi_callback_info info);
+
     /**
      * @brief  Remove an item.
      *
@@ -159,6 +234,109 @@ public:
      */
     static napi_value removeItem(napi_env env, napi_callback_info info);
 
+    /**
+     * @brief  Get several items in one call. If an array is passed after the keys, the tags of
+     * the found items are set at the same positions, empty tags being left unset.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Array of the item values, undefined for the missing items.
+     */
+    static napi_value getItems(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Set several items in one call, optionally all or none of them.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Array of the errors of the items, null for the items which were set,
+     * or nullptr if every item was set.
+     */
+    static napi_value setItems(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Remove several items in one call.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Count of removed items.
+     */
+    static napi_value removeItems(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Remove the items whose key starts with a prefix.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Count of removed items.
+     */
+    static napi_value removePrefix(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Remove the items associated to a tag.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Count of removed items.
+     */
+    static napi_value removeByTag(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Get a batch of keys, resuming a scan of all the keys.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Object holding the keys of the batch and the cursor of the next batch, 0 once the
+     * scan is complete.
+     */
+    static napi_value scan(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Get the keys which start with a prefix, in their byte order.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Array of keys.
+     */
+    static napi_value scanPrefix(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Get the keys from a first one up to a last one excluded, in their byte order.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Array of keys.
+     */
+    static napi_value range(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Get the keys of the items associated to a tag.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Array of keys.
+     */
+    static napi_value keysByTag(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Count the items associated to a tag.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Count of items.
+     */
+    static napi_value countByTag(napi_env env, napi_callback_info info);
+
     /**
      * @brief  Remove all the items.
      *
@@ -169,6 +347,46 @@ public:
      */
     static napi_value clear(napi_env env, napi_callback_info info);
 
+    /**
+     * @brief  Add a number to an item, 1 by default.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return new value of the item.
+     */
+    static napi_value increment(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Subtract a number from an item, 1 by default.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return new value of the item.
+     */
+    static napi_value decrement(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Set an item only if its current value is equal to the expected one.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return boolean value, true if the item was set.
+     */
+    static napi_value compareAndSet(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Set an item and get its previous value.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return previous item value or nullptr if the item did not exist.
+     */
+    static napi_value getAndSet(napi_env env, napi_callback_info info);
+
     /**
      * @brief  Lock the storage for writing and reading items.
      *
@@ -199,7 +417,130 @@ public:
      */
     static napi_value tryToLock(napi_env env, napi_callback_info info);
 
+    /**
+     * @brief  Lock the storage for reading items. Other readers are not blocked.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return nullptr.
+     */
+    static napi_value lockShared(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Unlock the storage for reading items.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return nullptr.
+     */
+    static napi_value unlockShared(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Get an item without blocking the main thread: the item is read by a worker thread.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Promise of the item value, or of undefined if the item was not found.
+     */
+    static napi_value getItemAsync(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Set an item without blocking the main thread: the item is written by a worker
+     * thread.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Promise resolved once the item is set.
+     */
+    static napi_value setItemAsync(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Lock writing on the storage without blocking the main thread: a worker thread waits
+     * for the storage on behalf of the main thread, which then owns the lock.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return Promise resolved once the main thread owns the lock.
+     */
+    static napi_value lockAsync(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Start watching the changes of the items, or replace the watched keys: a thread
+     * waits for the changes recorded by every process and dispatches those of the watched keys
+     * to the main thread.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return nullptr.
+     */
+    static napi_value watch(napi_env env, napi_callback_info info);
+
+    /**
+     * @brief  Stop watching the changes of the items.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     *
+     * @return nullptr.
+     */
+    static napi_value unwatch(napi_env env, napi_callback_info info);
+
 private:
+    /**
+     * @brief  Add a number to an item.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     * @param sign 1 to increment the item, -1 to decrement it.
+     *
+     * @return new value of the item.
+     */
+    static napi_value addToItem(napi_env env, napi_callback_info info, double sign);
+
+    /**
+     * @brief  Remove the items which match a prefix or a tag.
+     *
+     * @param env Nodejs environment handler.
+     * @param info Callback parameters.
+     * @param byTag true to match the tag of the items, false to match the prefix of their key.
+     *
+     * @return Count of removed items.
+     */
+    static napi_value removeMatching(napi_env env, napi_callback_info info, bool byTag);
+
+    /**
+     * @brief  Stop the watcher of the changes of a storage, if it has one.
+     *
+     * @param env Nodejs environment handler, nullptr once the environment is torn down.
+     * @param storage Watched storage.
+     */
+    static void stopWatching(napi_env env, storage::SharedStorage* storage);
+
+    /**
+     * @brief  Stop the watchers of all the storages, before the environment is torn down.
+     *
+     * @param arg Unused.
+     */
+    static void stopWatchers(void* arg);
+
+    /**
+     * @brief  Read the options of a new storage from a JavaScript object.
+     *
+     * @param env Nodejs environment handler.
+     * @param value Options object, its unknown properties are ignored.
+     * @param[out] options Options of the new storage.
+     *
+     * @return napi_ok if reading the options succeeded.
+     */
+    static napi_status getStorageOptions(napi_env env, napi_value value,
+                                         storage::StorageOptions& options);
+
     /**
      * @brief  Throw JavaScript exception according to the passed status.
      *
@@ -222,6 +563,61 @@ private:
     static napi_status throw_error(napi_env env, unsigned int status,
                                    const std::string& identifier);
 
+    /**
+     * @brief  Create JavaScript error according to the passed status.
+     *
+     * @param env Nodejs environment handler.
+     * @param status Status for which create the error.
+     * @param identifier String that identifies the storage or the item.
+     * @param[out] error Created error or nullptr if the status is eOk.
+     *
+     * @return napi_ok if creating the error succeeded.
+     */
+    static napi_status create_error(napi_env env, unsigned int status,
+                                    const std::string& identifier, napi_value* error);
+
+    /**
+     * @brief  Run an operation on a worker thread and settle its promise once it completed. If
+     * the current thread locked the storage, the operation is run at once instead, since a worker
+     * thread would wait for the current thread to unlock it.
+     *
+     * @param env Nodejs environment handler.
+     * @param instance Storage instance, referenced until the operation completed.
+     * @param operation Operation to run.
+     *
+     * @return Promise of the result of the operation, or nullptr if queuing it failed.
+     */
+    static napi_value queueOperation(napi_env env, napi_value instance,
+                                     std::unique_ptr<AsyncOperation> operation);
+
+    /**
+     * @brief  Run an operation, on a worker thread.
+     *
+     * @param env Nodejs environment handler.
+     * @param data Operation to run.
+     */
+    static void executeOperation(napi_env env, void* data);
+
+    /**
+     * @brief  Settle the promise of an operation run by a worker thread, then release it.
+     *
+     * @param env Nodejs environment handler.
+     * @param status napi_ok, unless the operation was cancelled.
+     * @param data Completed operation.
+     */
+    static void completeOperation(napi_env env, napi_status status, void* data);
+
+    /**
+     * @brief  Settle the promise of a completed operation: it is resolved with the result of the
+     * operation, or rejected with its error.
+     *
+     * @param env Nodejs environment handler.
+     * @param operation Completed operation.
+     *
+     * @return napi_ok if settling the promise succeeded.
+     */
+    static napi_status settleOperation(napi_env env, AsyncOperation& operation);
+
     static napi_ref m_constructor;
 };
 
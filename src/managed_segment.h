@@ -0,0 +1,60 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    managed_segment.h
+ */
+
+#ifndef MANAGED_SEGMENT_H_
+#define MANAGED_SEGMENT_H_
+
+
+// Includes.
+#include "storage_mutex.h"
+#include <boost/interprocess/indexes/iset_index.hpp>
+#include <boost/interprocess/managed_external_buffer.hpp>
+#include <boost/interprocess/mem_algo/rbtree_best_fit.hpp>
+
+
+namespace storage
+{
+
+/**
+ * @brief  Mutexes of the allocator and of the named objects of a memory segment. They share the
+ * recursive mutex bound while the segment is constructed.
+ */
+struct SegmentMutexFamily
+{
+    typedef SegmentMutex mutex_type;
+    typedef SegmentMutex recursive_mutex_type;
+};
+
+/**
+ * @brief  Memory segment of a shared storage. Its allocator takes the segment mutex of the storage,
+ * because the writers of different shards allocate concurrently, from every process.
+ */
+using ManagedSegment = boost::interprocess::basic_managed_external_buffer<
+    char, boost::interprocess::rbtree_best_fit<SegmentMutexFamily>,
+    boost::interprocess::iset_index>;
+
+/**
+ * @brief  Manager of the memory segment of a shared storage.
+ */
+using SegmentManager = ManagedSegment::segment_manager;
+
+} // namespace storage
+
+#endif /* MANAGED_SEGMENT_H_ */
@@ -20,7 +20,6 @@
 
 
 #include "napi_helpers.h"
-#include <vector>
 
 
 bool napi_helpers::isString(napi_env env, napi_value value)
@@ -111,6 +110,36 @@ napi_status napi_helpers::getValueStringUTF8(napi_env env, napi_value value, std
     return status;
 }
 
+napi_status napi_helpers::getValueStringUTF8(napi_env env, napi_value value, StringBuffer& buffer)
+{
+    size_t length = 0;
+    napi_status status = napi_get_value_string_utf8(env, value, buffer.m_local,
+                                                    StringBuffer::kLocalSize, &length);
+    if (status == napi_ok)
+    {
+        buffer.m_data = buffer.m_local;
+        buffer.m_length = length;
+
+        // a multi-byte character may have been dropped if the inline buffer is nearly full
+        if ((length + 4) >= StringBuffer::kLocalSize)
+        {
+            status = napi_get_value_string_utf8(env, value, nullptr, 0, &length);
+            if (status == napi_ok)
+            {
+                buffer.m_heap.resize(length + 1);
+                status = napi_get_value_string_utf8(env, value, buffer.m_heap.data(), length + 1,
+                                                    &length);
+            }
+            if (status == napi_ok)
+            {
+                buffer.m_data = buffer.m_heap.data();
+                buffer.m_length = length;
+            }
+        }
+    }
+    return status;
+}
+
 napi_status napi_helpers::createValueStringUTF8(const std::string& string, napi_env env,
                                                 napi_value* value)
 {
@@ -170,3 +199,26 @@ napi_status napi_helpers::parse(napi_env env, const std::string& string, napi_va
     }
     return status;
 }
+
+size_t napi_helpers::getElementSize(napi_typedarray_type type)
+{
+    switch (type)
+    {
+    case napi_int16_array:
+    case napi_uint16_array:
+        return 2;
+
+    case napi_int32_array:
+    case napi_uint32_array:
+    case napi_float32_array:
+        return 4;
+
+    case napi_float64_array:
+    case napi_bigint64_array:
+    case napi_biguint64_array:
+        return 8;
+
+    default:
+        return 1;
+    }
+}
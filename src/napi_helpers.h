@@ -24,10 +24,65 @@
 
 #include <node_api.h>
 #include <string>
+#include <vector>
 
 
 namespace napi_helpers
 {
+/**
+ * @brief  UTF-8 string buffer. Strings up to 255 bytes are stored inline, so that reading short
+ * strings such as item keys requires no heap allocation.
+ */
+class StringBuffer
+{
+public:
+    /**
+     * @brief  Constructor.
+     */
+    StringBuffer() : m_data(m_local), m_length(0) { m_local[0] = '\0'; }
+
+    /**
+     * @brief  Deleted copy constructor.
+     */
+    StringBuffer(const StringBuffer&) = delete;
+
+    /**
+     * @brief  Deleted copy assignment.
+     */
+    StringBuffer& operator=(const StringBuffer&) = delete;
+
+    /**
+     * @brief  Get the string bytes.
+     *
+     * @return Null-terminated string bytes.
+     */
+    const char* data() const { return m_data; }
+
+    /**
+     * @brief  Get the string length.
+     *
+     * @return Length in bytes of the string.
+     */
+    size_t length() const { return m_length; }
+
+    /**
+     * @brief  Copy the buffer into a string.
+     *
+     * @return Copy of the buffer.
+     */
+    std::string str() const { return std::string(m_data, m_length); }
+
+private:
+    friend napi_status getValueStringUTF8(napi_env env, napi_value value, StringBuffer& buffer);
+
+    static const size_t kLocalSize = 256;
+
+    char m_local[kLocalSize];
+    std::vector<char> m_heap;
+    const char* m_data;
+    size_t m_length;
+};
+
 /**
  * @brief  string type checking.
  *
@@ -119,6 +174,17 @@ bool isBool(napi_env env, napi_value value);
  */
 napi_status getValueStringUTF8(napi_env env, napi_value value, std::string& string);
 
+/**
+ * @brief read a string from a value without heap allocation for short strings.
+ *
+ * @param env Nodejs environment handler.
+ * @param value Value from which read the string.
+ * @param[out] buffer Read string.
+ *
+ * @return napi_ok if reading the string succeeded.
+ */
+napi_status getValueStringUTF8(napi_env env, napi_value value, StringBuffer& buffer);
+
 /**
  * @brief  create a string value.
  *
@@ -152,6 +218,15 @@ napi_status stringify(napi_env env, napi_value value, std::string& string);
  */
 napi_status parse(napi_env env, const std::string& string, napi_value* value);
 
+/**
+ * @brief  Get the size of the elements of a typed array.
+ *
+ * @param type Type of the typed array.
+ *
+ * @return Size in bytes of an element.
+ */
+size_t getElementSize(napi_typedarray_type type);
+
 } // namespace napi_helpers
 
 #endif /* NAPI_HELPERS_H_ */
@@ -21,11 +21,113 @@
 #ifndef SHARED_ITEM_H_
 #define SHARED_ITEM_H_
 
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <utility>
 
 namespace storage
 {
 
+/**
+ * @brief  Item key class.
+ * This class is a lightweight view on the bytes of a key, it does not own them. The hash of the key
+ * is computed once at construction time and reused by every lookup.
+ */
+class ItemKey
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    ItemKey() = delete;
+
+    /**
+     * @brief  Constructor.
+     *
+     * @param key Bytes of the key, they must outlive the item key.
+     * @param length Length in bytes of the key.
+     */
+    ItemKey(const char* key, size_t length)
+    : m_data(key), m_length(length), m_hash(hash(key, length))
+    {
+    }
+
+    /**
+     * @brief  Constructor.
+     *
+     * @param key Null-terminated key, it must outlive the item key.
+     */
+    ItemKey(const char* key) : ItemKey(key, std::strlen(key)) {}
+
+    /**
+     * @brief  Constructor.
+     *
+     * @param key Key, it must outlive the item key.
+     */
+    ItemKey(const std::string& key) : ItemKey(key.data(), key.size()) {}
+
+    /**
+     * @brief  Deleted constructor: a temporary string would not outlive the item key.
+     */
+    ItemKey(std::string&&) = delete;
+
+    /**
+     * @brief  Get the bytes of the key.
+     *
+     * @return Bytes of the key, not null-terminated.
+     */
+    const char* data() const { return m_data; }
+
+    /**
+     * @brief  Get the length of the key.
+     *
+     * @return Length in bytes of the key.
+     */
+    size_t length() const { return m_length; }
+
+    /**
+     * @brief  Get the hash of the key.
+     *
+     * @return Hash of the key.
+     */
+    uint64_t getHash() const { return m_hash; }
+
+    /**
+     * @brief  Copy the key into a string.
+     *
+     * @return Copy of the key.
+     */
+    std::string str() const { return std::string(m_data, m_length); }
+
+    /**
+     * @brief  Compute the hash of a key. The hash only depends on the key bytes so that it is the
+     * same in every process.
+     *
+     * @param key Key to hash.
+     * @param length Length in bytes of the key.
+     *
+     * @return Hash of the key.
+     */
+    static uint64_t hash(const char* key, size_t length)
+    {
+        // 64 bits FNV-1a
+        uint64_t result = 14695981039346656037ULL;
+        for (size_t iter = 0; iter < length; ++iter)
+        {
+            result ^= static_cast<unsigned char>(key[iter]);
+            result *= 1099511628211ULL;
+        }
+        return result;
+    }
+
+private:
+    const char* m_data;
+    size_t m_length;
+    uint64_t m_hash;
+};
+
+
 /**
  *  @brief  Item types.
  */
@@ -34,7 +136,76 @@ enum ItemType
     eNone = 0,
     eBool = 1,
     eDouble = 2,
-    eString = 3
+    eString = 3,
+    eBinary = 4
+};
+
+
+/**
+ * @brief  Binary value class.
+ * This class holds raw bytes, which may contain nulls and need not be valid UTF-8. A binary value
+ * either views bytes owned by the caller, so that they are copied once into the storage, or owns
+ * the bytes read from the storage.
+ */
+class BinaryValue
+{
+public:
+    /**
+     * @brief  Default constructor, empty value.
+     */
+    BinaryValue() : m_view(nullptr), m_length(0) {}
+
+    /**
+     * @brief  Constructor, view on bytes.
+     *
+     * @param data Bytes of the value, they must outlive the binary value.
+     * @param length Length in bytes of the value.
+     */
+    BinaryValue(const void* data, size_t length)
+    : m_view(static_cast<const char*>(data)), m_length(length)
+    {
+    }
+
+    /**
+     * @brief  Constructor, take the ownership of bytes.
+     *
+     * @param bytes Bytes of the value.
+     */
+    explicit BinaryValue(std::string&& bytes)
+    : m_bytes(std::move(bytes)), m_view(nullptr), m_length(m_bytes.size())
+    {
+    }
+
+    /**
+     * @brief  Get the bytes of the value.
+     *
+     * @return Bytes of the value.
+     */
+    const char* data() const { return (m_view != nullptr) ? m_view : m_bytes.data(); }
+
+    /**
+     * @brief  Get the length of the value.
+     *
+     * @return Length in bytes of the value.
+     */
+    size_t length() const { return m_length; }
+
+    /**
+     * @brief  Compare the bytes of two values.
+     *
+     * @param other Compared value.
+     *
+     * @return true if both values have the same bytes.
+     */
+    bool operator==(const BinaryValue& other) const
+    {
+        return (m_length == other.m_length) && (std::memcmp(data(), other.data(), m_length) == 0);
+    }
+
+private:
+    std::string m_bytes;
+    const char* m_view;
+    size_t m_length;
 };
 
 
@@ -153,6 +324,19 @@ inline Item<std::string>::Item(const std::string& value, const std::string& tag)
 {
 }
 
+/**
+ * @brief  Binary values specializations.
+ */
+template <> inline Item<BinaryValue>::Item() : m_type(eBinary) {}
+
+template <> inline Item<BinaryValue>::Item(const std::string& tag) : m_type(eBinary), m_tag(tag) {}
+
+template <>
+inline Item<BinaryValue>::Item(const BinaryValue& value, const std::string& tag)
+: m_value(value), m_type(eBinary), m_tag(tag)
+{
+}
+
 } // namespace storage
 
 #endif /* SHARED_STORAGE_H_ */
\ No newline at end of file
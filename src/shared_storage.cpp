@@ -20,47 +20,408 @@
 
 // Local includes.
 #include "shared_storage.h"
+#include "storage_snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 
 namespace storage
 {
 
-SharedStorage::SharedStorage(const std::string& name, const int64_t size)
-: m_name(name), m_segment(boost::interprocess::create_only, name.c_str(), size), m_mutex(nullptr),
-  m_itemInfoMap(nullptr)
+namespace
 {
-    initialize();
+const uint32_t kMaxShardsCount = 16;
+const int64_t kMinShardSize = 64 * 1024;
+const uint32_t kMaxReadersCount = 64;
+const int64_t kMinReaderSize = 16 * 1024;
+const int64_t kSlabSize = 4 * 1024;
+const int64_t kMinChangesCapacity = 256;
+const int64_t kMaxChangesCapacity = 256 * 1024;
+const char kStorageLogKey[] = "__storage_log__";
+const double kMinCompactedFragmentation = 0.1;
+const uint64_t kCompactionBatchSize = 256 * 1024;
+
+/**
+ * @brief  Compute the default count of shards of a storage: small storages are not worth being
+ * sharded.
+ */
+uint32_t getDefaultShardsCount(const int64_t size)
+{
+    int64_t count = size / kMinShardSize;
+    if (count < 1)
+    {
+        count = 1;
+    }
+    else if (count > kMaxShardsCount)
+    {
+        count = kMaxShardsCount;
+    }
+    return static_cast<uint32_t>(count);
+}
+
+/**
+ * @brief  Compute the count of lock-free reader slots of a storage.
+ */
+uint32_t getReadersCount(const int64_t size)
+{
+    int64_t count = size / kMinReaderSize;
+    if (count < 1)
+    {
+        count = 1;
+    }
+    else if (count > kMaxReadersCount)
+    {
+        count = kMaxReadersCount;
+    }
+    return static_cast<uint32_t>(count);
+}
+
+/**
+ * @brief  Compute the size of the slabs of a storage. Each shard keeps at least a slab per size
+ * class, which small storages cannot afford.
+ */
+size_t getSlabSize(const int64_t size, uint32_t shardsCount)
+{
+    const int64_t kMinSlabsShare = 16;
+    const int64_t slabsSize = shardsCount * SlabAllocator::kClassesCount * kSlabSize;
+    return (size >= slabsSize * kMinSlabsShare) ? static_cast<size_t>(kSlabSize) : 0;
+}
+
+/**
+ * @brief  Compute the count of bytes of the ring of changes of a storage: a small share of the
+ * storage, none for tiny storages whose items would not fit beside the ring.
+ */
+size_t getChangesCapacity(const int64_t size)
+{
+    const int64_t capacity = std::min(size / 64, kMaxChangesCapacity);
+    return (capacity >= kMinChangesCapacity) ? static_cast<size_t>(capacity) : 0;
+}
+
+/**
+ * @brief  Compute the size of the memory mapped for a storage, which bounds its growth.
+ */
+int64_t getMappedSize(const int64_t size, const int64_t maxSize)
+{
+#ifdef _WIN32
+    // a view cannot span beyond the end of the file which emulates the memory object
+    return size;
+#else
+    return std::max(size, maxSize);
+#endif
+}
+
+/**
+ * @brief  Wait for another process to finish creating a storage.
+ *
+ * @param ready Predicate which is true once the storage is created.
+ */
+template <class P> void waitForStorage(P ready)
+{
+    const int kMaxWaitAttempts = 100000;
+    for (int attempt = 0; !ready(); ++attempt)
+    {
+        if (attempt == kMaxWaitAttempts)
+        {
+            throw boost::interprocess::interprocess_exception("the storage is not initialized.");
+        }
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * @brief  Append the keys of the items which match a predicate to a batch. An unlimited batch
+ * takes the keys of all the items at once, else the batch resumes a scan of the items, which
+ * finds each item once even if the index grows between the batches.
+ *
+ * @param index Index of the items.
+ * @param cursor 0 for the first batch, or the cursor returned by the previous one.
+ * @param count Count of items from which the batch ends, the maximum size_t for no limit.
+ * @param matches Predicate which is true for the infos of the items to collect.
+ * @param[out] keys Keys of the batch, appended to the vector.
+ *
+ * @return Cursor of the next batch, 0 once every item was seen.
+ */
+template <class P>
+uint64_t collectKeys(const ItemIndex& index, uint64_t cursor, size_t count, P matches,
+                     std::vector<std::string>& keys)
+{
+    auto collect = [&](const ItemInfo& info) {
+        if (matches(info))
+        {
+            const ItemKey key = info.getKey();
+            keys.emplace_back(key.data(), key.length());
+        }
+    };
+    if (count == std::numeric_limits<size_t>::max())
+    {
+        index.forEach(collect);
+        return 0;
+    }
+    return index.scan(cursor, count, collect);
+}
+
+/**
+ * @brief  Storages locked for reading by the current thread, once per nested lockShared() call.
+ */
+thread_local std::vector<const SharedStorage*> tSharedLocks;
+} // namespace
+
+
+SharedStorage::SharedStorage(const std::string& name, const int64_t size,
+                             const StorageOptions& options)
+: m_name(name), m_object(boost::interprocess::create_only, name, options.m_backend),
+  m_region(), m_header(nullptr), m_segment(), m_epochs(nullptr), m_changes(nullptr),
+  m_shards(nullptr), m_shardsCount(0), m_log(), m_maintenance(), m_maintenanceMutex(),
+  m_maintenanceCondition(), m_closing(false), m_compacting(false)
+{
+    static_assert(sizeof(SegmentHeader) <= kHeaderSize, "the segment header is too large");
+    try
+    {
+        m_object.lockSharable();
+        const int64_t mappedSize = getMappedSize(size, options.m_maxSize);
+        m_object.truncate(size);
+        m_region = m_object.map(static_cast<std::size_t>(mappedSize));
+        char* address = static_cast<char*>(m_region.get_address());
+        m_header = new (address) SegmentHeader(size, mappedSize, options.m_maxMemory,
+                                               options.m_eviction);
+        {
+            // the mutexes of the allocator refer to the segment mutex of the header
+            SegmentMutex::Binding binding(&m_header->m_segmentMutex);
+            m_segment = ManagedSegment(
+                boost::interprocess::create_only, address + kHeaderSize, size - kHeaderSize);
+        }
+
+        const uint32_t shardsCount = (options.m_shardsCount > 0) ? options.m_shardsCount
+                                                                  : getDefaultShardsCount(size);
+        initialize(shardsCount, getReadersCount(size),
+                   options.m_slabs ? getSlabSize(size, shardsCount) : 0, getChangesCapacity(size),
+                   options.m_orderedKeys, options.m_tagIndex);
+
+        if (!options.m_logPath.empty())
+        {
+            // the recovered operations must not be logged again
+            if (replayLog(options.m_logPath) != eOk)
+            {
+                throw std::runtime_error("cannot replay the operation log");
+            }
+            char* path = static_cast<char*>(m_segment.allocate(options.m_logPath.size()));
+            std::memcpy(path, options.m_logPath.data(), options.m_logPath.size());
+            m_segment.construct<LogSettings>(kStorageLogKey)(
+                path, static_cast<uint32_t>(options.m_logPath.size()),
+                options.m_logFlushInterval, options.m_logFlushCount);
+            attachLog();
+        }
+        m_header->m_state.store(SegmentHeader::kReady, std::memory_order_release);
+    }
+    catch (const std::exception&)
+    {
+        // the name must not stay taken by a storage which cannot be opened
+        StorageObject::remove(name, options.m_backend);
+        throw;
+    }
 }
 
-SharedStorage::SharedStorage(const std::string& name)
-: m_name(name), m_segment(boost::interprocess::open_only, name.c_str()), m_mutex(nullptr),
-  m_itemInfoMap(nullptr)
+SharedStorage::SharedStorage(const std::string& name, StorageBackend backend)
+: m_name(name), m_object(boost::interprocess::open_only, name, backend),
+  m_region(), m_header(nullptr), m_segment(), m_epochs(nullptr), m_changes(nullptr),
+  m_shards(nullptr), m_shardsCount(0), m_log(), m_maintenance(), m_maintenanceMutex(),
+  m_maintenanceCondition(), m_closing(false), m_compacting(false)
 {
-    initialize();
+    // the creator may not have sized the memory object nor initialized it yet
+    waitForStorage([this]() {
+        boost::interprocess::offset_t size = 0;
+        return m_object.getSize(size) && (size >= kHeaderSize);
+    });
+    uint64_t mappedSize = 0;
+    {
+        boost::interprocess::mapped_region headerRegion(m_object.map(kHeaderSize));
+        SegmentHeader* header = static_cast<SegmentHeader*>(headerRegion.get_address());
+        waitForStorage([header]() {
+            return (header->m_state.load(std::memory_order_acquire) == SegmentHeader::kReady);
+        });
+        mappedSize = header->m_maxSize;
+    }
+
+    // the other processes wait for the first one to reset the storage before they use it
+    bool alone = m_object.tryLockExclusive();
+    if (!alone)
+    {
+        m_object.lockSharable();
+    }
+    m_region = m_object.map(static_cast<std::size_t>(mappedSize));
+    char* address = static_cast<char*>(m_region.get_address());
+    m_header = reinterpret_cast<SegmentHeader*>(address);
+    if (alone)
+    {
+        // the exclusive lock is released before the shared one is taken: a process which opens
+        // meanwhile finds the storage already reset by a live process
+        const uint32_t resetting = m_header->m_resettingProcess.load(std::memory_order_acquire);
+        alone = (resetting == 0) || !isProcessAlive(resetting);
+        if (alone)
+        {
+            m_header->m_resettingProcess.store(getCurrentProcessId(), std::memory_order_relaxed);
+
+            // the shards are found through the allocator, which a killed process may have left
+            // locked
+            new (&m_header->m_segmentMutex) boost::interprocess::interprocess_recursive_mutex();
+        }
+        else
+        {
+            m_object.lockSharable();
+        }
+    }
+    m_segment = ManagedSegment(
+        boost::interprocess::open_only, address + kHeaderSize,
+        static_cast<std::size_t>(m_header->m_size.load() - kHeaderSize));
+    initialize(1, 1, 0, 0, false, false);
+    if (alone)
+    {
+        reset();
+        m_object.lockSharable();
+        m_header->m_resettingProcess.store(0, std::memory_order_release);
+    }
+    attachLog();
 }
 
-void SharedStorage::initialize()
+void SharedStorage::initialize(uint32_t shardsCount, uint32_t readersCount, size_t slabSize,
+                               size_t changesCapacity, bool orderedKeys, bool tagIndex)
 {
-    const char kItemInfoMapKey[] = "__item_info_map__";
-    const char kStorageMutexKey[] = "__storage_mutex__";
+    const char kStorageEpochsKey[] = "__storage_epochs__";
+    const char kStorageChangesKey[] = "__storage_changes__";
+    const char kStorageShardsKey[] = "__storage_shards__";
+
+    m_epochs = m_segment.find_or_construct<EpochManager>(kStorageEpochsKey)(
+        m_segment.get_segment_manager(), readersCount);
+    // the changes of tiny storages cannot be watched
+    m_changes = (changesCapacity > 0)
+                    ? m_segment.find_or_construct<ChangeRing>(kStorageChangesKey, std::nothrow)(
+                          m_segment.get_segment_manager(), changesCapacity)
+                    : m_segment.find<ChangeRing>(kStorageChangesKey).first;
 
-    ItemInfoMapAllocator allocator(m_segment.get_segment_manager());
-    m_mutex = m_segment.find_or_construct<boost::interprocess::interprocess_recursive_mutex>(
-        kStorageMutexKey)();
-    m_itemInfoMap = m_segment.find_or_construct<ItemInfoMap>(kItemInfoMapKey)(
-        std::less<boost::interprocess::string>(), allocator);
+    InterprocessAllocator<char> allocator(m_segment.get_segment_manager());
+    m_segment.find_or_construct<StorageShard>(kStorageShardsKey)[shardsCount](
+        allocator, m_epochs, m_header->m_eviction, slabSize, orderedKeys, tagIndex, m_changes);
+
+    // the shards may have been constructed by another process with another count
+    std::pair<StorageShard*, std::size_t> shards = m_segment.find<StorageShard>(kStorageShardsKey);
+    m_shards = shards.first;
+    m_shardsCount = static_cast<uint32_t>(shards.second);
 }
 
-SharedStorage::~SharedStorage() {}
+void SharedStorage::reset()
+{
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        m_shards[iter].m_mutex.reset();
+        m_shards[iter].m_itemIndex.reset();
+    }
+    m_epochs->reset();
+    if (m_changes != nullptr)
+    {
+        m_changes->reset();
+    }
+}
+
+void SharedStorage::attachLog()
+{
+    LogSettings* settings = m_segment.find<LogSettings>(kStorageLogKey).first;
+    if (settings != nullptr)
+    {
+        m_log.reset(new OperationLog(std::string(settings->m_path.get(), settings->m_pathLength),
+                                     settings->m_flushInterval, settings->m_flushCount,
+                                     &settings->m_generation));
+    }
+}
+
+Status SharedStorage::replayLog(const std::string& path)
+{
+    std::vector<std::pair<std::string, uint64_t>> checkpoints;
+    if (!OperationLog::recover(path, checkpoints))
+    {
+        return eCannotCreateStorage;
+    }
+
+    // the operations are replayed on top of the last snapshot which can still be read
+    ChunkedReader reader(path);
+    uint64_t offset = 0;
+    bool restored = false;
+    for (auto iter = checkpoints.rbegin(); !restored && (iter != checkpoints.rend()); ++iter)
+    {
+        restored = (restore(iter->first) == eOk);
+        if (restored)
+        {
+            offset = std::min<uint64_t>(iter->second, reader.getSize());
+        }
+    }
+    if (!restored && !checkpoints.empty())
+    {
+        // a snapshot may have been partially restored
+        clear();
+    }
+
+    // the operations logged while the snapshot was written may be replayed twice, which is harmless
+    Status status = (reader.isOpen() && !reader.seek(offset)) ? eCannotCreateStorage : eOk;
+    LogRecord record;
+    while ((status == eOk) && OperationLog::read(reader, record))
+    {
+        ItemKey key(record.m_key, record.m_keyLength);
+        if (record.m_operation == eLogSet)
+        {
+            std::string tag(record.m_tag, record.m_tagLength);
+            status = writeItem(key, [&](ItemIndex& index, ItemInfo* info) {
+                return writeItemBytes(index, info, key, record.m_type, record.m_value,
+                                      record.m_valueLength, tag, record.m_deadline);
+            });
+        }
+        else if (record.m_operation == eLogRemove)
+        {
+            status = removeItem(key);
+            if (status == eItemNotFound)
+            {
+                status = eOk;
+            }
+        }
+        else if (record.m_operation == eLogClear)
+        {
+            status = clear();
+        }
+    }
+    return status;
+}
+
+SharedStorage::~SharedStorage()
+{
+    if (m_maintenance.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_maintenanceMutex);
+            m_closing = true;
+        }
+        m_maintenanceCondition.notify_one();
+        m_maintenance.join();
+    }
+}
 
 SharedStorage* SharedStorage::create(const std::string& name, const int64_t size, Status& status)
+{
+    return create(name, size, StorageOptions(), status);
+}
+
+SharedStorage* SharedStorage::create(const std::string& name, const int64_t size,
+                                     const StorageOptions& options, Status& status)
 {
     SharedStorage* storage = nullptr;
     status = eOk;
 
     try
     {
-        storage = new SharedStorage(name, size);
+        storage = new SharedStorage(name, size, options);
     }
     catch (const std::exception&)
     {
@@ -71,13 +432,19 @@ SharedStorage* SharedStorage::create(const std::string& name, const int64_t size
 }
 
 SharedStorage* SharedStorage::open(const std::string& name, Status& status)
+{
+    return open(name, eSharedMemory, status);
+}
+
+SharedStorage* SharedStorage::open(const std::string& name, StorageBackend backend,
+                                   Status& status)
 {
     SharedStorage* storage = nullptr;
     status = eOk;
 
     try
     {
-        storage = new SharedStorage(name);
+        storage = new SharedStorage(name, backend);
     }
     catch (const std::exception&)
     {
@@ -89,104 +456,1152 @@ SharedStorage* SharedStorage::open(const std::string& name, Status& status)
 
 Status SharedStorage::destroy(const std::string& name)
 {
-    bool destroyed = boost::interprocess::shared_memory_object::remove(name.c_str());
+    return destroy(name, eSharedMemory);
+}
+
+Status SharedStorage::destroy(const std::string& name, StorageBackend backend)
+{
+    bool destroyed = StorageObject::remove(name, backend);
     return destroyed ? eOk : eCannotDestroyStorage;
 }
 
 Status SharedStorage::destroy()
 {
-    bool destroyed = boost::interprocess::shared_memory_object::remove(m_name.c_str());
-    return destroyed ? eOk : eCannotDestroyStorage;
+    return destroy(m_name, m_object.getBackend());
 }
 
-Status SharedStorage::removeItem(const std::string& key)
+bool SharedStorage::grow(uint32_t generation)
 {
-    Status status = eOk;
-    boost::interprocess::string ipStrKey(key.c_str());
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_recursive_mutex> lock(
-        *m_mutex);
+    if (lock() != eOk)
+    {
+        return false;
+    }
 
-    ItemInfoMap::iterator info = m_itemInfoMap->find(ipStrKey);
-    if (info != m_itemInfoMap->end())
+    bool grown = (m_header->m_generation.load() != generation);
+    const uint64_t size = m_header->m_size.load();
+    if (!grown && (size < m_header->m_maxSize))
     {
-        ItemDestructor itemDestructor(*this);
-        status = getItem<ItemDestructor>(key, info->second, itemDestructor);
-        if (status == eOk)
+        const uint64_t newSize = std::min(size * 2, m_header->m_maxSize);
+        try
+        {
+            // the pages beyond the old end are already mapped by every process
+            m_object.truncate(static_cast<boost::interprocess::offset_t>(newSize));
+            m_segment.grow(static_cast<std::size_t>(newSize - size));
+            m_header->m_size.store(newSize);
+            m_header->m_generation.fetch_add(1);
+            grown = true;
+        }
+        catch (const std::exception&)
+        {
+            grown = false;
+        }
+    }
+    unlock();
+    return grown;
+}
+
+void SharedStorage::startMaintenance()
+{
+    std::lock_guard<std::mutex> lock(m_maintenanceMutex);
+    if (!m_maintenance.joinable() && !m_closing)
+    {
+        m_maintenance = std::thread(&SharedStorage::runMaintenance, this);
+    }
+}
+
+void SharedStorage::runMaintenance()
+{
+    const std::chrono::milliseconds kMaintenanceInterval(100);
+    std::unique_lock<std::mutex> lock(m_maintenanceMutex);
+
+    // the fragmentation which a batch could not reduce, the compaction waits until it changes
+    double idleFragmentation = -1;
+    while (!m_closing)
+    {
+        m_maintenanceCondition.wait_for(lock, kMaintenanceInterval, [this]() { return m_closing; });
+        if (!m_closing)
+        {
+            lock.unlock();
+            removeExpired();
+            if (m_compacting.load() && (this->lock() == eOk))
+            {
+                const double fragmentation = getFragmentation();
+                this->unlock();
+                uint64_t relocated = 0;
+                if ((fragmentation >= kMinCompactedFragmentation) &&
+                    (fragmentation != idleFragmentation) &&
+                    (relocateBlocks(kCompactionBatchSize, relocated) == 0))
+                {
+                    idleFragmentation = fragmentation;
+                }
+            }
+            lock.lock();
+        }
+    }
+}
+
+size_t SharedStorage::removeExpired()
+{
+    if (isLockedShared())
+    {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        size_t expired = 0;
+        do
+        {
+            // the shard is released between batches so that its writers are not delayed
+            boost::interprocess::scoped_lock<StorageMutex> lock(m_shards[iter].m_mutex);
+            expired = m_shards[iter].m_itemIndex.expire(kExpirationBatch);
+            count += expired;
+        } while (expired == kExpirationBatch);
+    }
+    return count;
+}
+
+int64_t SharedStorage::getUsedMemory() const
+{
+    uint64_t used = m_segment.get_size() - m_segment.get_free_memory();
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        used -= std::min(used, m_shards[iter].m_itemIndex.getSlabsFreeMemory());
+    }
+    return static_cast<int64_t>(used);
+}
+
+uint64_t SharedStorage::getExpiredCount() const
+{
+    uint64_t count = 0;
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        count += m_shards[iter].m_itemIndex.getExpiredCount();
+    }
+    return count;
+}
+
+Status SharedStorage::compact(CompactionReport& report)
+{
+    Status status = lock();
+    if (status != eOk)
+    {
+        return status;
+    }
+
+    // the retired blocks are not free memory yet, they would hide what is left to merge
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        m_shards[iter].m_itemIndex.reclaimRetired();
+    }
+    report.m_fragmentationBefore = getFragmentation();
+    report.m_fragmentationAfter = report.m_fragmentationBefore;
+    report.m_relocatedCount = 0;
+    unlock();
+
+    if (report.m_fragmentationBefore < kMinCompactedFragmentation)
+    {
+        return eOk;
+    }
+
+    // each pass frees the blocks which the next one may fill, until no block moves down
+    const uint64_t maxSize = static_cast<uint64_t>(m_segment.get_size());
+    uint64_t copied = 0;
+    uint64_t size = 0;
+    do
+    {
+        size = relocateBlocks(maxSize - copied, report.m_relocatedCount);
+        copied += size;
+    } while ((size > 0) && (copied < maxSize));
+
+    lock();
+    report.m_fragmentationAfter = getFragmentation();
+    unlock();
+    return eOk;
+}
+
+uint64_t SharedStorage::relocateBlocks(uint64_t maxSize, uint64_t& relocatedCount)
+{
+    std::vector<RelocatableBlock> blocks;
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        boost::interprocess::scoped_lock<StorageMutex> lock(m_shards[iter].m_mutex);
+        m_shards[iter].m_itemIndex.getRelocatableBlocks(iter, blocks);
+    }
+
+    // the highest blocks move first, so that the memory they free joins the free memory above them
+    // instead of opening holes between the blocks which stay
+    std::sort(blocks.begin(), blocks.end(),
+              [](const RelocatableBlock& first, const RelocatableBlock& second) {
+                  return first.m_bytes > second.m_bytes;
+              });
+    uint64_t copied = 0;
+    for (auto iter = blocks.begin(); (iter != blocks.end()) && (copied < maxSize); ++iter)
+    {
+        // the shard is released between blocks so that its writers are not delayed
+        boost::interprocess::scoped_lock<StorageMutex> lock(m_shards[iter->m_shard].m_mutex);
+        const size_t size = m_shards[iter->m_shard].m_itemIndex.relocateBlock(*iter);
+        if (size > 0)
+        {
+            copied += size;
+            ++relocatedCount;
+        }
+    }
+
+    // the previous copies must be deallocated for the free memory to coalesce
+    for (uint32_t iter = 0; (copied > 0) && (iter < m_shardsCount); ++iter)
+    {
+        boost::interprocess::scoped_lock<StorageMutex> lock(m_shards[iter].m_mutex);
+        m_shards[iter].m_itemIndex.reclaimRetired();
+    }
+    return copied;
+}
+
+void SharedStorage::startCompaction()
+{
+    m_compacting.store(true);
+    startMaintenance();
+}
+
+double SharedStorage::getFragmentation()
+{
+    const std::size_t freeMemory = m_segment.get_free_memory();
+    if (freeMemory == 0)
+    {
+        return 0;
+    }
+
+    // the allocator hands out its largest free block when no block has the preferred size
+    std::size_t largest = freeMemory;
+    char* reuse = nullptr;
+    char* block = m_segment.get_segment_manager()->allocation_command<char>(
+        boost::interprocess::allocate_new | boost::interprocess::nothrow_allocation, 1, largest,
+        reuse);
+    if (block == nullptr)
+    {
+        largest = 0;
+    }
+    else
+    {
+        m_segment.deallocate(block);
+    }
+    return 1.0 - static_cast<double>(std::min(largest, freeMemory)) / freeMemory;
+}
+
+bool SharedStorage::makeRoom(StorageShard& shard, uint32_t generation,
+                             const std::vector<uint64_t>* kept)
+{
+    if (m_header->m_eviction == eNoEviction)
+    {
+        return grow(generation);
+    }
+    if (isOverMemoryLimit())
+    {
+        return evict(shard, kept) || grow(generation);
+    }
+    if (grow(generation) || evict(shard, kept))
+    {
+        return true;
+    }
+
+    // the shard of the item may be empty while the others fill the storage
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        if (evict(m_shards[m_header->m_evictionHand.fetch_add(1) % m_shardsCount], kept))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SharedStorage::evict(StorageShard& shard, const std::vector<uint64_t>* kept)
+{
+    const size_t kEvictionBatch = 8;
+    boost::interprocess::scoped_lock<StorageMutex> lock(shard.m_mutex);
+    const size_t evicted = shard.m_itemIndex.evict(kEvictionBatch, kept);
+    m_header->m_evictedCount.fetch_add(evicted);
+    return (evicted > 0);
+}
+
+void SharedStorage::reduceMemory()
+{
+    // a whole turn of the shards without eviction means that nothing is left to evict
+    uint32_t idleShards = 0;
+    while (isOverMemoryLimit() && (idleShards < m_shardsCount))
+    {
+        if (evict(m_shards[m_header->m_evictionHand.fetch_add(1) % m_shardsCount]))
+        {
+            idleShards = 0;
+        }
+        else
         {
-            status = itemDestructor.getStatus();
+            ++idleShards;
         }
-        if ((status == eOk) || (status == eItemNotFound))
+    }
+}
+
+Status SharedStorage::writeItemBytes(ItemIndex& index, ItemInfo* info, const ItemKey& key,
+                                     ItemType type, const char* data, size_t length,
+                                     const std::string& tag, uint64_t deadline)
+{
+    try
+    {
+        if (info != nullptr)
         {
-            (*m_itemInfoMap).erase(info);
+            index.update(*info, type, data, length, tag, deadline);
         }
         else
         {
-            status = eCannotRemoveItem;
+            index.insert(key, type, data, length, tag, deadline);
+        }
+    }
+    catch (const std::exception&)
+    {
+        return eCannotConstructItem;
+    }
+
+    // the shard is still locked, so the log records the writes of a key in their order
+    if (m_log && !m_log->appendSet(key, type, data, length, tag, deadline))
+    {
+        return eCannotWriteLog;
+    }
+    return eOk;
+}
+
+Status SharedStorage::viewItem(const ItemKey& key, ItemView& view)
+{
+    view.reset();
+    StorageShard& shard = getShard(key);
+    bool found = false;
+    {
+        boost::interprocess::sharable_lock<StorageMutex> lock(shard.m_mutex,
+                                                              boost::interprocess::defer_lock);
+        if (!isLockedShared())
+        {
+            lock.lock();
+        }
+        found = shard.m_itemIndex.pin(key, view.m_type, view.m_block, view.m_copy, view.m_tag);
+
+        // the length of a pinned block is overwritten once a writer unlinks it
+        if (view.m_block != nullptr)
+        {
+            view.m_length = static_cast<size_t>(view.m_block->m_length);
+        }
+        else
+        {
+            view.m_length = view.m_copy.size();
+        }
+    }
+    return found ? eOk : eItemNotFound;
+}
+
+Status SharedStorage::removeItem(const ItemKey& key)
+{
+    return writeItem(key, [&](ItemIndex& index, ItemInfo* info) {
+        if (info == nullptr)
+        {
+            return eItemNotFound;
+        }
+        index.erase(*info);
+        return (m_log && !m_log->appendRemove(key)) ? eCannotWriteLog : eOk;
+    });
+}
+
+void SharedStorage::readItems(const std::vector<ItemKey>& keys, std::vector<ItemType>& types,
+                              std::vector<std::string>& values, std::vector<std::string>& tags)
+{
+    types.assign(keys.size(), eNone);
+    values.assign(keys.size(), std::string());
+    tags.assign(keys.size(), std::string());
+    std::vector<size_t> contended;
+    {
+        // a single reader slot for the whole batch, unless writers are already excluded
+        EpochGuard guard(*m_epochs);
+        const bool lockFree = guard.isEntered() || isLockedShared();
+        for (size_t iter = 0; iter < keys.size(); ++iter)
+        {
+            ItemIndex& index = getShard(keys[iter]).m_itemIndex;
+            ItemIndex::ReadStatus readStatus = ItemIndex::eContended;
+            for (int attempt = 0; lockFree && (readStatus == ItemIndex::eContended) &&
+                                  (attempt < kMaxReadAttempts);
+                 ++attempt)
+            {
+                readStatus = index.read(keys[iter], types[iter], values[iter], tags[iter]);
+            }
+            if (readStatus == ItemIndex::eContended)
+            {
+                contended.push_back(iter);
+            }
+            else if (readStatus != ItemIndex::eRead)
+            {
+                types[iter] = eNone;
+            }
+        }
+    }
+
+    // the keys which writers kept busy are read under the lock of their shard
+    std::vector<size_t> order = orderByShard(
+        contended.size(), [&](size_t iter) -> const ItemKey& { return keys[contended[iter]]; });
+    size_t next = 0;
+    while (next < order.size())
+    {
+        StorageShard& shard = getShard(keys[contended[order[next]]]);
+        boost::interprocess::sharable_lock<StorageMutex> lock(shard.m_mutex);
+        for (; (next < order.size()) && (&getShard(keys[contended[order[next]]]) == &shard);
+             ++next)
+        {
+            const size_t position = contended[order[next]];
+            if (shard.m_itemIndex.read(keys[position], types[position], values[position],
+                                       tags[position]) != ItemIndex::eRead)
+            {
+                types[position] = eNone;
+            }
+        }
+    }
+}
+
+Status SharedStorage::setItems(const std::vector<ItemUpdate>& updates, bool atomic,
+                               std::vector<Status>& statuses)
+{
+    statuses.assign(updates.size(), eOk);
+    std::vector<size_t> order = orderByShard(
+        updates.size(), [&](size_t iter) -> const ItemKey& { return updates[iter].m_key; });
+    if (std::any_of(updates.begin(), updates.end(),
+                    [](const ItemUpdate& update) { return (update.m_ttl > 0); }))
+    {
+        startMaintenance();
+    }
+
+    if (atomic)
+    {
+        // as for restore(), making room relocks the shards, which the current thread owns, and
+        // it must not evict the items which the batch already wrote
+        Status status = lock();
+        std::vector<PreviousItem> previous;
+        std::vector<uint64_t> written;
+        size_t next = 0;
+        uint32_t generation = 0;
+        while (status == eOk)
+        {
+            generation = m_header->m_generation.load();
+            status = writeItems(updates, order, next, order.size(), statuses, &previous);
+            if (status != eCannotConstructItem)
+            {
+                break;
+            }
+            for (size_t iter = written.size(); iter < next; ++iter)
+            {
+                written.push_back(updates[order[iter]].m_key.getHash());
+            }
+            std::sort(written.begin(), written.end());
+            if (!makeRoom(getShard(updates[order[next]].m_key), generation, &written))
+            {
+                break;
+            }
+            previous.pop_back();
+            status = eOk;
+        }
+        if (status == eCannotConstructItem)
+        {
+            previous.pop_back();
+            if (rollBack(updates, order, previous) != eOk)
+            {
+                status = eCannotRollBack;
+            }
+        }
+        if (status != eCannotUpgradeLock)
+        {
+            unlock();
+        }
+
+        if (status == eOk)
+        {
+            // a log which cannot be written does not undo the batch
+            auto failed = std::find_if(statuses.begin(), statuses.end(),
+                                       [](Status itemStatus) { return (itemStatus != eOk); });
+            status = (failed != statuses.end()) ? *failed : eOk;
         }
+        statuses.assign(updates.size(), status);
     }
     else
     {
-        status = eItemNotFound;
+        size_t next = 0;
+        while (next < order.size())
+        {
+            StorageShard& shard = getShard(updates[order[next]].m_key);
+            size_t end = next;
+            while ((end < order.size()) && (&getShard(updates[order[end]].m_key) == &shard))
+            {
+                ++end;
+            }
+
+            if (isLockedShared() && !shard.m_mutex.isOwnedByCurrentThread())
+            {
+                // waiting for the exclusive ownership would wait for the current thread itself
+                for (; next < end; ++next)
+                {
+                    statuses[order[next]] = eCannotUpgradeLock;
+                }
+            }
+
+            // an item which cannot be constructed even once room was made is skipped
+            while (next < end)
+            {
+                Status status = eOk;
+                uint32_t generation = 0;
+                do
+                {
+                    generation = m_header->m_generation.load();
+                    boost::interprocess::scoped_lock<StorageMutex> lock(shard.m_mutex);
+                    status = writeItems(updates, order, next, end, statuses, nullptr);
+                    shard.m_itemIndex.expire(kExpirationBatch);
+                } while ((status == eCannotConstructItem) && makeRoom(shard, generation));
+                if (status == eCannotConstructItem)
+                {
+                    ++next;
+                }
+            }
+        }
     }
 
-    return status;
+    if (isOverMemoryLimit())
+    {
+        reduceMemory();
+    }
+    auto failed = std::find_if(statuses.begin(), statuses.end(),
+                               [](Status status) { return (status != eOk); });
+    return (failed != statuses.end()) ? *failed : eOk;
 }
 
-Status SharedStorage::clear()
+Status SharedStorage::writeItems(const std::vector<ItemUpdate>& updates,
+                                 const std::vector<size_t>& order, size_t& next, size_t end,
+                                 std::vector<Status>& statuses,
+                                 std::vector<PreviousItem>* previous)
 {
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_recursive_mutex> lock(
-        *m_mutex);
+    const uint64_t now = getCurrentTime();
+    for (; next < end; ++next)
+    {
+        const ItemUpdate& update = updates[order[next]];
+        ItemIndex& index = getShard(update.m_key).m_itemIndex;
+        ItemInfo* info = index.find(update.m_key);
+        if (previous != nullptr)
+        {
+            PreviousItem item = {eNone, std::string(), std::string(), 0};
+            if (info != nullptr)
+            {
+                item.m_type = info->getType();
+                item.m_value.assign(info->getValueData(), info->getValueLength());
+                info->getTag(item.m_tag);
+                item.m_deadline = info->getDeadline();
+            }
+            previous->push_back(std::move(item));
+        }
+
+        const uint64_t deadline = (update.m_ttl > 0) ? (now + update.m_ttl) : 0;
+        Status status = writeItemBytes(index, info, update.m_key, update.m_type,
+                                       update.m_value.data(), update.m_value.size(),
+                                       update.m_tag, deadline);
+        statuses[order[next]] = status;
+        if (status == eCannotConstructItem)
+        {
+            return status;
+        }
+    }
+    return eOk;
+}
 
+Status SharedStorage::rollBack(const std::vector<ItemUpdate>& updates,
+                               const std::vector<size_t>& order,
+                               const std::vector<PreviousItem>& previous)
+{
+    // the batch failed, so that making room may evict any item, even one it wrote
+    Status result = eOk;
+    for (size_t iter = previous.size(); iter > 0; --iter)
+    {
+        const ItemKey& key = updates[order[iter - 1]].m_key;
+        const PreviousItem& item = previous[iter - 1];
+        StorageShard& shard = getShard(key);
+        ItemIndex& index = shard.m_itemIndex;
+        if (item.m_type != eNone)
+        {
+            // making room may evict the item, which is then looked up again
+            Status status = eOk;
+            uint32_t generation = 0;
+            do
+            {
+                generation = m_header->m_generation.load();
+                status = writeItemBytes(index, index.find(key), key, item.m_type,
+                                        item.m_value.data(), item.m_value.size(), item.m_tag,
+                                        item.m_deadline);
+            } while ((status == eCannotConstructItem) && makeRoom(shard, generation));
+            if (status == eCannotConstructItem)
+            {
+                result = eCannotRollBack;
+            }
+        }
+        else
+        {
+            ItemInfo* info = index.find(key);
+            if (info != nullptr)
+            {
+                index.erase(*info);
+                if (m_log)
+                {
+                    m_log->appendRemove(key);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+size_t SharedStorage::removeItems(const std::vector<ItemKey>& keys, std::vector<Status>& statuses)
+{
+    statuses.assign(keys.size(), eItemNotFound);
+    std::vector<size_t> order =
+        orderByShard(keys.size(), [&](size_t iter) -> const ItemKey& { return keys[iter]; });
+    size_t removed = 0;
+    size_t next = 0;
+    while (next < order.size())
+    {
+        StorageShard& shard = getShard(keys[order[next]]);
+        const bool canLock = !isLockedShared() || shard.m_mutex.isOwnedByCurrentThread();
+        boost::interprocess::scoped_lock<StorageMutex> lock(shard.m_mutex,
+                                                            boost::interprocess::defer_lock);
+        if (canLock)
+        {
+            lock.lock();
+        }
+        for (; (next < order.size()) && (&getShard(keys[order[next]]) == &shard); ++next)
+        {
+            const ItemKey& key = keys[order[next]];
+            Status& status = statuses[order[next]];
+            ItemInfo* info = canLock ? shard.m_itemIndex.find(key) : nullptr;
+            if (!canLock)
+            {
+                status = eCannotUpgradeLock;
+            }
+            else if (info != nullptr)
+            {
+                shard.m_itemIndex.erase(*info);
+                ++removed;
+                status = (m_log && !m_log->appendRemove(key)) ? eCannotWriteLog : eOk;
+            }
+        }
+        if (canLock)
+        {
+            shard.m_itemIndex.expire(kExpirationBatch);
+        }
+    }
+    return removed;
+}
+
+template <class C> Status SharedStorage::removeBatches(C collect, uint64_t budget, size_t& removed)
+{
+    // without budget, each shard is cleared in a single batch
+    const size_t count = (budget == 0) ? std::numeric_limits<size_t>::max() : kRemovalBatch;
+    removed = 0;
     Status status = eOk;
-    for (ItemInfoMap::iterator iter = m_itemInfoMap->begin();
-         (iter != m_itemInfoMap->end()) && (status == eOk); ++iter)
+    std::vector<std::string> keys;
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        StorageShard& shard = m_shards[iter];
+        if (isLockedShared() && !shard.m_mutex.isOwnedByCurrentThread())
+        {
+            return eCannotUpgradeLock;
+        }
+
+        uint64_t cursor = 0;
+        do
+        {
+            boost::interprocess::scoped_lock<StorageMutex> lock(shard.m_mutex);
+            const auto start = std::chrono::steady_clock::now();
+            do
+            {
+                keys.clear();
+                cursor = collect(static_cast<const ItemIndex&>(shard.m_itemIndex), cursor, count,
+                                 keys);
+                for (const std::string& key : keys)
+                {
+                    ItemInfo* info = shard.m_itemIndex.find(key);
+                    if (info != nullptr)
+                    {
+                        shard.m_itemIndex.erase(*info);
+                        ++removed;
+                        if (m_log && !m_log->appendRemove(key))
+                        {
+                            status = eCannotWriteLog;
+                        }
+                    }
+                }
+            } while ((cursor != 0) && ((std::chrono::steady_clock::now() - start) <
+                                       std::chrono::milliseconds(budget)));
+            shard.m_itemIndex.expire(kExpirationBatch);
+        } while (cursor != 0);
+    }
+    return status;
+}
+
+Status SharedStorage::removePrefix(const std::string& prefix, uint64_t budget, size_t& removed)
+{
+    const ItemKey from(prefix);
+    auto matches = [&prefix](const ItemKey& key) {
+        return (key.length() >= prefix.size()) &&
+               (std::memcmp(key.data(), prefix.data(), prefix.size()) == 0);
+    };
+    return removeBatches(
+        [&](const ItemIndex& index, uint64_t cursor, size_t count,
+            std::vector<std::string>& keys) {
+            if (!index.isOrdered())
+            {
+                return collectKeys(
+                    index, cursor, count,
+                    [&matches](const ItemInfo& info) { return matches(info.getKey()); }, keys);
+            }
+
+            // the removed keys leave the ordered keys, so each batch starts from the prefix again
+            index.forEachOrdered(from, [&](const ItemKey& key) {
+                if (!matches(key))
+                {
+                    return false;
+                }
+                keys.emplace_back(key.data(), key.length());
+                return keys.size() < count;
+            });
+            return static_cast<uint64_t>((keys.size() == count) ? 1 : 0);
+        },
+        budget, removed);
+}
+
+Status SharedStorage::removeByTag(const std::string& tag, uint64_t budget, size_t& removed)
+{
+    return removeBatches(
+        [&tag](const ItemIndex& index, uint64_t cursor, size_t count,
+               std::vector<std::string>& keys) {
+            if (!index.isTagged() || tag.empty())
+            {
+                return collectKeys(
+                    index, cursor, count,
+                    [&tag](const ItemInfo& info) { return info.hasTag(tag); }, keys);
+            }
+
+            // the removed items leave the tag index, so each batch starts from its first key
+            index.forEachTagged(tag, [&](const ItemKey& key) {
+                keys.emplace_back(key.data(), key.length());
+                return keys.size() < count;
+            });
+            return static_cast<uint64_t>((keys.size() == count) ? 1 : 0);
+        },
+        budget, removed);
+}
+
+void SharedStorage::getKeysByTag(const std::string& tag, std::vector<std::string>& keys)
+{
+    for (uint32_t shard = 0; shard < m_shardsCount; ++shard)
     {
-        ItemDestructor itemDestructor(*this);
-        status =
-            getItem<ItemDestructor>(std::string(iter->first.c_str()), iter->second, itemDestructor);
+        boost::interprocess::sharable_lock<StorageMutex> lock(m_shards[shard].m_mutex,
+                                                               boost::interprocess::defer_lock);
+        if (!isLockedShared())
+        {
+            lock.lock();
+        }
+        const ItemIndex& index = m_shards[shard].m_itemIndex;
+        if (index.isTagged() && !tag.empty())
+        {
+            index.forEachTagged(tag, [&keys](const ItemKey& key) {
+                keys.emplace_back(key.data(), key.length());
+                return true;
+            });
+        }
+        else
+        {
+            const uint64_t now = getCurrentTime();
+            index.forEach([&](const ItemInfo& info) {
+                if (info.hasTag(tag) && !info.isExpired(now))
+                {
+                    const ItemKey key = info.getKey();
+                    keys.emplace_back(key.data(), key.length());
+                }
+            });
+        }
+    }
+}
+
+size_t SharedStorage::countByTag(const std::string& tag)
+{
+    size_t count = 0;
+    for (uint32_t shard = 0; shard < m_shardsCount; ++shard)
+    {
+        boost::interprocess::sharable_lock<StorageMutex> lock(m_shards[shard].m_mutex,
+                                                               boost::interprocess::defer_lock);
+        if (!isLockedShared())
+        {
+            lock.lock();
+        }
+        const ItemIndex& index = m_shards[shard].m_itemIndex;
+        if (index.isTagged() && !tag.empty())
+        {
+            count += index.countTagged(tag);
+        }
+        else
+        {
+            const uint64_t now = getCurrentTime();
+            index.forEach([&](const ItemInfo& info) {
+                if (info.hasTag(tag) && !info.isExpired(now))
+                {
+                    ++count;
+                }
+            });
+        }
+    }
+    return count;
+}
+
+uint64_t SharedStorage::scan(uint64_t cursor, size_t count, std::vector<std::string>& keys)
+{
+    // the cursor holds the shard into its high bits and the bucket of the shard into its low bits
+    uint32_t shard = static_cast<uint32_t>(cursor >> 32);
+    uint64_t bucket = cursor & 0xFFFFFFFF;
+    const size_t end = keys.size() + count;
+    while ((shard < m_shardsCount) && (keys.size() < end))
+    {
+        {
+            boost::interprocess::sharable_lock<StorageMutex> lock(m_shards[shard].m_mutex,
+                                                                   boost::interprocess::defer_lock);
+            if (!isLockedShared())
+            {
+                lock.lock();
+            }
+            bucket = m_shards[shard].m_itemIndex.scan(
+                bucket, end - keys.size(), [&keys](const ItemInfo& info) {
+                    const ItemKey key = info.getKey();
+                    keys.emplace_back(key.data(), key.length());
+                });
+        }
+        if (bucket == 0)
+        {
+            ++shard;
+        }
+    }
+    return (shard < m_shardsCount) ? ((static_cast<uint64_t>(shard) << 32) | bucket) : 0;
+}
+
+template <class P>
+void SharedStorage::getOrderedKeys(const ItemKey& from, P inRange, size_t limit,
+                                   std::vector<std::string>& keys)
+{
+    auto isBefore = [](const std::string& left, const std::string& right) {
+        return isKeyBefore(left.data(), left.size(), right.data(), right.size());
+    };
+
+    const size_t first = keys.size();
+    for (uint32_t shard = 0; (shard < m_shardsCount) && (limit > 0); ++shard)
+    {
+        const size_t merged = keys.size();
+        {
+            boost::interprocess::sharable_lock<StorageMutex> lock(m_shards[shard].m_mutex,
+                                                                   boost::interprocess::defer_lock);
+            if (!isLockedShared())
+            {
+                lock.lock();
+            }
+            const ItemIndex& index = m_shards[shard].m_itemIndex;
+            if (index.isOrdered())
+            {
+                index.forEachOrdered(from, [&](const ItemKey& key) {
+                    if (!inRange(key))
+                    {
+                        return false;
+                    }
+                    keys.emplace_back(key.data(), key.length());
+                    return (keys.size() - merged) < limit;
+                });
+            }
+            else
+            {
+                const uint64_t now = getCurrentTime();
+                index.forEach([&](const ItemInfo& info) {
+                    const ItemKey key = info.getKey();
+                    if (!info.isExpired(now) &&
+                        !isKeyBefore(key.data(), key.length(), from.data(), from.length()) &&
+                        inRange(key))
+                    {
+                        keys.emplace_back(key.data(), key.length());
+                    }
+                });
+                std::sort(keys.begin() + merged, keys.end(), isBefore);
+            }
+        }
+
+        // the keys beyond the limit cannot be part of the result anymore
+        std::inplace_merge(keys.begin() + first, keys.begin() + merged, keys.end(), isBefore);
+        if ((keys.size() - first) > limit)
+        {
+            keys.resize(first + limit);
+        }
+    }
+}
+
+void SharedStorage::scanPrefix(const std::string& prefix, size_t limit,
+                               std::vector<std::string>& keys)
+{
+    getOrderedKeys(
+        ItemKey(prefix), [&prefix](const ItemKey& key) {
+            return (key.length() >= prefix.size()) &&
+                   (std::memcmp(key.data(), prefix.data(), prefix.size()) == 0);
+        },
+        limit, keys);
+}
+
+void SharedStorage::range(const std::string& start, const std::string& end, size_t limit,
+                          std::vector<std::string>& keys)
+{
+    getOrderedKeys(
+        ItemKey(start), [&end](const ItemKey& key) {
+            return end.empty() || isKeyBefore(key.data(), key.length(), end.data(), end.size());
+        },
+        limit, keys);
+}
+
+Status SharedStorage::increment(const ItemKey& key, double delta, double& result)
+{
+    return writeItem(key, [&](ItemIndex& index, ItemInfo* info) {
+        double value = 0.0;
+        std::string tag;
+        uint64_t deadline = 0;
+        if (info != nullptr)
+        {
+            if ((info->getType() != eDouble) || (info->getValueLength() != sizeof(double)))
+            {
+                return eItemTypeMismatch;
+            }
+            std::memcpy(&value, info->getValueData(), sizeof(double));
+            info->getTag(tag);
+            deadline = info->getDeadline();
+        }
+
+        // numbers are stored inline, so the value is updated in place under the slot version
+        value += delta;
+        Status status =
+            writeItemBytes(index, info, key, eDouble, reinterpret_cast<const char*>(&value),
+                           sizeof(double), tag, deadline);
         if (status == eOk)
         {
-            status = itemDestructor.getStatus();
+            result = value;
         }
-        if (status == eItemNotFound)
+        return status;
+    });
+}
+
+Status SharedStorage::snapshot(const std::string& path)
+{
+    // the operations logged from now on may be missing from the snapshot
+    const LogPosition logPosition = m_log ? m_log->getPosition() : LogPosition{0, 0};
+    SnapshotWriter writer(path);
+    bool written = true;
+    std::string tag;
+    const uint64_t now = getCurrentTime();
+    for (uint32_t iter = 0; written && (iter < m_shardsCount); ++iter)
+    {
         {
-            status = eOk;
+            boost::interprocess::sharable_lock<StorageMutex> lock(m_shards[iter].m_mutex,
+                                                                  boost::interprocess::defer_lock);
+            if (!isLockedShared())
+            {
+                lock.lock();
+            }
+            m_shards[iter].m_itemIndex.forEach([&](const ItemInfo& info) {
+                if (!info.isExpired(now))
+                {
+                    info.getTag(tag);
+                    writer.append(info.getKey(), info.getType(), info.getValueData(),
+                                  info.getValueLength(), tag, info.getDeadline());
+                }
+            });
         }
+
+        // the file is written once the shard is released
+        written = writer.flush();
     }
-    if (status == eOk)
+    written = writer.close() && written;
+    if (!written)
     {
-        m_itemInfoMap->clear();
+        return eCannotWriteSnapshot;
     }
-    else
+    return (m_log && !m_log->checkpoint(path, logPosition, [this]() { return (lock() == eOk); },
+                                        [this]() { unlock(); }))
+               ? eCannotWriteLog
+               : eOk;
+}
+
+Status SharedStorage::restore(const std::string& path)
+{
+    SnapshotReader reader(path);
+    if (!reader.isValid())
+    {
+        return eCannotReadSnapshot;
+    }
+
+    Status status = lock();
+    if (status != eOk)
     {
-        status = eCannotClearStorage;
+        return status;
+    }
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        m_shards[iter].m_itemIndex.clear();
+    }
+    postClear();
+    if (m_log && !m_log->appendClear())
+    {
+        status = eCannotWriteLog;
+    }
+
+    SnapshotEntry entry;
+    const uint64_t now = getCurrentTime();
+    while ((status == eOk) && reader.next(entry))
+    {
+        if ((entry.m_deadline != 0) && (entry.m_deadline <= now))
+        {
+            continue;
+        }
+        ItemKey key(entry.m_key, entry.m_keyLength);
+        std::string tag(entry.m_tag, entry.m_tagLength);
+        ItemIndex& index = getShard(key).m_itemIndex;
+        uint32_t generation = 0;
+        do
+        {
+            // growing relocks the shards, which the current thread already owns
+            generation = m_header->m_generation.load();
+            status = writeItemBytes(index, index.find(key), key, entry.m_type, entry.m_value,
+                                    entry.m_valueLength, tag, entry.m_deadline);
+        } while ((status == eCannotConstructItem) && grow(generation));
+    }
+    unlock();
+    return status;
+}
+
+Status SharedStorage::clear()
+{
+    Status status = lock();
+    if (status == eOk)
+    {
+        for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+        {
+            m_shards[iter].m_itemIndex.clear();
+        }
+        postClear();
+        if (m_log && !m_log->appendClear())
+        {
+            status = eCannotWriteLog;
+        }
+        unlock();
     }
     return status;
 }
 
-void SharedStorage::lock()
+Status SharedStorage::lock()
+{
+    return lockFor(getCurrentThreadId());
+}
+
+Status SharedStorage::lockFor(uint64_t owner)
+{
+    if (isLockedShared() && !m_shards[0].m_mutex.isOwnedByCurrentThread())
+    {
+        // the shards would wait for the current thread to release them
+        return eCannotUpgradeLock;
+    }
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        m_shards[iter].m_mutex.lock(owner);
+    }
+    return eOk;
+}
+
+void SharedStorage::beginLockFor()
+{
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+    {
+        m_shards[iter].m_mutex.beginHandOff();
+    }
+}
+
+void SharedStorage::endLockFor()
 {
-    if (m_mutex != nullptr)
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
     {
-        m_mutex->lock();
+        m_shards[iter].m_mutex.endHandOff();
     }
 }
 
 void SharedStorage::unlock()
 {
-    if (m_mutex != nullptr)
+    for (uint32_t iter = m_shardsCount; iter > 0; --iter)
     {
-        m_mutex->unlock();
+        m_shards[iter - 1].m_mutex.unlock();
     }
 }
 
+bool SharedStorage::isLockedByCurrentThread() const
+{
+    // the shards are locked in order, the last one is owned once they all are
+    return (m_shardsCount > 0) && m_shards[m_shardsCount - 1].m_mutex.isOwnedByCurrentThread();
+}
+
 bool SharedStorage::tryToLock()
 {
-    if (m_mutex != nullptr)
+    for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
     {
-        return m_mutex->try_lock();
+        if (!m_shards[iter].m_mutex.try_lock())
+        {
+            // release the shards which are already locked
+            while (iter > 0)
+            {
+                m_shards[--iter].m_mutex.unlock();
+            }
+            return false;
+        }
     }
-    return false;
+    return (m_shardsCount > 0);
+}
+
+void SharedStorage::lockShared()
+{
+    // a nested request would wait for pending writers, which wait for the current thread
+    if (!isLockedShared())
+    {
+        for (uint32_t iter = 0; iter < m_shardsCount; ++iter)
+        {
+            m_shards[iter].m_mutex.lock_sharable();
+        }
+    }
+    tSharedLocks.push_back(this);
+}
+
+void SharedStorage::unlockShared()
+{
+    std::vector<const SharedStorage*>::iterator found =
+        std::find(tSharedLocks.begin(), tSharedLocks.end(), this);
+    if (found != tSharedLocks.end())
+    {
+        tSharedLocks.erase(found);
+        if (!isLockedShared())
+        {
+            for (uint32_t iter = m_shardsCount; iter > 0; --iter)
+            {
+                m_shards[iter - 1].m_mutex.unlock_sharable();
+            }
+        }
+    }
+}
+
+bool SharedStorage::isLockedShared() const
+{
+    return !tSharedLocks.empty() &&
+           (std::find(tSharedLocks.begin(), tSharedLocks.end(), this) != tSharedLocks.end());
 }
 
-} // namespace storage
\ No newline at end of file
+} // namespace storage
@@ -23,38 +23,27 @@
 
 
 // Includes.
+#include "epoch_manager.h"
+#include "item_index.h"
+#include "managed_segment.h"
 #include "shared_item.h"
-#include <boost/interprocess/containers/map.hpp>
-#include <boost/interprocess/containers/string.hpp>
-#include <boost/interprocess/managed_shared_memory.hpp>
-#include <boost/interprocess/sync/interprocess_recursive_mutex.hpp>
+#include "storage_log.h"
+#include "storage_mutex.h"
+#include "storage_object.h"
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/interprocess/sync/sharable_lock.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 
 namespace storage
 {
 
-// Declarations.
-class ItemInfo;
-class ItemDestructor;
-
-// Type defs.
-template <class T>
-using InterprocessAllocator =
-    boost::interprocess::allocator<T, boost::interprocess::managed_shared_memory::segment_manager>;
-
-using ItemInfoMapAllocator =
-    InterprocessAllocator<std::pair<const boost::interprocess::string, ItemInfo>>;
-
-using ItemInfoMap =
-    boost::interprocess::map<boost::interprocess::string, ItemInfo,
-                             std::less<boost::interprocess::string>, ItemInfoMapAllocator>;
-
-using CharAllocator =
-    boost::interprocess::allocator<char,
-                                   boost::interprocess::managed_shared_memory::segment_manager>;
-
-using StringValue = boost::interprocess::basic_string<char, std::char_traits<char>, CharAllocator>;
-
 /**
  *  @brief  Status / Error codes.
  */
@@ -70,428 +59,1396 @@ enum Status
     eCannotReplaceItem = 7,
     eCannotConstructItem = 8,
     eCannotDestroyItem = 9,
-    eCannotClearStorage = 10
+    eCannotClearStorage = 10,
+    eCannotUpgradeLock = 11,
+    eItemTypeMismatch = 12,
+    eCannotWriteSnapshot = 13,
+    eCannotReadSnapshot = 14,
+    eCannotWriteLog = 15,
+    eCannotRollBack = 16
+};
+
+/**
+ * @brief  Options of a new shared storage.
+ */
+struct StorageOptions
+{
+    /**
+     * @brief  Constructor.
+     */
+    StorageOptions()
+    : m_shardsCount(0), m_maxSize(0), m_backend(eSharedMemory), m_logPath(),
+      m_logFlushInterval(10), m_logFlushCount(1024), m_maxMemory(0), m_eviction(eNoEviction),
+      m_slabs(true), m_orderedKeys(false), m_tagIndex(false)
+    {
+    }
+
+    uint32_t m_shardsCount;   ///< Count of shards, 0 to compute it according to the storage size.
+    int64_t m_maxSize;        ///< Size up to which the storage grows when full, 0 not to grow.
+    StorageBackend m_backend; ///< Memory object backing the storage.
+    std::string m_logPath;    ///< Path of the operation log, empty not to log the operations.
+    uint32_t m_logFlushInterval; ///< Maximum delay in milliseconds before logged operations are
+                                 ///< flushed to the disk, 0 to flush each one before returning.
+    uint32_t m_logFlushCount;    ///< Count of logged operations which are flushed without delay.
+    int64_t m_maxMemory;         ///< Memory in bytes above which items are evicted, 0 to only
+                                 ///< evict items when the storage is full.
+    EvictionPolicy m_eviction;   ///< Policy which chooses the evicted items.
+    bool m_slabs; ///< Allocate the small blocks from slabs, if the storage is large enough.
+    bool m_orderedKeys; ///< Keep the keys in their byte order, for the prefix and range queries.
+    bool m_tagIndex;    ///< Keep the keys of the items associated to each tag.
+};
+
+/**
+ * @brief  Outcome of a compaction. The fragmentation is the share of the free memory which is not
+ * part of the largest free block: 0 when the free memory is contiguous, close to 1 when it is
+ * scattered into small blocks.
+ */
+struct CompactionReport
+{
+    /**
+     * @brief  Constructor.
+     */
+    CompactionReport() : m_fragmentationBefore(0), m_fragmentationAfter(0), m_relocatedCount(0)
+    {
+    }
+
+    double m_fragmentationBefore; ///< Fragmentation of the free memory before the compaction.
+    double m_fragmentationAfter;  ///< Fragmentation of the free memory after the compaction.
+    uint64_t m_relocatedCount;    ///< Count of relocated blocks.
 };
 
+
 /**
- *  @brief  Information about shared items. For each item, the storage maintains its type and its
- * tag.
+ * @brief  View on the value of an item, read without copy from the memory segment. The value
+ * block is pinned: writers store the new values of the item into other blocks, and the block is
+ * only deallocated once the view is released, so its bytes stay valid and unchanged meanwhile.
+ * Values small enough to be stored inline are copied instead.
+ *
+ * The view must be released before the storage is closed. A process which dies with views leaks
+ * their blocks.
  */
-class ItemInfo
+class ItemView
+{
+public:
+    /**
+     * @brief  Constructor of an empty view.
+     */
+    ItemView() : m_type(eNone), m_block(nullptr), m_length(0) {}
+
+    /**
+     * @brief  Deleted copy constructor.
+     */
+    ItemView(const ItemView&) = delete;
+
+    /**
+     * @brief  Deleted assignment operator.
+     */
+    ItemView& operator=(const ItemView&) = delete;
+
+    /**
+     * @brief  Destructor, release the view.
+     */
+    ~ItemView() { reset(); }
+
+    /**
+     * @brief  Release the view, the shard lock is not needed.
+     */
+    void reset()
+    {
+        if (m_block != nullptr)
+        {
+            m_block->unpin();
+            m_block = nullptr;
+        }
+        m_type = eNone;
+        m_length = 0;
+        m_copy.clear();
+        m_tag.clear();
+    }
+
+    /**
+     * @brief  Get the type of the item.
+     *
+     * @return Type of the item, eNone if the view is empty.
+     */
+    ItemType getType() const { return m_type; }
+
+    /**
+     * @brief  Get the value bytes.
+     *
+     * @return Value bytes, valid until the view is released.
+     */
+    const char* data() const { return (m_block != nullptr) ? m_block->data() : m_copy.data(); }
+
+    /**
+     * @brief  Get the length of the value.
+     *
+     * @return Length in bytes of the value.
+     */
+    size_t length() const { return m_length; }
+
+    /**
+     * @brief  Get the tag associated to the item.
+     *
+     * @return Tag associated to the item.
+     */
+    const std::string& getTag() const { return m_tag; }
+
+    /**
+     * @brief  Check if the value is read from the memory segment.
+     *
+     * @return true if a value block is pinned, false if the value was copied.
+     */
+    bool isPinned() const { return (m_block != nullptr); }
+
+private:
+    friend class SharedStorage;
+
+    ItemType m_type;
+    ValueBlock* m_block;
+    size_t m_length;
+    std::string m_copy;
+    std::string m_tag;
+};
+
+
+/**
+ * @brief  Update of an item within a batch. The value is kept as the bytes which are stored, so
+ * that a batch may mix value types.
+ */
+class ItemUpdate
 {
 public:
     /**
      * @brief  Deleted constructor.
      */
-    ItemInfo() = delete;
+    ItemUpdate() = delete;
 
     /**
      * @brief  Constructor.
      *
-     * @param type Type of the shared item.
-     * @param tag Tag associated to the shared item.
+     * @param key Key of the item, its bytes must outlive the update.
+     * @param item Descriptor of the item.
+     * @param ttl Delay in milliseconds after which the item expires, 0 if it does not expire.
+     * @tparam T Value type of the item.
+     */
+    template <class T>
+    ItemUpdate(const ItemKey& key, const Item<T>& item, uint64_t ttl)
+    : m_key(key), m_type(item.getType()), m_value(getBytes(item.getValue())),
+      m_tag(item.getTag()), m_ttl(ttl)
+    {
+    }
+
+    /**
+     * @brief  Get the key of the item.
+     *
+     * @return Key of the item.
+     */
+    const ItemKey& getKey() const { return m_key; }
+
+private:
+    friend class SharedStorage;
+
+    static std::string getBytes(const std::string& value) { return value; }
+
+    static std::string getBytes(const BinaryValue& value)
+    {
+        return std::string(value.data(), value.length());
+    }
+
+    template <class T> static std::string getBytes(const T& value)
+    {
+        return std::string(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    ItemKey m_key;
+    ItemType m_type;
+    std::string m_value;
+    std::string m_tag;
+    uint64_t m_ttl;
+};
+
+
+/**
+ * @brief  Header at the start of the memory of a shared storage, before its memory segment. The
+ * memory object only spans the current size of the storage, but each process maps the maximum
+ * size at once: growing the storage never moves it, so the other processes have nothing to remap.
+ */
+struct SegmentHeader
+{
+    /**
+     * @brief  Constructor.
+     *
+     * @param size Initial size in bytes of the storage.
+     * @param maxSize Size in bytes up to which the storage may grow.
+     * @param maxMemory Memory in bytes above which items are evicted, 0 for no limit.
+     * @param eviction Policy which chooses the evicted items.
+     */
+    SegmentHeader(uint64_t size, uint64_t maxSize, uint64_t maxMemory, EvictionPolicy eviction)
+    : m_state(0), m_generation(0), m_size(size), m_maxSize(maxSize), m_maxMemory(maxMemory),
+      m_eviction(eviction), m_evictionHand(0), m_evictedCount(0), m_resettingProcess(0),
+      m_segmentMutex()
+    {
+    }
+
+    static const uint32_t kReady = 1;
+
+    std::atomic<uint32_t> m_state;         ///< kReady once the storage is initialized.
+    std::atomic<uint32_t> m_generation;    ///< Count of times the storage has grown.
+    std::atomic<uint64_t> m_size;          ///< Current size in bytes of the memory object.
+    uint64_t m_maxSize;                    ///< Size in bytes of the memory mapped by each process.
+    uint64_t m_maxMemory;                  ///< Memory in bytes above which items are evicted.
+    EvictionPolicy m_eviction;             ///< Policy which chooses the evicted items.
+    std::atomic<uint32_t> m_evictionHand;  ///< Next shard from which items are evicted.
+    std::atomic<uint64_t> m_evictedCount;  ///< Count of items evicted since the creation.
+    std::atomic<uint32_t> m_resettingProcess; ///< Process resetting the storage, 0 if none.
+    boost::interprocess::interprocess_recursive_mutex m_segmentMutex; ///< Mutex of the allocator.
+};
+
+/**
+ * @brief  Shard of a shared storage. The items are spread among the shards according to the hash
+ * of their key, and each shard has its own mutex so that accesses to different shards do not
+ * serialize. Writers own the mutex exclusively. Readers copy the items without lock and only
+ * share the mutex when writers keep them retrying.
+ */
+struct StorageShard
+{
+    /**
+     * @brief  Constructor.
+     *
+     * @param allocator Allocator of the item index.
+     * @param epochs Epoch manager of the lock-free readers.
+     * @param policy Policy which chooses the evicted items.
+     * @param slabSize Size in bytes of the slabs of the small blocks, 0 not to use slabs.
+     * @param orderedKeys true to also keep the keys in their byte order.
+     * @param tagIndex true to also keep the keys of the items associated to each tag.
+     * @param changes Ring into which the changes of the items are recorded, nullptr for none.
+     */
+    StorageShard(const InterprocessAllocator<char>& allocator, EpochManager* epochs,
+                 EvictionPolicy policy, size_t slabSize, bool orderedKeys, bool tagIndex,
+                 ChangeRing* changes)
+    : m_mutex(), m_itemIndex(allocator, epochs, policy, slabSize, orderedKeys, tagIndex, changes)
+    {
+    }
+
+    StorageMutex m_mutex;   ///< Mutex of the shard items.
+    ItemIndex m_itemIndex; ///< Index of the shard items.
+};
+
+/**
+ * @brief  native shared storage implementation
+ */
+class SharedStorage
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    SharedStorage() = delete;
+
+    /**
+     * @brief  Destructor.
+     */
+    ~SharedStorage();
+
+    /**
+     * @brief  Create a shared storage.
+     *
+     * @param name Name of the new shared storage.
+     * @param size Size in bytes of the new shared storage.
+     * @param[out] status Status is eOk if creation succeeded
+     * or eCannotCreateStorage if creation failed.
+     *
+     * @return Pointer to a new shared storage.
+     */
+    static SharedStorage* create(const std::string& name, const int64_t size, Status& status);
+
+    /**
+     * @brief  Create a shared storage. If an operation log is set and already exists, the storage
+     * is recovered from it: the last snapshot recorded into the log is restored, then the
+     * operations logged after it are replayed.
+     *
+     * @param name Name of the new shared storage.
+     * @param size Size in bytes of the new shared storage.
+     * @param options Options of the new shared storage.
+     * @param[out] status Status is eOk if creation succeeded
+     * or eCannotCreateStorage if creation failed.
+     *
+     * @return Pointer to a new shared storage.
+     */
+    static SharedStorage* create(const std::string& name, const int64_t size,
+                                 const StorageOptions& options, Status& status);
+
+    /**
+     * @brief  Only open a shared storage.
+     *
+     * @param name Name of the shared storage to open.
+     * @param[out] status Status is eOk if opening succeeded
+     * or eCannotOpenStorage if opening failed.
+     *
+     * @return Pointer to the opened shared storage.
+     */
+    static SharedStorage* open(const std::string& name, Status& status);
+
+    /**
+     * @brief  Only open a shared storage.
+     *
+     * @param name Name of the shared storage to open.
+     * @param backend Memory object backing the shared storage.
+     * @param[out] status Status is eOk if opening succeeded
+     * or eCannotOpenStorage if opening failed.
+     *
+     * @return Pointer to the opened shared storage.
+     */
+    static SharedStorage* open(const std::string& name, StorageBackend backend, Status& status);
+
+    /**
+     * @brief  Destroy a shared storage.
+     *
+     * @param name Name of the shared storage to destroy.
+     *
+     * @return eOk if destruction succeeded
+     * or eCannotDestroyStorage if destruction failed.
+     */
+    static Status destroy(const std::string& name);
+
+    /**
+     * @brief  Destroy a shared storage.
+     *
+     * @param name Name of the shared storage to destroy.
+     * @param backend Memory object backing the shared storage.
+     *
+     * @return eOk if destruction succeeded
+     * or eCannotDestroyStorage if destruction failed.
+     */
+    static Status destroy(const std::string& name, StorageBackend backend);
+
+    /**
+     * @brief  Destroy a shared storage.
+     *
+     * @return eOk if destruction succeeded
+     * or eCannotDestroyStorage if destruction failed.
+     */
+    Status destroy();
+
+    /**
+     * @brief  Insert a new item into the shared storage.
+     *
+     * @param key Key to identify the new item.
+     * @param item Descriptor of the new item.
+     * @tparam T Value type of the item.
+     *
+     * @return eOk if inserting the item succeeded
+     * or eCannotConstructItem if inserting the item failed
+     * or eCannotReplaceItem if an item with the same key cannot be overwritten
+     * or eCannotUpgradeLock if the current thread locked the storage for reading
+     * or eCannotWriteLog if the item was inserted but logging it failed.
+     */
+    template <class T> Status setItem(const ItemKey& key, const Item<T>& item);
+
+    /**
+     * @brief  Insert a new item into the shared storage, which expires after a delay. Expired
+     * items are seen as missing at once, then erased by writers of their shard or by a thread of
+     * the processes which set expiring items.
+     *
+     * @param key Key to identify the new item.
+     * @param item Descriptor of the new item.
+     * @param ttl Delay in milliseconds after which the item expires, 0 if it does not expire.
+     * @tparam T Value type of the item.
+     *
+     * @return eOk if inserting the item succeeded
+     * or eCannotConstructItem if inserting the item failed
+     * or eCannotReplaceItem if an item with the same key cannot be overwritten
+     * or eCannotUpgradeLock if the current thread locked the storage for reading
+     * or eCannotWriteLog if the item was inserted but logging it failed.
+     */
+    template <class T> Status setItem(const ItemKey& key, const Item<T>& item, uint64_t ttl);
+
+    /**
+     * @brief  Get an item already stored in the shared storage. The item is copied before being
+     * consumed, so the consumer does not delay writers.
+     *
+     * @param key Key of the desired item.
+     * @param consumer Consumer of the item.
+     *
+     * an item consumer must implement the template method "set" where T is the item value type:
+     *   template<class T>
+     *   void set(const ItemKey& key, Item<T>& item);
+     *
+     * @return eOk if the item was found
+     * or eItemNotFound if the item doesn't exist
+     * or eUnknownItemType if the item type is unsupported.
+     */
+    template <class C> Status getItem(const ItemKey& key, C& consumer);
+
+    /**
+     * @brief  Get a view on the value of an item, without copying it out of the memory segment.
+     * The shard is only locked for reading while the value block is pinned.
+     *
+     * @param key Key of the desired item.
+     * @param[out] view View on the value, which replaces the previous one.
+     *
+     * @return eOk if the item was found
+     * or eItemNotFound if the item doesn't exist.
+     */
+    Status viewItem(const ItemKey& key, ItemView& view);
+
+    /**
+     * @brief  Remove an item from the shared storage.
+     *
+     * @param key Key of the desired item.
+     *
+     * @return eOk if removing the item succeeded
+     * or eCannotRemoveItem if removing the item failed
+     * or eItemNotFound if the item doesn't exist
+     * or eCannotUpgradeLock if the current thread locked the storage for reading
+     * or eCannotWriteLog if the item was removed but logging it failed.
+     */
+    Status removeItem(const ItemKey& key);
+
+    /**
+     * @brief  Get several items at once. They are read without lock under a single reader slot,
+     * then the keys which writers kept busy are read under the lock of their shard, each shard
+     * being locked once. The items are consumed once every key was read.
+     *
+     * @param keys Keys of the desired items.
+     * @param consumers Consumers of the items, one per key.
+     * @param[out] statuses Status of each key: eOk if the item was found, eItemNotFound if it
+     * doesn't exist or eUnknownItemType if its type is unsupported.
+     * @tparam C Item consumer, as for getItem().
+     *
+     * @return Count of items found.
+     */
+    template <class C>
+    size_t getItems(const std::vector<ItemKey>& keys, std::vector<C>& consumers,
+                    std::vector<Status>& statuses);
+
+    /**
+     * @brief  Insert or overwrite several items at once, each shard being locked once for all its
+     * items. All-or-nothing batches lock the whole storage, and restore the items they already
+     * wrote when an item cannot be written even once room was made.
+     *
+     * @param updates Updates of the items, applied in order.
+     * @param atomic If true, either all the items are written or none is.
+     * @param[out] statuses Status of each update, as for setItem(). For all-or-nothing batches,
+     * every status is the status of the batch.
+     *
+     * @return eOk if every item was written,
+     * eCannotRollBack if an all-or-nothing batch failed and some of its items keep their new value
+     * or the status of the first update which failed.
+     */
+    Status setItems(const std::vector<ItemUpdate>& updates, bool atomic,
+                    std::vector<Status>& statuses);
+
+    /**
+     * @brief  Remove several items at once, each shard being locked once for all its items.
+     *
+     * @param keys Keys of the items.
+     * @param[out] statuses Status of each key, as for removeItem().
+     *
+     * @return Count of removed items.
+     */
+    size_t removeItems(const std::vector<ItemKey>& keys, std::vector<Status>& statuses);
+
+    /**
+     * @brief  Remove the items whose key starts with a prefix. Each shard is locked once for all
+     * its items, unless a time budget is set: the lock is then released between batches whenever
+     * it was held for longer, so that other writers make progress.
+     *
+     * @param prefix Prefix of the keys.
+     * @param budget Maximum time in milliseconds each shard lock is held for, 0 for no limit.
+     * @param[out] removed Count of removed items.
+     *
+     * @return eOk if the items were removed
+     * or eCannotUpgradeLock if the current thread holds a lock for reading
+     * or eCannotWriteLog if a removal could not be logged.
+     */
+    Status removePrefix(const std::string& prefix, uint64_t budget, size_t& removed);
+
+    /**
+     * @brief  Remove the items associated to a tag, as removePrefix() removes keys.
+     *
+     * @param tag Tag of the items, empty for the items without tag.
+     * @param budget Maximum time in milliseconds each shard lock is held for, 0 for no limit.
+     * @param[out] removed Count of removed items.
+     *
+     * @return eOk if the items were removed
+     * or eCannotUpgradeLock if the current thread holds a lock for reading
+     * or eCannotWriteLog if a removal could not be logged.
+     */
+    Status removeByTag(const std::string& tag, uint64_t budget, size_t& removed);
+
+    /**
+     * @brief  Get the keys of the items associated to a tag. Each shard is only locked for reading
+     * while its keys are copied. The shards read the keys of the tag from their tag index if the
+     * storage keeps one, else they filter all their items.
+     *
+     * @param tag Tag of the items, empty for the items without tag.
+     * @param[out] keys Keys of the items, appended to the vector.
+     */
+    void getKeysByTag(const std::string& tag, std::vector<std::string>& keys);
+
+    /**
+     * @brief  Count the items associated to a tag, as getKeysByTag() finds them.
+     *
+     * @param tag Tag of the items, empty for the items without tag.
+     *
+     * @return Count of the items.
+     */
+    size_t countByTag(const std::string& tag);
+
+    /**
+     * @brief  Get the ring into which the changes of the items of every process are recorded.
+     *
+     * @return Ring of the changes, nullptr if the storage was too small to hold it.
+     */
+    ChangeRing* getChanges() { return m_changes; }
+
+    /**
+     * @brief  Get a batch of keys, resuming a scan of all the keys. Each shard is only locked for
+     * reading while a batch of its keys is copied. A key which exists during the whole scan is
+     * returned exactly once, even if items are written or shards grow between the batches. Keys
+     * which are added or removed meanwhile may be returned or not.
+     *
+     * @param cursor 0 to start a scan, or the cursor returned by the previous call.
+     * @param count Count of keys from which the batch ends, it may hold a few more keys.
+     * @param[out] keys Keys of the batch, appended to the vector.
+     *
+     * @return Cursor of the next batch, lower than 2^53, 0 once the scan is complete.
+     */
+    uint64_t scan(uint64_t cursor, size_t count, std::vector<std::string>& keys);
+
+    /**
+     * @brief  Get the keys which start with a prefix, in the order of their bytes. Each shard is
+     * only locked for reading while its keys are copied. The shards find the first keys through
+     * their ordered keys if the storage keeps them, else they filter all their keys.
+     *
+     * @param prefix Prefix of the keys.
+     * @param limit Maximum count of keys.
+     * @param[out] keys Keys found, appended to the vector.
+     */
+    void scanPrefix(const std::string& prefix, size_t limit, std::vector<std::string>& keys);
+
+    /**
+     * @brief  Get the keys from a first one up to a last one excluded, in the order of their bytes.
+     * Each shard is only locked for reading while its keys are copied.
+     *
+     * @param start First key of the range, included.
+     * @param end Key which ends the range, excluded, or empty for the keys after the first one.
+     * @param limit Maximum count of keys.
+     * @param[out] keys Keys found, appended to the vector.
+     */
+    void range(const std::string& start, const std::string& end, size_t limit,
+               std::vector<std::string>& keys);
+
+    /**
+     * @brief  Erase the expired items of every shard, each shard being locked in turn.
+     *
+     * @return Count of erased items.
+     */
+    size_t removeExpired();
+
+    /**
+     * @brief  Add a number to a numeric item, in a single update of its shard. A missing item is
+     * created with the number as value. The item keeps its deadline.
+     *
+     * @param key Key of the item.
+     * @param delta Number to add.
+     * @param[out] result Value of the item once updated.
+     *
+     * @return eOk if updating the item succeeded
+     * or eItemTypeMismatch if the value of the item is not a number
+     * or eCannotConstructItem if creating the item failed
+     * or eCannotUpgradeLock if the current thread locked the storage for reading.
+     */
+    Status increment(const ItemKey& key, double delta, double& result);
+
+    /**
+     * @brief  Subtract a number from a numeric item, in a single update of its shard. A missing
+     * item is created with the opposite of the number as value.
+     *
+     * @param key Key of the item.
+     * @param delta Number to subtract.
+     * @param[out] result Value of the item once updated.
+     *
+     * @return eOk if updating the item succeeded
+     * or eItemTypeMismatch if the value of the item is not a number
+     * or eCannotConstructItem if creating the item failed
+     * or eCannotUpgradeLock if the current thread locked the storage for reading.
+     */
+    Status decrement(const ItemKey& key, double delta, double& result)
+    {
+        return increment(key, -delta, result);
+    }
+
+    /**
+     * @brief  Replace an item only if its current value is equal to the expected one. The tag of
+     * the item is not compared.
+     *
+     * @param key Key of the item.
+     * @param expected Expected value of the item.
+     * @param item Descriptor of the new item.
+     * @param[out] swapped true if the item was replaced.
+     * @tparam T Value type of the expected value.
+     * @tparam U Value type of the new item.
+     *
+     * @return eOk if the item was compared, even if it did not match or does not exist
+     * or eCannotConstructItem if replacing the item failed
+     * or eCannotUpgradeLock if the current thread locked the storage for reading.
+     */
+    template <class T, class U>
+    Status compareAndSet(const ItemKey& key, const T& expected, const Item<U>& item,
+                         bool& swapped);
+
+    /**
+     * @brief  Replace an item and get its previous value, in a single update of its shard. A
+     * missing item is created.
+     *
+     * @param key Key of the item.
+     * @param item Descriptor of the new item.
+     * @param consumer Consumer of the previous item, it is not called if the item did not exist.
+     * @tparam T Value type of the new item.
+     *
+     * an item consumer must implement the template method "set" where T is the item value type:
+     *   template<class T>
+     *   void set(const ItemKey& key, Item<T>& item);
+     *
+     * @return eOk if replacing the item succeeded
+     * or eCannotConstructItem if replacing the item failed
+     * or eCannotUpgradeLock if the current thread locked the storage for reading
+     * or eUnknownItemType if the previous item type is unsupported.
+     */
+    template <class T, class C>
+    Status getAndSet(const ItemKey& key, const Item<T>& item, C& consumer);
+
+    /**
+     * @brief  Clear the shared storage.
+     *
+     * @return eOk if the storage was successfully cleared
+     * or eCannotClearStorage if removing all items failed
+     * or eCannotUpgradeLock if the current thread locked the storage for reading
+     * or eCannotWriteLog if the storage was cleared but logging it failed.
+     */
+    Status clear();
+
+    /**
+     * @brief  Lock writing on the shared storage. All the shards are locked in order.
+     *
+     * @return eOk if locking succeeded
+     * or eCannotUpgradeLock if the current thread locked the storage for reading.
+     */
+    Status lock();
+
+    /**
+     * @brief  Unlock writing on the shared storage.
+     */
+    void unlock();
+
+    /**
+     * @brief  Lock writing on the shared storage on behalf of another thread, which then owns the
+     * storage as if it locked it itself and unlocks it. A helper thread waits for the shards in
+     * place of a thread which must not block. The owner thread must call beginLockFor() before.
+     *
+     * @param owner Identifier of the owner thread, as returned by getCurrentThreadId().
+     *
+     * @return eOk if locking succeeded
+     * or eCannotUpgradeLock if the current thread locked the storage for reading.
+     */
+    Status lockFor(uint64_t owner);
+
+    /**
+     * @brief  Announce that a helper thread will lock the storage on behalf of the current thread
+     * with lockFor(). Until endLockFor() is called, the threads which wait for a shard check
+     * periodically if it was locked on their behalf: the other locks do not pay for the check.
+     */
+    void beginLockFor();
+
+    /**
+     * @brief  End an announcement made by beginLockFor(), once lockFor() returned or will not be
+     * called.
+     */
+    void endLockFor();
+
+    /**
+     * @brief  Check if the current thread locked writing on the shared storage.
+     *
+     * @return true if the current thread holds the writing lock.
+     */
+    bool isLockedByCurrentThread() const;
+
+    /**
+     * @brief Try to lock writing on the shared storage.
+     *
+     * @return true if locking succeeded.
+     */
+    bool tryToLock();
+
+    /**
+     * @brief  Lock reading on the shared storage, so that the current thread gets a consistent view
+     * of several items. Other readers are not blocked, writers wait until the storage is unlocked.
+     * The current thread cannot write until it unlocks the storage, unless it also holds the
+     * writing lock.
+     */
+    void lockShared();
+
+    /**
+     * @brief  Unlock reading on the shared storage.
+     */
+    void unlockShared();
+
+    /**
+     * @brief  Check if the current thread locked reading on the shared storage.
+     *
+     * @return true if the current thread holds a reading lock.
+     */
+    bool isLockedShared() const;
+
+    /**
+     * @brief  Write all the items into a snapshot file. The shards are copied one after the other,
+     * each one only excluding its writers while its items are copied into memory: the snapshot is
+     * consistent per shard, or as a whole if the storage is locked meanwhile. With an operation
+     * log, the snapshot is then recorded into the log so that recovery starts from it.
+     *
+     * @param path Path of the snapshot file, it is overwritten if it exists.
+     *
+     * @return eOk if writing the snapshot succeeded
+     * or eCannotWriteSnapshot if writing the file failed
+     * or eCannotWriteLog if recording the snapshot into the log failed.
+     */
+    Status snapshot(const std::string& path);
+
+    /**
+     * @brief  Replace all the items with the items of a snapshot file. The whole storage is locked
+     * once and the items are inserted straight into the shards.
+     *
+     * @param path Path of the snapshot file.
+     *
+     * @return eOk if restoring the snapshot succeeded
+     * or eCannotReadSnapshot if the file is missing or corrupted, then the items are unchanged
+     * or eCannotConstructItem if the storage is full, then the snapshot is partially restored
+     * or eCannotUpgradeLock if the current thread locked the storage for reading.
+     */
+    Status restore(const std::string& path);
+
+    /**
+     * @brief  Relocate the items towards the start of the memory segment, so that free memory
+     * scattered by removals coalesces into blocks large enough for new items. The blocks are
+     * relocated from the end of the segment downwards, each one only excluding the writers of its
+     * shard. The sweep is repeated until no block moves down. Nothing is relocated if the
+     * fragmentation is already low.
+     *
+     * @param[out] report Fragmentation before and after the compaction.
+     *
+     * @return eOk if the storage was compacted
+     * or eCannotUpgradeLock if the current thread locked the storage for reading.
+     */
+    Status compact(CompactionReport& report);
+
+    /**
+     * @brief  Compact the storage incrementally from a thread of the current process: a batch of
+     * blocks is relocated periodically while the fragmentation is high, until stopCompaction() is
+     * called.
+     */
+    void startCompaction();
+
+    /**
+     * @brief  Stop the incremental compaction of the current process.
+     */
+    void stopCompaction() { m_compacting.store(false); }
+
+    /**
+     * @brief  Get the current size of the shared storage, which increases when it grows.
+     *
+     * @return Size in bytes of the shared storage.
+     */
+    int64_t getSize() const { return static_cast<int64_t>(m_header->m_size.load()); }
+
+    /**
+     * @brief  Get the memory used by the items of the shared storage. The free chunks of the slabs
+     * are not counted.
+     *
+     * @return Size in bytes of the allocated memory.
+     */
+    int64_t getUsedMemory() const;
+
+    /**
+     * @brief  Get the count of items evicted to make room for others.
+     *
+     * @return Count of items evicted since the creation of the storage.
+     */
+    uint64_t getEvictedCount() const { return m_header->m_evictedCount.load(); }
+
+    /**
+     * @brief  Get the count of expired items which were erased.
+     *
+     * @return Count of items erased after their deadline, since the creation of the storage.
+     */
+    uint64_t getExpiredCount() const;
+
+    /**
+     * @brief  Get the count of shards of the shared storage.
+     *
+     * @return Count of shards.
+     */
+    uint32_t getShardsCount() const { return m_shardsCount; }
+
+private:
+    /**
+     * @brief Constructor.
+     *
+     * @param name Name of the new shared storage.
+     * @param size Size in bytes of the new shared storage.
+     * @param options Options of the new shared storage.
+     */
+    SharedStorage(const std::string& name, const int64_t size, const StorageOptions& options);
+
+    /**
+     * @brief Constructor.
+     *
+     * @param name Name of the shared storage to open.
+     * @param backend Memory object backing the shared storage.
+     */
+    SharedStorage(const std::string& name, StorageBackend backend);
+
+    /**
+     *  @brief  Initialize the shared storage.
+     *
+     * @param shardsCount Count of shards to construct if the storage is not initialized yet.
+     * @param readersCount Count of lock-free reader slots to construct if the storage is not
+     * initialized yet.
+     * @param slabSize Size in bytes of the slabs of each shard if the storage is not initialized
+     * yet, 0 not to use slabs.
+     * @param changesCapacity Count of bytes of the ring of changes if the storage is not
+     * initialized yet, 0 to only find the ring of an initialized storage.
+     * @param orderedKeys true to keep the keys in their byte order if the storage is not
+     * initialized yet.
+     * @param tagIndex true to keep the keys of the items associated to each tag if the storage
+     * is not initialized yet.
      */
-    ItemInfo(ItemType type, const std::string& tag, const InterprocessAllocator<char>& allocator)
-    : m_type(type), m_tag(tag.c_str(), allocator)
-    {
-    }
+    void initialize(uint32_t shardsCount, uint32_t readersCount, size_t slabSize,
+                    size_t changesCapacity, bool orderedKeys, bool tagIndex);
 
     /**
-     * @brief  Get the type of the shared item.
-     *
-     * @return Type of the shared item.
+     * @brief  Reset the state which the processes that used the storage before left into it: the
+     * locks and their owners, the reader slots, the views and the watchers. A storage backed by a
+     * file keeps that state after its processes died or the host restarted.
      */
-    ItemType getType() const { return m_type; }
+    void reset();
 
     /**
-     * @brief  Set the tag associated to the shared item.
-     *
-     * @param tag Tag associated to the shared item.
+     * @brief  Open the operation log shared by the processes, if the storage has one.
      */
-    void setTag(const std::string& tag) { m_tag.assign(tag.c_str()); }
+    void attachLog();
 
     /**
-     * @brief  Get the tag associated to the shared item.
+     * @brief  Recover the items from an operation log, before the log is attached.
+     *
+     * @param path Path of the operation log.
      *
-     * @param[out] tag Tag associated to the shared item.
+     * @return eOk if the log is missing or was replayed
+     * or the status of the operation which could not be replayed.
      */
-    void getTag(std::string& tag) const { tag.assign(m_tag.c_str()); }
-
-private:
-    ItemType m_type;
-    StringValue m_tag;
-};
+    Status replayLog(const std::string& path);
 
-
-/**
- * @brief  native shared storage implementation
- */
-class SharedStorage
-{
-public:
     /**
-     * @brief  Deleted constructor.
+     * @brief  Get the keys which are not before a bound and match a predicate, in the order of
+     * their bytes. The keys of each shard are merged with the keys of the previous ones.
+     *
+     * @param from Lower bound of the keys.
+     * @param inRange Predicate which is false from the first key after the matching ones.
+     * @param limit Maximum count of keys.
+     * @param[out] keys Keys found, appended to the vector.
      */
-    SharedStorage() = delete;
+    template <class P>
+    void getOrderedKeys(const ItemKey& from, P inRange, size_t limit,
+                        std::vector<std::string>& keys);
 
     /**
-     * @brief  Destructor.
+     * @brief  Remove batches of items from each shard, until a shard has no item left to remove.
+     *
+     * @param collect Function called with the index of a shard, the cursor of the batch, the
+     * count of items from which the batch ends and the vector to which the keys of the batch are
+     * appended, returns the cursor of the next batch or 0 once the shard has no item left to
+     * remove.
+     * @param budget Maximum time in milliseconds each shard lock is held for, 0 for no limit.
+     * @param[out] removed Count of removed items.
+     *
+     * @return eOk if the items were removed
+     * or eCannotUpgradeLock if the current thread holds a lock for reading
+     * or eCannotWriteLog if a removal could not be logged.
      */
-    ~SharedStorage();
+    template <class C> Status removeBatches(C collect, uint64_t budget, size_t& removed);
 
     /**
-     * @brief  Create a shared storage.
+     * @brief  Get the shard which holds an item.
      *
-     * @param name Name of the new shared storage.
-     * @param size Size in bytes of the new shared storage.
-     * @param[out] status Status is eOk if creation succeeded
-     * or eCannotCreateStorage if creation failed.
+     * @param key Key of the item.
      *
-     * @return Pointer to a new shared storage.
+     * @return Shard of the item.
      */
-    static SharedStorage* create(const std::string& name, const int64_t size, Status& status);
+    StorageShard& getShard(const ItemKey& key) { return m_shards[getShardIndex(key)]; }
 
     /**
-     * @brief  Only open a shared storage.
+     * @brief  Get the index of the shard which holds an item.
      *
-     * @param name Name of the shared storage to open.
-     * @param[out] status Status is eOk if opening succeeded
-     * or eCannotOpenStorage if opening failed.
+     * @param key Key of the item.
      *
-     * @return Pointer to the opened shared storage.
+     * @return Index of the shard of the item.
      */
-    static SharedStorage* open(const std::string& name, Status& status);
+    uint32_t getShardIndex(const ItemKey& key) const
+    {
+        return static_cast<uint32_t>(key.getHash() >> 32) % m_shardsCount;
+    }
 
     /**
-     * @brief  Destroy a shared storage.
+     * @brief  Order the keys of a batch by shard, so that each shard is locked once.
      *
-     * @param name Name of the shared storage to destroy.
+     * @param count Count of keys in the batch.
+     * @param getKey Function which returns the key at a position of the batch.
      *
-     * @return eOk if destruction succeeded
-     * or eCannotDestroyStorage if destruction failed.
+     * @return Positions of the keys, ordered by shard then by position.
      */
-    static Status destroy(const std::string& name);
+    template <class F> std::vector<size_t> orderByShard(size_t count, F getKey) const;
 
     /**
-     * @brief  Destroy a shared storage.
+     * @brief  Copy several items, for getItems().
      *
-     * @return eOk if destruction succeeded
-     * or eCannotDestroyStorage if destruction failed.
+     * @param keys Keys of the items.
+     * @param[out] types Types of the items, eNone for the missing ones.
+     * @param[out] values Bytes of the values.
+     * @param[out] tags Tags of the items.
      */
-    Status destroy();
+    void readItems(const std::vector<ItemKey>& keys, std::vector<ItemType>& types,
+                   std::vector<std::string>& values, std::vector<std::string>& tags);
 
     /**
-     * @brief  Insert a new item into the shared storage.
+     * @brief  State of an item before a batch wrote it, to roll the batch back.
+     */
+    struct PreviousItem
+    {
+        ItemType m_type;     ///< Type of the item, eNone if it did not exist.
+        std::string m_value; ///< Bytes of the value.
+        std::string m_tag;   ///< Tag of the item.
+        uint64_t m_deadline; ///< Time at which the item expires, 0 if it does not expire.
+    };
+
+    /**
+     * @brief  Write updates of a batch, whose shards are locked. Writing stops at the first item
+     * which cannot be constructed, so that room is made before writing it again.
      *
-     * @param key Key to identify the new item.
-     * @param item Descriptor of the new item.
-     * @tparam T Value type of the item.
+     * @param updates Updates of the batch.
+     * @param order Positions of the updates, grouped by shard.
+     * @param[in,out] next Position in order of the first update to write, then of the update
+     * which cannot be constructed.
+     * @param end Position in order after the last update to write.
+     * @param[out] statuses Status of each update.
+     * @param[out] previous Previous state of each written item, or nullptr.
      *
-     * @return eOk if inserting the item succeeded
-     * or eCannotConstructItem if inserting the item failed
-     * or eCannotReplaceItem if an item with the same key cannot be overwritten.
+     * @return eOk if every update was written
+     * or eCannotConstructItem if an item cannot be constructed.
      */
-    template <class T> Status setItem(const std::string& key, const Item<T>& item);
+    Status writeItems(const std::vector<ItemUpdate>& updates, const std::vector<size_t>& order,
+                      size_t& next, size_t end, std::vector<Status>& statuses,
+                      std::vector<PreviousItem>* previous);
 
     /**
-     * @brief  Get an item already stored in the shared storage.
-     *
-     * @param key Key of the desired item.
-     * @param consumer Consumer of the item.
+     * @brief  Restore the items written by a batch, in reverse order. Their shards are locked.
+     * Erasing the new items frees memory, but a previous value which was updated in place may
+     * still lack room once room was made: the item then keeps the value of the batch.
      *
-     * an item consumer must implement the template method "set" where T is the item value type:
-     *   template<class T>
-     *   void set(const std::string& key, Item<T>& item);
+     * @param updates Updates of the batch.
+     * @param order Positions of the updates, grouped by shard.
+     * @param previous Previous state of each written item.
      *
-     * @return eOk if the item was found
-     * or eItemNotFound if the item doesn't exist
-     * or eUnknownItemType if the item type is unsupported.
+     * @return eOk if every item was restored
+     * or eCannotRollBack if an item keeps the value of the batch.
      */
-    template <class C> Status getItem(const std::string& key, C& consumer);
+    Status rollBack(const std::vector<ItemUpdate>& updates, const std::vector<size_t>& order,
+                  const std::vector<PreviousItem>& previous);
 
     /**
-     * @brief  Remove an item from the shared storage.
+     * @brief  Lock the shard of an item for writing, then update the item.
      *
-     * @param key Key of the desired item.
+     * @param key Key of the item.
+     * @param function Update of the item, called with the index of the shard and the infos of the
+     * item, or nullptr if the item does not exist. It returns the status of the update.
      *
-     * @return eOk if removing the item succeeded
-     * or eCannotRemoveItem if removing the item failed
-     * or eItemNotFound if the item doesn't exist.
+     * @return Status of the update
+     * or eCannotUpgradeLock if the current thread locked the storage for reading.
      */
-    Status removeItem(const std::string& key);
+    template <class F> Status writeItem(const ItemKey& key, F function);
 
     /**
-     * @brief  Clear the shared storage.
+     * @brief  Double the size of the shared storage, up to its maximum size. All the shards are
+     * locked meanwhile because growing the segment must not race with allocations.
      *
-     * @return eOk if the storage was successfully cleared
-     * or eCannotClearStorage if removing all items failed.
+     * @param generation Generation of the storage when the allocation failed: if another thread
+     * grew the storage since, it is not grown again.
+     *
+     * @return true if the storage has grown since the allocation failed.
      */
-    Status clear();
+    bool grow(uint32_t generation);
 
     /**
-     * @brief  Lock writing on the shared storage.
+     * @brief  Start the thread which erases the expired items and compacts the storage, unless it
+     * already runs.
      */
-    void lock();
+    void startMaintenance();
 
     /**
-     * @brief  Unlock writing on the shared storage.
+     * @brief  Erase the expired items and compact a batch of blocks periodically, until the
+     * storage is closed.
      */
-    void unlock();
+    void runMaintenance();
 
     /**
-     * @brief Try to lock writing on the shared storage.
+     * @brief  Sweep the blocks of every shard from the end of the memory segment downwards, and
+     * relocate each one which the allocator has room for at a lower address.
      *
-     * @return true if locking succeeded.
+     * @param maxSize Count of copied bytes after which the sweep stops.
+     * @param[in,out] relocatedCount Count of relocated blocks, increased.
+     *
+     * @return Count of copied bytes, 0 if no block moved.
      */
-    bool tryToLock();
-
-private:
-    friend class ItemDestructor;
+    uint64_t relocateBlocks(uint64_t maxSize, uint64_t& relocatedCount);
 
     /**
-     * @brief Constructor.
+     * @brief  Measure the fragmentation of the free memory. The storage must be locked, because
+     * the largest free block is allocated to be measured.
      *
-     * @param name Name of the new shared storage.
-     * @param size Size in bytes of the new shared storage.
+     * @return Share of the free memory which is not part of the largest free block.
      */
-    SharedStorage(const std::string& name, const int64_t size);
+    double getFragmentation();
 
     /**
-     * @brief Constructor.
+     * @brief  Make room after an allocation failed, by growing the storage or by evicting items.
+     * Items are evicted first once the memory limit is reached.
      *
-     * @param name Name of the new shared storage.
+     * @param shard Shard into which the allocation failed, its items are evicted first.
+     * @param generation Generation of the storage when the allocation failed.
+     * @param kept Sorted hashes of the keys of the items not to evict, or nullptr.
+     *
+     * @return true if the allocation may be tried again.
      */
-    SharedStorage(const std::string& name);
+    bool makeRoom(StorageShard& shard, uint32_t generation,
+                  const std::vector<uint64_t>* kept = nullptr);
 
     /**
-     *  @brief  Initialize the shared storage.
+     * @brief  Evict a batch of items from a shard.
+     *
+     * @param shard Shard from which evict the items, it must not be locked for reading.
+     * @param kept Sorted hashes of the keys of the items not to evict, or nullptr.
+     *
+     * @return true if items were evicted.
      */
-    void initialize();
+    bool evict(StorageShard& shard, const std::vector<uint64_t>* kept = nullptr);
 
     /**
-     * @brief  Get an item already stored in the shared storage.
-     *
-     * @param key Key of the desired item.
-     * @param info Infos related to the item.
-     * @param consumer Consumer of the item.
-     *
-     * an item consumer must implement the template method "set" where T is the item value type:
-     *   template<class T>
-     *   void set(const std::string& key, Item<T>& item);
-     *
-     * @return eOk if the item was found
-     * or eItemNotFound if the item doesn't exist
-     * or eUnknownItemType if the item type is unsupported.
+     * @brief  Record that all the items were removed, once for all the shards.
      */
-    template <class C> Status getItem(const std::string& key, const ItemInfo& info, C& consumer);
+    void postClear()
+    {
+        if (m_changes != nullptr)
+        {
+            m_changes->post(eChangeClear, nullptr, 0);
+        }
+    }
 
     /**
-     * @brief  Create and add infos according to the passed item.
-     *
-     * @param key Key of the item.
-     * @param item Item for which add the infos.
-     * @tparam T Value type of the item.
+     * @brief  Evict items from the shards in turn until the memory limit is respected.
      */
-    template <class T> void addItemInfo(const boost::interprocess::string& key, const Item<T> item);
+    void reduceMemory();
 
     /**
-     * @brief  Update the infos which are related to the passed item.
+     * @brief  Check if the items use more memory than the limit.
      *
-     * @param info Infos related to the item.
-     * @param item Item for which update the infos.
-     * @tparam T Value type of the item.
+     * @return true if items must be evicted.
      */
-    template <class T> void updateItemInfo(ItemInfo& info, const Item<T> item);
+    bool isOverMemoryLimit() const
+    {
+        return (m_header->m_maxMemory > 0) &&
+               (static_cast<uint64_t>(getUsedMemory()) > m_header->m_maxMemory);
+    }
 
     /**
-     * @brief  Construct the item into the memory segment and write the value.
+     * @brief  Pass a copy of an item to its consumer.
      *
      * @param key Key of the item.
-     * @param value Value of the item.
+     * @param type Type of the item.
+     * @param bytes Value bytes of the item, they may be moved to the consumed value.
+     * @param tag Tag associated to the item.
+     * @param consumer Consumer of the item.
+     *
+     * an item consumer must implement the template method "set" where T is the item value type:
+     *   template<class T>
+     *   void set(const ItemKey& key, Item<T>& item);
      *
-     * @return eOk if instantiating the item succeeded
-     * or eCannotConstructItem if instantiating the item failed.
+     * @return eOk if the item was consumed
+     * or eItemNotFound if the item value doesn't match its type
+     * or eUnknownItemType if the item type is unsupported.
      */
-    template <class T> Status constructItemValue(const std::string& key, const T& value);
+    template <class C>
+    Status getItem(const ItemKey& key, ItemType type, std::string& bytes, const std::string& tag,
+                   C& consumer);
 
     /**
-     * @brief  Destroy the item into the memory segment.
+     * @brief  Write an item into the memory segment, creating it or replacing its value.
      *
+     * @param index Index which holds the item.
+     * @param info Infos of the item or nullptr if the item does not exist yet.
      * @param key Key of the item.
+     * @param item Item to write.
+     * @param deadline Time at which the item expires, 0 if it does not expire.
+     * @tparam T Value type of the item.
      *
-     * @return eOk if destroying the item succeeded
-     * or eCannotDestroyItem if destroying the item failed.
+     * @return eOk if writing the item succeeded
+     * or eCannotConstructItem if the memory segment is full
+     * or eCannotWriteLog if the item was written but logging it failed.
      */
-    template <class T> Status destroyItemValue(const std::string& key);
+    template <class T>
+    Status writeItemValue(ItemIndex& index, ItemInfo* info, const ItemKey& key,
+                          const Item<T>& item, uint64_t deadline);
 
     /**
-     * @brief  Update the item value into the memory segment.
+     * @brief  Write the bytes of an item into the memory segment, creating it or replacing its
+     * value.
      *
+     * @param index Index which holds the item.
+     * @param info Infos of the item or nullptr if the item does not exist yet.
      * @param key Key of the item.
-     * @param value Value of the item.
+     * @param type Type of the item.
+     * @param data Value bytes of the item.
+     * @param length Length in bytes of the value.
+     * @param tag Tag associated to the item.
+     * @param deadline Time at which the item expires, 0 if it does not expire.
      *
-     * @return eOk if updating the item succeeded
-     * or eItemNotFound if the item doesn't exists.
+     * @return eOk if writing the item succeeded
+     * or eCannotConstructItem if the memory segment is full
+     * or eCannotWriteLog if the item was written but logging it failed.
      */
-    template <class T> Status updateItemValue(const std::string& key, const T& value);
+    Status writeItemBytes(ItemIndex& index, ItemInfo* info, const ItemKey& key, ItemType type,
+                          const char* data, size_t length, const std::string& tag,
+                          uint64_t deadline);
 
     /**
-     * @brief  Read the  item value from the memory segment.
+     * @brief  Read the item value from its bytes.
      *
-     * @param key Key of the item.
+     * @param bytes Value bytes of the item, they may be moved to the value.
      * @param[out] value Value of the item.
      *
      * @return eOk if reading the item succeeded
-     * or eItemNotFound if the item doesn't exists.
+     * or eItemNotFound if the bytes do not match the value type.
      */
-    template <class T> Status readItemValue(const std::string& key, T& value);
+    template <class T> Status readItemValue(std::string& bytes, T& value);
+
+    static const int kMaxReadAttempts = 16;
+
+    static const int64_t kHeaderSize = 128;
+
+    static const size_t kExpirationBatch = 16;
+    static const size_t kRemovalBatch = 256;
 
     std::string m_name;
-    boost::interprocess::managed_shared_memory m_segment;
-    boost::interprocess::interprocess_recursive_mutex* m_mutex;
-    ItemInfoMap* m_itemInfoMap;
+    StorageObject m_object;
+    boost::interprocess::mapped_region m_region;
+    SegmentHeader* m_header;
+    ManagedSegment m_segment;
+    EpochManager* m_epochs;
+    ChangeRing* m_changes;
+    StorageShard* m_shards;
+    uint32_t m_shardsCount;
+    std::unique_ptr<OperationLog> m_log;
+    std::thread m_maintenance;
+    std::mutex m_maintenanceMutex;
+    std::condition_variable m_maintenanceCondition;
+    bool m_closing;
+    std::atomic<bool> m_compacting;
 };
 
 
-/**
- * @brief  Item destructor compliant with item consumer specifications.
- */
-class ItemDestructor
+template <class T> inline Status SharedStorage::setItem(const ItemKey& key, const Item<T>& item)
 {
-public:
-    /**
-     * @brief Deleted destructor.
-     */
-    ItemDestructor() = delete;
-
-    /**
-     * @brief  Constructor.
-     *
-     * @param storage Storage in which destroy the item value.
-     */
-    ItemDestructor(SharedStorage& storage) : m_storage(storage), m_status(eOk) {}
-
-    /**
-     * @brief  Get the status of item value destruction.
-     *
-     * @return eOk if destroying the item succeeded
-     * or eCannotDestroyItem if destroying the item failed.
-     */
-    Status getStatus() const { return m_status; }
+    return setItem<T>(key, item, 0);
+}
 
-    /**
-     * @brief  Destroy the item value.
-     *
-     * @param key Key of the item.
-     * @param item Item description.
-     * @tparam T Value type of the item.
-     */
-    template <class T> void set(const std::string& key, Item<T>& /*item*/)
+template <class T>
+inline Status SharedStorage::setItem(const ItemKey& key, const Item<T>& item, uint64_t ttl)
+{
+    const uint64_t deadline = (ttl > 0) ? (getCurrentTime() + ttl) : 0;
+    if (deadline != 0)
     {
-        m_status = m_storage.destroyItemValue<T>(key);
+        startMaintenance();
     }
 
-private:
-    SharedStorage& m_storage;
-    Status m_status;
-};
+    // an item with the same key may already exist, then its value is overwritten whatever its type
+    return writeItem(key, [&](ItemIndex& index, ItemInfo* info) {
+        return writeItemValue<T>(index, info, key, item, deadline);
+    });
+}
+
+template <class T, class U>
+inline Status SharedStorage::compareAndSet(const ItemKey& key, const T& expected,
+                                           const Item<U>& item, bool& swapped)
+{
+    swapped = false;
+    return writeItem(key, [&](ItemIndex& index, ItemInfo* info) {
+        if ((info == nullptr) || (info->getType() != Item<T>().getType()))
+        {
+            return eOk;
+        }
+
+        T value = T();
+        std::string bytes(info->getValueData(), info->getValueLength());
+        if ((readItemValue<T>(bytes, value) != eOk) || !(value == expected))
+        {
+            return eOk;
+        }
+
+        Status status = writeItemValue<U>(index, info, key, item, 0);
+        swapped = (status == eOk);
+        return status;
+    });
+}
+
+template <class T, class C>
+inline Status SharedStorage::getAndSet(const ItemKey& key, const Item<T>& item, C& consumer)
+{
+    ItemType type = eNone;
+    std::string bytes;
+    std::string tag;
+    Status status = writeItem(key, [&](ItemIndex& index, ItemInfo* info) {
+        if (info != nullptr)
+        {
+            type = info->getType();
+            bytes.assign(info->getValueData(), info->getValueLength());
+            info->getTag(tag);
+        }
+        return writeItemValue<T>(index, info, key, item, 0);
+    });
 
+    // the previous item is consumed once the shard is unlocked
+    if ((status == eOk) && (type != eNone))
+    {
+        status = getItem<C>(key, type, bytes, tag, consumer);
+    }
+    return status;
+}
 
-template <class T> inline Status SharedStorage::setItem(const std::string& key, const Item<T>& item)
+template <class C> inline Status SharedStorage::getItem(const ItemKey& key, C& consumer)
 {
-    Status status = eOk;
-    bool constructNewValue = false;
-    boost::interprocess::string ipStrKey(key.c_str());
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_recursive_mutex> lock(
-        *m_mutex);
+    StorageShard& shard = getShard(key);
+    ItemType type = eNone;
+    std::string bytes;
+    std::string tag;
+    ItemIndex::ReadStatus readStatus = ItemIndex::eContended;
 
-    ItemInfoMap::iterator info = m_itemInfoMap->find(ipStrKey);
-    if (info != m_itemInfoMap->end())
+    if (isLockedShared())
+    {
+        // writers are already excluded
+        readStatus = shard.m_itemIndex.read(key, type, bytes, tag);
+    }
+    else
     {
-        // an item with the same key already exists
-        if (info->second.getType() != item.getType())
         {
-            // the value type is different, then destroy the value and construct a
-            // new one
-            ItemDestructor itemDestructor(*this);
-            status = getItem<ItemDestructor>(key, info->second, itemDestructor);
-            if (status == eOk)
-            {
-                status = itemDestructor.getStatus();
-            }
-            if ((status == eOk) || (status == eItemNotFound))
-            {
-                (*m_itemInfoMap).erase(info);
-                constructNewValue = true;
-            }
-            else
+            // copy the item without lock, again if a writer updated it meanwhile
+            EpochGuard guard(*m_epochs);
+            for (int iter = 0; guard.isEntered() && (readStatus == ItemIndex::eContended) &&
+                               (iter < kMaxReadAttempts);
+                 ++iter)
             {
-                status = eCannotReplaceItem;
+                readStatus = shard.m_itemIndex.read(key, type, bytes, tag);
             }
         }
-        else
+        if (readStatus == ItemIndex::eContended)
         {
-            // the value type is the same, just update the value and the tag
-            status = updateItemValue<T>(key, item.getValue());
-            if (status == eItemNotFound)
-            {
-                (*m_itemInfoMap).erase(info);
-                constructNewValue = true;
-            }
-            else if (status == eOk)
-            {
-                updateItemInfo<T>(info->second, item);
-            }
+            // too many concurrent updates or readers, wait for the writers
+            boost::interprocess::sharable_lock<StorageMutex> lock(shard.m_mutex);
+            readStatus = shard.m_itemIndex.read(key, type, bytes, tag);
         }
     }
-    else
+
+    if (readStatus != ItemIndex::eRead)
     {
-        // the item does not exist, create a new one
-        constructNewValue = true;
+        return eItemNotFound;
     }
+    return getItem<C>(key, type, bytes, tag, consumer);
+}
 
-    if (constructNewValue)
+template <class C>
+inline size_t SharedStorage::getItems(const std::vector<ItemKey>& keys, std::vector<C>& consumers,
+                                      std::vector<Status>& statuses)
+{
+    std::vector<ItemType> types;
+    std::vector<std::string> values;
+    std::vector<std::string> tags;
+    readItems(keys, types, values, tags);
+
+    size_t found = 0;
+    statuses.assign(keys.size(), eItemNotFound);
+    for (size_t iter = 0; iter < keys.size(); ++iter)
     {
-        status = constructItemValue<T>(key, item.getValue());
-        if (status == eOk)
+        if (types[iter] != eNone)
         {
-            addItemInfo<T>(ipStrKey, item);
+            statuses[iter] = getItem<C>(keys[iter], types[iter], values[iter], tags[iter],
+                                        consumers[iter]);
+            found += (statuses[iter] == eOk) ? 1 : 0;
         }
     }
-
-    return status;
+    return found;
 }
 
-template <class C> inline Status SharedStorage::getItem(const std::string& key, C& consumer)
+template <class F>
+inline std::vector<size_t> SharedStorage::orderByShard(size_t count, F getKey) const
 {
-    Status status = eOk;
-    std::string strKey;
-    boost::interprocess::string ipStrKey(key.c_str());
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_recursive_mutex> lock(
-        *m_mutex);
-
-    ItemInfoMap::iterator info = m_itemInfoMap->find(ipStrKey);
-    if (info != m_itemInfoMap->end())
+    std::vector<size_t> order(count);
+    std::vector<uint32_t> shards(count);
+    for (size_t iter = 0; iter < count; ++iter)
     {
-        status = getItem<C>(key, info->second, consumer);
+        order[iter] = iter;
+        shards[iter] = getShardIndex(getKey(iter));
     }
-    else
+
+    // the updates of a key keep their order
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t left, size_t right) { return shards[left] < shards[right]; });
+    return order;
+}
+
+template <class F> inline Status SharedStorage::writeItem(const ItemKey& key, F function)
+{
+    StorageShard& shard = getShard(key);
+    if (isLockedShared() && !shard.m_mutex.isOwnedByCurrentThread())
     {
-        status = eItemNotFound;
+        // waiting for the exclusive ownership would wait for the current thread itself
+        return eCannotUpgradeLock;
     }
 
+    // the shard is released before making room, which locks the shards in order
+    Status status = eOk;
+    uint32_t generation = 0;
+    do
+    {
+        generation = m_header->m_generation.load();
+        boost::interprocess::scoped_lock<StorageMutex> lock(shard.m_mutex);
+        status = function(shard.m_itemIndex, shard.m_itemIndex.find(key));
+        shard.m_itemIndex.expire(kExpirationBatch);
+    } while ((status == eCannotConstructItem) && makeRoom(shard, generation));
+
+    if ((status == eOk) && isOverMemoryLimit())
+    {
+        reduceMemory();
+    }
     return status;
 }
 
 template <class C>
-inline Status SharedStorage::getItem(const std::string& key, const ItemInfo& info, C& consumer)
+inline Status SharedStorage::getItem(const ItemKey& key, ItemType type, std::string& bytes,
+                                     const std::string& tag, C& consumer)
 {
     Status status = eOk;
-    std::string tag;
-    info.getTag(tag);
 
     auto readItem = [&](auto value) {
-        status = readItemValue<decltype(value)>(key, value);
+        status = readItemValue<decltype(value)>(bytes, value);
         if (status == eOk)
         {
             Item<decltype(value)> item(value, tag);
@@ -499,7 +1456,7 @@ inline Status SharedStorage::getItem(const std::string& key, const ItemInfo& inf
         }
     };
 
-    switch (info.getType())
+    switch (type)
     {
     case eBool:
     {
@@ -522,6 +1479,13 @@ inline Status SharedStorage::getItem(const std::string& key, const ItemInfo& inf
         break;
     }
 
+    case eBinary:
+    {
+        BinaryValue value;
+        readItem(value);
+        break;
+    }
+
     default:
         status = eUnknownItemType;
         break;
@@ -531,63 +1495,19 @@ inline Status SharedStorage::getItem(const std::string& key, const ItemInfo& inf
 }
 
 template <class T>
-inline void SharedStorage::addItemInfo(const boost::interprocess::string& key, const Item<T> item)
-{
-    ItemInfo info(item.getType(), item.getTag(),
-                  InterprocessAllocator<char>(m_segment.get_segment_manager()));
-    (*m_itemInfoMap).insert(std::pair<const boost::interprocess::string, ItemInfo>(key, info));
-}
-
-template <class T> inline void SharedStorage::updateItemInfo(ItemInfo& info, const Item<T> item)
-{
-    info.setTag(item.getTag());
-}
-
-template <class T>
-inline Status SharedStorage::constructItemValue(const std::string& key, const T& value)
-{
-    T* obj = nullptr;
-    try
-    {
-        obj = m_segment.construct<T>(key.c_str())(value);
-    }
-    catch (const std::exception&)
-    {
-    }
-    return (obj != nullptr) ? eOk : eCannotConstructItem;
-}
-
-template <class T> inline Status SharedStorage::destroyItemValue(const std::string& key)
-{
-    bool done = false;
-    try
-    {
-        done = m_segment.destroy<T>(key.c_str());
-    }
-    catch (const std::exception&)
-    {
-    }
-    return (done) ? eOk : eCannotDestroyItem;
-}
-
-template <class T>
-inline Status SharedStorage::updateItemValue(const std::string& key, const T& value)
+inline Status SharedStorage::writeItemValue(ItemIndex& index, ItemInfo* info, const ItemKey& key,
+                                            const Item<T>& item, uint64_t deadline)
 {
-    T* localValue = m_segment.find<T>(key.c_str()).first;
-    if (localValue != nullptr)
-    {
-        *localValue = value;
-        return eOk;
-    }
-    return eItemNotFound;
+    return writeItemBytes(index, info, key, item.getType(),
+                          reinterpret_cast<const char*>(&item.getValue()), sizeof(T),
+                          item.getTag(), deadline);
 }
 
-template <class T> Status SharedStorage::readItemValue(const std::string& key, T& value)
+template <class T> Status SharedStorage::readItemValue(std::string& bytes, T& value)
 {
-    const T* localValue = m_segment.find<T>(key.c_str()).first;
-    if (localValue != nullptr)
+    if (bytes.size() == sizeof(T))
     {
-        value = *localValue;
+        std::memcpy(&value, bytes.data(), sizeof(T));
         return eOk;
     }
     return eItemNotFound;
@@ -599,57 +1519,42 @@ template <class T> Status SharedStorage::readItemValue(const std::string& key, T
  */
 
 template <>
-inline Status SharedStorage::constructItemValue<std::string>(const std::string& key,
-                                                             const std::string& value)
+inline Status SharedStorage::writeItemValue<std::string>(ItemIndex& index, ItemInfo* info,
+                                                          const ItemKey& key,
+                                                          const Item<std::string>& item,
+                                                          uint64_t deadline)
 {
-    StringValue* obj = nullptr;
-    try
-    {
-        obj = m_segment.construct<StringValue>(key.c_str())(value.c_str(),
-                                                            m_segment.get_segment_manager());
-    }
-    catch (const std::exception&)
-    {
-    }
-    return (obj != nullptr) ? eOk : eCannotConstructItem;
+    return writeItemBytes(index, info, key, item.getType(), item.getValue().data(),
+                          item.getValue().size(), item.getTag(), deadline);
 }
 
-template <> inline Status SharedStorage::destroyItemValue<std::string>(const std::string& key)
+template <>
+inline Status SharedStorage::readItemValue<std::string>(std::string& bytes, std::string& value)
 {
-    bool done = false;
-    try
-    {
-        done = m_segment.destroy<StringValue>(key.c_str());
-    }
-    catch (const std::exception&)
-    {
-    }
-    return (done) ? eOk : eCannotDestroyItem;
+    value.swap(bytes);
+    return eOk;
 }
 
+
+/**
+ * @brief  Binary values specializations.
+ */
+
 template <>
-inline Status SharedStorage::updateItemValue<std::string>(const std::string& key,
-                                                          const std::string& value)
+inline Status SharedStorage::writeItemValue<BinaryValue>(ItemIndex& index, ItemInfo* info,
+                                                          const ItemKey& key,
+                                                          const Item<BinaryValue>& item,
+                                                          uint64_t deadline)
 {
-    StringValue* localValue = m_segment.find<StringValue>(key.c_str()).first;
-    if (localValue != nullptr)
-    {
-        localValue->assign(value.c_str());
-        return eOk;
-    }
-    return eItemNotFound;
+    return writeItemBytes(index, info, key, item.getType(), item.getValue().data(),
+                          item.getValue().length(), item.getTag(), deadline);
 }
 
 template <>
-inline Status SharedStorage::readItemValue<std::string>(const std::string& key, std::string& value)
+inline Status SharedStorage::readItemValue<BinaryValue>(std::string& bytes, BinaryValue& value)
 {
-    const StringValue* localValue = m_segment.find<StringValue>(key.c_str()).first;
-    if (localValue != nullptr)
-    {
-        value.assign(localValue->c_str());
-        return eOk;
-    }
-    return eItemNotFound;
+    value = BinaryValue(std::move(bytes));
+    return eOk;
 }
 
 
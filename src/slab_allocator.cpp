@@ -0,0 +1,161 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    slab_allocator.cpp
+ */
+
+// Local includes.
+#include "slab_allocator.h"
+#include <new>
+
+
+namespace storage
+{
+
+// the chunks are multiples of 16 bytes so that they keep the alignment of the segment
+const size_t SlabAllocator::kClassSizes[kClassesCount] = {32, 48, 64, 96, 128, 160, 192, 256};
+
+SlabAllocator::SlabAllocator(
+    SegmentManager* manager, size_t slabSize)
+: m_manager(manager), m_slabSize(slabSize), m_slabs(), m_freeMemory(0)
+{
+    static_assert(sizeof(Slab) % 16 == 0, "the chunks must stay aligned");
+}
+
+char* SlabAllocator::allocate(size_t size)
+{
+    const size_t sizeClass = getClass(size);
+    Slab* slab = m_slabs[sizeClass].get();
+    if (slab == nullptr)
+    {
+        void* bytes = m_manager->allocate_aligned(static_cast<std::size_t>(m_slabSize),
+                                                  static_cast<std::size_t>(m_slabSize));
+        slab = new (bytes) Slab();
+        slab->m_used = 0;
+        slab->m_carved = 0;
+        link(slab, sizeClass);
+        m_freeMemory.fetch_add(getChunksCount(sizeClass) * kClassSizes[sizeClass],
+                               std::memory_order_relaxed);
+    }
+
+    // the chunks which were never handed out are not chained, they follow the carved ones
+    char* chunk = slab->m_free.get();
+    if (chunk != nullptr)
+    {
+        slab->m_free = *reinterpret_cast<boost::interprocess::offset_ptr<char>*>(chunk);
+    }
+    else
+    {
+        chunk = reinterpret_cast<char*>(slab + 1) + slab->m_carved * kClassSizes[sizeClass];
+        ++slab->m_carved;
+    }
+    if (++slab->m_used == getChunksCount(sizeClass))
+    {
+        unlink(slab, sizeClass);
+    }
+    m_freeMemory.fetch_sub(kClassSizes[sizeClass], std::memory_order_relaxed);
+    return chunk;
+}
+
+void SlabAllocator::deallocate(char* bytes, size_t size)
+{
+    const size_t sizeClass = getClass(size);
+    Slab* slab = getSlab(bytes);
+    if (slab->m_used == getChunksCount(sizeClass))
+    {
+        link(slab, sizeClass);
+    }
+    new (bytes) boost::interprocess::offset_ptr<char>(slab->m_free);
+    slab->m_free = bytes;
+    --slab->m_used;
+    m_freeMemory.fetch_add(kClassSizes[sizeClass], std::memory_order_relaxed);
+
+    // keep the last slab of the class, a single chunk would otherwise allocate it again and again
+    if ((slab->m_used == 0) && ((slab->m_previous != nullptr) || (slab->m_next != nullptr)))
+    {
+        unlink(slab, sizeClass);
+        m_manager->deallocate(slab);
+        m_freeMemory.fetch_sub(getChunksCount(sizeClass) * kClassSizes[sizeClass],
+                               std::memory_order_relaxed);
+    }
+}
+
+void SlabAllocator::trim()
+{
+    for (size_t sizeClass = 0; sizeClass < kClassesCount; ++sizeClass)
+    {
+        Slab* slab = m_slabs[sizeClass].get();
+        while (slab != nullptr)
+        {
+            Slab* next = slab->m_next.get();
+            if (slab->m_used == 0)
+            {
+                unlink(slab, sizeClass);
+                m_manager->deallocate(slab);
+                m_freeMemory.fetch_sub(getChunksCount(sizeClass) * kClassSizes[sizeClass],
+                                       std::memory_order_relaxed);
+            }
+            slab = next;
+        }
+    }
+}
+
+size_t SlabAllocator::getClass(size_t size)
+{
+    size_t sizeClass = 0;
+    while (kClassSizes[sizeClass] < size)
+    {
+        ++sizeClass;
+    }
+    return sizeClass;
+}
+
+uint32_t SlabAllocator::getChunksCount(size_t sizeClass) const
+{
+    return static_cast<uint32_t>((m_slabSize - sizeof(Slab)) / kClassSizes[sizeClass]);
+}
+
+void SlabAllocator::link(Slab* slab, size_t sizeClass)
+{
+    slab->m_previous = nullptr;
+    slab->m_next = m_slabs[sizeClass];
+    if (slab->m_next != nullptr)
+    {
+        slab->m_next->m_previous = slab;
+    }
+    m_slabs[sizeClass] = slab;
+}
+
+void SlabAllocator::unlink(Slab* slab, size_t sizeClass)
+{
+    if (slab->m_previous != nullptr)
+    {
+        slab->m_previous->m_next = slab->m_next;
+    }
+    else
+    {
+        m_slabs[sizeClass] = slab->m_next;
+    }
+    if (slab->m_next != nullptr)
+    {
+        slab->m_next->m_previous = slab->m_previous;
+    }
+    slab->m_previous = nullptr;
+    slab->m_next = nullptr;
+}
+
+} // namespace storage
@@ -0,0 +1,179 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    slab_allocator.h
+ */
+
+#ifndef SLAB_ALLOCATOR_H_
+#define SLAB_ALLOCATOR_H_
+
+
+// Includes.
+#include "managed_segment.h"
+#include <atomic>
+#include <boost/interprocess/offset_ptr.hpp>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace storage
+{
+
+/**
+ * @brief  Allocator of small blocks living into the memory segment, which carves slabs allocated
+ * from the segment into chunks of a few size classes.
+ *
+ * Each size class keeps the slabs which have free chunks into a list, and each slab chains its
+ * own free chunks: allocating or deallocating a chunk neither searches the tree of free blocks of
+ * the segment nor takes its mutex. The slabs are aligned on their size, so that the slab of a
+ * chunk is found from its address. A slab whose chunks are all free goes back to the segment,
+ * unless it is the last slab of its class.
+ *
+ * The allocator is not synchronized: its owner must serialize the allocations and deallocations.
+ */
+class SlabAllocator
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    SlabAllocator() = delete;
+
+    /**
+     * @brief  Constructor.
+     *
+     * @param manager Manager of the memory segment from which allocate the slabs.
+     * @param slabSize Size in bytes of each slab, a power of two, or 0 to disable the allocator.
+     */
+    SlabAllocator(SegmentManager* manager,
+                  size_t slabSize);
+
+    /**
+     * @brief  Check if a block is allocated from the slabs.
+     *
+     * @param size Size in bytes of the block.
+     *
+     * @return true if the block must be allocated and deallocated through the slab allocator.
+     */
+    bool accepts(size_t size) const { return (m_slabSize != 0) && (size <= kMaxChunkSize); }
+
+    /**
+     * @brief  Allocate a chunk.
+     *
+     * @param size Size in bytes of the chunk, which must be accepted.
+     *
+     * @return Allocated chunk.
+     *
+     * @throw boost::interprocess::bad_alloc if a slab cannot be allocated.
+     */
+    char* allocate(size_t size);
+
+    /**
+     * @brief  Deallocate a chunk.
+     *
+     * @param bytes Chunk returned by allocate().
+     * @param size Size in bytes passed to allocate().
+     */
+    void deallocate(char* bytes, size_t size);
+
+    /**
+     * @brief  Give back to the segment the slabs whose chunks are all free.
+     */
+    void trim();
+
+    /**
+     * @brief  Get the memory of the free chunks, which the segment counts as allocated.
+     *
+     * @return Size in bytes of the free chunks.
+     */
+    uint64_t getFreeMemory() const { return m_freeMemory.load(std::memory_order_relaxed); }
+
+    static const size_t kMaxChunkSize = 256;
+    static const size_t kClassesCount = 8;
+
+private:
+    /**
+     * @brief  Header at the start of a slab, followed by its chunks.
+     */
+    struct Slab
+    {
+        boost::interprocess::offset_ptr<Slab> m_previous; ///< Previous slab with free chunks.
+        boost::interprocess::offset_ptr<Slab> m_next;     ///< Next slab with free chunks.
+        boost::interprocess::offset_ptr<char> m_free;     ///< First free chunk, chained.
+        uint32_t m_used;                                  ///< Count of allocated chunks.
+        uint32_t m_carved; ///< Count of chunks handed out at least once, the next ones follow.
+    };
+
+    /**
+     * @brief  Get the size class of a block.
+     *
+     * @param size Size in bytes of the block.
+     *
+     * @return Index of the smallest class which holds the block.
+     */
+    static size_t getClass(size_t size);
+
+    /**
+     * @brief  Get the count of chunks of a slab.
+     *
+     * @param sizeClass Size class of the slab.
+     *
+     * @return Count of chunks.
+     */
+    uint32_t getChunksCount(size_t sizeClass) const;
+
+    /**
+     * @brief  Get the slab which holds a chunk.
+     *
+     * @param bytes Chunk.
+     *
+     * @return Slab of the chunk.
+     */
+    Slab* getSlab(char* bytes) const
+    {
+        return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(bytes) &
+                                       ~static_cast<uintptr_t>(m_slabSize - 1));
+    }
+
+    /**
+     * @brief  Insert a slab at the head of the list of its class.
+     *
+     * @param slab Slab with free chunks.
+     * @param sizeClass Size class of the slab.
+     */
+    void link(Slab* slab, size_t sizeClass);
+
+    /**
+     * @brief  Remove a slab from the list of its class.
+     *
+     * @param slab Slab of the list.
+     * @param sizeClass Size class of the slab.
+     */
+    void unlink(Slab* slab, size_t sizeClass);
+
+    static const size_t kClassSizes[kClassesCount];
+
+    boost::interprocess::offset_ptr<SegmentManager>
+        m_manager;
+    uint64_t m_slabSize;
+    boost::interprocess::offset_ptr<Slab> m_slabs[kClassesCount]; ///< Slabs with free chunks.
+    std::atomic<uint64_t> m_freeMemory;
+};
+
+} // namespace storage
+
+#endif /* SLAB_ALLOCATOR_H_ */
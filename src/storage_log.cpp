@@ -0,0 +1,564 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    storage_log.cpp
+ */
+
+// Local includes.
+#include "storage_log.h"
+#include "storage_mutex.h"
+#include "storage_snapshot.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace storage
+{
+
+namespace
+{
+const size_t kRecordSize = 2 + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+const size_t kCopySize = 64 * 1024;
+
+/**
+ * @brief  Encode a record.
+ */
+std::string encodeRecord(LogOperation operation, ItemType type, const char* key, size_t keyLength,
+                         const char* tag, size_t tagLength, const char* value, size_t valueLength,
+                         uint64_t deadline)
+{
+    std::string buffer;
+    buffer.reserve(kRecordSize + keyLength + tagLength + valueLength + sizeof(uint64_t));
+    buffer.push_back(static_cast<char>(operation));
+    buffer.push_back(static_cast<char>(type));
+    appendInteger<uint32_t>(buffer, static_cast<uint32_t>(keyLength));
+    appendInteger<uint32_t>(buffer, static_cast<uint32_t>(tagLength));
+    appendInteger<uint64_t>(buffer, static_cast<uint64_t>(valueLength));
+    appendInteger<uint64_t>(buffer, deadline);
+    buffer.append(key, keyLength);
+    buffer.append(tag, tagLength);
+    buffer.append(value, valueLength);
+    appendInteger<uint64_t>(buffer, updateChecksum(kChecksumSeed, buffer.data(), buffer.size()));
+    return buffer;
+}
+
+/**
+ * @brief  Open a file for appending, creating it if needed.
+ */
+int openForAppend(const std::string& path)
+{
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+#endif
+}
+
+/**
+ * @brief  Create a file for writing, truncating it if it exists.
+ */
+int openForWrite(const std::string& path)
+{
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_TRUNC | _O_CREAT | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+#endif
+}
+
+/**
+ * @brief  Close a file.
+ */
+void closeFile(int file)
+{
+#ifdef _WIN32
+    _close(file);
+#else
+    ::close(file);
+#endif
+}
+
+/**
+ * @brief  Get the size of an open file.
+ */
+bool getFileSize(int file, uint64_t& size)
+{
+#ifdef _WIN32
+    struct _stat64 status;
+    const bool found = (_fstat64(file, &status) == 0);
+#else
+    struct stat status;
+    const bool found = (::fstat(file, &status) == 0);
+#endif
+    size = found ? static_cast<uint64_t>(status.st_size) : 0;
+    return found;
+}
+
+/**
+ * @brief  Write all the bytes of a buffer at the end of a file.
+ */
+bool writeAll(int file, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+#ifdef _WIN32
+        const int written = _write(file, data, static_cast<unsigned int>(length));
+#else
+        const ssize_t written = ::write(file, data, length);
+#endif
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+/**
+ * @brief  Flush the written bytes of a file to the disk.
+ */
+bool syncFile(int file)
+{
+#ifdef _WIN32
+    return (_commit(file) == 0);
+#elif defined(__APPLE__)
+    return (::fcntl(file, F_FULLFSYNC) == 0) || (::fsync(file) == 0);
+#else
+    return (::fdatasync(file) == 0);
+#endif
+}
+
+/**
+ * @brief  Flush the entries of the directory of a file to the disk, so that a renamed file keeps
+ * its new name after a host crash.
+ */
+bool syncDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    const size_t separator = path.find_last_of('/');
+    std::string directory(".");
+    if (separator != std::string::npos)
+    {
+        directory = path.substr(0, (separator > 0) ? separator : 1);
+    }
+    const int file = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+    {
+        return false;
+    }
+    const bool synced = (::fsync(file) == 0);
+    ::close(file);
+    return synced;
+#endif
+}
+
+/**
+ * @brief  Replace a file by another one.
+ */
+bool replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    return (MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+    return (::rename(from.c_str(), to.c_str()) == 0);
+#endif
+}
+
+/**
+ * @brief  Make a descriptor refer to another open file, atomically for the threads which use it.
+ */
+bool redirectFile(int from, int to)
+{
+#ifdef _WIN32
+    return (_dup2(from, to) == 0);
+#else
+    int redirected = -1;
+    do
+    {
+        redirected = ::dup2(from, to);
+    } while ((redirected < 0) && (errno == EINTR));
+    return (redirected == to);
+#endif
+}
+
+/**
+ * @brief  Copy the end of a file, from an offset, at the end of another file.
+ */
+bool copyTail(std::ifstream& from, uint64_t& offset, int to, std::string& buffer)
+{
+    from.clear();
+    if (!from.seekg(0, std::ios::end))
+    {
+        return false;
+    }
+    const uint64_t end = static_cast<uint64_t>(from.tellg());
+    if ((end < offset) || !from.seekg(static_cast<std::streamoff>(offset), std::ios::beg))
+    {
+        return false;
+    }
+    buffer.resize(kCopySize);
+    while (offset < end)
+    {
+        const size_t length = static_cast<size_t>(std::min<uint64_t>(end - offset, kCopySize));
+        if (!from.read(&buffer[0], static_cast<std::streamsize>(length)) ||
+            !writeAll(to, buffer.data(), length))
+        {
+            return false;
+        }
+        offset += length;
+    }
+    return true;
+}
+
+/**
+ * @brief  Cut a file to a given size.
+ */
+bool truncateFile(const std::string& path, uint64_t size)
+{
+#ifdef _WIN32
+    const int file = _open(path.c_str(), _O_WRONLY | _O_BINARY);
+    if (file < 0)
+    {
+        return false;
+    }
+    const bool truncated = (_chsize_s(file, static_cast<__int64>(size)) == 0);
+    _close(file);
+    return truncated;
+#else
+    return (::truncate(path.c_str(), static_cast<off_t>(size)) == 0);
+#endif
+}
+} // namespace
+
+
+OperationLog::OperationLog(const std::string& path, uint32_t flushInterval, uint32_t flushCount,
+                           std::atomic<uint32_t>* generation)
+: m_path(path), m_file(-1), m_generation(generation),
+  m_openedGeneration(generation->load(std::memory_order_acquire)), m_rotationMutex(),
+  m_flushInterval(flushInterval), m_flushCount((flushCount > 0) ? flushCount : 1), m_pending(0),
+  m_stopping(false), m_mutex(), m_condition(), m_flusher()
+{
+    // the log which is opened is at least as recent as the generation read before
+    m_file = openForAppend(path);
+    if (m_file < 0)
+    {
+        throw std::runtime_error("cannot open the operation log");
+    }
+    if (m_flushInterval > 0)
+    {
+        m_flusher = std::thread(&OperationLog::run, this);
+    }
+}
+
+OperationLog::~OperationLog()
+{
+    if (m_flusher.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_condition.notify_one();
+        m_flusher.join();
+    }
+    syncFile(m_file);
+    closeFile(m_file);
+}
+
+bool OperationLog::appendSet(const ItemKey& key, ItemType type, const char* data, size_t length,
+                             const std::string& tag, uint64_t deadline)
+{
+    return append(eLogSet, type, key.data(), key.length(), tag.data(), tag.size(), data, length,
+                  deadline);
+}
+
+bool OperationLog::appendRemove(const ItemKey& key)
+{
+    return append(eLogRemove, eNone, key.data(), key.length(), nullptr, 0, nullptr, 0, 0);
+}
+
+bool OperationLog::appendClear()
+{
+    return append(eLogClear, eNone, nullptr, 0, nullptr, 0, nullptr, 0, 0);
+}
+
+bool OperationLog::checkpoint(const std::string& path, const LogPosition& start,
+                              const std::function<bool()>& lockWriters,
+                              const std::function<void()>& unlockWriters)
+{
+    // the rotations of a process share the name of their new log
+    std::lock_guard<std::mutex> lock(m_rotationMutex);
+    bool locked = true;
+    if (rotate(path, start, lockWriters, unlockWriters, locked))
+    {
+        return true;
+    }
+    if (locked)
+    {
+        return false;
+    }
+
+    // the current thread keeps the writers out, so no other process replaces the log meanwhile
+    return (m_generation->load(std::memory_order_acquire) != start.m_generation) ||
+           (append(eLogCheckpoint, eNone, path.data(), path.size(), nullptr, 0,
+                   reinterpret_cast<const char*>(&start.m_offset), sizeof(start.m_offset), 0) &&
+            flush());
+}
+
+LogPosition OperationLog::getPosition() const
+{
+    // the log is opened again, the one of this process may have been replaced
+    LogPosition position = {0, 0};
+    bool found = false;
+    while (!found)
+    {
+        position.m_generation = m_generation->load(std::memory_order_acquire);
+        const int file = openForAppend(m_path);
+        found = (file >= 0) && getFileSize(file, position.m_offset) &&
+                (m_generation->load(std::memory_order_acquire) == position.m_generation);
+        if (file >= 0)
+        {
+            closeFile(file);
+        }
+        else
+        {
+            // the records which follow the snapshot are all replayed
+            position.m_offset = 0;
+            found = true;
+        }
+    }
+    return position;
+}
+
+bool OperationLog::flush()
+{
+    m_pending.store(0);
+    return syncFile(m_file);
+}
+
+bool OperationLog::recover(const std::string& path,
+                           std::vector<std::pair<std::string, uint64_t>>& checkpoints)
+{
+    checkpoints.clear();
+    ChunkedReader reader(path);
+    if (!reader.isOpen())
+    {
+        return true;
+    }
+    LogRecord record;
+    while (read(reader, record))
+    {
+        if ((record.m_operation == eLogCheckpoint) && (record.m_valueLength == sizeof(uint64_t)))
+        {
+            checkpoints.emplace_back(std::string(record.m_key, record.m_keyLength),
+                                     readInteger<uint64_t>(record.m_value));
+        }
+    }
+    if (reader.hasFailed())
+    {
+        return false;
+    }
+
+    // a crash may leave a partially written record, it is dropped so that appending resumes after
+    // the last valid record
+    return (reader.getOffset() == reader.getSize()) || truncateFile(path, reader.getOffset());
+}
+
+bool OperationLog::read(ChunkedReader& reader, LogRecord& record)
+{
+    const char* data = reader.peek(kRecordSize);
+    if (data == nullptr)
+    {
+        return false;
+    }
+    const uint64_t keyLength = readInteger<uint32_t>(data + 2);
+    const uint64_t tagLength = readInteger<uint32_t>(data + 2 + sizeof(uint32_t));
+    const uint64_t valueLength = readInteger<uint64_t>(data + 2 + 2 * sizeof(uint32_t));
+    const uint64_t deadline =
+        readInteger<uint64_t>(data + 2 + 2 * sizeof(uint32_t) + sizeof(uint64_t));
+    const uint64_t available = reader.getSize() - reader.getOffset() - kRecordSize;
+    if ((available < sizeof(uint64_t)) || (valueLength > available) ||
+        (keyLength + tagLength + valueLength + sizeof(uint64_t) > available))
+    {
+        return false;
+    }
+    const size_t length = kRecordSize + static_cast<size_t>(keyLength + tagLength + valueLength);
+    data = reader.peek(length + sizeof(uint64_t));
+    if ((data == nullptr) ||
+        (updateChecksum(kChecksumSeed, data, length) != readInteger<uint64_t>(data + length)))
+    {
+        return false;
+    }
+
+    const uint8_t operation = static_cast<uint8_t>(data[0]);
+    if ((operation < eLogSet) || (operation > eLogCheckpoint))
+    {
+        return false;
+    }
+    record.m_operation = static_cast<LogOperation>(operation);
+    record.m_type = static_cast<ItemType>(static_cast<uint8_t>(data[1]));
+    record.m_key = data + kRecordSize;
+    record.m_keyLength = static_cast<size_t>(keyLength);
+    record.m_tag = record.m_key + keyLength;
+    record.m_tagLength = static_cast<size_t>(tagLength);
+    record.m_value = record.m_tag + tagLength;
+    record.m_valueLength = static_cast<size_t>(valueLength);
+    record.m_deadline = deadline;
+    reader.skip(length + sizeof(uint64_t));
+    return true;
+}
+
+bool OperationLog::append(LogOperation operation, ItemType type, const char* key,
+                          size_t keyLength, const char* tag, size_t tagLength, const char* value,
+                          size_t valueLength, uint64_t deadline)
+{
+    const std::string buffer = encodeRecord(operation, type, key, keyLength, tag, tagLength, value,
+                                            valueLength, deadline);
+
+    // a single write keeps the record whole when several processes append to the log
+    if (!switchToCurrentLog() || !writeAll(m_file, buffer.data(), buffer.size()))
+    {
+        return false;
+    }
+    if (m_flushInterval == 0)
+    {
+        return syncFile(m_file);
+    }
+    if (m_pending.fetch_add(1) + 1 == m_flushCount)
+    {
+        m_condition.notify_one();
+    }
+    return true;
+}
+
+bool OperationLog::rotate(const std::string& path, const LogPosition& start,
+                          const std::function<bool()>& lockWriters,
+                          const std::function<void()>& unlockWriters, bool& locked)
+{
+    if (m_generation->load(std::memory_order_acquire) != start.m_generation)
+    {
+        return true;
+    }
+    const std::string nextPath = m_path + "." + std::to_string(getCurrentProcessId()) + ".next";
+    const int to = openForWrite(nextPath);
+    if (to < 0)
+    {
+        return false;
+    }
+
+    // the records which follow the checkpoint are replayed on top of the snapshot
+    const uint64_t checkpointSize = kRecordSize + path.size() + 2 * sizeof(uint64_t);
+    const std::string checkpoint =
+        encodeRecord(eLogCheckpoint, eNone, path.data(), path.size(), nullptr, 0,
+                     reinterpret_cast<const char*>(&checkpointSize), sizeof(checkpointSize), 0);
+    std::ifstream from(m_path.c_str(), std::ios::binary);
+    std::string buffer;
+    uint64_t copied = start.m_offset;
+    const bool written = writeAll(to, checkpoint.data(), checkpoint.size()) &&
+                         copyTail(from, copied, to, buffer);
+
+    // the last records are copied once the writers are locked, then the log is replaced
+    bool done = false;
+    bool renamed = false;
+    if (written)
+    {
+        locked = lockWriters();
+    }
+    if (written && locked)
+    {
+        // another snapshot may have replaced the log meanwhile, the log then follows it
+        done = (m_generation->load(std::memory_order_acquire) != start.m_generation);
+        renamed = !done && copyTail(from, copied, to, buffer) && syncFile(to) &&
+                  replaceFile(nextPath, m_path);
+        if (renamed)
+        {
+            m_generation->fetch_add(1, std::memory_order_release);
+        }
+        unlockWriters();
+    }
+    closeFile(to);
+    if (renamed)
+    {
+        done = syncDirectory(m_path);
+    }
+    else
+    {
+        std::remove(nextPath.c_str());
+    }
+    return done;
+}
+
+bool OperationLog::switchToCurrentLog()
+{
+    const uint32_t generation = m_generation->load(std::memory_order_acquire);
+    if (generation == m_openedGeneration.load(std::memory_order_relaxed))
+    {
+        return true;
+    }
+
+    // the descriptor is replaced in place, the other threads of the process keep using it
+    const int file = openForAppend(m_path);
+    if (file < 0)
+    {
+        return false;
+    }
+    const bool redirected = redirectFile(file, m_file);
+    closeFile(file);
+    if (redirected)
+    {
+        m_openedGeneration.store(generation, std::memory_order_relaxed);
+    }
+    return redirected;
+}
+
+void OperationLog::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping)
+    {
+        m_condition.wait_for(lock, std::chrono::milliseconds(m_flushInterval),
+                             [this]() { return m_stopping || (m_pending.load() >= m_flushCount); });
+        if (m_pending.exchange(0) > 0)
+        {
+            // writers are not blocked by the flush, only their next notification waits
+            lock.unlock();
+            syncFile(m_file);
+            lock.lock();
+        }
+    }
+}
+
+} // namespace storage
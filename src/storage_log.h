@@ -0,0 +1,310 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    storage_log.h
+ */
+
+#ifndef STORAGE_LOG_H_
+#define STORAGE_LOG_H_
+
+
+// Includes.
+#include "shared_item.h"
+#include <atomic>
+#include <boost/interprocess/offset_ptr.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace storage
+{
+
+class ChunkedReader;
+
+/**
+ * @brief  Operations recorded into the log.
+ */
+enum LogOperation
+{
+    eLogSet = 1,       ///< An item was created or replaced.
+    eLogRemove = 2,    ///< An item was removed.
+    eLogClear = 3,     ///< All the items were removed.
+    eLogCheckpoint = 4 ///< A snapshot was written, its key is the path of the snapshot.
+};
+
+/**
+ * @brief  Operation read from the log. Its bytes belong to the log reader.
+ */
+struct LogRecord
+{
+    LogOperation m_operation; ///< Recorded operation.
+    ItemType m_type;          ///< Type of the item.
+    const char* m_key;        ///< Key bytes, or path of the snapshot of a checkpoint.
+    size_t m_keyLength;       ///< Length in bytes of the key.
+    const char* m_tag;        ///< Tag bytes.
+    size_t m_tagLength;       ///< Length in bytes of the tag.
+    const char* m_value;      ///< Value bytes, or log offset of a checkpoint.
+    size_t m_valueLength;     ///< Length in bytes of the value.
+    uint64_t m_deadline;      ///< Time at which the item expires, 0 if it does not expire.
+};
+
+/**
+ * @brief  Position in the log from which the records must be replayed on top of a snapshot.
+ */
+struct LogPosition
+{
+    uint32_t m_generation; ///< Count of times the log was replaced before.
+    uint64_t m_offset;     ///< Offset in bytes into the log.
+};
+
+/**
+ * @brief  Settings of the log, stored into the memory segment so that every process which opens
+ * the storage writes into the same log.
+ */
+struct LogSettings
+{
+    /**
+     * @brief  Constructor.
+     *
+     * @param path Path of the log, allocated into the memory segment.
+     * @param pathLength Length in bytes of the path.
+     * @param flushInterval Maximum delay in milliseconds before the operations are flushed.
+     * @param flushCount Count of operations after which they are flushed without delay.
+     */
+    LogSettings(char* path, uint32_t pathLength, uint32_t flushInterval, uint32_t flushCount)
+    : m_path(path), m_pathLength(pathLength), m_flushInterval(flushInterval),
+      m_flushCount(flushCount), m_generation(0)
+    {
+    }
+
+    boost::interprocess::offset_ptr<char> m_path;
+    uint32_t m_pathLength;
+    uint32_t m_flushInterval;
+    uint32_t m_flushCount;
+    std::atomic<uint32_t> m_generation; ///< Count of times the log was replaced by a new one.
+};
+
+/**
+ * @brief  Append-only log of the operations of a storage, so that they can be replayed after the
+ * storage was lost.
+ *
+ * Each record is written without delay, in the order in which the shards serialize the operations,
+ * so that it survives the process. Flushing the records to the disk is done by a thread of each
+ * process, once every few milliseconds or once enough operations are pending: writers do not wait
+ * for the disk, and a single flush covers the operations of all the processes.
+ *
+ * Each checkpoint replaces the log by a new one, which starts with the checkpoint, so that the log
+ * only holds the records which follow the last snapshot. The processes switch to the new log before
+ * they write their next record.
+ *
+ * A record is made of:
+ *   operation (1 byte), item type (1 byte), key length (4 bytes), tag length (4 bytes),
+ *   value length (8 bytes), deadline (8 bytes), key bytes, tag bytes, value bytes,
+ *   64 bits FNV-1a checksum of the previous bytes of the record (8 bytes).
+ */
+class OperationLog
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    OperationLog() = delete;
+
+    /**
+     * @brief  Constructor, open the log for appending and start the flushing thread. Throw a
+     * std::runtime_error if the log cannot be opened.
+     *
+     * @param path Path of the log, it is created if it does not exist.
+     * @param flushInterval Maximum delay in milliseconds before the operations are flushed, 0 to
+     * flush each operation before returning.
+     * @param flushCount Count of operations after which they are flushed without delay.
+     * @param generation Count of times the log was replaced, shared by all the processes.
+     */
+    OperationLog(const std::string& path, uint32_t flushInterval, uint32_t flushCount,
+                 std::atomic<uint32_t>* generation);
+
+    /**
+     * @brief  Destructor, flush the pending operations and stop the flushing thread.
+     */
+    ~OperationLog();
+
+    /**
+     * @brief  Deleted copy constructor.
+     */
+    OperationLog(const OperationLog&) = delete;
+
+    /**
+     * @brief  Deleted assignment operator.
+     */
+    OperationLog& operator=(const OperationLog&) = delete;
+
+    /**
+     * @brief  Record that an item was created or replaced.
+     *
+     * @param key Key of the item.
+     * @param type Type of the item.
+     * @param data Value bytes of the item.
+     * @param length Length in bytes of the value.
+     * @param tag Tag associated to the item.
+     * @param deadline Time at which the item expires, 0 if it does not expire.
+     *
+     * @return true if writing the record succeeded.
+     */
+    bool appendSet(const ItemKey& key, ItemType type, const char* data, size_t length,
+                   const std::string& tag, uint64_t deadline);
+
+    /**
+     * @brief  Record that an item was removed.
+     *
+     * @param key Key of the item.
+     *
+     * @return true if writing the record succeeded.
+     */
+    bool appendRemove(const ItemKey& key);
+
+    /**
+     * @brief  Record that all the items were removed.
+     *
+     * @return true if writing the record succeeded.
+     */
+    bool appendClear();
+
+    /**
+     * @brief  Record that a snapshot was written. The log is replaced by a new one which starts with
+     * the checkpoint, followed by the records written since the snapshot started. Most of them are
+     * copied while the writers go on, the writers are locked to copy the last ones.
+     *
+     * If the writers cannot be locked, the checkpoint is appended to the log instead. If another
+     * snapshot replaced the log meanwhile, nothing is recorded: the log follows that snapshot.
+     *
+     * @param path Path of the snapshot.
+     * @param start End of the log when the snapshot started, as returned by getPosition().
+     * @param lockWriters Function which locks every writer of the log, it returns false if the
+     * writers cannot be locked.
+     * @param unlockWriters Function which unlocks the writers.
+     *
+     * @return true if the checkpoint was written and flushed.
+     */
+    bool checkpoint(const std::string& path, const LogPosition& start,
+                    const std::function<bool()>& lockWriters,
+                    const std::function<void()>& unlockWriters);
+
+    /**
+     * @brief  Get the end of the current log.
+     *
+     * @return Position of the end of the log.
+     */
+    LogPosition getPosition() const;
+
+    /**
+     * @brief  Flush the records to the disk.
+     *
+     * @return true if flushing succeeded.
+     */
+    bool flush();
+
+    /**
+     * @brief  Check the records of a log and drop its torn end, left by a host crash.
+     *
+     * @param path Path of the log.
+     * @param[out] checkpoints Path of the snapshot and log offset of each checkpoint, in order.
+     *
+     * @return true if the log does not exist or if its valid records were checked.
+     */
+    static bool recover(const std::string& path,
+                        std::vector<std::pair<std::string, uint64_t>>& checkpoints);
+
+    /**
+     * @brief  Read the record at the current offset of a log.
+     *
+     * @param reader Reader of the log, moved to the next record.
+     * @param[out] record Record read, its bytes stay valid until the next read.
+     *
+     * @return true if a valid record was read.
+     */
+    static bool read(ChunkedReader& reader, LogRecord& record);
+
+private:
+    /**
+     * @brief  Write a record, then count it as pending.
+     *
+     * @param operation Recorded operation.
+     * @param type Type of the item.
+     * @param key Key bytes.
+     * @param keyLength Length in bytes of the key.
+     * @param tag Tag bytes.
+     * @param tagLength Length in bytes of the tag.
+     * @param value Value bytes.
+     * @param valueLength Length in bytes of the value.
+     * @param deadline Time at which the item expires, 0 if it does not expire.
+     *
+     * @return true if writing the record succeeded.
+     */
+    bool append(LogOperation operation, ItemType type, const char* key, size_t keyLength,
+                const char* tag, size_t tagLength, const char* value, size_t valueLength,
+                uint64_t deadline);
+
+    /**
+     * @brief  Replace the log by a new one which starts with a checkpoint.
+     *
+     * @param path Path of the snapshot.
+     * @param start End of the log when the snapshot started.
+     * @param lockWriters Function which locks every writer of the log.
+     * @param unlockWriters Function which unlocks the writers.
+     * @param[out] locked Set to false if the writers could not be locked, left as is otherwise.
+     *
+     * @return true if the log was replaced, or if another snapshot replaced it meanwhile.
+     */
+    bool rotate(const std::string& path, const LogPosition& start,
+                const std::function<bool()>& lockWriters,
+                const std::function<void()>& unlockWriters, bool& locked);
+
+    /**
+     * @brief  Switch to the current log if another process replaced it.
+     *
+     * @return true if the current log is open.
+     */
+    bool switchToCurrentLog();
+
+    /**
+     * @brief  Flush the pending records periodically, until the log is closed.
+     */
+    void run();
+
+    std::string m_path;
+    int m_file;
+    std::atomic<uint32_t>* m_generation;
+    std::atomic<uint32_t> m_openedGeneration;
+    std::mutex m_rotationMutex;
+    uint32_t m_flushInterval;
+    uint32_t m_flushCount;
+    std::atomic<uint32_t> m_pending;
+    bool m_stopping;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::thread m_flusher;
+};
+
+} // namespace storage
+
+#endif /* STORAGE_LOG_H_ */
@@ -0,0 +1,259 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    storage_mutex.cpp
+ */
+
+// Local includes.
+#include "storage_mutex.h"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/interprocess/detail/os_thread_functions.hpp>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+
+namespace storage
+{
+
+namespace
+{
+std::atomic<uint64_t> sProcessId(0);
+thread_local boost::interprocess::interprocess_recursive_mutex* tBoundMutex = nullptr;
+
+/**
+ * @brief  Forget the process id of the parent process in a forked process.
+ */
+void resetProcessId()
+{
+    sProcessId.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief  Get the id of the current process, cached because it is read on each lock.
+ */
+uint64_t getProcessId()
+{
+    uint64_t processId = sProcessId.load(std::memory_order_relaxed);
+    if (processId == 0)
+    {
+#ifndef _WIN32
+        static std::once_flag sRegisterFork;
+        std::call_once(sRegisterFork, []() { pthread_atfork(nullptr, nullptr, resetProcessId); });
+#endif
+        processId = static_cast<uint64_t>(boost::interprocess::ipcdetail::get_current_process_id());
+        sProcessId.store(processId, std::memory_order_relaxed);
+    }
+    return processId;
+}
+
+/**
+ * @brief  Get the time until which a thread waits for a mutex before checking if a helper thread
+ * acquired it on its behalf.
+ */
+boost::posix_time::ptime getWaitingDeadline()
+{
+    return boost::posix_time::microsec_clock::universal_time() +
+           boost::posix_time::milliseconds(10);
+}
+} // namespace
+
+
+uint64_t getCurrentThreadId()
+{
+    static std::atomic<uint32_t> sThreadsCount(0);
+    thread_local const uint32_t tThreadIndex = ++sThreadsCount;
+    return (getProcessId() << 32) | tThreadIndex;
+}
+
+uint32_t getCurrentProcessId()
+{
+    return static_cast<uint32_t>(getProcessId());
+}
+
+bool isProcessAlive(uint32_t processId)
+{
+#ifdef _WIN32
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, processId);
+    if (process == nullptr)
+    {
+        return (GetLastError() != ERROR_INVALID_PARAMETER);
+    }
+    const bool alive = (WaitForSingleObject(process, 0) == WAIT_TIMEOUT);
+    CloseHandle(process);
+    return alive;
+#else
+    // the signal 0 only checks that the process exists, it may belong to another user
+    return (kill(static_cast<pid_t>(processId), 0) == 0) || (errno != ESRCH);
+#endif
+}
+
+void StorageMutex::lock()
+{
+    const uint64_t threadId = getCurrentThreadId();
+    bool owned = (m_owner.load(std::memory_order_acquire) == threadId);
+    if (!owned && !m_mutex.try_lock())
+    {
+        // the owner thread announced the hand-off before it may wait, it cannot miss it
+        if (m_handOffs.load(std::memory_order_relaxed) == 0)
+        {
+            m_mutex.lock();
+        }
+        else
+        {
+            while (!owned && !m_mutex.timed_lock(getWaitingDeadline()))
+            {
+                // a helper thread may have acquired the mutex on behalf of the current thread
+                owned = (m_owner.load(std::memory_order_acquire) == threadId);
+            }
+        }
+    }
+    if (owned)
+    {
+        ++m_count;
+    }
+    else
+    {
+        m_count = 1;
+        m_owner.store(threadId, std::memory_order_relaxed);
+    }
+}
+
+void StorageMutex::lock(uint64_t owner)
+{
+    if (owner == getCurrentThreadId())
+    {
+        lock();
+    }
+    else
+    {
+        // a helper thread waits even if the owner holds the mutex, until it releases it
+        m_mutex.lock();
+
+        // the owner may lock again as soon as it is published, from another thread
+        m_count = 1;
+        m_owner.store(owner, std::memory_order_release);
+    }
+}
+
+bool StorageMutex::try_lock()
+{
+    const uint64_t threadId = getCurrentThreadId();
+    if (m_owner.load(std::memory_order_acquire) != threadId)
+    {
+        if (!m_mutex.try_lock())
+        {
+            return false;
+        }
+        m_owner.store(threadId, std::memory_order_relaxed);
+    }
+    ++m_count;
+    return true;
+}
+
+void StorageMutex::unlock()
+{
+    if (--m_count == 0)
+    {
+        m_owner.store(0, std::memory_order_relaxed);
+        m_mutex.unlock();
+    }
+}
+
+void StorageMutex::lock_sharable()
+{
+    bool owned = isOwnedByCurrentThread();
+    if (!owned && !m_mutex.try_lock_sharable())
+    {
+        if (m_handOffs.load(std::memory_order_relaxed) == 0)
+        {
+            m_mutex.lock_sharable();
+        }
+        else
+        {
+            while (!owned && !m_mutex.timed_lock_sharable(getWaitingDeadline()))
+            {
+                // a helper thread may have acquired the mutex on behalf of the current thread
+                owned = isOwnedByCurrentThread();
+            }
+        }
+    }
+    if (owned)
+    {
+        // the owner already excludes the other threads, reading is a nested ownership
+        ++m_count;
+    }
+}
+
+bool StorageMutex::try_lock_sharable()
+{
+    if (isOwnedByCurrentThread())
+    {
+        ++m_count;
+        return true;
+    }
+    return m_mutex.try_lock_sharable();
+}
+
+void StorageMutex::unlock_sharable()
+{
+    if (isOwnedByCurrentThread())
+    {
+        unlock();
+    }
+    else
+    {
+        m_mutex.unlock_sharable();
+    }
+}
+
+void StorageMutex::reset()
+{
+    // a mutex cannot be unlocked by another process than its owner, it is constructed again
+    new (&m_mutex) boost::interprocess::interprocess_sharable_mutex();
+    m_owner.store(0, std::memory_order_relaxed);
+    m_count = 0;
+    m_handOffs.store(0, std::memory_order_relaxed);
+}
+
+SegmentMutex::Binding::Binding(boost::interprocess::interprocess_recursive_mutex* mutex)
+: m_previous(tBoundMutex)
+{
+    tBoundMutex = mutex;
+}
+
+SegmentMutex::Binding::~Binding()
+{
+    tBoundMutex = m_previous;
+}
+
+SegmentMutex::SegmentMutex() : m_mutex(tBoundMutex)
+{
+    if (m_mutex == nullptr)
+    {
+        throw std::logic_error("no mutex is bound to the segment");
+    }
+}
+
+} // namespace storage
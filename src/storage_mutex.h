@@ -0,0 +1,258 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    storage_mutex.h
+ */
+
+#ifndef STORAGE_MUTEX_H_
+#define STORAGE_MUTEX_H_
+
+
+// Includes.
+#include <atomic>
+#include <boost/interprocess/offset_ptr.hpp>
+#include <boost/interprocess/sync/interprocess_recursive_mutex.hpp>
+#include <boost/interprocess/sync/interprocess_sharable_mutex.hpp>
+#include <cstdint>
+
+
+namespace storage
+{
+
+/**
+ * @brief  Get an identifier of the current thread which is unique among all the processes.
+ *
+ * @return Identifier of the current thread, never 0.
+ */
+uint64_t getCurrentThreadId();
+
+/**
+ * @brief  Get the identifier of the current process.
+ *
+ * @return Identifier of the current process, never 0.
+ */
+uint32_t getCurrentProcessId();
+
+/**
+ * @brief  Check if a process is still running, so that the state it left into a storage can be
+ * released once it died.
+ *
+ * @param processId Identifier of the process.
+ *
+ * @return false if the process is known to have exited, true otherwise.
+ */
+bool isProcessAlive(uint32_t processId);
+
+
+/**
+ * @brief  Interprocess reader-writer mutex living into the memory segment.
+ *
+ * Exclusive ownership is recursive: the owner thread may lock the mutex again, for writing or for
+ * reading, without waiting. Sharable ownership is not recursive, callers must not request it twice
+ * because a pending writer would block the second request.
+ *
+ * The methods follow the naming of Boost.Interprocess mutexes so that scoped_lock and sharable_lock
+ * can be used.
+ */
+class StorageMutex
+{
+public:
+    /**
+     * @brief  Constructor.
+     */
+    StorageMutex() : m_mutex(), m_owner(0), m_count(0), m_handOffs(0) {}
+
+    /**
+     * @brief  Deleted copy constructor.
+     */
+    StorageMutex(const StorageMutex&) = delete;
+
+    /**
+     * @brief  Deleted assignment operator.
+     */
+    StorageMutex& operator=(const StorageMutex&) = delete;
+
+    /**
+     * @brief  Acquire exclusive ownership, waiting for readers and writers to release the mutex,
+     * or, while a hand-off is pending, for a helper thread to acquire it on behalf of the current
+     * thread.
+     */
+    void lock();
+
+    /**
+     * @brief  Acquire exclusive ownership on behalf of a thread, which then owns the mutex as if
+     * it locked it itself. It lets a helper thread wait for the mutex in place of the owner. The
+     * helper always waits for the mutex, even if the owner thread holds it meanwhile. The owner
+     * thread must call beginHandOff() before the helper may call it.
+     *
+     * @param owner Identifier of the owner thread, as returned by getCurrentThreadId().
+     */
+    void lock(uint64_t owner);
+
+    /**
+     * @brief  Announce that a helper thread will acquire the mutex on behalf of the current thread.
+     * Until endHandOff() is called, the threads which wait for the mutex check periodically if it
+     * was acquired on their behalf, instead of blocking.
+     */
+    void beginHandOff() { m_handOffs.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief  End a hand-off announced by beginHandOff(), once the helper thread acquired the
+     * mutex or will not try anymore.
+     */
+    void endHandOff() { m_handOffs.fetch_sub(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief  Try to acquire exclusive ownership without waiting.
+     *
+     * @return true if the mutex was acquired.
+     */
+    bool try_lock();
+
+    /**
+     * @brief  Release exclusive ownership, or a nested ownership of the owner thread.
+     */
+    void unlock();
+
+    /**
+     * @brief  Acquire sharable ownership, waiting for writers to release the mutex, or, while a
+     * hand-off is pending, for a helper thread to acquire exclusive ownership on behalf of the
+     * current thread.
+     */
+    void lock_sharable();
+
+    /**
+     * @brief  Try to acquire sharable ownership without waiting.
+     *
+     * @return true if the mutex was acquired.
+     */
+    bool try_lock_sharable();
+
+    /**
+     * @brief  Release sharable ownership.
+     */
+    void unlock_sharable();
+
+    /**
+     * @brief  Check if the current thread owns the mutex exclusively.
+     *
+     * @return true if the current thread owns the mutex exclusively.
+     */
+    bool isOwnedByCurrentThread() const
+    {
+        // acquire the count published by a helper thread which locked on behalf of this one
+        return (m_owner.load(std::memory_order_acquire) == getCurrentThreadId());
+    }
+
+    /**
+     * @brief  Release every ownership left by the processes which used the mutex, once none of
+     * them runs anymore.
+     */
+    void reset();
+
+private:
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the owner must be readable by all the processes");
+
+    boost::interprocess::interprocess_sharable_mutex m_mutex;
+    std::atomic<uint64_t> m_owner;
+    uint32_t m_count;
+    std::atomic<uint32_t> m_handOffs; ///< Count of the pending hand-offs.
+};
+
+
+/**
+ * @brief  Mutex of the allocator of a memory segment. The allocator constructs its mutexes into
+ * the segment, out of reach of the storage, so they all refer to a single recursive mutex which
+ * the storage can reset once the processes which used it died.
+ */
+class SegmentMutex
+{
+public:
+    /**
+     * @brief  Mutex to which the segment mutexes constructed by the current thread refer, as long
+     * as the binding lives.
+     */
+    class Binding
+    {
+    public:
+        /**
+         * @brief  Constructor.
+         *
+         * @param mutex Mutex of the storage, it must live in the same mapping as the segment.
+         */
+        explicit Binding(boost::interprocess::interprocess_recursive_mutex* mutex);
+
+        /**
+         * @brief  Destructor, restore the previous binding.
+         */
+        ~Binding();
+
+        /**
+         * @brief  Deleted copy constructor.
+         */
+        Binding(const Binding&) = delete;
+
+        /**
+         * @brief  Deleted assignment operator.
+         */
+        Binding& operator=(const Binding&) = delete;
+
+    private:
+        boost::interprocess::interprocess_recursive_mutex* m_previous;
+    };
+
+    /**
+     * @brief  Constructor, refer to the mutex bound by the current thread.
+     *
+     * @throw  std::logic_error if no mutex is bound.
+     */
+    SegmentMutex();
+
+    /**
+     * @brief  Deleted copy constructor.
+     */
+    SegmentMutex(const SegmentMutex&) = delete;
+
+    /**
+     * @brief  Deleted assignment operator.
+     */
+    SegmentMutex& operator=(const SegmentMutex&) = delete;
+
+    /**
+     * @brief  Acquire the bound mutex, recursively.
+     */
+    void lock() { m_mutex->lock(); }
+
+    /**
+     * @brief  Try to acquire the bound mutex without waiting.
+     *
+     * @return true if the mutex was acquired.
+     */
+    bool try_lock() { return m_mutex->try_lock(); }
+
+    /**
+     * @brief  Release the bound mutex.
+     */
+    void unlock() { m_mutex->unlock(); }
+
+private:
+    boost::interprocess::offset_ptr<boost::interprocess::interprocess_recursive_mutex> m_mutex;
+};
+
+} // namespace storage
+
+#endif /* STORAGE_MUTEX_H_ */
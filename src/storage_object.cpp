@@ -0,0 +1,177 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    storage_object.cpp
+ */
+
+// Local includes.
+#include "storage_object.h"
+#include <boost/interprocess/detail/os_file_functions.hpp>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <sys/file.h>
+#endif
+
+
+namespace storage
+{
+
+namespace
+{
+#ifdef _WIN32
+/**
+ * @brief  Get the overlapped structure of the byte which processes lock to use a memory object.
+ * The byte lies far beyond the end of the object, so that the lock never prevents an access.
+ */
+OVERLAPPED getLockedByte()
+{
+    OVERLAPPED overlapped = {};
+    overlapped.OffsetHigh = 0x7FFFFFFF;
+    return overlapped;
+}
+#endif
+} // namespace
+
+
+StorageObject::StorageObject(boost::interprocess::create_only_t, const std::string& name,
+                             StorageBackend backend)
+: m_backend(backend), m_memory(), m_file()
+{
+    if (m_backend == eMappedFile)
+    {
+        // a file mapping can only be created from an existing file
+        boost::interprocess::file_handle_t handle = boost::interprocess::ipcdetail::create_new_file(
+            name.c_str(), boost::interprocess::read_write);
+        if (handle == boost::interprocess::ipcdetail::invalid_file())
+        {
+            boost::interprocess::error_info error(boost::interprocess::system_error_code());
+            throw boost::interprocess::interprocess_exception(error);
+        }
+        boost::interprocess::ipcdetail::close_file(handle);
+        m_file = boost::interprocess::file_mapping(name.c_str(), boost::interprocess::read_write);
+    }
+    else
+    {
+        m_memory = boost::interprocess::shared_memory_object(
+            boost::interprocess::create_only, name.c_str(), boost::interprocess::read_write);
+    }
+}
+
+StorageObject::StorageObject(boost::interprocess::open_only_t, const std::string& name,
+                             StorageBackend backend)
+: m_backend(backend), m_memory(), m_file()
+{
+    if (m_backend == eMappedFile)
+    {
+        m_file = boost::interprocess::file_mapping(name.c_str(), boost::interprocess::read_write);
+    }
+    else
+    {
+        m_memory = boost::interprocess::shared_memory_object(
+            boost::interprocess::open_only, name.c_str(), boost::interprocess::read_write);
+    }
+}
+
+bool StorageObject::getSize(boost::interprocess::offset_t& size) const
+{
+    if (m_backend == eMappedFile)
+    {
+        return boost::interprocess::ipcdetail::get_file_size(
+            boost::interprocess::ipcdetail::file_handle_from_mapping_handle(
+                m_file.get_mapping_handle()),
+            size);
+    }
+    return m_memory.get_size(size);
+}
+
+void StorageObject::truncate(boost::interprocess::offset_t size)
+{
+    if (m_backend == eMappedFile)
+    {
+        bool truncated = boost::interprocess::ipcdetail::truncate_file(
+            boost::interprocess::ipcdetail::file_handle_from_mapping_handle(
+                m_file.get_mapping_handle()),
+            static_cast<std::size_t>(size));
+        if (!truncated)
+        {
+            boost::interprocess::error_info error(boost::interprocess::system_error_code());
+            throw boost::interprocess::interprocess_exception(error);
+        }
+    }
+    else
+    {
+        m_memory.truncate(size);
+    }
+}
+
+boost::interprocess::mapped_region StorageObject::map(std::size_t size) const
+{
+    if (m_backend == eMappedFile)
+    {
+        return boost::interprocess::mapped_region(m_file, boost::interprocess::read_write, 0,
+                                                  size);
+    }
+    return boost::interprocess::mapped_region(m_memory, boost::interprocess::read_write, 0, size);
+}
+
+bool StorageObject::tryLockExclusive()
+{
+    // the locks belong to the opening of the object, not to the process, so that a process which
+    // already uses the object does not see itself as the only one
+#ifdef _WIN32
+    OVERLAPPED overlapped = getLockedByte();
+    return (LockFileEx(getHandle(), LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0,
+                       &overlapped) != FALSE);
+#else
+    return (flock(getHandle(), LOCK_EX | LOCK_NB) == 0);
+#endif
+}
+
+void StorageObject::lockSharable()
+{
+    // a file system without locks cannot tell the first process, which then resets nothing
+#ifdef _WIN32
+    OVERLAPPED overlapped = getLockedByte();
+    UnlockFileEx(getHandle(), 0, 1, 0, &overlapped);
+    LockFileEx(getHandle(), 0, 0, 1, 0, &overlapped);
+#else
+    int result = 0;
+    do
+    {
+        result = flock(getHandle(), LOCK_SH);
+    } while ((result != 0) && (errno == EINTR));
+#endif
+}
+
+boost::interprocess::file_handle_t StorageObject::getHandle() const
+{
+    return boost::interprocess::ipcdetail::file_handle_from_mapping_handle(
+        (m_backend == eMappedFile) ? m_file.get_mapping_handle() : m_memory.get_mapping_handle());
+}
+
+bool StorageObject::remove(const std::string& name, StorageBackend backend)
+{
+    if (backend == eMappedFile)
+    {
+        return boost::interprocess::file_mapping::remove(name.c_str());
+    }
+    return boost::interprocess::shared_memory_object::remove(name.c_str());
+}
+
+} // namespace storage
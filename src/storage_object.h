@@ -0,0 +1,148 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    storage_object.h
+ */
+
+#ifndef STORAGE_OBJECT_H_
+#define STORAGE_OBJECT_H_
+
+
+// Includes.
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <string>
+
+
+namespace storage
+{
+
+/**
+ * @brief  Kind of memory object backing a shared storage.
+ */
+enum StorageBackend
+{
+    eSharedMemory = 0, ///< Shared memory object, lost when the host restarts.
+    eMappedFile = 1    ///< File mapped into memory, the storage name is its path.
+};
+
+/**
+ * @brief  Memory object backing a shared storage, either a shared memory object or a file. Both
+ * are mapped the same way, so the storage does not depend on its backend once mapped.
+ */
+class StorageObject
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    StorageObject() = delete;
+
+    /**
+     * @brief  Create a new empty memory object, fail if it already exists.
+     *
+     * @param name Name of the shared memory object or path of the file.
+     * @param backend Kind of memory object.
+     */
+    StorageObject(boost::interprocess::create_only_t, const std::string& name,
+                  StorageBackend backend);
+
+    /**
+     * @brief  Open an existing memory object.
+     *
+     * @param name Name of the shared memory object or path of the file.
+     * @param backend Kind of memory object.
+     */
+    StorageObject(boost::interprocess::open_only_t, const std::string& name,
+                  StorageBackend backend);
+
+    /**
+     * @brief  Get the kind of memory object.
+     *
+     * @return Backend of the memory object.
+     */
+    StorageBackend getBackend() const { return m_backend; }
+
+    /**
+     * @brief  Get the size of the memory object.
+     *
+     * @param[out] size Size in bytes of the memory object.
+     *
+     * @return true if getting the size succeeded.
+     */
+    bool getSize(boost::interprocess::offset_t& size) const;
+
+    /**
+     * @brief  Resize the memory object, throw an interprocess_exception if it failed.
+     *
+     * @param size New size in bytes of the memory object.
+     */
+    void truncate(boost::interprocess::offset_t size);
+
+    /**
+     * @brief  Map the start of the memory object for reading and writing. The mapping may span
+     * beyond the end of the object, those pages can only be accessed once the object is resized.
+     *
+     * @param size Size in bytes of the mapping.
+     *
+     * @return Mapped region.
+     */
+    boost::interprocess::mapped_region map(std::size_t size) const;
+
+    /**
+     * @brief  Try to become the only process which uses the memory object, without waiting. The
+     * state which the previous processes left into the object, even those which died while
+     * holding a lock, can then be reset.
+     *
+     * @return true if no other process uses the memory object. lockSharable() must then be
+     * called once the state is reset.
+     */
+    bool tryLockExclusive();
+
+    /**
+     * @brief  Declare that the current process uses the memory object until it is closed, waiting
+     * while another process resets the state of the object.
+     */
+    void lockSharable();
+
+    /**
+     * @brief  Remove a memory object, it stays mapped by the processes which use it.
+     *
+     * @param name Name of the shared memory object or path of the file.
+     * @param backend Kind of memory object.
+     *
+     * @return true if removing the memory object succeeded.
+     */
+    static bool remove(const std::string& name, StorageBackend backend);
+
+private:
+    /**
+     * @brief  Get the handle of the file or of the shared memory object.
+     *
+     * @return Handle of the memory object.
+     */
+    boost::interprocess::file_handle_t getHandle() const;
+
+    StorageBackend m_backend;
+    boost::interprocess::shared_memory_object m_memory;
+    boost::interprocess::file_mapping m_file;
+};
+
+} // namespace storage
+
+#endif /* STORAGE_OBJECT_H_ */
@@ -0,0 +1,216 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    storage_snapshot.cpp
+ */
+
+// Local includes.
+#include "storage_snapshot.h"
+#include <algorithm>
+#include <iterator>
+
+
+namespace storage
+{
+
+namespace
+{
+const char kSnapshotMagic[4] = {'W', 'K', 'S', 'S'};
+const uint32_t kSnapshotVersion = 2;
+const size_t kHeaderSize = sizeof(kSnapshotMagic) + sizeof(uint32_t);
+const size_t kRecordSizeV1 = 1 + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+const size_t kRecordSize = kRecordSizeV1 + sizeof(uint64_t);
+const size_t kTrailerSize = 1 + 2 * sizeof(uint64_t);
+const size_t kChunkSize = 64 * 1024;
+} // namespace
+
+
+ChunkedReader::ChunkedReader(const std::string& path)
+: m_file(path.c_str(), std::ios::binary), m_buffer(), m_position(0), m_offset(0), m_size(0)
+{
+    if (m_file.is_open() && m_file.seekg(0, std::ios::end))
+    {
+        m_size = static_cast<uint64_t>(m_file.tellg());
+        m_file.seekg(0, std::ios::beg);
+    }
+}
+
+const char* ChunkedReader::peek(size_t length)
+{
+    if (length > m_size - m_offset)
+    {
+        return nullptr;
+    }
+    const size_t available = m_buffer.size() - m_position;
+    if (available < length)
+    {
+        // the bytes already read are dropped before the buffer grows
+        m_buffer.erase(0, m_position);
+        m_position = 0;
+        const size_t wanted = std::max(length - available, kChunkSize);
+        m_buffer.resize(available + wanted);
+        m_file.read(&m_buffer[available], static_cast<std::streamsize>(wanted));
+        m_buffer.resize(available + static_cast<size_t>(m_file.gcount()));
+        if (m_buffer.size() < length)
+        {
+            return nullptr;
+        }
+    }
+    return m_buffer.data() + m_position;
+}
+
+void ChunkedReader::skip(size_t length)
+{
+    m_position += length;
+    m_offset += length;
+}
+
+bool ChunkedReader::seek(uint64_t offset)
+{
+    if (offset > m_size)
+    {
+        return false;
+    }
+    m_file.clear();
+    m_file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+    m_buffer.clear();
+    m_position = 0;
+    m_offset = offset;
+    return m_file.good();
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+: m_file(path.c_str(), std::ios::binary | std::ios::trunc), m_buffer(), m_count(0),
+  m_checksum(kChecksumSeed)
+{
+    m_buffer.append(kSnapshotMagic, sizeof(kSnapshotMagic));
+    appendInteger<uint32_t>(m_buffer, kSnapshotVersion);
+}
+
+void SnapshotWriter::append(const ItemKey& key, ItemType type, const char* data, size_t length,
+                            const std::string& tag, uint64_t deadline)
+{
+    m_buffer.push_back(static_cast<char>(type));
+    appendInteger<uint32_t>(m_buffer, static_cast<uint32_t>(key.length()));
+    appendInteger<uint32_t>(m_buffer, static_cast<uint32_t>(tag.size()));
+    appendInteger<uint64_t>(m_buffer, static_cast<uint64_t>(length));
+    appendInteger<uint64_t>(m_buffer, deadline);
+    m_buffer.append(key.data(), key.length());
+    m_buffer.append(tag);
+    m_buffer.append(data, length);
+    ++m_count;
+}
+
+bool SnapshotWriter::flush()
+{
+    m_checksum = updateChecksum(m_checksum, m_buffer.data(), m_buffer.size());
+    m_file.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+    m_buffer.clear();
+    return m_file.good();
+}
+
+bool SnapshotWriter::close()
+{
+    m_buffer.push_back(static_cast<char>(eNone));
+    appendInteger<uint64_t>(m_buffer, m_count);
+    bool written = flush();
+    appendInteger<uint64_t>(m_buffer, m_checksum);
+    m_file.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+    m_buffer.clear();
+    m_file.close();
+    return written && !m_file.fail();
+}
+
+SnapshotReader::SnapshotReader(const std::string& path)
+: m_bytes(), m_offset(kHeaderSize), m_end(0), m_recordSize(kRecordSize), m_valid(false)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+    {
+        return;
+    }
+    m_bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (file.bad() || (m_bytes.size() < kHeaderSize + kTrailerSize) ||
+        (std::memcmp(m_bytes.data(), kSnapshotMagic, sizeof(kSnapshotMagic)) != 0))
+    {
+        return;
+    }
+    const uint32_t version = readInteger<uint32_t>(m_bytes.data() + sizeof(kSnapshotMagic));
+    if ((version == 0) || (version > kSnapshotVersion))
+    {
+        return;
+    }
+    m_recordSize = (version == 1) ? kRecordSizeV1 : kRecordSize;
+
+    const size_t checked = m_bytes.size() - sizeof(uint64_t);
+    const uint64_t checksum = updateChecksum(kChecksumSeed, m_bytes.data(), checked);
+    if (checksum != readInteger<uint64_t>(m_bytes.data() + checked))
+    {
+        return;
+    }
+
+    // walk the records once so that next() never reads a malformed snapshot
+    m_end = m_bytes.size() - kTrailerSize;
+    uint64_t count = 0;
+    SnapshotEntry entry;
+    while (parse(entry))
+    {
+        ++count;
+    }
+    m_valid = (m_offset == m_end) && (m_bytes[m_end] == static_cast<char>(eNone)) &&
+              (readInteger<uint64_t>(m_bytes.data() + m_end + 1) == count);
+    m_offset = kHeaderSize;
+}
+
+bool SnapshotReader::next(SnapshotEntry& entry)
+{
+    return m_valid && parse(entry);
+}
+
+bool SnapshotReader::parse(SnapshotEntry& entry)
+{
+    if ((m_end - m_offset < m_recordSize) || (m_bytes[m_offset] == static_cast<char>(eNone)))
+    {
+        return false;
+    }
+
+    const char* record = m_bytes.data() + m_offset;
+    const uint8_t type = static_cast<uint8_t>(record[0]);
+    const uint64_t keyLength = readInteger<uint32_t>(record + 1);
+    const uint64_t tagLength = readInteger<uint32_t>(record + 1 + sizeof(uint32_t));
+    const uint64_t valueLength = readInteger<uint64_t>(record + 1 + 2 * sizeof(uint32_t));
+    const uint64_t available = m_end - m_offset - m_recordSize;
+    if ((type > eBinary) || (keyLength > available) || (tagLength > available - keyLength) ||
+        (valueLength > available - keyLength - tagLength))
+    {
+        return false;
+    }
+
+    entry.m_type = static_cast<ItemType>(type);
+    entry.m_deadline = (m_recordSize == kRecordSize) ? readInteger<uint64_t>(record + kRecordSizeV1)
+                                                     : 0;
+    entry.m_key = record + m_recordSize;
+    entry.m_keyLength = static_cast<size_t>(keyLength);
+    entry.m_tag = entry.m_key + keyLength;
+    entry.m_tagLength = static_cast<size_t>(tagLength);
+    entry.m_value = entry.m_tag + tagLength;
+    entry.m_valueLength = static_cast<size_t>(valueLength);
+    m_offset += m_recordSize + static_cast<size_t>(keyLength + tagLength + valueLength);
+    return true;
+}
+
+} // namespace storage
@@ -0,0 +1,297 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    storage_snapshot.h
+ */
+
+#ifndef STORAGE_SNAPSHOT_H_
+#define STORAGE_SNAPSHOT_H_
+
+
+// Includes.
+#include "shared_item.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+
+namespace storage
+{
+
+const uint64_t kChecksumSeed = 14695981039346656037ULL;
+
+/**
+ * @brief  Continue a 64 bits FNV-1a checksum with more bytes.
+ *
+ * @param checksum Checksum of the previous bytes, kChecksumSeed for the first bytes.
+ * @param data Bytes to add to the checksum.
+ * @param length Count of bytes to add.
+ *
+ * @return Checksum of all the bytes.
+ */
+inline uint64_t updateChecksum(uint64_t checksum, const char* data, size_t length)
+{
+    for (size_t iter = 0; iter < length; ++iter)
+    {
+        checksum ^= static_cast<unsigned char>(data[iter]);
+        checksum *= 1099511628211ULL;
+    }
+    return checksum;
+}
+
+/**
+ * @brief  Append the bytes of an integer to a buffer, in the byte order of the host.
+ *
+ * @param buffer Buffer to append to.
+ * @param value Integer to append.
+ */
+template <class T> inline void appendInteger(std::string& buffer, T value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/**
+ * @brief  Read an integer from its bytes, in the byte order of the host.
+ *
+ * @param data Bytes of the integer.
+ *
+ * @return Integer read.
+ */
+template <class T> inline T readInteger(const char* data)
+{
+    T value = 0;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+/**
+ * @brief  Reader of a file through a bounded buffer, so that files larger than the memory can be
+ * parsed: the buffer holds a chunk of the file, and only grows to hold a larger record. Records are
+ * peeked at the current offset, then skipped.
+ */
+class ChunkedReader
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    ChunkedReader() = delete;
+
+    /**
+     * @brief  Constructor, open the file.
+     *
+     * @param path Path of the file.
+     */
+    explicit ChunkedReader(const std::string& path);
+
+    /**
+     * @brief  Check if the file was opened.
+     *
+     * @return true if the file exists and was opened.
+     */
+    bool isOpen() const { return m_file.is_open(); }
+
+    /**
+     * @brief  Check if reading the file failed, which is not the case at its end.
+     *
+     * @return true if an I/O error occurred.
+     */
+    bool hasFailed() const { return m_file.bad(); }
+
+    /**
+     * @brief  Get the size of the file when it was opened.
+     *
+     * @return Size in bytes of the file.
+     */
+    uint64_t getSize() const { return m_size; }
+
+    /**
+     * @brief  Get the current offset.
+     *
+     * @return Offset in bytes of the next byte to read.
+     */
+    uint64_t getOffset() const { return m_offset; }
+
+    /**
+     * @brief  Get bytes at the current offset without moving it. They stay valid until the next
+     * call.
+     *
+     * @param length Count of bytes.
+     *
+     * @return Bytes read, or nullptr if the file ends before.
+     */
+    const char* peek(size_t length);
+
+    /**
+     * @brief  Move the current offset after peeked bytes.
+     *
+     * @param length Count of bytes, at most the count of the last peek.
+     */
+    void skip(size_t length);
+
+    /**
+     * @brief  Move the current offset.
+     *
+     * @param offset New offset in bytes, at most the size of the file.
+     *
+     * @return true if the offset was moved.
+     */
+    bool seek(uint64_t offset);
+
+private:
+    std::ifstream m_file;
+    std::string m_buffer;
+    size_t m_position;
+    uint64_t m_offset;
+    uint64_t m_size;
+};
+
+/**
+ * @brief  Item read from a snapshot. Its bytes belong to the snapshot reader.
+ */
+struct SnapshotEntry
+{
+    ItemType m_type;      ///< Type of the item.
+    const char* m_key;    ///< Key bytes.
+    size_t m_keyLength;   ///< Length in bytes of the key.
+    const char* m_tag;    ///< Tag bytes.
+    size_t m_tagLength;   ///< Length in bytes of the tag.
+    const char* m_value;  ///< Value bytes.
+    size_t m_valueLength; ///< Length in bytes of the value.
+    uint64_t m_deadline;  ///< Time at which the item expires, 0 if it does not expire.
+};
+
+/**
+ * @brief  Writer of a snapshot file.
+ *
+ * A snapshot starts with a header, then holds one record per item:
+ *   type (1 byte), key length (4 bytes), tag length (4 bytes), value length (8 bytes),
+ *   deadline (8 bytes), key bytes, tag bytes, value bytes.
+ * Snapshots of the first version have no deadline.
+ * It ends with a record of type eNone followed by the count of items (8 bytes) and the 64 bits
+ * FNV-1a checksum of all the previous bytes (8 bytes). Integers are written in the byte order of
+ * the host.
+ *
+ * Records are appended to a memory buffer, which is written to the file on flush(), so that the
+ * items can be copied quickly and written once their storage is released.
+ */
+class SnapshotWriter
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    SnapshotWriter() = delete;
+
+    /**
+     * @brief  Constructor, create the snapshot file and write its header.
+     *
+     * @param path Path of the snapshot file, it is overwritten if it exists.
+     */
+    explicit SnapshotWriter(const std::string& path);
+
+    /**
+     * @brief  Append an item to the buffer.
+     *
+     * @param key Key of the item.
+     * @param type Type of the item.
+     * @param data Value bytes of the item.
+     * @param length Length in bytes of the value.
+     * @param tag Tag associated to the item.
+     * @param deadline Time at which the item expires, 0 if it does not expire.
+     */
+    void append(const ItemKey& key, ItemType type, const char* data, size_t length,
+                const std::string& tag, uint64_t deadline);
+
+    /**
+     * @brief  Write the buffer to the file.
+     *
+     * @return true if writing succeeded.
+     */
+    bool flush();
+
+    /**
+     * @brief  Write the end of the snapshot and close the file.
+     *
+     * @return true if the whole snapshot was written.
+     */
+    bool close();
+
+private:
+    std::ofstream m_file;
+    std::string m_buffer;
+    uint64_t m_count;
+    uint64_t m_checksum;
+};
+
+/**
+ * @brief  Reader of a snapshot file. The whole file is loaded and checked at construction, so that
+ * a truncated or corrupted snapshot is rejected before any item is read.
+ */
+class SnapshotReader
+{
+public:
+    /**
+     * @brief  Deleted constructor.
+     */
+    SnapshotReader() = delete;
+
+    /**
+     * @brief  Constructor, load and check the snapshot file.
+     *
+     * @param path Path of the snapshot file.
+     */
+    explicit SnapshotReader(const std::string& path);
+
+    /**
+     * @brief  Check if the snapshot was loaded and is not corrupted.
+     *
+     * @return true if the snapshot is valid.
+     */
+    bool isValid() const { return m_valid; }
+
+    /**
+     * @brief  Read the next item.
+     *
+     * @param[out] entry Next item.
+     *
+     * @return true if an item was read, false at the end of the snapshot.
+     */
+    bool next(SnapshotEntry& entry);
+
+private:
+    /**
+     * @brief  Read an item at the current offset.
+     *
+     * @param[out] entry Item read.
+     *
+     * @return true if an item was read, false at the end of the items or if the record overflows
+     * the snapshot.
+     */
+    bool parse(SnapshotEntry& entry);
+
+    std::string m_bytes;
+    size_t m_offset;
+    size_t m_end;
+    size_t m_recordSize;
+    bool m_valid;
+};
+
+} // namespace storage
+
+#endif /* STORAGE_SNAPSHOT_H_ */
@@ -23,10 +23,25 @@
 #include "common_process.h"
 #include "shared_storage.h"
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/anonymous_shared_memory.hpp>
+#include <boost/interprocess/file_mapping.hpp>
 #include <boost/process/child.hpp>
+#include <algorithm>
 #include <chrono>
+#include <fstream>
+#include <atomic>
 #include <future>
+#include <limits>
+#include <map>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 const int64_t kSize = 1024 * 1024;
 
@@ -42,31 +57,45 @@ public:
     operator double() const { return m_double; }
     operator std::string() const { return m_string; }
 
-    template <class T> void set(const std::string& key, storage::Item<T>& item) {}
+    template <class T> void set(const storage::ItemKey& key, storage::Item<T>& item) {}
 
     storage::ItemType m_type;
     bool m_bool;
     double m_double;
     std::string m_string;
+    std::string m_tag;
 };
 
-template <> void ItemConsumer::set<bool>(const std::string& key, storage::Item<bool>& item)
+template <> void ItemConsumer::set<bool>(const storage::ItemKey& key, storage::Item<bool>& item)
 {
     m_type = item.getType();
     m_bool = item.getValue();
+    m_tag = item.getTag();
 }
 
-template <> void ItemConsumer::set<double>(const std::string& key, storage::Item<double>& item)
+template <> void ItemConsumer::set<double>(const storage::ItemKey& key, storage::Item<double>& item)
 {
     m_type = item.getType();
     m_double = item.getValue();
+    m_tag = item.getTag();
 }
 
 template <>
-void ItemConsumer::set<std::string>(const std::string& key, storage::Item<std::string>& item)
+void ItemConsumer::set<std::string>(const storage::ItemKey& key,
+                                    storage::Item<std::string>& item)
 {
     m_type = item.getType();
     m_string = item.getValue();
+    m_tag = item.getTag();
+}
+
+template <>
+void ItemConsumer::set<storage::BinaryValue>(const storage::ItemKey& key,
+                                             storage::Item<storage::BinaryValue>& item)
+{
+    m_type = item.getType();
+    m_string.assign(item.getValue().data(), item.getValue().length());
+    m_tag = item.getTag();
 }
 
 
@@ -76,10 +105,10 @@ class StorageSetter
 public:
     StorageSetter() = delete;
 
-    StorageSetter(const std::string& name)
+    StorageSetter(const std::string& name, int64_t size = kSize)
     {
         storage::Status status = storage::eOk;
-        m_storage.reset(storage::SharedStorage::create(name, kSize, status));
+        m_storage.reset(storage::SharedStorage::create(name, size, status));
     }
 
     storage::SharedStorage* get() const { return m_storage.get(); }
@@ -325,6 +354,2207 @@ TEST_CASE("String item can be created, read, updated and removed")
 }
 
 
+TEST_CASE("Binary item can be created, read, compared and removed")
+{
+    StorageSetter setter(std::string("binary-storage"));
+    std::string key("binary-item"), tag("bytes");
+    const unsigned char bytes[] = {0x00, 0xff, 0xfe, 0x00, 0x80, 0x41, 0x00};
+    storage::BinaryValue value(bytes, sizeof(bytes));
+    storage::Status status =
+        setter.get()->setItem(key, storage::Item<storage::BinaryValue>(value, tag));
+
+    SECTION("Reading a binary item")
+    {
+        REQUIRE(status == storage::eOk);
+        ItemConsumer consumer;
+        status = setter.get()->getItem<ItemConsumer>(key, consumer);
+        CHECK(status == storage::eOk);
+        CHECK(consumer.getType() == storage::eBinary);
+        CHECK(consumer.m_tag == tag);
+        CHECK(consumer.m_string ==
+              std::string(reinterpret_cast<const char*>(bytes), sizeof(bytes)));
+    }
+
+    SECTION("Comparing and setting a binary item")
+    {
+        bool swapped = true;
+        storage::BinaryValue other(bytes, sizeof(bytes) - 1);
+        status = setter.get()->compareAndSet(key, other, storage::Item<double>(1.0, ""), swapped);
+        CHECK(status == storage::eOk);
+        CHECK(!swapped);
+        status = setter.get()->compareAndSet(key, value, storage::Item<double>(2.0, ""), swapped);
+        CHECK(status == storage::eOk);
+        CHECK(swapped);
+        ItemConsumer consumer;
+        setter.get()->getItem<ItemConsumer>(key, consumer);
+        CHECK(consumer.getType() == storage::eDouble);
+    }
+
+    SECTION("Removing a binary item")
+    {
+        status = setter.get()->removeItem(key);
+        CHECK(status == storage::eOk);
+        ItemConsumer consumer;
+        status = setter.get()->getItem<ItemConsumer>(key, consumer);
+        CHECK(status == storage::eItemNotFound);
+    }
+}
+
+
+TEST_CASE("String values keep their bytes whatever their length")
+{
+    StorageSetter setter(std::string("inline-storage"));
+    std::string key("inline-item"), tag;
+    std::string inlineValue(23, 'i');
+    std::string spilledValue(24, 's');
+    std::string binaryValue("nul\0byte", 8);
+
+    auto roundTrip = [&](const std::string& value) {
+        storage::Status status =
+            setter.get()->setItem(key, storage::Item<std::string>(value, tag));
+        REQUIRE(status == storage::eOk);
+        ItemConsumer consumer;
+        status = setter.get()->getItem<ItemConsumer>(key, consumer);
+        REQUIRE(status == storage::eOk);
+        CHECK(static_cast<std::string>(consumer) == value);
+    };
+
+    SECTION("Growing and shrinking a string value")
+    {
+        roundTrip(inlineValue);
+        roundTrip(spilledValue);
+        roundTrip(spilledValue + spilledValue + spilledValue);
+        roundTrip(spilledValue);
+        roundTrip(inlineValue);
+        roundTrip(std::string());
+    }
+
+    SECTION("Writing a string value with null bytes") { roundTrip(binaryValue); }
+
+    SECTION("Overriding a spilled string with a double value")
+    {
+        roundTrip(spilledValue);
+        storage::Status status = setter.get()->setItem(key, storage::Item<double>(2.5, tag));
+        REQUIRE(status == storage::eOk);
+        ItemConsumer consumer;
+        status = setter.get()->getItem<ItemConsumer>(key, consumer);
+        CHECK(status == storage::eOk);
+        CHECK(consumer.getType() == storage::eDouble);
+        CHECK(static_cast<double>(consumer) == 2.5);
+    }
+}
+
+
+TEST_CASE("Items are identified by the bytes of their key")
+{
+    StorageSetter setter(std::string("key-storage"));
+    const char kKey[] = {'k', 'e', 'y', '\0', '1'};
+    storage::ItemKey key(kKey, sizeof(kKey));
+    storage::ItemKey truncatedKey(kKey);
+    std::string longKey(1000, 'k');
+
+    storage::Status status = setter.get()->setItem(key, storage::Item<double>(1, ""));
+    REQUIRE(status == storage::eOk);
+    status = setter.get()->setItem(longKey, storage::Item<double>(2, ""));
+    REQUIRE(status == storage::eOk);
+
+    SECTION("Reading items with binary and long keys")
+    {
+        ItemConsumer consumer;
+        status = setter.get()->getItem<ItemConsumer>(key, consumer);
+        CHECK(status == storage::eOk);
+        CHECK(static_cast<double>(consumer) == 1);
+        status = setter.get()->getItem<ItemConsumer>(longKey, consumer);
+        CHECK(status == storage::eOk);
+        CHECK(static_cast<double>(consumer) == 2);
+    }
+
+    SECTION("Reading an item with a key prefix")
+    {
+        ItemConsumer consumer;
+        status = setter.get()->getItem<ItemConsumer>(truncatedKey, consumer);
+        CHECK(status == storage::eItemNotFound);
+        const std::string itemKey = longKey.substr(1);
+        status = setter.get()->getItem<ItemConsumer>(itemKey, consumer);
+        CHECK(status == storage::eItemNotFound);
+    }
+}
+
+
+TEST_CASE("Many items can be created, read and removed")
+{
+    StorageSetter setter(std::string("many-items-storage"));
+    const int kItemsCount = 2000;
+    auto makeKey = [](int index) { return std::string("item-") + std::to_string(index); };
+
+    storage::Status status = storage::eOk;
+    for (int iter = 0; (iter < kItemsCount) && (status == storage::eOk); ++iter)
+    {
+        const std::string itemKey = makeKey(iter);
+        status = setter.get()->setItem(itemKey, storage::Item<double>(iter, ""));
+    }
+    REQUIRE(status == storage::eOk);
+
+    SECTION("Reading all the items")
+    {
+        for (int iter = 0; iter < kItemsCount; ++iter)
+        {
+            ItemConsumer consumer;
+            const std::string itemKey = makeKey(iter);
+            status = setter.get()->getItem<ItemConsumer>(itemKey, consumer);
+            REQUIRE(status == storage::eOk);
+            REQUIRE(static_cast<double>(consumer) == iter);
+        }
+    }
+
+    SECTION("Removing and re-creating half of the items")
+    {
+        for (int iter = 0; iter < kItemsCount; iter += 2)
+        {
+            const std::string itemKey = makeKey(iter);
+            REQUIRE(setter.get()->removeItem(itemKey) == storage::eOk);
+        }
+        for (int iter = 0; iter < kItemsCount; ++iter)
+        {
+            ItemConsumer consumer;
+            const std::string itemKey = makeKey(iter);
+            status = setter.get()->getItem<ItemConsumer>(itemKey, consumer);
+            REQUIRE(status == (((iter % 2) == 0) ? storage::eItemNotFound : storage::eOk));
+        }
+        for (int iter = 0; iter < kItemsCount; iter += 2)
+        {
+            const std::string itemKey = makeKey(iter);
+            status = setter.get()->setItem(itemKey, storage::Item<std::string>("new", ""));
+            REQUIRE(status == storage::eOk);
+        }
+        ItemConsumer consumer;
+        const std::string itemKey = makeKey(42);
+        status = setter.get()->getItem<ItemConsumer>(itemKey, consumer);
+        CHECK(status == storage::eOk);
+        CHECK(static_cast<std::string>(consumer) == "new");
+    }
+
+    SECTION("Clearing all the items")
+    {
+        REQUIRE(setter.get()->clear() == storage::eOk);
+        ItemConsumer consumer;
+        const std::string itemKey = makeKey(1);
+        status = setter.get()->getItem<ItemConsumer>(itemKey, consumer);
+        CHECK(status == storage::eItemNotFound);
+        status = setter.get()->setItem(itemKey, storage::Item<bool>(true, ""));
+        CHECK(status == storage::eOk);
+    }
+}
+
+
+TEST_CASE("Items can be read, written and removed in batches")
+{
+    storage::StorageOptions options;
+    options.m_shardsCount = 4;
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create("batch-storage", kSize, options, status));
+    REQUIRE(status == storage::eOk);
+
+    const int kItemsCount = 40;
+    std::vector<std::string> names;
+    for (int iter = 0; iter < kItemsCount; ++iter)
+    {
+        names.push_back(std::string("batch-") + std::to_string(iter));
+    }
+    std::vector<storage::ItemKey> keys(names.begin(), names.end());
+    std::vector<storage::ItemUpdate> updates;
+    for (int iter = 0; iter < kItemsCount; ++iter)
+    {
+        if ((iter % 2) == 0)
+        {
+            updates.emplace_back(keys[iter], storage::Item<double>(iter, "even"), 0);
+        }
+        else
+        {
+            updates.emplace_back(keys[iter], storage::Item<std::string>(names[iter], "odd"), 0);
+        }
+    }
+    std::vector<storage::Status> statuses;
+    REQUIRE(localStorage->setItems(updates, false, statuses) == storage::eOk);
+    REQUIRE(statuses.size() == kItemsCount);
+
+    SECTION("Reading the items in one batch, missing ones included")
+    {
+        keys.emplace_back("missing");
+        std::vector<ItemConsumer> consumers(keys.size());
+        CHECK(localStorage->getItems(keys, consumers, statuses) == kItemsCount);
+        for (int iter = 0; iter < kItemsCount; ++iter)
+        {
+            REQUIRE(statuses[iter] == storage::eOk);
+            if ((iter % 2) == 0)
+            {
+                CHECK(static_cast<double>(consumers[iter]) == iter);
+                CHECK(consumers[iter].m_tag == "even");
+            }
+            else
+            {
+                CHECK(static_cast<std::string>(consumers[iter]) == names[iter]);
+            }
+        }
+        CHECK(statuses.back() == storage::eItemNotFound);
+        CHECK(consumers.back().getType() == storage::eNone);
+    }
+
+    SECTION("Reporting the items which cannot be written")
+    {
+        const std::string huge(2 * kSize, 'h');
+        std::vector<storage::ItemUpdate> failing;
+        failing.emplace_back(keys[0], storage::Item<std::string>("first", ""), 0);
+        failing.emplace_back(keys[1], storage::Item<std::string>(huge, ""), 0);
+        failing.emplace_back(keys[2], storage::Item<std::string>("last", ""), 0);
+        CHECK(localStorage->setItems(failing, false, statuses) == storage::eCannotConstructItem);
+        CHECK(statuses[0] == storage::eOk);
+        CHECK(statuses[1] == storage::eCannotConstructItem);
+        CHECK(statuses[2] == storage::eOk);
+        ItemConsumer consumer;
+        REQUIRE(localStorage->getItem(keys[2], consumer) == storage::eOk);
+        CHECK(consumer.m_string == "last");
+    }
+
+    SECTION("Writing all the items or none of them")
+    {
+        const std::string huge(2 * kSize, 'h');
+        std::vector<storage::ItemUpdate> failing;
+        failing.emplace_back(keys[0], storage::Item<std::string>("first", ""), 0);
+        failing.emplace_back(storage::ItemKey("new"), storage::Item<bool>(true, ""), 0);
+        failing.emplace_back(keys[0], storage::Item<std::string>("again", ""), 0);
+        failing.emplace_back(keys[1], storage::Item<std::string>(huge, ""), 0);
+        CHECK(localStorage->setItems(failing, true, statuses) == storage::eCannotConstructItem);
+        CHECK(statuses[0] == storage::eCannotConstructItem);
+        ItemConsumer consumer;
+        REQUIRE(localStorage->getItem(keys[0], consumer) == storage::eOk);
+        CHECK(static_cast<double>(consumer) == 0);
+        CHECK(consumer.m_tag == "even");
+        CHECK(localStorage->getItem("new", consumer) == storage::eItemNotFound);
+        REQUIRE(localStorage->getItem(keys[1], consumer) == storage::eOk);
+        CHECK(consumer.m_string == names[1]);
+
+        failing.pop_back();
+        CHECK(localStorage->setItems(failing, true, statuses) == storage::eOk);
+        REQUIRE(localStorage->getItem(keys[0], consumer) == storage::eOk);
+        CHECK(consumer.m_string == "again");
+    }
+
+    SECTION("Removing the items in one batch")
+    {
+        keys.emplace_back("missing");
+        CHECK(localStorage->removeItems(keys, statuses) == kItemsCount);
+        CHECK(statuses.front() == storage::eOk);
+        CHECK(statuses.back() == storage::eItemNotFound);
+        ItemConsumer consumer;
+        CHECK(localStorage->getItem(keys[7], consumer) == storage::eItemNotFound);
+    }
+
+    SECTION("Refusing to write while the storage is locked for reading")
+    {
+        localStorage->lockShared();
+        CHECK(localStorage->setItems(updates, true, statuses) == storage::eCannotUpgradeLock);
+        CHECK(localStorage->setItems(updates, false, statuses) == storage::eCannotUpgradeLock);
+        localStorage->removeItems(keys, statuses);
+        CHECK(statuses[0] == storage::eCannotUpgradeLock);
+        localStorage->unlockShared();
+    }
+
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+
+
+TEST_CASE("Keys can be scanned in batches")
+{
+    storage::StorageOptions options;
+    options.m_shardsCount = 4;
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create("scanned-storage", 4 * kSize, options, status));
+    REQUIRE(status == storage::eOk);
+
+    const int kItemsCount = 500;
+    for (int iter = 0; iter < kItemsCount; ++iter)
+    {
+        const std::string itemKey = std::string("scanned-") + std::to_string(iter);
+        status = localStorage->setItem(itemKey, storage::Item<double>(iter, ""));
+        REQUIRE(status == storage::eOk);
+    }
+
+    // count the times each key is returned, until the scan is complete
+    std::map<std::string, int> returned;
+    auto scanBatch = [&](uint64_t cursor) {
+        std::vector<std::string> keys;
+        cursor = localStorage->scan(cursor, 32, keys);
+        for (const std::string& key : keys)
+        {
+            ++returned[key];
+        }
+        return cursor;
+    };
+    auto checkReturnedOnce = [&](const std::string& prefix, int count) {
+        for (int iter = 0; iter < count; ++iter)
+        {
+            CHECK(returned[prefix + std::to_string(iter)] == 1);
+        }
+    };
+
+    SECTION("Returning every key once")
+    {
+        uint64_t cursor = 0;
+        int batches = 0;
+        do
+        {
+            cursor = scanBatch(cursor);
+            ++batches;
+        } while (cursor != 0);
+        CHECK(batches > 1);
+        CHECK(returned.size() == kItemsCount);
+        checkReturnedOnce("scanned-", kItemsCount);
+    }
+
+    SECTION("Returning every key once while the shards grow")
+    {
+        uint64_t cursor = scanBatch(0);
+        for (int iter = 0; iter < 4 * kItemsCount; ++iter)
+        {
+            const std::string itemKey = std::string("added-") + std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<double>(iter, ""));
+            REQUIRE(status == storage::eOk);
+        }
+        for (int iter = 0; iter < kItemsCount; iter += 2)
+        {
+            const std::string itemKey = std::string("scanned-") + std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<std::string>("updated", ""));
+            REQUIRE(status == storage::eOk);
+        }
+        while (cursor != 0)
+        {
+            cursor = scanBatch(cursor);
+        }
+        checkReturnedOnce("scanned-", kItemsCount);
+        for (const auto& entry : returned)
+        {
+            CHECK(entry.second == 1);
+        }
+    }
+
+    SECTION("Skipping the removed keys")
+    {
+        uint64_t cursor = scanBatch(0);
+        for (int iter = 0; iter < kItemsCount; ++iter)
+        {
+            const std::string itemKey = std::string("scanned-") + std::to_string(iter);
+            localStorage->removeItem(itemKey);
+        }
+        const size_t scanned = returned.size();
+        while (cursor != 0)
+        {
+            cursor = scanBatch(cursor);
+        }
+        CHECK(returned.size() == scanned);
+    }
+
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+
+
+TEST_CASE("Keys can be queried in their byte order")
+{
+    storage::StorageOptions options;
+    options.m_shardsCount = 4;
+    SECTION("Filtering the keys of each shard")
+    {
+        options.m_orderedKeys = false;
+    }
+    SECTION("Walking the ordered keys of each shard")
+    {
+        options.m_orderedKeys = true;
+    }
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create("ordered-storage", 4 * kSize, options, status));
+    REQUIRE(status == storage::eOk);
+
+    // the numbers are padded so that the byte order is the numeric one
+    auto getKey = [](const char* prefix, int number) {
+        std::string digits = std::to_string(number);
+        return prefix + std::string(3 - digits.size(), '0') + digits;
+    };
+    for (int iter = 999; iter >= 0; iter -= 3)
+    {
+        const std::string movieKey = getKey("movie:", iter);
+        const std::string actorKey = getKey("actor:", iter);
+        REQUIRE(localStorage->setItem(movieKey, storage::Item<double>(iter, "")) == storage::eOk);
+        REQUIRE(localStorage->setItem(actorKey, storage::Item<double>(iter, "")) == storage::eOk);
+    }
+    REQUIRE(localStorage->setItem("movie", storage::Item<double>(0, "")) == storage::eOk);
+    REQUIRE(localStorage->setItem("movie:expired", storage::Item<double>(0, ""), 1) ==
+            storage::eOk);
+    const std::string itemKey = getKey("movie:", 3);
+    localStorage->removeItem(itemKey);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    std::vector<std::string> keys;
+    localStorage->scanPrefix("movie:", 5, keys);
+    CHECK(keys == std::vector<std::string>({getKey("movie:", 0), getKey("movie:", 6),
+                                            getKey("movie:", 9), getKey("movie:", 12),
+                                            getKey("movie:", 15)}));
+
+    keys.clear();
+    localStorage->scanPrefix("movie:", std::numeric_limits<size_t>::max(), keys);
+    CHECK(keys.size() == 333);
+    CHECK(std::is_sorted(keys.begin(), keys.end()));
+
+    keys.clear();
+    localStorage->range(getKey("actor:", 500), getKey("actor:", 510),
+                        std::numeric_limits<size_t>::max(), keys);
+    CHECK(keys == std::vector<std::string>({getKey("actor:", 501), getKey("actor:", 504),
+                                            getKey("actor:", 507)}));
+
+    keys.clear();
+    localStorage->range(getKey("movie:", 990), "", 10, keys);
+    CHECK(keys == std::vector<std::string>({getKey("movie:", 990), getKey("movie:", 993),
+                                            getKey("movie:", 996), getKey("movie:", 999)}));
+
+    CHECK(localStorage->clear() == storage::eOk);
+    keys.clear();
+    localStorage->range("", "", 10, keys);
+    CHECK(keys.empty());
+
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+
+
+TEST_CASE("Items can be removed by prefix or by tag")
+{
+    storage::StorageOptions options;
+    options.m_shardsCount = 4;
+    uint64_t budget = 0;
+    SECTION("Removing under one lock hold per shard")
+    {
+        budget = 0;
+    }
+    SECTION("Removing the ordered keys")
+    {
+        options.m_orderedKeys = true;
+    }
+    SECTION("Removing in batches within a time budget")
+    {
+        budget = 1;
+    }
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create("removed-storage", 4 * kSize, options, status));
+    REQUIRE(status == storage::eOk);
+
+    const int kItemsCount = 1000;
+    for (int iter = 0; iter < kItemsCount; ++iter)
+    {
+        const std::string number = std::to_string(iter);
+        const std::string firstKey = "tenant:1:" + number;
+        const std::string secondKey = "tenant:2:" + number;
+        REQUIRE(localStorage->setItem(firstKey, storage::Item<double>(iter, "")) == storage::eOk);
+        REQUIRE(localStorage->setItem(secondKey,
+                                      storage::Item<double>(iter, (iter % 2) ? "odd" : "")) ==
+                storage::eOk);
+    }
+
+    size_t removed = 0;
+    CHECK(localStorage->removePrefix("tenant:1:", budget, removed) == storage::eOk);
+    CHECK(removed == kItemsCount);
+    CHECK(localStorage->removePrefix("tenant:1:", budget, removed) == storage::eOk);
+    CHECK(removed == 0);
+
+    CHECK(localStorage->removeByTag("odd", budget, removed) == storage::eOk);
+    CHECK(removed == kItemsCount / 2);
+    ItemConsumer consumer;
+    CHECK(localStorage->getItem("tenant:2:2", consumer) == storage::eOk);
+    CHECK(localStorage->getItem("tenant:2:3", consumer) == storage::eItemNotFound);
+
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+
+
+TEST_CASE("Items can be found by tag")
+{
+    storage::StorageOptions options;
+    options.m_shardsCount = 4;
+    SECTION("Filtering the items of each shard")
+    {
+        options.m_tagIndex = false;
+    }
+    SECTION("Reading the tag index of each shard")
+    {
+        options.m_tagIndex = true;
+    }
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create("tagged-storage", 4 * kSize, options, status));
+    REQUIRE(status == storage::eOk);
+
+    const int kItemsCount = 300;
+    for (int iter = 0; iter < kItemsCount; ++iter)
+    {
+        const std::string number = std::to_string(iter);
+        const std::string sessionKey = "session:" + number;
+        const std::string flagKey = "flag:" + number;
+        const std::string plainKey = "plain:" + number;
+        REQUIRE(localStorage->setItem(sessionKey, storage::Item<double>(iter, "session")) ==
+                storage::eOk);
+        REQUIRE(localStorage->setItem(flagKey, storage::Item<double>(iter, "flag")) ==
+                storage::eOk);
+        REQUIRE(localStorage->setItem(plainKey, storage::Item<double>(iter, "")) == storage::eOk);
+    }
+    CHECK(localStorage->countByTag("session") == kItemsCount);
+    CHECK(localStorage->countByTag("") == kItemsCount);
+    CHECK(localStorage->countByTag("missing") == 0);
+
+    // moving items from a tag to another one, and removing or expiring others
+    for (int iter = 0; iter < 100; ++iter)
+    {
+        const std::string number = std::to_string(iter);
+        const std::string sessionKey = "session:" + number;
+        const std::string flagKey = "flag:" + number;
+        REQUIRE(localStorage->setItem(sessionKey, storage::Item<double>(iter, "flag")) ==
+                storage::eOk);
+        REQUIRE(localStorage->removeItem(flagKey) == storage::eOk);
+    }
+    REQUIRE(localStorage->setItem("session:100", storage::Item<double>(100, "session"), 1) ==
+            storage::eOk);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CHECK(localStorage->countByTag("session") == kItemsCount - 101);
+    CHECK(localStorage->countByTag("flag") == kItemsCount);
+
+    std::vector<std::string> keys;
+    localStorage->getKeysByTag("flag", keys);
+    CHECK(keys.size() == kItemsCount);
+    CHECK(std::count(keys.begin(), keys.end(), "session:42") == 1);
+    CHECK(std::count(keys.begin(), keys.end(), "flag:42") == 0);
+
+    size_t removed = 0;
+    CHECK(localStorage->removeByTag("flag", 1, removed) == storage::eOk);
+    CHECK(removed == kItemsCount);
+    CHECK(localStorage->countByTag("flag") == 0);
+
+    CHECK(localStorage->clear() == storage::eOk);
+    CHECK(localStorage->countByTag("session") == 0);
+    REQUIRE(localStorage->setItem("session:0", storage::Item<double>(0, "session")) ==
+            storage::eOk);
+    CHECK(localStorage->countByTag("session") == 1);
+
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+
+
+TEST_CASE("Changes of the items can be watched")
+{
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create("watched-storage", kSize, status));
+    REQUIRE(status == storage::eOk);
+    std::unique_ptr<storage::SharedStorage> openedStorage(
+        storage::SharedStorage::open("watched-storage", status));
+    REQUIRE(status == storage::eOk);
+    storage::ChangeRing* ring = openedStorage->getChanges();
+    REQUIRE(ring != nullptr);
+    std::vector<storage::Change> changes;
+
+    SECTION("Reading the changes of every kind")
+    {
+        REQUIRE(localStorage->setItem("unwatched", storage::Item<double>(0, "")) == storage::eOk);
+        uint64_t position = 0;
+        REQUIRE(ring->attach(position));
+        REQUIRE(localStorage->setItem("key", storage::Item<double>(1, "")) == storage::eOk);
+        REQUIRE(localStorage->setItem("key", storage::Item<double>(2, "")) == storage::eOk);
+        REQUIRE(localStorage->removeItem("key") == storage::eOk);
+        REQUIRE(localStorage->setItem("ttl", storage::Item<double>(3, ""), 1) == storage::eOk);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        CHECK(localStorage->removeExpired() == 1);
+        REQUIRE(localStorage->clear() == storage::eOk);
+
+        ring->read(position, 0, changes);
+        REQUIRE(changes.size() == 6);
+        CHECK(changes[0].m_kind == storage::eChangeSet);
+        CHECK(changes[0].m_key == "key");
+        CHECK(changes[1].m_kind == storage::eChangeSet);
+        CHECK(changes[2].m_kind == storage::eChangeRemove);
+        CHECK(changes[2].m_key == "key");
+        CHECK(changes[3].m_kind == storage::eChangeSet);
+        CHECK(changes[4].m_kind == storage::eChangeExpire);
+        CHECK(changes[4].m_key == "ttl");
+        CHECK(changes[5].m_kind == storage::eChangeClear);
+        CHECK(changes[5].m_key.empty());
+        ring->detach();
+    }
+
+    SECTION("Losing the changes overwritten before being read")
+    {
+        uint64_t position = 0;
+        REQUIRE(ring->attach(position));
+        for (int iter = 0; iter < 2000; ++iter)
+        {
+            const std::string itemKey = "key:" + std::to_string(iter);
+            REQUIRE(localStorage->setItem(itemKey,
+                                          storage::Item<double>(iter, "")) == storage::eOk);
+        }
+        ring->read(position, 0, changes);
+        REQUIRE(changes.size() == 1);
+        CHECK(changes[0].m_kind == storage::eChangeLost);
+
+        changes.clear();
+        REQUIRE(localStorage->removeItem("key:0") == storage::eOk);
+        ring->read(position, 0, changes);
+        REQUIRE(changes.size() == 1);
+        CHECK(changes[0].m_kind == storage::eChangeRemove);
+        ring->detach();
+    }
+
+    SECTION("Recording the changes of concurrent writers")
+    {
+        // the records of the writers fit into the ring, none of them may be lost
+        const int kWritersCount = 4;
+        const int kChangesCount = 100;
+        uint64_t position = 0;
+        REQUIRE(ring->attach(position));
+        auto write = [&](int writer) {
+            for (int iter = 0; iter < kChangesCount; ++iter)
+            {
+                const std::string itemKey =
+                    "writer:" + std::to_string(writer) + ":" + std::to_string(iter);
+                localStorage->setItem(itemKey, storage::Item<double>(iter, ""));
+            }
+        };
+        std::vector<std::future<void>> writers;
+        for (int writer = 0; writer < kWritersCount; ++writer)
+        {
+            writers.push_back(std::async(std::launch::async, write, writer));
+        }
+        for (int attempt = 0;
+             (changes.size() < kWritersCount * kChangesCount) && (attempt < 1000); ++attempt)
+        {
+            ring->read(position, 10, changes);
+        }
+        for (std::future<void>& writer : writers)
+        {
+            writer.get();
+        }
+
+        REQUIRE(changes.size() == kWritersCount * kChangesCount);
+        std::set<std::string> keys;
+        for (const storage::Change& change : changes)
+        {
+            CHECK(change.m_kind == storage::eChangeSet);
+            keys.insert(change.m_key);
+        }
+        CHECK(keys.size() == kWritersCount * kChangesCount);
+        CHECK(keys.count("writer:3:99") == 1);
+        ring->detach();
+    }
+
+    SECTION("Waking a thread which waits for changes")
+    {
+        uint64_t position = 0;
+        REQUIRE(ring->attach(position));
+        std::future<size_t> waiter = std::async(std::launch::async, [&]() {
+            ring->read(position, 10000, changes);
+            return changes.size();
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        REQUIRE(localStorage->setItem("key", storage::Item<double>(1, "")) == storage::eOk);
+        REQUIRE(waiter.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        CHECK(waiter.get() == 1);
+        ring->detach();
+    }
+
+#ifndef _WIN32
+    SECTION("Dropping the watchers of a dead process")
+    {
+        const pid_t child = fork();
+        if (child == 0)
+        {
+            // the child dies while it watches
+            uint64_t position = 0;
+            _exit(ring->attach(position) ? 0 : 1);
+        }
+        REQUIRE(child > 0);
+        int childStatus = 0;
+        REQUIRE(waitpid(child, &childStatus, 0) == child);
+        REQUIRE(WIFEXITED(childStatus));
+        REQUIRE(WEXITSTATUS(childStatus) == 0);
+
+        // nothing is recorded once the last live watcher detached
+        uint64_t position = 0;
+        REQUIRE(ring->attach(position));
+        ring->detach();
+        REQUIRE(localStorage->setItem("key", storage::Item<double>(1, "")) == storage::eOk);
+        uint64_t nextPosition = 0;
+        REQUIRE(ring->attach(nextPosition));
+        CHECK(nextPosition == position);
+        ring->detach();
+    }
+#endif
+
+    openedStorage.reset();
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+
+
+TEST_CASE("Items can be spread among several shards")
+{
+    std::string shardedStorageName("sharded-storage");
+    storage::StorageOptions options;
+    options.m_shardsCount = 8;
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create(shardedStorageName, kSize, options, status));
+    REQUIRE(status == storage::eOk);
+    REQUIRE(localStorage->getShardsCount() == 8);
+
+    SECTION("Opening a sharded storage")
+    {
+        std::unique_ptr<storage::SharedStorage> openedStorage(
+            storage::SharedStorage::open(shardedStorageName, status));
+        REQUIRE(status == storage::eOk);
+        CHECK(openedStorage->getShardsCount() == 8);
+
+        for (int iter = 0; iter < 100; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<double>(iter, ""));
+            REQUIRE(status == storage::eOk);
+        }
+        for (int iter = 0; iter < 100; ++iter)
+        {
+            ItemConsumer consumer;
+            const std::string itemKey = std::to_string(iter);
+            status = openedStorage->getItem<ItemConsumer>(itemKey, consumer);
+            REQUIRE(status == storage::eOk);
+            CHECK(static_cast<double>(consumer) == iter);
+        }
+        CHECK(openedStorage->clear() == storage::eOk);
+        ItemConsumer consumer;
+        status = localStorage->getItem<ItemConsumer>("42", consumer);
+        CHECK(status == storage::eItemNotFound);
+    }
+
+    SECTION("Locking all the shards")
+    {
+        localStorage->lock();
+        status = localStorage->setItem("locked", storage::Item<bool>(true, ""));
+        CHECK(status == storage::eOk);
+
+        auto tryToLock = [&localStorage]() {
+            bool locked = localStorage->tryToLock();
+            if (locked)
+            {
+                localStorage->unlock();
+            }
+            return locked;
+        };
+        CHECK(std::async(std::launch::async, tryToLock).get() == false);
+        localStorage->unlock();
+        CHECK(std::async(std::launch::async, tryToLock).get() == true);
+    }
+
+    SECTION("Locking the shards on behalf of another thread")
+    {
+        auto tryToLock = [&localStorage]() {
+            bool locked = localStorage->tryToLock();
+            if (locked)
+            {
+                localStorage->unlock();
+            }
+            return locked;
+        };
+
+        std::promise<void> locked;
+        std::promise<void> released;
+        std::future<void> holding = std::async(std::launch::async, [&]() {
+            localStorage->lock();
+            locked.set_value();
+            released.get_future().wait();
+            localStorage->unlock();
+        });
+        locked.get_future().wait();
+
+        // another thread waits for the shards, the current thread owns them afterwards
+        const uint64_t owner = storage::getCurrentThreadId();
+        localStorage->beginLockFor();
+        std::future<storage::Status> locking = std::async(
+            std::launch::async, [&localStorage, owner]() { return localStorage->lockFor(owner); });
+        CHECK(locking.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+        CHECK_FALSE(localStorage->isLockedByCurrentThread());
+        released.set_value();
+        holding.get();
+        CHECK(locking.get() == storage::eOk);
+        localStorage->endLockFor();
+        CHECK(localStorage->isLockedByCurrentThread());
+        status = localStorage->setItem("locked", storage::Item<bool>(true, ""));
+        CHECK(status == storage::eOk);
+        CHECK(std::async(std::launch::async, tryToLock).get() == false);
+        localStorage->unlock();
+        CHECK_FALSE(localStorage->isLockedByCurrentThread());
+        CHECK(std::async(std::launch::async, tryToLock).get() == true);
+    }
+
+    SECTION("Writing while the shards are locked on behalf of the current thread")
+    {
+        auto tryToLock = [&localStorage]() {
+            bool locked = localStorage->tryToLock();
+            if (locked)
+            {
+                localStorage->unlock();
+            }
+            return locked;
+        };
+
+        // the current thread locks and unlocks the shards while the helper thread waits for them
+        const uint64_t owner = storage::getCurrentThreadId();
+        for (int round = 0; round < 200; ++round)
+        {
+            localStorage->beginLockFor();
+            std::future<storage::Status> locking =
+                std::async(std::launch::async,
+                           [&localStorage, owner]() { return localStorage->lockFor(owner); });
+            do
+            {
+                status = localStorage->setItem("pending", storage::Item<int32_t>(round, ""));
+                REQUIRE(status == storage::eOk);
+                localStorage->removeItem("pending");
+            } while (locking.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+            REQUIRE(locking.get() == storage::eOk);
+            localStorage->endLockFor();
+            REQUIRE(localStorage->isLockedByCurrentThread());
+            REQUIRE(std::async(std::launch::async, tryToLock).get() == false);
+            localStorage->unlock();
+            REQUIRE(std::async(std::launch::async, tryToLock).get() == true);
+        }
+    }
+
+    SECTION("Sharing the shards between readers")
+    {
+        status = localStorage->setItem("shared", storage::Item<double>(42, ""));
+        REQUIRE(status == storage::eOk);
+
+        auto getItem = [&localStorage]() {
+            ItemConsumer consumer;
+            return localStorage->getItem<ItemConsumer>("shared", consumer);
+        };
+        auto tryToLock = [&localStorage]() {
+            bool locked = localStorage->tryToLock();
+            if (locked)
+            {
+                localStorage->unlock();
+            }
+            return locked;
+        };
+
+        localStorage->lockShared();
+        localStorage->lockShared();
+        CHECK(localStorage->isLockedShared());
+        CHECK(getItem() == storage::eOk);
+        CHECK(std::async(std::launch::async, getItem).get() == storage::eOk);
+        CHECK(std::async(std::launch::async, tryToLock).get() == false);
+        status = localStorage->setItem("shared", storage::Item<double>(0, ""));
+        CHECK(status == storage::eCannotUpgradeLock);
+        CHECK(localStorage->removeItem("shared") == storage::eCannotUpgradeLock);
+        CHECK(localStorage->lock() == storage::eCannotUpgradeLock);
+        CHECK(localStorage->tryToLock() == false);
+
+        localStorage->unlockShared();
+        CHECK(localStorage->isLockedShared());
+        CHECK(std::async(std::launch::async, tryToLock).get() == false);
+        localStorage->unlockShared();
+        CHECK_FALSE(localStorage->isLockedShared());
+        CHECK(std::async(std::launch::async, tryToLock).get() == true);
+
+        // the writer may also read without releasing its lock
+        REQUIRE(localStorage->lock() == storage::eOk);
+        localStorage->lockShared();
+        CHECK(getItem() == storage::eOk);
+        status = localStorage->setItem("shared", storage::Item<double>(0, ""));
+        CHECK(status == storage::eOk);
+        localStorage->unlockShared();
+        CHECK(std::async(std::launch::async, tryToLock).get() == false);
+        localStorage->unlock();
+        CHECK(std::async(std::launch::async, tryToLock).get() == true);
+    }
+
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+
+
+TEST_CASE("Storage grows up to its maximum size")
+{
+    std::string growingStorageName("growing-storage");
+    storage::StorageOptions options;
+    options.m_maxSize = 1024 * 1024;
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create(growingStorageName, 64 * 1024, options, status));
+    REQUIRE(status == storage::eOk);
+    CHECK(localStorage->getSize() == 64 * 1024);
+
+    // the storage is opened before growing, it must see the items stored beyond its initial size
+    std::unique_ptr<storage::SharedStorage> openedStorage(
+        storage::SharedStorage::open(growingStorageName, status));
+    REQUIRE(status == storage::eOk);
+
+    SECTION("Growing the storage when it is full")
+    {
+        const std::string value(1000, 'g');
+        for (int iter = 0; iter < 500; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<std::string>(value, ""));
+            REQUIRE(status == storage::eOk);
+        }
+        CHECK(localStorage->getSize() > 64 * 1024);
+        CHECK(localStorage->getSize() <= options.m_maxSize);
+        CHECK(openedStorage->getSize() == localStorage->getSize());
+
+        for (int iter = 0; iter < 500; ++iter)
+        {
+            ItemConsumer consumer;
+            const std::string itemKey = std::to_string(iter);
+            status = openedStorage->getItem<ItemConsumer>(itemKey, consumer);
+            REQUIRE(status == storage::eOk);
+            CHECK(consumer.m_string == value);
+        }
+        status = openedStorage->setItem("opened", storage::Item<bool>(true, ""));
+        CHECK(status == storage::eOk);
+    }
+
+    SECTION("Failing to grow the storage beyond its maximum size")
+    {
+        const std::string value(2 * 1024 * 1024, 'g');
+        status = localStorage->setItem("huge", storage::Item<std::string>(value, ""));
+        CHECK(status == storage::eCannotConstructItem);
+        CHECK(localStorage->getSize() == options.m_maxSize);
+    }
+
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+
+
+TEST_CASE("Items are evicted when the storage is full")
+{
+    std::string evictingStorageName("evicting-storage");
+    storage::SharedStorage::destroy(evictingStorageName);
+    storage::StorageOptions options;
+    options.m_shardsCount = 4;
+    storage::Status status = storage::eOk;
+    const std::string value(1000, 'e');
+
+    // the storages are large enough for the tables of slots to be small besides the items
+
+    SECTION("Keeping the items which are read with the clock policy")
+    {
+        options.m_eviction = storage::eEvictClock;
+        std::unique_ptr<storage::SharedStorage> localStorage(
+            storage::SharedStorage::create(evictingStorageName, 1024 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        REQUIRE(localStorage->setItem("hot", storage::Item<std::string>(value, "")) ==
+                storage::eOk);
+
+        for (int iter = 0; iter < 5000; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<std::string>(value, ""));
+            REQUIRE(status == storage::eOk);
+            ItemConsumer consumer;
+            REQUIRE(localStorage->getItem("hot", consumer) == storage::eOk);
+        }
+        CHECK(localStorage->getEvictedCount() > 0);
+        ItemConsumer consumer;
+        CHECK(localStorage->getItem("4999", consumer) == storage::eOk);
+        CHECK(localStorage->getItem("0", consumer) == storage::eItemNotFound);
+        CHECK(localStorage->destroy() == storage::eOk);
+    }
+
+    SECTION("Keeping the items which are read often with the lfu policy")
+    {
+        options.m_eviction = storage::eEvictLfu;
+        std::unique_ptr<storage::SharedStorage> localStorage(
+            storage::SharedStorage::create(evictingStorageName, 1024 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        REQUIRE(localStorage->setItem("hot", storage::Item<std::string>(value, "")) ==
+                storage::eOk);
+
+        for (int iter = 0; iter < 5000; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<std::string>(value, ""));
+            REQUIRE(status == storage::eOk);
+            ItemConsumer consumer;
+            REQUIRE(localStorage->getItem("hot", consumer) == storage::eOk);
+        }
+        CHECK(localStorage->getEvictedCount() > 0);
+        CHECK(localStorage->destroy() == storage::eOk);
+    }
+
+    SECTION("Evicting the items above the memory limit")
+    {
+        options.m_eviction = storage::eEvictClock;
+        options.m_maxMemory = 128 * 1024;
+        std::unique_ptr<storage::SharedStorage> localStorage(
+            storage::SharedStorage::create(evictingStorageName, 512 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+
+        for (int iter = 0; iter < 1000; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<std::string>(value, ""));
+            REQUIRE(status == storage::eOk);
+            CHECK(localStorage->getUsedMemory() <= options.m_maxMemory);
+        }
+        CHECK(localStorage->getEvictedCount() > 0);
+        CHECK(localStorage->destroy() == storage::eOk);
+    }
+
+    SECTION("Keeping the items which an atomic batch wrote")
+    {
+        options.m_eviction = storage::eEvictClock;
+        std::unique_ptr<storage::SharedStorage> localStorage(
+            storage::SharedStorage::create(evictingStorageName, 1024 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        for (int iter = 0; iter < 1000; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<std::string>(value, ""));
+            REQUIRE(status == storage::eOk);
+        }
+
+        const int kBatchCount = 600;
+        std::vector<std::string> names;
+        for (int iter = 0; iter < kBatchCount; ++iter)
+        {
+            names.push_back("batch-" + std::to_string(iter));
+        }
+        std::vector<storage::ItemUpdate> updates;
+        for (const std::string& name : names)
+        {
+            updates.emplace_back(storage::ItemKey(name), storage::Item<std::string>(value, ""), 0);
+        }
+        std::vector<storage::Status> statuses;
+        REQUIRE(localStorage->setItems(updates, true, statuses) == storage::eOk);
+        ItemConsumer consumer;
+        for (const std::string& name : names)
+        {
+            REQUIRE(localStorage->getItem(name, consumer) == storage::eOk);
+        }
+        CHECK(localStorage->destroy() == storage::eOk);
+    }
+
+    SECTION("Failing without eviction policy")
+    {
+        std::unique_ptr<storage::SharedStorage> localStorage(
+            storage::SharedStorage::create(evictingStorageName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+
+        for (int iter = 0; (status == storage::eOk) && (iter < 2000); ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<std::string>(value, ""));
+        }
+        CHECK(status == storage::eCannotConstructItem);
+        CHECK(localStorage->getEvictedCount() == 0);
+        CHECK(localStorage->destroy() == storage::eOk);
+    }
+
+    SECTION("Reporting an atomic batch which cannot be rolled back")
+    {
+        options.m_shardsCount = 1;
+        std::unique_ptr<storage::SharedStorage> localStorage(
+            storage::SharedStorage::create(evictingStorageName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        const std::string large(32 * 1024, 'l');
+        REQUIRE(localStorage->setItem("large", storage::Item<std::string>(large, "")) ==
+                storage::eOk);
+        for (int iter = 0; (status == storage::eOk) && (iter < 2000); ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<std::string>(value, ""));
+        }
+        REQUIRE(status == storage::eCannotConstructItem);
+
+        // the viewed value outlives the update, so that restoring it needs another block
+        storage::ItemView view;
+        REQUIRE(localStorage->viewItem("large", view) == storage::eOk);
+        std::vector<storage::ItemUpdate> updates;
+        updates.emplace_back(storage::ItemKey("large"), storage::Item<std::string>("small", ""),
+                             0);
+        updates.emplace_back(storage::ItemKey("huge"), storage::Item<std::string>(large, ""), 0);
+        std::vector<storage::Status> statuses;
+        CHECK(localStorage->setItems(updates, true, statuses) == storage::eCannotRollBack);
+        CHECK(statuses[0] == storage::eCannotRollBack);
+        view.reset();
+
+        ItemConsumer consumer;
+        REQUIRE(localStorage->getItem("large", consumer) == storage::eOk);
+        CHECK(consumer.m_string == "small");
+        CHECK(localStorage->getItem("huge", consumer) == storage::eItemNotFound);
+        CHECK(localStorage->destroy() == storage::eOk);
+    }
+}
+
+
+TEST_CASE("Items expire after their time to live")
+{
+    StorageSetter setter(kStorageName);
+    REQUIRE(setter.get() != nullptr);
+    storage::SharedStorage* localStorage = setter.get();
+    ItemConsumer consumer;
+
+    SECTION("Missing items once expired")
+    {
+        REQUIRE(localStorage->setItem("session", storage::Item<bool>(true, ""), 50) ==
+                storage::eOk);
+        REQUIRE(localStorage->setItem("kept", storage::Item<bool>(true, ""), 50) == storage::eOk);
+        REQUIRE(localStorage->setItem("kept", storage::Item<bool>(true, "")) == storage::eOk);
+        CHECK(localStorage->getItem("session", consumer) == storage::eOk);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        CHECK(localStorage->getItem("session", consumer) == storage::eItemNotFound);
+        CHECK(localStorage->removeItem("session") == storage::eItemNotFound);
+        CHECK(localStorage->getItem("kept", consumer) == storage::eOk);
+        CHECK(localStorage->getExpiredCount() == 1);
+    }
+
+    SECTION("Erasing the expired items the earliest first")
+    {
+        for (int iter = 0; iter < 500; ++iter)
+        {
+            const uint64_t ttl = (iter % 2 == 0) ? (10 + (iter * 7) % 40) : 60000;
+            const std::string itemKey = std::to_string(iter);
+            REQUIRE(localStorage->setItem(itemKey, storage::Item<double>(iter, ""),
+                                          ttl) == storage::eOk);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(60));
+        // the expiration thread may already have erased some of them
+        localStorage->removeExpired();
+        CHECK(localStorage->getExpiredCount() == 250);
+        for (int iter = 0; iter < 500; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            CHECK(localStorage->getItem(itemKey, consumer) ==
+                  ((iter % 2 == 0) ? storage::eItemNotFound : storage::eOk));
+        }
+    }
+
+    SECTION("Keeping the deadline of incremented items")
+    {
+        double result = 0.0;
+        REQUIRE(localStorage->setItem("window", storage::Item<double>(1.0, ""), 50) ==
+                storage::eOk);
+        REQUIRE(localStorage->increment("window", 1.0, result) == storage::eOk);
+        CHECK(result == 2.0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        CHECK(localStorage->getItem("window", consumer) == storage::eItemNotFound);
+    }
+
+    SECTION("Restoring the deadlines of a snapshot")
+    {
+        boost::filesystem::path snapshotPath(boost::filesystem::temp_directory_path());
+        snapshotPath /= boost::filesystem::path("storage-ttl-snapshot.wks");
+        REQUIRE(localStorage->setItem("short", storage::Item<bool>(true, ""), 50) == storage::eOk);
+        REQUIRE(localStorage->setItem("long", storage::Item<bool>(true, ""), 60000) ==
+                storage::eOk);
+        REQUIRE(localStorage->snapshot(snapshotPath.string()) == storage::eOk);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        REQUIRE(localStorage->restore(snapshotPath.string()) == storage::eOk);
+        CHECK(localStorage->getItem("short", consumer) == storage::eItemNotFound);
+        CHECK(localStorage->getItem("long", consumer) == storage::eOk);
+        boost::filesystem::remove(snapshotPath);
+    }
+}
+
+
+TEST_CASE("Small values are allocated from slabs")
+{
+    const int64_t kSlabsStorageSize = 16 * 1024 * 1024;
+    const std::string kSlabsStorageName("slabs-storage");
+    storage::SharedStorage::destroy(kSlabsStorageName);
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create(kSlabsStorageName, kSlabsStorageSize, status));
+    REQUIRE(status == storage::eOk);
+    ItemConsumer consumer;
+
+    SECTION("Reading back values of every size class")
+    {
+        for (int iter = 0; iter < 5000; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            REQUIRE(localStorage->setItem(itemKey,
+                                          storage::Item<std::string>(
+                                              std::string(iter % 300, 'a' + iter % 26),
+                                              std::string(iter % 40, 't'))) == storage::eOk);
+        }
+        for (int iter = 0; iter < 5000; iter += 3)
+        {
+            const std::string itemKey = std::to_string(iter);
+            REQUIRE(localStorage->setItem(itemKey,
+                                          storage::Item<std::string>(
+                                              std::string((iter * 7) % 300, 'z'), "")) ==
+                    storage::eOk);
+        }
+        for (int iter = 1; iter < 5000; iter += 3)
+        {
+            const std::string itemKey = std::to_string(iter);
+            REQUIRE(localStorage->removeItem(itemKey) == storage::eOk);
+        }
+
+        for (int iter = 0; iter < 5000; ++iter)
+        {
+            storage::Status expected = (iter % 3 == 1) ? storage::eItemNotFound : storage::eOk;
+            const std::string itemKey = std::to_string(iter);
+            REQUIRE(localStorage->getItem(itemKey, consumer) == expected);
+            if (iter % 3 == 0)
+            {
+                CHECK(consumer.m_string == std::string((iter * 7) % 300, 'z'));
+                CHECK(consumer.m_tag.empty());
+            }
+            else if (iter % 3 == 2)
+            {
+                CHECK(consumer.m_string == std::string(iter % 300, 'a' + iter % 26));
+                CHECK(consumer.m_tag == std::string(iter % 40, 't'));
+            }
+        }
+    }
+
+    SECTION("Not counting the free chunks as used memory")
+    {
+        const int64_t emptyMemory = localStorage->getUsedMemory();
+        for (int iter = 0; iter < 5000; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            REQUIRE(localStorage->setItem(itemKey,
+                                          storage::Item<std::string>(std::string(100, 'm'),
+                                                                     "")) == storage::eOk);
+        }
+        const int64_t filledMemory = localStorage->getUsedMemory();
+        CHECK(filledMemory > emptyMemory + 5000 * 100);
+        for (int iter = 0; iter < 5000; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            REQUIRE(localStorage->removeItem(itemKey) == storage::eOk);
+        }
+        // the retired blocks are reclaimed by the next writers
+        for (int iter = 0; iter < 1000; ++iter)
+        {
+            REQUIRE(localStorage->setItem("flag", storage::Item<bool>(true, "")) == storage::eOk);
+        }
+        CHECK(localStorage->getUsedMemory() < filledMemory - 5000 * 100);
+    }
+
+    localStorage->destroy();
+}
+
+
+TEST_CASE("Storage can be compacted")
+{
+    StorageSetter setter(kStorageName);
+    REQUIRE(setter.get() != nullptr);
+    storage::SharedStorage* localStorage = setter.get();
+    ItemConsumer consumer;
+
+    // removing every other item of variable size scatters the free memory
+    const int kCount = 1000;
+    for (int iter = 0; iter < kCount; ++iter)
+    {
+        const std::string itemKey = std::to_string(iter);
+        REQUIRE(localStorage->setItem(itemKey,
+                                      storage::Item<std::string>(
+                                          std::string(30 + (iter * 37) % 200, 'a' + iter % 26),
+                                          "tag" + std::to_string(iter))) == storage::eOk);
+    }
+    for (int iter = 0; iter < kCount; iter += 2)
+    {
+        const std::string itemKey = std::to_string(iter);
+        REQUIRE(localStorage->removeItem(itemKey) == storage::eOk);
+    }
+
+    auto checkItems = [&]() {
+        for (int iter = 1; iter < kCount; iter += 2)
+        {
+            const std::string itemKey = std::to_string(iter);
+            REQUIRE(localStorage->getItem(itemKey, consumer) == storage::eOk);
+            CHECK(consumer.m_string == std::string(30 + (iter * 37) % 200, 'a' + iter % 26));
+            CHECK(consumer.m_tag == "tag" + std::to_string(iter));
+        }
+    };
+
+    SECTION("Reporting the fragmentation before and after")
+    {
+        storage::CompactionReport report;
+        REQUIRE(localStorage->compact(report) == storage::eOk);
+        CHECK(report.m_relocatedCount > 0);
+        CHECK(report.m_fragmentationBefore > 0.25);
+        CHECK(report.m_fragmentationAfter < report.m_fragmentationBefore);
+        checkItems();
+    }
+
+    SECTION("Reading the items while they are relocated")
+    {
+        std::atomic<bool> done(false);
+        std::future<int> reader = std::async(std::launch::async, [&]() {
+            ItemConsumer readerConsumer;
+            int mismatches = 0;
+            while (!done.load())
+            {
+                for (int iter = 1; iter < kCount; iter += 2)
+                {
+                    const std::string itemKey = std::to_string(iter);
+                    if ((localStorage->getItem(itemKey, readerConsumer) !=
+                         storage::eOk) ||
+                        (readerConsumer.m_string !=
+                         std::string(30 + (iter * 37) % 200, 'a' + iter % 26)))
+                    {
+                        ++mismatches;
+                    }
+                }
+            }
+            return mismatches;
+        });
+        storage::CompactionReport report;
+        REQUIRE(localStorage->compact(report) == storage::eOk);
+        done.store(true);
+        CHECK(reader.get() == 0);
+        checkItems();
+    }
+
+    SECTION("Compacting incrementally in the background")
+    {
+        localStorage->startCompaction();
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        localStorage->stopCompaction();
+        checkItems();
+
+        storage::CompactionReport report;
+        REQUIRE(localStorage->compact(report) == storage::eOk);
+        CHECK(report.m_fragmentationAfter <= report.m_fragmentationBefore);
+    }
+
+    SECTION("Refusing to compact a storage locked for reading")
+    {
+        storage::CompactionReport report;
+        localStorage->lockShared();
+        CHECK(localStorage->compact(report) == storage::eCannotUpgradeLock);
+        localStorage->unlockShared();
+    }
+}
+
+
+TEST_CASE("Compaction packs the free memory")
+{
+    StorageSetter setter(kStorageName, 2 * kSize);
+    REQUIRE(setter.get() != nullptr);
+    storage::SharedStorage* localStorage = setter.get();
+    ItemConsumer consumer;
+
+    SECTION("Leaving an unfragmented storage as is")
+    {
+        for (int iter = 0; iter < 2000; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            REQUIRE(localStorage->setItem(itemKey,
+                                          storage::Item<std::string>(
+                                              std::string(30 + (iter * 37) % 200, 'u'), "")) ==
+                    storage::eOk);
+        }
+        storage::CompactionReport report;
+        REQUIRE(localStorage->compact(report) == storage::eOk);
+        CHECK(report.m_fragmentationAfter <= report.m_fragmentationBefore);
+
+        // once packed, the blocks have nowhere lower to go
+        const double fragmentation = report.m_fragmentationAfter;
+        REQUIRE(localStorage->compact(report) == storage::eOk);
+        CHECK(report.m_relocatedCount == 0);
+        CHECK(report.m_fragmentationAfter <= fragmentation);
+    }
+
+    SECTION("Making room for a large value in a single call")
+    {
+        // removing every other value leaves holes too small for a large value
+        const std::string value(1000, 'v');
+        int count = 0;
+        std::string itemKey = std::to_string(count);
+        while (localStorage->setItem(itemKey, storage::Item<std::string>(value, "")) ==
+               storage::eOk)
+        {
+            itemKey = std::to_string(++count);
+        }
+        for (int iter = 0; iter < count; iter += 2)
+        {
+            itemKey = std::to_string(iter);
+            REQUIRE(localStorage->removeItem(itemKey) == storage::eOk);
+        }
+        const storage::Item<std::string> large(std::string(100 * 1024, 'l'), "");
+        REQUIRE(localStorage->setItem("large", large) == storage::eCannotConstructItem);
+
+        storage::CompactionReport report;
+        REQUIRE(localStorage->compact(report) == storage::eOk);
+        CHECK(report.m_relocatedCount > 0);
+        CHECK(report.m_fragmentationAfter < 0.25);
+        CHECK(localStorage->setItem("large", large) == storage::eOk);
+        for (int iter = 1; iter < count; iter += 2)
+        {
+            itemKey = std::to_string(iter);
+            REQUIRE(localStorage->getItem(itemKey, consumer) == storage::eOk);
+            CHECK(consumer.m_string == value);
+        }
+    }
+}
+
+
+TEST_CASE("Values can be viewed without copy")
+{
+    StorageSetter setter(kStorageName);
+    REQUIRE(setter.get() != nullptr);
+    storage::SharedStorage* localStorage = setter.get();
+    ItemConsumer consumer;
+    const std::string key("viewed");
+    const std::string value(1000, 'v');
+    REQUIRE(localStorage->setItem(key, storage::Item<std::string>(value, "tag")) == storage::eOk);
+
+    storage::ItemView view;
+    REQUIRE(localStorage->viewItem(key, view) == storage::eOk);
+    REQUIRE(view.isPinned());
+    CHECK(view.getType() == storage::eString);
+    CHECK(view.getTag() == "tag");
+    CHECK(std::string(view.data(), view.length()) == value);
+
+    SECTION("Keeping the viewed bytes while the item is updated")
+    {
+        const std::string newValue(1000, 'n');
+        REQUIRE(localStorage->setItem(key, storage::Item<std::string>(newValue, "")) ==
+                storage::eOk);
+        CHECK(std::string(view.data(), view.length()) == value);
+        REQUIRE(localStorage->getItem(key, consumer) == storage::eOk);
+        CHECK(consumer.m_string == newValue);
+    }
+
+    SECTION("Keeping the viewed bytes once the item is removed, until the view is released")
+    {
+        REQUIRE(localStorage->removeItem(key) == storage::eOk);
+        storage::CompactionReport report;
+        REQUIRE(localStorage->compact(report) == storage::eOk);
+        CHECK(std::string(view.data(), view.length()) == value);
+        const int64_t pinnedMemory = localStorage->getUsedMemory();
+        view.reset();
+        REQUIRE(localStorage->compact(report) == storage::eOk);
+        CHECK(localStorage->getUsedMemory() < pinnedMemory);
+    }
+
+    SECTION("Copying the values stored inline")
+    {
+        REQUIRE(localStorage->setItem("inline", storage::Item<double>(2.5, "")) == storage::eOk);
+        REQUIRE(localStorage->viewItem("inline", view) == storage::eOk);
+        CHECK(!view.isPinned());
+        REQUIRE(view.length() == sizeof(double));
+        double number = 0.0;
+        std::memcpy(&number, view.data(), sizeof(double));
+        CHECK(number == 2.5);
+        CHECK(localStorage->viewItem("missing", view) == storage::eItemNotFound);
+        CHECK(view.getType() == storage::eNone);
+    }
+}
+
+
+TEST_CASE("Storage can be backed by a file")
+{
+    boost::filesystem::path filePath(boost::filesystem::temp_directory_path());
+    filePath /= boost::filesystem::path("file-storage.wks");
+    const std::string fileName(filePath.string());
+    storage::SharedStorage::destroy(fileName, storage::eMappedFile);
+
+    storage::StorageOptions options;
+    options.m_backend = storage::eMappedFile;
+    options.m_maxSize = 1024 * 1024;
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create(fileName, 64 * 1024, options, status));
+    REQUIRE(status == storage::eOk);
+    CHECK(boost::filesystem::exists(filePath));
+
+    SECTION("Reopening a file storage once it is closed")
+    {
+        const std::string value(1000, 'f');
+        for (int iter = 0; iter < 100; ++iter)
+        {
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->setItem(itemKey, storage::Item<std::string>(value, "file"));
+            REQUIRE(status == storage::eOk);
+        }
+        const int64_t size = localStorage->getSize();
+        CHECK(size > 64 * 1024);
+        localStorage.reset();
+        CHECK(storage::SharedStorage::open(fileName, status) == nullptr);
+        CHECK(status == storage::eCannotOpenStorage);
+
+        localStorage.reset(storage::SharedStorage::open(fileName, storage::eMappedFile, status));
+        REQUIRE(status == storage::eOk);
+        CHECK(localStorage->getSize() == size);
+        for (int iter = 0; iter < 100; ++iter)
+        {
+            ItemConsumer consumer;
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->getItem<ItemConsumer>(itemKey, consumer);
+            REQUIRE(status == storage::eOk);
+            CHECK(consumer.m_string == value);
+            CHECK(consumer.m_tag == "file");
+        }
+    }
+
+    SECTION("Creating a file storage that already exists")
+    {
+        std::unique_ptr<storage::SharedStorage> otherStorage(
+            storage::SharedStorage::create(fileName, 64 * 1024, options, status));
+        CHECK(status == storage::eCannotCreateStorage);
+        CHECK(otherStorage == nullptr);
+    }
+
+    CHECK(localStorage->destroy() == storage::eOk);
+    CHECK_FALSE(boost::filesystem::exists(filePath));
+}
+
+
+#ifndef _WIN32
+TEST_CASE("File storages left by a killed process can be reopened")
+{
+    boost::filesystem::path filePath(boost::filesystem::temp_directory_path());
+    filePath /= boost::filesystem::path("killed-storage.wks");
+    const std::string fileName(filePath.string());
+    storage::SharedStorage::destroy(fileName, storage::eMappedFile);
+    const std::string value(1000, 'k');
+
+    const pid_t child = fork();
+    if (child == 0)
+    {
+        // the child is killed while it locks the storage and views an item
+        storage::StorageOptions options;
+        options.m_backend = storage::eMappedFile;
+        storage::Status status = storage::eOk;
+        storage::SharedStorage* childStorage =
+            storage::SharedStorage::create(fileName, 256 * 1024, options, status);
+        storage::ItemView view;
+        if ((childStorage == nullptr) ||
+            (childStorage->setItem("viewed", storage::Item<std::string>(value, "")) !=
+             storage::eOk) ||
+            (childStorage->viewItem("viewed", view) != storage::eOk) ||
+            (childStorage->lock() != storage::eOk))
+        {
+            _exit(1);
+        }
+
+        // it also dies as if it was allocating, the header starts the file
+        boost::interprocess::file_mapping file(fileName.c_str(), boost::interprocess::read_write);
+        boost::interprocess::mapped_region header(file, boost::interprocess::read_write, 0,
+                                                  sizeof(storage::SegmentHeader));
+        static_cast<storage::SegmentHeader*>(header.get_address())->m_segmentMutex.lock();
+        raise(SIGKILL);
+    }
+    REQUIRE(child > 0);
+    int childStatus = 0;
+    REQUIRE(waitpid(child, &childStatus, 0) == child);
+    REQUIRE(WIFSIGNALED(childStatus));
+
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::open(fileName, storage::eMappedFile, status));
+    REQUIRE(status == storage::eOk);
+    ItemConsumer consumer;
+    REQUIRE(localStorage->getItem("viewed", consumer) == storage::eOk);
+    CHECK(consumer.m_string == value);
+    CHECK(localStorage->setItem("viewed", storage::Item<bool>(true, "")) == storage::eOk);
+    CHECK(localStorage->setItem("other", storage::Item<double>(1, "")) == storage::eOk);
+    REQUIRE(localStorage->lock() == storage::eOk);
+    localStorage->unlock();
+
+    // a second opening by the same process keeps the locks of the first one
+    REQUIRE(localStorage->lock() == storage::eOk);
+    std::unique_ptr<storage::SharedStorage> otherStorage(
+        storage::SharedStorage::open(fileName, storage::eMappedFile, status));
+    REQUIRE(status == storage::eOk);
+    std::future<storage::Status> removal = std::async(
+        std::launch::async, [&otherStorage]() { return otherStorage->removeItem("other"); });
+    CHECK(removal.wait_for(std::chrono::milliseconds(200)) == std::future_status::timeout);
+    localStorage->unlock();
+    CHECK(removal.get() == storage::eOk);
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+
+
+TEST_CASE("File storages are not used before their first opener resets them")
+{
+    boost::filesystem::path filePath(boost::filesystem::temp_directory_path());
+    filePath /= boost::filesystem::path("resetting-storage.wks");
+    const std::string fileName(filePath.string());
+    storage::SharedStorage::destroy(fileName, storage::eMappedFile);
+    {
+        storage::StorageOptions options;
+        options.m_backend = storage::eMappedFile;
+        storage::Status status = storage::eOk;
+        std::unique_ptr<storage::SharedStorage> createdStorage(
+            storage::SharedStorage::create(fileName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        REQUIRE(createdStorage->setItem("kept", storage::Item<double>(1, "")) == storage::eOk);
+    }
+
+    // the current process opens the storage first and stays within the reset
+    storage::StorageObject object(boost::interprocess::open_only, fileName, storage::eMappedFile);
+    REQUIRE(object.tryLockExclusive());
+    boost::interprocess::mapped_region header(object.map(sizeof(storage::SegmentHeader)));
+    storage::SegmentHeader* segmentHeader =
+        static_cast<storage::SegmentHeader*>(header.get_address());
+    segmentHeader->m_segmentMutex.lock();
+
+    const pid_t child = fork();
+    if (child == 0)
+    {
+        storage::Status status = storage::eOk;
+        std::unique_ptr<storage::SharedStorage> childStorage(
+            storage::SharedStorage::open(fileName, storage::eMappedFile, status));
+        _exit(((status == storage::eOk) &&
+               (childStorage->setItem("child", storage::Item<bool>(true, "")) == storage::eOk))
+                  ? 0
+                  : 1);
+    }
+    REQUIRE(child > 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CHECK(waitpid(child, nullptr, WNOHANG) == 0);
+
+    // the mutex is rebuilt, a process which waited for it would never be woken up
+    new (&segmentHeader->m_segmentMutex) boost::interprocess::interprocess_recursive_mutex();
+    object.lockSharable();
+    int childStatus = 0;
+    pid_t exited = 0;
+    for (int iter = 0; (exited == 0) && (iter < 500); ++iter)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        exited = waitpid(child, &childStatus, WNOHANG);
+    }
+    if (exited == 0)
+    {
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+    }
+    REQUIRE(exited == child);
+    CHECK(WIFEXITED(childStatus));
+    CHECK(WEXITSTATUS(childStatus) == 0);
+
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::open(fileName, storage::eMappedFile, status));
+    REQUIRE(status == storage::eOk);
+    ItemConsumer consumer;
+    CHECK(localStorage->getItem("kept", consumer) == storage::eOk);
+    CHECK(localStorage->getItem("child", consumer) == storage::eOk);
+    CHECK(localStorage->destroy() == storage::eOk);
+}
+#endif
+
+
+TEST_CASE("Storage can be snapshotted and restored")
+{
+    StorageSetter setter(kStorageName);
+    REQUIRE(setter.get() != nullptr);
+    storage::SharedStorage* localStorage = setter.get();
+
+    boost::filesystem::path snapshotPath(boost::filesystem::temp_directory_path());
+    snapshotPath /= boost::filesystem::path("storage-snapshot.wks");
+    const std::string snapshotName(snapshotPath.string());
+    const std::string longValue(300, 's');
+    for (int iter = 0; iter < 100; ++iter)
+    {
+        const std::string number = std::to_string(iter);
+        const std::string boolKey = "bool" + number;
+        const std::string doubleKey = "double" + number;
+        const std::string stringKey = "string" + number;
+        localStorage->setItem(boolKey, storage::Item<bool>((iter % 2) == 0, "b"));
+        localStorage->setItem(doubleKey, storage::Item<double>(iter, ""));
+        localStorage->setItem(stringKey, storage::Item<std::string>(longValue, "s"));
+    }
+    REQUIRE(localStorage->snapshot(snapshotName) == storage::eOk);
+
+    SECTION("Restoring the items of a snapshot")
+    {
+        localStorage->removeItem("double42");
+        localStorage->setItem("extra", storage::Item<bool>(true, ""));
+        REQUIRE(localStorage->restore(snapshotName) == storage::eOk);
+
+        for (int iter = 0; iter < 100; ++iter)
+        {
+            ItemConsumer consumer;
+            const std::string number = std::to_string(iter);
+            const std::string boolKey = "bool" + number;
+            const std::string doubleKey = "double" + number;
+            const std::string stringKey = "string" + number;
+            REQUIRE(localStorage->getItem(boolKey, consumer) == storage::eOk);
+            CHECK(consumer.m_bool == ((iter % 2) == 0));
+            CHECK(consumer.m_tag == "b");
+            REQUIRE(localStorage->getItem(doubleKey, consumer) == storage::eOk);
+            CHECK(consumer.m_double == iter);
+            REQUIRE(localStorage->getItem(stringKey, consumer) == storage::eOk);
+            CHECK(consumer.m_string == longValue);
+            CHECK(consumer.m_tag == "s");
+        }
+        ItemConsumer consumer;
+        CHECK(localStorage->getItem("extra", consumer) == storage::eItemNotFound);
+    }
+
+    SECTION("Rejecting a corrupted snapshot")
+    {
+        {
+            std::fstream file(snapshotName.c_str(),
+                              std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(100);
+            file.put('X');
+        }
+        localStorage->setItem("kept", storage::Item<bool>(true, ""));
+        CHECK(localStorage->restore(snapshotName) == storage::eCannotReadSnapshot);
+        CHECK(localStorage->restore(snapshotName + ".missing") == storage::eCannotReadSnapshot);
+
+        ItemConsumer consumer;
+        CHECK(localStorage->getItem("kept", consumer) == storage::eOk);
+    }
+
+    SECTION("Snapshotting while items are updated")
+    {
+        std::atomic<bool> writing(true);
+        std::future<void> writer = std::async(std::launch::async, [&]() {
+            for (int iter = 0; writing; ++iter)
+            {
+                const std::string itemKey = std::string("racy") + std::to_string(iter % 50);
+                localStorage->setItem(itemKey, storage::Item<double>(iter, ""));
+            }
+        });
+        for (int iter = 0; iter < 20; ++iter)
+        {
+            CHECK(localStorage->snapshot(snapshotName) == storage::eOk);
+        }
+        writing = false;
+        writer.get();
+        CHECK(localStorage->restore(snapshotName) == storage::eOk);
+    }
+
+    boost::filesystem::remove(snapshotPath);
+}
+
+
+TEST_CASE("Storage can be recovered from its operation log")
+{
+    const std::string kLogStorageName("log_storage");
+    boost::filesystem::path logPath(boost::filesystem::temp_directory_path());
+    logPath /= boost::filesystem::path("storage-log.wkl");
+    boost::filesystem::path snapshotPath(boost::filesystem::temp_directory_path());
+    snapshotPath /= boost::filesystem::path("storage-log-snapshot.wks");
+    boost::filesystem::remove(logPath);
+    boost::filesystem::remove(snapshotPath);
+    storage::SharedStorage::destroy(kLogStorageName);
+
+    storage::StorageOptions options;
+    options.m_logPath = logPath.string();
+    options.m_logFlushInterval = 5;
+    options.m_logFlushCount = 16;
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create(kLogStorageName, 256 * 1024, options, status));
+    REQUIRE(status == storage::eOk);
+
+    for (int iter = 0; iter < 100; ++iter)
+    {
+        const std::string itemKey = std::to_string(iter);
+        REQUIRE(localStorage->setItem(itemKey, storage::Item<double>(iter, "log")) == storage::eOk);
+    }
+    double result = 0.0;
+    REQUIRE(localStorage->increment("counter", 3.0, result) == storage::eOk);
+    REQUIRE(localStorage->removeItem("7") == storage::eOk);
+
+    SECTION("Replaying the operations when the storage is created again")
+    {
+        localStorage.reset();
+        REQUIRE(storage::SharedStorage::destroy(kLogStorageName) == storage::eOk);
+        localStorage.reset(
+            storage::SharedStorage::create(kLogStorageName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+
+        for (int iter = 0; iter < 100; ++iter)
+        {
+            ItemConsumer consumer;
+            const std::string itemKey = std::to_string(iter);
+            status = localStorage->getItem(itemKey, consumer);
+            CHECK(status == ((iter == 7) ? storage::eItemNotFound : storage::eOk));
+        }
+        ItemConsumer consumer;
+        REQUIRE(localStorage->getItem("counter", consumer) == storage::eOk);
+        CHECK(consumer.m_double == 3.0);
+        REQUIRE(localStorage->getItem("42", consumer) == storage::eOk);
+        CHECK(consumer.m_double == 42.0);
+        CHECK(consumer.m_tag == "log");
+    }
+
+    SECTION("Replaying the operations on top of the last snapshot")
+    {
+        REQUIRE(localStorage->snapshot(snapshotPath.string()) == storage::eOk);
+        REQUIRE(localStorage->clear() == storage::eOk);
+        REQUIRE(localStorage->setItem("after", storage::Item<bool>(true, "")) == storage::eOk);
+
+        // the snapshot is not replayed over the operations which followed it
+        localStorage.reset();
+        REQUIRE(storage::SharedStorage::destroy(kLogStorageName) == storage::eOk);
+        localStorage.reset(
+            storage::SharedStorage::create(kLogStorageName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+
+        ItemConsumer consumer;
+        CHECK(localStorage->getItem("42", consumer) == storage::eItemNotFound);
+        REQUIRE(localStorage->getItem("after", consumer) == storage::eOk);
+        CHECK(consumer.m_bool);
+    }
+
+    SECTION("Starting a new log with each snapshot")
+    {
+        std::unique_ptr<storage::SharedStorage> openedStorage(
+            storage::SharedStorage::open(kLogStorageName, status));
+        REQUIRE(status == storage::eOk);
+        const uintmax_t size = boost::filesystem::file_size(logPath);
+        REQUIRE(localStorage->snapshot(snapshotPath.string()) == storage::eOk);
+        CHECK(boost::filesystem::file_size(logPath) < size / 10);
+
+        // the storage opened before switches to the new log
+        REQUIRE(openedStorage->setItem("opened", storage::Item<bool>(true, "")) == storage::eOk);
+        REQUIRE(localStorage->removeItem("42") == storage::eOk);
+        openedStorage.reset();
+
+        localStorage.reset();
+        REQUIRE(storage::SharedStorage::destroy(kLogStorageName) == storage::eOk);
+        localStorage.reset(
+            storage::SharedStorage::create(kLogStorageName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        ItemConsumer consumer;
+        CHECK(localStorage->getItem("opened", consumer) == storage::eOk);
+        CHECK(localStorage->getItem("42", consumer) == storage::eItemNotFound);
+        CHECK(localStorage->getItem("7", consumer) == storage::eItemNotFound);
+        REQUIRE(localStorage->getItem("41", consumer) == storage::eOk);
+        CHECK(consumer.m_double == 41.0);
+        REQUIRE(localStorage->getItem("counter", consumer) == storage::eOk);
+        CHECK(consumer.m_double == 3.0);
+    }
+
+    SECTION("Keeping the operations logged while the log is replaced")
+    {
+        const int kWritesCount = 200;
+        std::future<bool> writing = std::async(std::launch::async, [&localStorage]() {
+            bool written = true;
+            for (int iter = 0; written && (iter < kWritesCount); ++iter)
+            {
+                const std::string itemKey = "written" + std::to_string(iter);
+                written = (localStorage->setItem(itemKey, storage::Item<double>(iter, "")) ==
+                           storage::eOk);
+            }
+            return written;
+        });
+        for (int iter = 0; iter < 5; ++iter)
+        {
+            REQUIRE(localStorage->snapshot(snapshotPath.string()) == storage::eOk);
+        }
+        REQUIRE(writing.get());
+
+        localStorage.reset();
+        REQUIRE(storage::SharedStorage::destroy(kLogStorageName) == storage::eOk);
+        localStorage.reset(
+            storage::SharedStorage::create(kLogStorageName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        int found = 0;
+        for (int iter = 0; iter < kWritesCount; ++iter)
+        {
+            ItemConsumer consumer;
+            const std::string itemKey = "written" + std::to_string(iter);
+            if (localStorage->getItem(itemKey, consumer) == storage::eOk)
+            {
+                ++found;
+            }
+        }
+        CHECK(found == kWritesCount);
+    }
+
+    SECTION("Dropping a torn operation at the end of the log")
+    {
+        localStorage.reset();
+        REQUIRE(storage::SharedStorage::destroy(kLogStorageName) == storage::eOk);
+        const uintmax_t size = boost::filesystem::file_size(logPath);
+        {
+            std::ofstream file(logPath.string().c_str(), std::ios::binary | std::ios::app);
+            file.write("\x01\x02torn", 6);
+        }
+        localStorage.reset(
+            storage::SharedStorage::create(kLogStorageName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        CHECK(boost::filesystem::file_size(logPath) == size);
+
+        REQUIRE(localStorage->setItem("next", storage::Item<bool>(true, "")) == storage::eOk);
+        localStorage.reset();
+        REQUIRE(storage::SharedStorage::destroy(kLogStorageName) == storage::eOk);
+        localStorage.reset(
+            storage::SharedStorage::create(kLogStorageName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        ItemConsumer consumer;
+        CHECK(localStorage->getItem("next", consumer) == storage::eOk);
+        CHECK(localStorage->getItem("99", consumer) == storage::eOk);
+    }
+
+    SECTION("Sharing the log with the storages opened on it")
+    {
+        std::unique_ptr<storage::SharedStorage> openedStorage(
+            storage::SharedStorage::open(kLogStorageName, status));
+        REQUIRE(status == storage::eOk);
+        REQUIRE(openedStorage->setItem("opened", storage::Item<bool>(true, "")) == storage::eOk);
+        openedStorage.reset();
+
+        localStorage.reset();
+        REQUIRE(storage::SharedStorage::destroy(kLogStorageName) == storage::eOk);
+        localStorage.reset(
+            storage::SharedStorage::create(kLogStorageName, 256 * 1024, options, status));
+        REQUIRE(status == storage::eOk);
+        ItemConsumer consumer;
+        CHECK(localStorage->getItem("opened", consumer) == storage::eOk);
+    }
+
+    localStorage.reset();
+    storage::SharedStorage::destroy(kLogStorageName);
+    boost::filesystem::remove(logPath);
+    boost::filesystem::remove(snapshotPath);
+}
+
+
+TEST_CASE("Items can be read while they are updated")
+{
+    StorageSetter setter(kStorageName);
+    REQUIRE(setter.get() != nullptr);
+    storage::SharedStorage* localStorage = setter.get();
+
+    const std::string longValue(200, 'a');
+    const std::string shortValue(10, 'b');
+    std::atomic<bool> writing(true);
+
+    auto write = [&]() {
+        for (int iter = 0; iter < 20000; ++iter)
+        {
+            localStorage->setItem("racy", storage::Item<std::string>(longValue, "a"));
+            localStorage->setItem("racy", storage::Item<std::string>(shortValue, "b"));
+            localStorage->setItem("racy", storage::Item<double>(42, "c"));
+            if ((iter % 10) == 0)
+            {
+                localStorage->removeItem("racy");
+
+                // make the index grow and shrink so that its tables are retired too
+                const std::string itemKey = std::to_string(iter);
+                localStorage->setItem(itemKey, storage::Item<bool>(true, ""));
+                if ((iter % 1000) == 0)
+                {
+                    localStorage->clear();
+                }
+            }
+        }
+        writing = false;
+    };
+
+    auto read = [&]() {
+        int inconsistencies = 0;
+        while (writing)
+        {
+            ItemConsumer consumer;
+            if (localStorage->getItem("racy", consumer) == storage::eOk)
+            {
+                bool consistent = false;
+                if (consumer.getType() == storage::eString)
+                {
+                    consistent = ((consumer.m_string == longValue) && (consumer.m_tag == "a")) ||
+                                 ((consumer.m_string == shortValue) && (consumer.m_tag == "b"));
+                }
+                else if (consumer.getType() == storage::eDouble)
+                {
+                    consistent = (consumer.m_double == 42) && (consumer.m_tag == "c");
+                }
+                if (!consistent)
+                {
+                    ++inconsistencies;
+                }
+            }
+        }
+        return inconsistencies;
+    };
+
+    std::future<int> firstReader = std::async(std::launch::async, read);
+    std::future<int> secondReader = std::async(std::launch::async, read);
+    write();
+    CHECK(firstReader.get() == 0);
+    CHECK(secondReader.get() == 0);
+
+    ItemConsumer consumer;
+    REQUIRE(localStorage->getItem("racy", consumer) == storage::eOk);
+    CHECK(consumer.m_double == 42);
+}
+
+
+#ifndef _WIN32
+TEST_CASE("Reader slots of dead processes are released")
+{
+    boost::interprocess::mapped_region region(
+        boost::interprocess::anonymous_shared_memory(64 * 1024));
+    char* address = static_cast<char*>(region.get_address());
+
+    // the allocator refers to a mutex of the same mapping, as to the header of a storage
+    storage::SegmentMutex::Binding binding(new (address)
+                                               boost::interprocess::interprocess_recursive_mutex());
+    const size_t kMutexSize = 128;
+    storage::ManagedSegment segment(boost::interprocess::create_only, address + kMutexSize,
+                                    region.get_size() - kMutexSize);
+    const uint32_t kReadersCount = 4;
+    storage::EpochManager* epochs = segment.construct<storage::EpochManager>(
+        boost::interprocess::anonymous_instance)(segment.get_segment_manager(), kReadersCount);
+
+    const uint32_t reader = epochs->enter();
+    REQUIRE(reader < kReadersCount);
+    epochs->advance();
+    const pid_t child = fork();
+    if (child == 0)
+    {
+        // the child dies while reading
+        epochs->enter();
+        _exit(0);
+    }
+    REQUIRE(child > 0);
+    REQUIRE(waitpid(child, nullptr, 0) == child);
+
+    // the slot of a live reader is kept
+    CHECK(epochs->releaseDeadReaders() == 1);
+    CHECK(epochs->getOldestReader() == 1);
+    epochs->leave(reader);
+    CHECK(epochs->getOldestReader() == UINT64_MAX);
+    CHECK(epochs->releaseDeadReaders() == 0);
+}
+#endif
+
+
+TEST_CASE("Items can be updated atomically")
+{
+    StorageSetter setter(kStorageName);
+    REQUIRE(setter.get() != nullptr);
+    storage::SharedStorage* localStorage = setter.get();
+    storage::Status status = storage::eOk;
+    const std::string key("counter");
+
+    SECTION("Incrementing and decrementing a double item")
+    {
+        double value = 0;
+        CHECK(localStorage->increment(key, 1, value) == storage::eOk);
+        CHECK(value == 1);
+        status = localStorage->setItem(key, storage::Item<double>(10, "tag"));
+        REQUIRE(status == storage::eOk);
+        CHECK(localStorage->increment(key, 2.5, value) == storage::eOk);
+        CHECK(value == 12.5);
+        CHECK(localStorage->decrement(key, 0.5, value) == storage::eOk);
+        CHECK(value == 12);
+
+        ItemConsumer consumer;
+        REQUIRE(localStorage->getItem(key, consumer) == storage::eOk);
+        CHECK(consumer.m_double == 12);
+        CHECK(consumer.m_tag == "tag");
+
+        status = localStorage->setItem(key, storage::Item<std::string>("twelve", ""));
+        REQUIRE(status == storage::eOk);
+        CHECK(localStorage->increment(key, 1, value) == storage::eItemTypeMismatch);
+        CHECK(value == 12);
+    }
+
+    SECTION("Incrementing a double item from several threads")
+    {
+        auto increment = [&]() {
+            for (int iter = 0; iter < 10000; ++iter)
+            {
+                double value = 0;
+                localStorage->increment(key, 1, value);
+            }
+        };
+        std::future<void> first = std::async(std::launch::async, increment);
+        std::future<void> second = std::async(std::launch::async, increment);
+        increment();
+        first.get();
+        second.get();
+
+        ItemConsumer consumer;
+        REQUIRE(localStorage->getItem(key, consumer) == storage::eOk);
+        CHECK(consumer.m_double == 30000);
+    }
+
+    SECTION("Comparing and setting an item")
+    {
+        bool swapped = true;
+        status = localStorage->compareAndSet(key, 1.0, storage::Item<double>(2, ""), swapped);
+        CHECK(status == storage::eOk);
+        CHECK_FALSE(swapped);
+
+        status = localStorage->setItem(key, storage::Item<std::string>("first", ""));
+        REQUIRE(status == storage::eOk);
+        status = localStorage->compareAndSet(key, std::string("other"),
+                                             storage::Item<bool>(true, ""), swapped);
+        CHECK(status == storage::eOk);
+        CHECK_FALSE(swapped);
+        status = localStorage->compareAndSet(key, true, storage::Item<bool>(true, ""), swapped);
+        CHECK(status == storage::eOk);
+        CHECK_FALSE(swapped);
+        status = localStorage->compareAndSet(key, std::string("first"),
+                                             storage::Item<bool>(true, "tag"), swapped);
+        CHECK(status == storage::eOk);
+        CHECK(swapped);
+
+        ItemConsumer consumer;
+        REQUIRE(localStorage->getItem(key, consumer) == storage::eOk);
+        CHECK(consumer.getType() == storage::eBool);
+        CHECK(consumer.m_tag == "tag");
+    }
+
+    SECTION("Getting and setting an item")
+    {
+        ItemConsumer previous;
+        status = localStorage->getAndSet(key, storage::Item<double>(1, "a"), previous);
+        CHECK(status == storage::eOk);
+        CHECK(previous.getType() == storage::eNone);
+
+        status = localStorage->getAndSet(key, storage::Item<std::string>("two", "b"), previous);
+        CHECK(status == storage::eOk);
+        CHECK(previous.getType() == storage::eDouble);
+        CHECK(previous.m_double == 1);
+        CHECK(previous.m_tag == "a");
+
+        ItemConsumer consumer;
+        REQUIRE(localStorage->getItem(key, consumer) == storage::eOk);
+        CHECK(consumer.m_string == "two");
+        CHECK(consumer.m_tag == "b");
+    }
+
+    SECTION("Updating an item while the storage is locked for reading")
+    {
+        double value = 0;
+        bool swapped = false;
+        ItemConsumer previous;
+        localStorage->lockShared();
+        CHECK(localStorage->increment(key, 1, value) == storage::eCannotUpgradeLock);
+        status = localStorage->compareAndSet(key, 0.0, storage::Item<double>(1, ""), swapped);
+        CHECK(status == storage::eCannotUpgradeLock);
+        status = localStorage->getAndSet(key, storage::Item<double>(1, ""), previous);
+        CHECK(status == storage::eCannotUpgradeLock);
+        localStorage->unlockShared();
+    }
+}
+
+
 TEST_CASE("Shared storage returns valid error code")
 {
     SECTION("Creating a shared storage that aready exist")
@@ -359,7 +2589,7 @@ TEST_CASE("Shared storage returns valid error code")
 
         ItemConsumer consumer;
         storage::Status status =
-            setter.get()->getItem<ItemConsumer>(std::string("unexistant_item"), consumer);
+            setter.get()->getItem<ItemConsumer>("unexistant_item", consumer);
         CHECK(status == storage::eItemNotFound);
         CHECK(consumer.getType() == storage::eNone);
     }
@@ -368,7 +2598,7 @@ TEST_CASE("Shared storage returns valid error code")
     {
         StorageSetter setter(kStorageName);
 
-        storage::Status status = setter.get()->removeItem(std::string("unexistant_item"));
+        storage::Status status = setter.get()->removeItem("unexistant_item");
         CHECK(status == storage::eItemNotFound);
     }
 
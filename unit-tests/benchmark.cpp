@@ -0,0 +1,98 @@
+/*
+ * This file is part of Wakanda software, licensed by 4D under
+ *  ( i ) the GNU General Public License version 3 ( GNU GPL v3 ), or
+ *  ( ii ) the Affero General Public License version 3 ( AGPL v3 ) or
+ *  ( iii ) a commercial license.
+ * This file remains the exclusive property of 4D and/or its licensors
+ * and is protected by national and international legislations.
+ * In any event, Licensee's compliance with the terms and conditions
+ * of the applicable license constitutes a prerequisite to any use of this file.
+ * Except as otherwise expressly stated in the applicable license,
+ * such license does not include any other license or rights on this file,
+ * 4D's and/or its licensors' trademarks and/or other proprietary rights.
+ * Consequently, no title, copyright or other proprietary rights
+ * other than those specified in the applicable license is granted.
+ */
+
+/**
+ * \file    benchmark.cpp
+ */
+
+// Local includes.
+#include "catch.hpp"
+#include "shared_storage.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const int64_t kBenchmarkSize = 64 * 1024 * 1024;
+const int kOperationsCount = 200000;
+const int kKeysCount = 10000;
+
+/**
+ * @brief  Churn small string items from several threads, as sessions or counters do.
+ *
+ * @return Count of operations per second.
+ */
+double churn(bool slabs, int threadsCount)
+{
+    const std::string kBenchmarkName("benchmark-storage");
+    storage::SharedStorage::destroy(kBenchmarkName);
+    storage::StorageOptions options;
+    options.m_slabs = slabs;
+    storage::Status status = storage::eOk;
+    std::unique_ptr<storage::SharedStorage> localStorage(
+        storage::SharedStorage::create(kBenchmarkName, kBenchmarkSize, options, status));
+    REQUIRE(status == storage::eOk);
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < threadsCount; ++thread)
+    {
+        threads.emplace_back([&, thread]() {
+            for (int iter = 0; iter < kOperationsCount / threadsCount; ++iter)
+            {
+                const int key = (iter * 7919 + thread * kKeysCount) % (kKeysCount * threadsCount);
+                const std::string itemKey = std::to_string(key);
+                if (iter % 4 == 3)
+                {
+                    localStorage->removeItem(itemKey);
+                }
+                else
+                {
+                    localStorage->setItem(itemKey,
+                                          storage::Item<std::string>(
+                                              std::string(24 + (iter * 31) % 220, 'v'), ""));
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    localStorage->destroy();
+    return kOperationsCount / elapsed.count();
+}
+} // namespace
+
+
+TEST_CASE("Small values are allocated faster from slabs", "[.][benchmark]")
+{
+    // hidden from the default run, launch it with: cpp-tests [benchmark]
+    for (int threadsCount : {1, 4})
+    {
+        const double segmentRate = churn(false, threadsCount);
+        const double slabsRate = churn(true, threadsCount);
+        std::cout << std::fixed << std::setprecision(0) << threadsCount
+                  << " thread(s): segment allocator " << segmentRate << " op/s, slabs "
+                  << slabsRate << " op/s" << std::endl;
+    }
+}
@@ -29,19 +29,20 @@ class ItemConsumer
 public:
     ItemConsumer() : m_double(0){};
 
-    template <class T> void set(const std::string& key, storage::Item<T>& item) {}
+    template <class T> void set(const storage::ItemKey& key, storage::Item<T>& item) {}
 
     double m_double;
     std::string m_string;
 };
 
-template <> void ItemConsumer::set<double>(const std::string& key, storage::Item<double>& item)
+template <> void ItemConsumer::set<double>(const storage::ItemKey& key, storage::Item<double>& item)
 {
     m_double = item.getValue();
 }
 
 template <>
-void ItemConsumer::set<std::string>(const std::string& key, storage::Item<std::string>& item)
+void ItemConsumer::set<std::string>(const storage::ItemKey& key,
+                                    storage::Item<std::string>& item)
 {
     m_string = item.getValue();
 }
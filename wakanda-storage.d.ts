@@ -1,37 +1,110 @@
 
 declare namespace WakandaStorage {
+    /**
+    * Storage creation options
+    */
+    export interface CreateOptions {
+        /**
+        * Count of shards, each shard has its own lock. Default: computed from the storage size, up to 16.
+        */
+        shards?: Number;
+
+        /**
+        * Size in octets up to which the storage grows when it is full. Default: the storage does not grow.
+        */
+        maxSize?: Number;
+
+        /**
+        * Memory backing the storage: 'memory' for shared memory, or 'file' to map the file named after the storage and keep it across restarts. Default: 'memory'.
+        */
+        backend?: String;
+
+        /**
+        * Path of an append-only log of the changes. If the log exists, the storage is recovered from it: the last snapshot recorded into the log is restored, then the changes logged after it are replayed. Default: no log.
+        */
+        log?: String;
+
+        /**
+        * Maximum delay in milliseconds before the logged changes are flushed to the disk, 0 to flush each change before returning. Default: 10.
+        */
+        logFlushInterval?: Number;
+
+        /**
+        * Count of logged changes which are flushed to the disk without waiting for logFlushInterval. Default: 1024.
+        */
+        logFlushCount?: Number;
+
+        /**
+        * Memory in octets used by the items above which items are evicted. Default: items are only evicted when the storage is full, if an eviction policy is set.
+        */
+        maxMemory?: Number;
+
+        /**
+        * Policy which chooses the evicted items: 'clock' for the items which were not read lately, 'lfu' for the items which were read the least often, or 'none'. Default: 'clock' if maxMemory is set, 'none' otherwise.
+        */
+        eviction?: String;
+
+        /**
+        * Allocate the small keys and values from slabs of fixed size chunks, which is faster and fragments the memory less. Slabs are only used if the storage is large enough. Default: true.
+        */
+        slabs?: Boolean;
+
+        /**
+        * Keep the keys sorted, so that scanPrefix() and range() only read the keys they return. New keys are set more slowly. Default: false.
+        */
+        orderedKeys?: Boolean;
+
+        /**
+        * Keep the keys of the values of each tag, so that keysByTag(), countByTag() and removeByTag() only read the keys of the tag. Tagged values are written more slowly. Default: false.
+        */
+        tagIndex?: Boolean;
+    }
+
     /**
     * Create a storage
     * @param storageName Defines the storage name
     * @param storageSize Optionnal, Defines, the storage size in octet. Default: 1048576 octets.
+    * @param options Optionnal, Defines the storage options.
     * @returns The created storage
     */
-    export function create(storageName: String, storageSize? : Number): WakandaStorageInstance;
+    export function create(storageName: String, storageSize? : Number, options? : CreateOptions): WakandaStorageInstance;
 
     /**
     * Get an existing storage
     * @param storageName The storage to returns
+    * @param options Optionnal, only the backend option is used.
     * @returns The named storage if exists
     */
-    export function get(storageName: String): WakandaStorageInstance;
+    export function get(storageName: String, options? : CreateOptions): WakandaStorageInstance;
 
     /**
     * Destroy an existing storage
     * As `wakanda-storage` is shared between all Node processes, the storage memory is not freed until `destroy()` is called.
     * @param storageName The storage to destroy
+    * @param options Optionnal, only the backend option is used.
+    */
+    export function destroy(storageName: String, options? : CreateOptions);
+
+    /**
+    * Replace all the key/values of an existing storage with the ones of a snapshot
+    * @param storageName The storage to restore
+    * @param snapshotPath Path of the snapshot file written by snapshot()
+    * @param options Optionnal, only the backend option is used.
+    * @returns The restored storage
     */
-    export function destroy(storageName: String);
+    export function restore(storageName: String, snapshotPath: String, options? : CreateOptions): WakandaStorageInstance;
 }
 
 declare interface WakandaStorageInstance {
 
     /**
     * Set a storage key/value
-    * `Date` and `Buffer` are not supported.
+    * `Buffer` and typed arrays are stored as raw bytes and read back as the same type.
     * @param key A storage key
     * @param value A storage value
+    * @param ttlMs Optionnal, delay in milliseconds after which the key expires. Default: the key does not expire.
     */
-    set(key: String, value: String | Number | Boolean | Array | Object);
+    set(key: String, value: String | Number | Boolean | Array | Object, ttlMs?: Number);
 
     /**
     * Get a storage key/value
@@ -40,17 +113,175 @@ declare interface WakandaStorageInstance {
     */
     get(key: String): String | Number | Boolean |  Array | Object
 
+    /**
+    * Get the bytes of a storage value without copy, they stay unchanged until the ArrayBuffer is collected. It must not be written to.
+    * @param key Storage key
+    * @return an ArrayBuffer referring to the shared memory, or undefined
+    */
+    view(key: String): ArrayBuffer
+
     /**
     * Remove storage key
     * @param key A storage key
     */
     remove(key: String);
 
+    /**
+    * Get several storage keys/values in one call
+    * @param keys Storage keys
+    * @return the values in the order of the keys, undefined for the missing keys
+    */
+    getMany(keys: String[]): Array<any>;
+
+    /**
+    * Set several storage keys/values in one call
+    * @param entries [key, value] pairs, or an object whose properties are set
+    * @param options Optionnal, atomic: set every entry or none of them, ttl: time to live in milliseconds of every entry
+    * @return the error of each entry, null for the entries which were set
+    */
+    setMany(entries: Array<[String, any]> | Map<String, any> | Object, options?: { atomic?: Boolean, ttl?: Number }): Array<Error>;
+
+    /**
+    * Remove several storage keys in one call
+    * @param keys Storage keys
+    * @return the count of removed keys
+    */
+    removeMany(keys: String[]): Number;
+
+    /**
+    * Remove all the keys which start with a prefix
+    * @param prefix Prefix of the keys
+    * @param options Optionnal, budget: maximum milliseconds each shard is locked for. Default: no limit.
+    * @return the count of removed keys
+    */
+    removePrefix(prefix: String, options?: { budget?: Number }): Number;
+
+    /**
+    * Remove all the keys whose value has a tag, such as 'object' or 'date'
+    * @param tag Tag of the values, empty for strings, numbers and booleans
+    * @param options Optionnal, budget: maximum milliseconds each shard is locked for. Default: no limit.
+    * @return the count of removed keys
+    */
+    removeByTag(tag: String, options?: { budget?: Number }): Number;
+
+    /**
+    * Get a batch of keys, resuming a scan of all the keys
+    * @param cursor 0 to start a scan, or the cursor of the previous batch
+    * @param count Count of keys of the batch, 100 by default
+    * @return the keys of the batch and the cursor of the next batch, 0 once the scan is complete
+    */
+    scan(cursor?: Number, count?: Number): { cursor: Number, keys: String[] };
+
+    /**
+    * Iterate over all the storage keys, scanned in batches
+    */
+    keys(): IterableIterator<String>;
+
+    /**
+    * Iterate over all the storage key/values, scanned in batches
+    */
+    entries(): IterableIterator<[String, String | Number | Boolean | Array | Object]>;
+
+    /**
+    * Get the keys which start with a prefix, in the order of their UTF-8 bytes
+    * @param prefix Prefix of the keys
+    * @param limit Optionnal, maximum count of keys. Default: no limit.
+    * @return the keys
+    */
+    scanPrefix(prefix: String, limit?: Number): String[];
+
+    /**
+    * Get the keys from a first one up to a last one excluded, in the order of their UTF-8 bytes
+    * @param start First key of the range
+    * @param end Optionnal, key which ends the range, excluded. Default: no end.
+    * @param limit Optionnal, maximum count of keys. Default: no limit.
+    * @return the keys
+    */
+    range(start: String, end?: String, limit?: Number): String[];
+
+    /**
+    * Get the keys whose value has a tag, such as 'object' or 'date'
+    * @param tag Tag of the values, empty for strings, numbers and booleans
+    * @return the keys
+    */
+    keysByTag(tag: String): String[];
+
+    /**
+    * Count the keys whose value has a tag, such as 'object' or 'date'
+    * @param tag Tag of the values, empty for strings, numbers and booleans
+    * @return the count of keys
+    */
+    countByTag(tag: String): Number;
+
     /**
     * Removes all storage keys/values
     */
     clear();
 
+    /**
+    * Add a number to a numeric key/value, without any other process updating the key in between.
+    * A missing key is created from 0.
+    * @param key A storage key
+    * @param delta Optionnal, number to add. Default: 1.
+    * @return the new value
+    */
+    increment(key: String, delta?: Number): Number;
+
+    /**
+    * Subtract a number from a numeric key/value, without any other process updating the key in between.
+    * A missing key is created from 0.
+    * @param key A storage key
+    * @param delta Optionnal, number to subtract. Default: 1.
+    * @return the new value
+    */
+    decrement(key: String, delta?: Number): Number;
+
+    /**
+    * Set a storage key/value only if its current value is equal to the expected one
+    * @param key A storage key
+    * @param expected Expected value
+    * @param value A storage value
+    * @return true if the value was set
+    */
+    compareAndSet(key: String, expected: String | Number | Boolean | Array | Object, value: String | Number | Boolean | Array | Object): Boolean;
+
+    /**
+    * Set a storage key/value and get its previous value
+    * @param key A storage key
+    * @param value A storage value
+    * @return the previous value, undefined if the key did not exist
+    */
+    getAndSet(key: String, value: String | Number | Boolean | Array | Object): String | Number | Boolean | Array | Object;
+
+    /**
+    * Write all the key/values into a snapshot file, without blocking the event loop
+    * @param snapshotPath Path of the snapshot file
+    * @return a promise resolved once the snapshot is written
+    */
+    snapshot(snapshotPath: String): Promise<void>;
+
+    /**
+    * Get the storage statistics
+    * @return the size of the storage and the memory used by its items in octets, the counts of evicted and expired items
+    */
+    stats(): { size: Number, usedMemory: Number, evicted: Number, expired: Number };
+
+    /**
+    * Relocate the items so that the free memory coalesces
+    * @return the fragmentation of the free memory before and after, from 0 to 1, and the count of relocated blocks
+    */
+    compact(): { fragmentationBefore: Number, fragmentationAfter: Number, relocated: Number };
+
+    /**
+    * Compact the storage incrementally from a background thread of the current process
+    */
+    startCompaction();
+
+    /**
+    * Stop the incremental compaction of the current process
+    */
+    stopCompaction();
+
     /**
     * Lock storage.
     * No key/value can be updated until unlock
@@ -67,6 +298,49 @@ declare interface WakandaStorageInstance {
     * Try to lock the storage. If already lock, then it returns `false`
     */
     tryLock(): Boolean
+
+    /**
+    * Lock storage for reading.
+    * Other readers are not blocked, no key/value can be updated until unlockShared.
+    * The locking process cannot update keys/values either, unless it also holds the lock.
+    */
+    lockShared();
+
+    /**
+    * Unlock storage for reading
+    */
+    unlockShared()
+
+    /**
+    * Get a key/value, read by a worker thread without blocking the event loop
+    * @param key A storage key
+    * @return a promise resolved with the value, undefined if the key does not exist
+    */
+    getAsync(key: String): Promise<String | Number | Boolean | Array | Object>;
+
+    /**
+    * Set a key/value, written by a worker thread without blocking the event loop
+    * @param key A storage key
+    * @param value A storage value
+    * @param ttlMs Time to live of the key/value in milliseconds
+    * @return a promise resolved once the key/value is set
+    */
+    setAsync(key: String, value: String | Number | Boolean | Array | Object, ttlMs?: Number): Promise<void>;
+
+    /**
+    * Lock storage, a worker thread waiting for it without blocking the event loop.
+    * The lock is owned by the current thread once the promise is resolved, until unlock.
+    * @return a promise resolved once the storage is locked
+    */
+    lockAsync(): Promise<void>;
+
+    /**
+    * Watch the changes of keys made by any process
+    * @param keyOrPrefix A storage key, or a prefix of keys ending with '*'
+    * @param callback Called with the key and the type of each change: 'set', 'remove', 'expire', 'evict', or with an undefined key, 'clear' or 'lost'
+    * @return a watcher, whose close() method stops the calls
+    */
+    watch(keyOrPrefix: String, callback: (key: String | undefined, type: String) => void): { close(): void };
 }
 
 export = WakandaStorage;
\ No newline at end of file